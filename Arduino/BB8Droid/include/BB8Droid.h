@@ -36,15 +36,23 @@ public:
 
   virtual Result incomingControlPacket(uint16_t station, PacketSource source, uint8_t rssi, const ControlPacket& packet);
 
-  virtual Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream);
   virtual Result fillAndSendStatePacket();
 
-  virtual Result setParameterValue(const String& name, const String& stringVal);
+  virtual Result setParameterValue(const char* name, const char* stringVal);
 
   void printCurrentSystemStatus(ConsoleStream *stream = NULL);
 
 protected:
   void setControlParameters();
+  Result cmdStatus(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSelftest(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdRunningStatus(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdPlaySound(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdCalibrate(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdDrive(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdMode(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSetPixel(const ConsoleWords& words, ConsoleStream *stream);
+  static const CommandDef COMMANDS[];
 
   typedef struct {
     float driveSpeedKp, driveSpeedKi, driveSpeedKd;
@@ -6,6 +6,30 @@
 
 BB8 BB8::bb8;
 
+const Subsystem::CommandDef BB8::COMMANDS[] = {
+  command("status",         0, 0, &BB8::cmdStatus),
+  command("selftest",       0, 0, &BB8::cmdSelftest),
+  command("running_status", 1, 1, &BB8::cmdRunningStatus),
+  command("play_sound",     2, 2, &BB8::cmdPlaySound),
+  command("calibrate",      0, 0, &BB8::cmdCalibrate),
+  command("drive",          2, 2, &BB8::cmdDrive),
+  command("mode",           0, 1, &BB8::cmdMode),
+  command("set_pixel",      4, 4, &BB8::cmdSetPixel)
+};
+
+static const struct {
+  const char* name;
+  BB8::Mode mode;
+} MODE_NAMES[] = {
+  { "off",        BB8::MODE_OFF },
+  { "roll",       BB8::MODE_ROLL_CONTROL_ONLY },
+  { "speed",      BB8::MODE_SPEED_CONTROL_ONLY },
+  { "speed_roll", BB8::MODE_SPEED_ROLL_CONTROL },
+  { "pos",        BB8::MODE_POS_CONTROL },
+  { "kiosk",      BB8::MODE_KIOSK },
+  { "calib",      BB8::MODE_CALIB }
+};
+
 ServoLimits servolimits[] = {
   { 0.0f, 360.0f, 0.0f, 60.0 },
   { 120.0f, 240.0f, 0.0f, 60.0 },
@@ -51,6 +75,7 @@ BB8::BB8():
           "        drive pwm|speed|position <val>  Set drive motor setpoint\r\n"
           "        mode off|roll|speed|speed_roll|pos|kiosk|calib  Set drive mode\r\n"
           "        set_pixel <num> <r> <g> <b>     Set Neopixel <num> (1-3) to rgb color";
+  setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
   started_ = false;
   operationStatus_ = RES_SUBSYS_NOT_STARTED;
 }
@@ -207,7 +232,7 @@ Result BB8::setMode(BB8::Mode mode) {
   return RES_OK;
 }
 
-Result BB8::setParameterValue(const String& name, const String& stringVal) {
+Result BB8::setParameterValue(const char* name, const char* stringVal) {
   Result retval = Subsystem::setParameterValue(name, stringVal);
   if(retval != RES_OK) return retval;
 
@@ -438,137 +463,96 @@ Result BB8::incomingControlPacket(uint16_t station, PacketSource source, uint8_t
   return RES_OK;
 }
 
-Result BB8::handleConsoleCommand(const std::vector<String> &words, ConsoleStream *stream) {
-  if (words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
+Result BB8::cmdStatus(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  printStatus(stream);
+  stream->printf("\n");
+  return RES_OK;
+}
 
-  if (words[0] == "status") {
-    if (words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    printStatus(stream);
-    stream->printf("\n");
-    return RES_OK;
-  }
+Result BB8::cmdSelftest(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  Result res = selfTest(stream);
+  stream->printf("%s\n", errorMessage(res));
+  return RES_OK;
+}
 
-  else if(words[0] == "selftest") {
-    if(words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    Result res = selfTest(stream);
-    stream->printf("%s\n", errorMessage(res));
+Result BB8::cmdRunningStatus(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  if (words[1] == "on" || words[1] == "true") {
+    runningStatus_ = true;
+    return RES_OK;
+  } else if (words[1] == "off" || words[1] == "false") {
+    runningStatus_ = false;
     return RES_OK;
   }
+  return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if (words[0] == "running_status") {
-    if (words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if (words[1] == "on" || words[1] == "true") {
-      runningStatus_ = true;
-      return RES_OK;
-    } else if (words[1] == "off" || words[1] == "false") {
-      runningStatus_ = false;
-      return RES_OK;
-    }
-    return RES_CMD_INVALID_ARGUMENT;
-  }
+Result BB8::cmdPlaySound(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  int folder = words[1].toInt();
+  int sound = words[2].toInt();
+  if (BB8Sound::sound.playFolder(folder, sound) == false) return RES_CMD_FAILURE;
+  return RES_OK;
+}
+
+Result BB8::cmdCalibrate(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  imu_.calibrateGyro(stream);
+  return RES_OK;
+}
 
-  else if (words[0] == "play_sound") {
-    if (words.size() != 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    int folder = words[1].toInt();
-    int sound = words[2].toInt();
-    if (BB8Sound::sound.playFolder(folder, sound) == false) return RES_CMD_FAILURE;
+Result BB8::cmdDrive(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  if (words[1] == "pwm") {
+    pwmControl_ = true;
+    driveMotor_.set(words[2].toFloat());
+    driveMotor_.setEnabled(true);
     return RES_OK;
-  }
+  } else if (words[1] == "position") {
+    pwmControl_ = false;
+    driveEncoder_.setMode(bb::Encoder::INPUT_POSITION);
+    driveController_.setGoal(words[2].toFloat());
+    driveMotor_.setEnabled(true);
+    return RES_OK;
+  } else if (words[1] == "speed") {
+    pwmControl_ = false;
+    driveEncoder_.setMode(bb::Encoder::INPUT_SPEED);
+    driveController_.setGoal(words[2].toFloat());
+    return RES_OK;
+  } else return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if (words[0] == "calibrate") {
-    imu_.calibrateGyro(stream);
+Result BB8::cmdMode(const ConsoleWords& words, ConsoleStream *stream) {
+  if (words.size() == 1) {
+    const char* name = "unknown";
+    for (auto& m: MODE_NAMES) {
+      if (m.mode == mode_) name = m.name;
+    }
+    if (stream) stream->printf("%s\n", name);
+    return RES_OK;
   }
 
-  else if (words[0] == "drive") {
-    if (words.size() != 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-
-    if (words[1] == "pwm") {
-      pwmControl_ = true;
-      driveMotor_.set(words[2].toFloat());
-      driveMotor_.setEnabled(true);
+  for (auto& m: MODE_NAMES) {
+    if (words[1] == m.name) {
+      mode_ = m.mode;
       return RES_OK;
-    } else if (words[1] == "position") {
-      pwmControl_ = false;
-      driveEncoder_.setMode(bb::Encoder::INPUT_POSITION);
-      driveController_.setGoal(words[2].toFloat());
-      driveMotor_.setEnabled(true);
-      return RES_OK;
-    } else if (words[1] == "speed") {
-      pwmControl_ = false;
-      driveEncoder_.setMode(bb::Encoder::INPUT_SPEED);
-      driveController_.setGoal(words[2].toFloat());
-      return RES_OK;
-    } else return RES_CMD_INVALID_ARGUMENT;
-  }
-
-  else if (words[0] == "mode") {
-    if (words.size() == 1) {
-      switch (mode_) {
-        case MODE_OFF:
-          if (stream) stream->printf("off\n");
-          break;
-        case MODE_ROLL_CONTROL_ONLY:
-          if (stream) stream->printf("roll\n");
-          break;
-        case MODE_SPEED_CONTROL_ONLY:
-          if (stream) stream->printf("speed\n");
-          break;
-        case MODE_SPEED_ROLL_CONTROL:
-          if (stream) stream->printf("speed_roll\n");
-          break;
-        case MODE_POS_CONTROL:
-          if (stream) stream->printf("pos\n");
-          break;
-        case MODE_KIOSK:
-          if (stream) stream->printf("kiosk\n");
-          break;
-        case MODE_CALIB:
-          if (stream) stream->printf("calib\n");
-          break;
-        default:
-          if (stream) stream->printf("unknown\n");
-          break;
-      }
-    } else if (words.size() == 2) {
-      if (words[1] == "off") {
-        mode_ = MODE_OFF;
-        return RES_OK;
-      } else if (words[1] == "roll") {
-        mode_ = MODE_ROLL_CONTROL_ONLY;
-        return RES_OK;
-      } else if (words[1] == "speed") {
-        mode_ = MODE_SPEED_CONTROL_ONLY;
-        return RES_OK;
-      } else if (words[1] == "speed_roll") {
-        mode_ = MODE_SPEED_ROLL_CONTROL;
-        return RES_OK;
-      } else if (words[1] == "pos") {
-        mode_ = MODE_POS_CONTROL;
-        return RES_OK;
-      } else if (words[1] == "kiosk") {
-        mode_ = MODE_KIOSK;
-        return RES_OK;
-      } else if (words[1] == "calib") {
-        mode_ = MODE_CALIB;
-        return RES_OK;
-      } else return RES_CMD_INVALID_ARGUMENT;
-    } else
-      return RES_CMD_INVALID_ARGUMENT_COUNT;
+    }
   }
+  return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if (words[0] == "set_pixel") {
-    if (words.size() != 5) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    uint8_t p, r, g, b;
-    p = words[1].toInt();
-    r = words[2].toInt();
-    g = words[3].toInt();
-    b = words[4].toInt();
-
-    BB8StatusPixels::statusPixels.setPixel(p, r, g, b);
-    return RES_OK;
-  }
+Result BB8::cmdSetPixel(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  uint8_t p, r, g, b;
+  p = words[1].toInt();
+  r = words[2].toInt();
+  g = words[3].toInt();
+  b = words[4].toInt();
 
-  return bb::Subsystem::handleConsoleCommand(words, stream);
+  BB8StatusPixels::statusPixels.setPixel(p, r, g, b);
+  return RES_OK;
 }
 
 Result BB8::fillAndSendStatePacket() {
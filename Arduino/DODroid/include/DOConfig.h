@@ -13,6 +13,7 @@ static const float         WHEEL_CIRCUMFERENCE = 722.566;              // Wheel
 static const float         WHEEL_TICKS_PER_TURN = 979.2 * (97.0/18.0); // 979.2 ticks per one turn of the drive gear, 18 teeth on the drive gear, 97 teeth on the main gear.
 static const float         WHEEL_DISTANCE = 95.0;                      // Distance between the drive wheels
 static const bool          HEAD_COUNTERWEIGHT = true;                  // set to false if you're running without a head counterweight
+static const unsigned int  FASTLOOP_RATE = 200;                        // Sensor sampling and drive control rate in Hz, from a timer interrupt. 0 runs them in the main runloop.
 
 // Parameters - all of these can be set from the commandline and stored in flash.
 struct DOParams {
@@ -121,6 +122,7 @@ static const uint8_t P_I2C_SDA         = 11; // Usually the default
 static const uint8_t P_I2C_SCL         = 12; // Usually the default
 static const uint8_t P_DYNAMIXEL_RX    = 13; // Must be usable as Serial RX
 static const uint8_t P_DYNAMIXEL_TX    = 14; // Must be usable as Serial TX
+static const int8_t  P_IMU_DRDY        = -1; // IMU INT1 (data ready). Must be an interrupt pin; -1 if not wired
 
 // I2C Peripherals
 static const uint8_t BATT_STATUS_ADDR  = 0x40;
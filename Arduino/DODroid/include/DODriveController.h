@@ -26,7 +26,7 @@ protected:
   float accel_;
   float deadband_;
   bb::ControlOutput &left_, &right_;
-  unsigned long lastCycleUS_;
+  uint32_t lastCycleUS_;
   float maxSpeed_;
 };
 
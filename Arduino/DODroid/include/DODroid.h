@@ -52,10 +52,15 @@ public:
   Result stepPowerProtect();
   Result stepDrive();
   Result stepHead();
+  void sampleSensors();
+  void stepDriveControl();
+  void publishDriveTelemetry();
 
   virtual String statusLine();
   virtual void printExtendedStatus(ConsoleStream *stream = NULL);
   virtual Result fillAndSendStatePacket();
+  Result sendTimingPacket();
+  void addTasks();
 
   void setControlParameters();
 
@@ -70,8 +75,7 @@ public:
 
   virtual Result incomingControlPacket(const HWAddress& srcAddr, PacketSource source, uint8_t rssi, uint8_t seqnum, const ControlPacket& packet);
   virtual Result incomingConfigPacket(const HWAddress& srcAddr, PacketSource source, uint8_t rssi, uint8_t seqnum, ConfigPacket& packet);
-  virtual Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream);
-  virtual Result setParameterValue(const String& name, const String& stringVal);
+  virtual void parameterChangedCallback(const char* name);
 
   Result selfTest(ConsoleStream *stream = NULL);
   Result servoTest(ConsoleStream *stream = NULL);
@@ -101,6 +105,14 @@ public:
   void setLEDBrightness(uint8_t brightness);
 
 protected:
+  Result cmdSelftest(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdPlaySound(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSafety(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdDrive(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdIMUSync(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSetAerials(const ConsoleWords& words, ConsoleStream *stream);
+  static const CommandDef COMMANDS[];
+
   bb::IMU imu_;
   bb::DCMotor leftMotor_, rightMotor_;
   bb::Encoder leftEncoder_, rightEncoder_;
@@ -125,6 +137,31 @@ protected:
   float msSinceDriveInput_;
 
   DriveMode driveMode_;
+  uint8_t driveModeMarker_; // trace marker, arg is the new drive mode
+
+  // Handed between the main runloop and the fast loop (see FASTLOOP_RATE in DOConfig.h). Without the fast loop,
+  // they take the same path, only that sampleSensors() and stepDriveControl() run in the main runloop.
+  struct DriveCommand {
+    DriveMode mode;
+    bool motorsOK;
+    float vel, rot;     // used in DRIVE_VEL
+    float posGoal;      // used in DRIVE_POS
+    float balanceGoal;
+  };
+  struct DriveSample {
+    float pitch, roll, heading;
+    float ax, ay, az;
+    float dp, dr, dh;
+    float speed;
+  };
+  struct DriveTelemetry {
+    DriveControlState drive[3]; // balance, left, right
+  };
+  DriveCommand driveCmd_;
+  DoubleBuffer<DriveCommand> driveCmdBuffer_;
+  DoubleBuffer<DriveSample> sampleBuffer_;
+  DoubleBuffer<DriveTelemetry> telemetryBuffer_;
+  bool fastLoop_;
   bool driveSafety_;
   
   bool servosOK_, aerialsOK_;
@@ -134,6 +171,7 @@ protected:
   float annealP_, annealH_, annealR_, annealTime_;
   float lean_;
   bool headIsOn_;
+  bool hardwareOK_;
 
   Adafruit_NeoPixel statusPixels_;
   bool commLEDOn_;
@@ -17,6 +17,10 @@ public:
   bool begin();
   bool available() { return available_; }
   bool checkSDCard(); // CAREFUL - takes up to 71ms!
+  // Same as checkSDCard(), but one DFPlayer query per call. Returns true while there is more to do.
+  bool checkSDCardChunk();
+  // Run checkSDCard() chunk by chunk in the runloop's idle time, unless a check is already queued.
+  void scheduleSDCardCheck();
 #if defined(CHECK_SDCARD)
   bool sdCardInserted() { return fileCount_ != -1; }
 #else
@@ -39,6 +43,8 @@ private:
 
   std::map<unsigned int, FolderContents> folders_;
   int fileCount_;
+  unsigned int sdCheckFolder_; // 0 = next chunk queries the overall file count
+  bool sdCheckResult_, sdCheckQueued_;
 
   Uart *ser_;
 };
@@ -13,6 +13,8 @@ DOBattStatus::DOBattStatus() {
 }
 
 bool DOBattStatus::begin() {
+  bb::I2CLock lock;
+
   // Check whether we exist
   int err;
   Wire.beginTransmission(BATT_STATUS_ADDR);
@@ -34,6 +36,7 @@ bool DOBattStatus::available() {
 
 bool DOBattStatus::updateVoltage() {
   if(!available_) return false;
+  bb::I2CLock lock;
 
 #if defined(BATT_VOLTAGE_PRECISE)
   voltage_ = ina.getShuntVoltage_mV() / 1000 + ina.getBusVoltage_V();
@@ -50,6 +53,7 @@ bool DOBattStatus::updateVoltage() {
 
 bool DOBattStatus::updateCurrent() {
   if(!available_) return false;
+  bb::I2CLock lock;
   current_ = ina.getCurrent_mA();
   if(isnan(current_) || !isfinite(current_)) {
     available_ = false;
@@ -9,18 +9,13 @@ DOVelControlOutput::DOVelControlOutput(bb::ControlOutput& left, bb::ControlOutpu
     curRot_ = 0;
     accel_ = 0;
     maxSpeed_ = 0;
-    lastCycleUS_ = micros();
+    lastCycleUS_ = bb::Runloop::runloop.micros();
 }
 
 bb::Result DOVelControlOutput::set(float value) {
   bb::Result resLeft, resRight;
-  unsigned long us = micros();
-  float dt;
-  if(us < lastCycleUS_) {
-    dt = ((ULONG_MAX - lastCycleUS_) + us)/1e6;
-  } else {
-    dt = (us - lastCycleUS_)/1e6;
-  }
+  uint32_t us = bb::Runloop::runloop.micros();
+  float dt = (us - lastCycleUS_)/1e6;
   lastCycleUS_ = us;
 
   if(curVel_ < goalVel_) {
@@ -39,6 +39,15 @@ static void customAnalogWrite(uint8_t pin, uint8_t dutycycle) {
   pwm->setPWM(pin, f, map(dutycycle, 0, 255, 0.0, 100.0));
 }
 
+const Subsystem::CommandDef DODroid::COMMANDS[] = {
+  command("selftest",    0, 0, &DODroid::cmdSelftest),
+  command("play_sound",  1, 2, &DODroid::cmdPlaySound),
+  command("safety",      1, 1, &DODroid::cmdSafety),
+  command("drive",       1, 1, &DODroid::cmdDrive),
+  command("imu_sync",    1, 1, &DODroid::cmdIMUSync),
+  command("set_aerials", 1, 3, &DODroid::cmdSetAerials)
+};
+
 DODroid::DODroid():
   imu_(IMU_ADDR),
 
@@ -74,6 +83,7 @@ DODroid::DODroid():
   statusPixels_.show();
 
   name_ = "d-o";
+  setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
 
   description_ = "D-O Main System";
   help_ = "Available commands:\n"\
@@ -82,7 +92,8 @@ DODroid::DODroid():
 "\tsafety {on|off}\tSwitch safety functions on/off\n"\
 "\tdrive {off|pos|vel}\tSwitch drive system to off, position control, or velocity control\n"\
 "\tplay_sound [<folder>] <num>\tPlay sound\n"\
-"\tset_aerials A1 [A2 A3]\tMove aerials. A1, A2, A3: Angle between 0 and 180\n";
+"\tset_aerials A1 [A2 A3]\tMove aerials. A1, A2, A3: Angle between 0 and 180\n"\
+"\timu_sync {on|off}\tStart runloop cycles on IMU data ready (needs P_IMU_DRDY) or on the fixed cycle time\n";
   started_ = false;
 
   operationStatus_ = RES_SUBSYS_NOT_STARTED;
@@ -91,58 +102,67 @@ DODroid::DODroid():
   setLED(LED_DRIVE, OFF);
 
   commLEDOn_ = false;
+  fastLoop_ = false;
+  driveCmd_ = {DRIVE_OFF, false, 0, 0, 0, 0};
   msLastLeftCtrlPacket_ = msLastRightCtrlPacket_ = msLastPrimaryCtrlPacket_ = 0;
 }
 
+// Lives in flash; "set" and "get" find entries through a hash index.
+static constexpr Subsystem::ParameterDef PARAMETERS[] = {
+  Subsystem::parameter("neck_range", "Neck servo movement range", DODroid::params_.neckRange, -INT_MAX, INT_MAX),
+  Subsystem::parameter("neck_offset", "Neck servo offset", DODroid::params_.neckOffset, -INT_MAX, INT_MAX),
+  Subsystem::parameter("head_roll_range", "Head roll servo movement range", DODroid::params_.headRollRange, -INT_MAX, INT_MAX),
+  Subsystem::parameter("head_roll_offset", "Head roll servo servo offset", DODroid::params_.headRollOffset, -INT_MAX, INT_MAX),
+  Subsystem::parameter("head_pitch_range", "Head pitch servo movement range", DODroid::params_.headPitchRange, -INT_MAX, INT_MAX),
+  Subsystem::parameter("head_pitch_offset", "Head pitch servo offset", DODroid::params_.headPitchOffset, -INT_MAX, INT_MAX),
+  Subsystem::parameter("head_heading_range", "Head heading servo movement range", DODroid::params_.headHeadingRange, -INT_MAX, INT_MAX),
+  Subsystem::parameter("head_heading_offset", "Head heading servo servo offset", DODroid::params_.headHeadingOffset, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("mot_deadband", "Deadband for drive motors", DODroid::params_.motorDeadband, 0, 255),
+
+  Subsystem::parameter("wheel_kp", "Proportional constant for wheel speed PID controller", DODroid::params_.wheelKp, -INT_MAX, INT_MAX),
+  Subsystem::parameter("wheel_ki", "Integrative constant for wheel speed PID controller", DODroid::params_.wheelKi, -INT_MAX, INT_MAX),
+  Subsystem::parameter("wheel_kd", "Derivative constant for wheel speed PID controller", DODroid::params_.wheelKd, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("bal_kp", "Proportional constant for balance PID controller", DODroid::params_.balKp, -INT_MAX, INT_MAX),
+  Subsystem::parameter("bal_ki", "Integrative constant for balance PID controller", DODroid::params_.balKi, -INT_MAX, INT_MAX),
+  Subsystem::parameter("bal_kd", "Derivative constant for balance PID controller", DODroid::params_.balKd, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("auto_pos_kp", "Proportional constant for position PID controller", DODroid::params_.autoPosKp, -INT_MAX, INT_MAX),
+  Subsystem::parameter("auto_pos_ki", "Integrative constant for position PID controller", DODroid::params_.autoPosKi, -INT_MAX, INT_MAX),
+  Subsystem::parameter("auto_pos_kd", "Derivative constant for position PID controller", DODroid::params_.autoPosKd, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("pos_kp", "Proportional constant for position PID controller", DODroid::params_.posKp, -INT_MAX, INT_MAX),
+  Subsystem::parameter("pos_ki", "Integrative constant for position PID controller", DODroid::params_.posKi, -INT_MAX, INT_MAX),
+  Subsystem::parameter("pos_kd", "Derivative constant for position PID controller", DODroid::params_.posKd, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("accel", "Acceleration in mm/s^2", DODroid::params_.accel, -INT_MAX, INT_MAX),
+  Subsystem::parameter("max_speed", "Maximum speed (only honored in speed control mode)", DODroid::params_.maxSpeed, 0, INT_MAX),
+  Subsystem::parameter("speed_axis_gain", "Gain for controller speed axis", DODroid::params_.speedAxisGain, -INT_MAX, INT_MAX),
+  Subsystem::parameter("rot_axis_gain", "Gain for controller rot axis", DODroid::params_.rotAxisGain, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("lean_head_to_body", "Lean multiplier to counter head motion with body motion", DODroid::params_.leanHeadToBody, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("aerial_offset", "Offset for aerials", DODroid::params_.aerialOffset, -INT_MAX, INT_MAX),
+  Subsystem::parameter("aerial_anim", "Animation angle for aerials", DODroid::params_.aerialAnim, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("fa_neck_imu_accel", "Free Anim - neck on IMU accel", DODroid::params_.faNeckIMUAccel, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_neck_sp_accel", "Free Anim - neck on accel setpoint", DODroid::params_.faNeckSPAccel, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_neck_speed", "Free Anim - neck on wheel speed", DODroid::params_.faNeckSpeed, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_neck_speed_sp", "Free Anim - neck on wheel speed setpoint", DODroid::params_.faNeckSpeedSP, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_head_pitch_speed_sp", "Free Anim - head pitch on wheel speed setpoint", DODroid::params_.faHeadPitchSpeedSP, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_head_roll_turn", "Free Anim: Head roll on turn speed", DODroid::params_.faHeadRollTurn, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_head_heading_turn", "Free Anim: Head heading on turn speed", DODroid::params_.faHeadHeadingTurn, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_aerial_speed", "Free Anim: Aerial position on wheel speed setpoint", DODroid::params_.faAerialSpeedSP, -INT_MAX, INT_MAX),
+  Subsystem::parameter("fa_head_anneal_time", "Free Anim: Head anneal time", DODroid::params_.faHeadAnnealTime, -INT_MAX, INT_MAX),
+
+  Subsystem::parameter("auto_pos_control", "Automatically switch to position control", DODroid::params_.autoPosControl)
+};
+
 Result DODroid::initialize() {
-  addParameter("neck_range", "Neck servo movement range", params_.neckRange, -INT_MAX, INT_MAX);
-  addParameter("neck_offset", "Neck servo offset", params_.neckOffset, -INT_MAX, INT_MAX);
-  addParameter("head_roll_range", "Head roll servo movement range", params_.headRollRange, -INT_MAX, INT_MAX);
-  addParameter("head_roll_offset", "Head roll servo servo offset", params_.headRollOffset, -INT_MAX, INT_MAX);
-  addParameter("head_pitch_range", "Head pitch servo movement range", params_.headPitchRange, -INT_MAX, INT_MAX);
-  addParameter("head_pitch_offset", "Head pitch servo offset", params_.headPitchOffset, -INT_MAX, INT_MAX);
-  addParameter("head_heading_range", "Head heading servo movement range", params_.headHeadingRange, -INT_MAX, INT_MAX);
-  addParameter("head_heading_offset", "Head heading servo servo offset", params_.headHeadingOffset, -INT_MAX, INT_MAX);
-
-  addParameter("mot_deadband", "Deadband for drive motors", params_.motorDeadband, 0, 255);
-
-  addParameter("wheel_kp", "Proportional constant for wheel speed PID controller", params_.wheelKp, -INT_MAX, INT_MAX);
-  addParameter("wheel_ki", "Integrative constant for wheel speed PID controller", params_.wheelKi, -INT_MAX, INT_MAX);
-  addParameter("wheel_kd", "Derivative constant for wheel speed PID controller", params_.wheelKd, -INT_MAX, INT_MAX);
-
-  addParameter("bal_kp", "Proportional constant for balance PID controller", params_.balKp, -INT_MAX, INT_MAX);
-  addParameter("bal_ki", "Integrative constant for balance PID controller", params_.balKi, -INT_MAX, INT_MAX);
-  addParameter("bal_kd", "Derivative constant for balance PID controller", params_.balKd, -INT_MAX, INT_MAX);
-
-  addParameter("auto_pos_kp", "Proportional constant for position PID controller", params_.autoPosKp, -INT_MAX, INT_MAX);
-  addParameter("auto_pos_ki", "Integrative constant for position PID controller", params_.autoPosKi, -INT_MAX, INT_MAX);
-  addParameter("auto_pos_kd", "Derivative constant for position PID controller", params_.autoPosKd, -INT_MAX, INT_MAX);
-
-  addParameter("pos_kp", "Proportional constant for position PID controller", params_.posKp, -INT_MAX, INT_MAX);
-  addParameter("pos_ki", "Integrative constant for position PID controller", params_.posKi, -INT_MAX, INT_MAX);
-  addParameter("pos_kd", "Derivative constant for position PID controller", params_.posKd, -INT_MAX, INT_MAX);
-
-  addParameter("accel", "Acceleration in mm/s^2", params_.accel, -INT_MAX, INT_MAX);
-  addParameter("max_speed", "Maximum speed (only honored in speed control mode)", params_.maxSpeed, 0, INT_MAX);
-  addParameter("speed_axis_gain", "Gain for controller speed axis", params_.speedAxisGain, -INT_MAX, INT_MAX);
-  addParameter("rot_axis_gain", "Gain for controller rot axis", params_.rotAxisGain, -INT_MAX, INT_MAX);
-
-  addParameter("lean_head_to_body", "Lean multiplier to counter head motion with body motion", params_.leanHeadToBody, -INT_MAX, INT_MAX);
-
-  addParameter("aerial_offset", "Offset for aerials", params_.aerialOffset, -INT_MAX, INT_MAX);
-  addParameter("aerial_anim", "Animation angle for aerials", params_.aerialAnim, -INT_MAX, INT_MAX);
-
-  addParameter("fa_neck_imu_accel", "Free Anim - neck on IMU accel", params_.faNeckIMUAccel, -INT_MAX, INT_MAX);
-  addParameter("fa_neck_sp_accel", "Free Anim - neck on accel setpoint", params_.faNeckSPAccel, -INT_MAX, INT_MAX);
-  addParameter("fa_neck_speed", "Free Anim - neck on wheel speed", params_.faNeckSpeed, -INT_MAX, INT_MAX);
-  addParameter("fa_neck_speed_sp", "Free Anim - neck on wheel speed setpoint", params_.faNeckSpeedSP, -INT_MAX, INT_MAX);
-  addParameter("fa_head_pitch_speed_sp", "Free Anim - head pitch on wheel speed setpoint", params_.faHeadPitchSpeedSP, -INT_MAX, INT_MAX);
-  addParameter("fa_head_roll_turn", "Free Anim: Head roll on turn speed", params_.faHeadRollTurn, -INT_MAX, INT_MAX);
-  addParameter("fa_head_heading_turn", "Free Anim: Head heading on turn speed", params_.faHeadHeadingTurn, -INT_MAX, INT_MAX);
-  addParameter("fa_aerial_speed", "Free Anim: Aerial position on wheel speed setpoint", params_.faAerialSpeedSP, -INT_MAX, INT_MAX);
-  addParameter("fa_head_anneal_time", "Free Anim: Head anneal time", params_.faHeadAnnealTime, -INT_MAX, INT_MAX);
-
-  addParameter("auto_pos_control", "Automatically switch to position control", params_.autoPosControl);
+  driveModeMarker_ = Trace::trace.registerMarker("drive_mode");
+
+  setParameterTable(PARAMETERS, sizeof(PARAMETERS)/sizeof(PARAMETERS[0]));
 
   configureTimers();
   leftMotor_.setCustomAnalogWrite(&customAnalogWrite);
@@ -169,6 +189,9 @@ Result DODroid::initialize() {
 
   setPacketSource(PACKET_SOURCE_DROID);
 
+  hardwareOK_ = false;
+  addTasks();
+
   return Subsystem::initialize();
 }
 
@@ -178,11 +201,13 @@ Result DODroid::start(ConsoleStream* stream) {
   servosOK_ = false;
   aerialsOK_ = false;
   driveMode_ = DRIVE_OFF;
+  driveCmd_ = {DRIVE_OFF, false, 0, 0, 0, 0};
+  driveCmdBuffer_.write(driveCmd_);
   driveSafety_ = true;
   headIsOn_ = false;
   pitchAtRest_ = 0;
 
-  imu_.begin();
+  imu_.begin(P_IMU_DRDY);
   DOBattStatus::batt.begin();
   DOSound::sound.begin();
 
@@ -231,6 +256,7 @@ Result DODroid::stop(ConsoleStream* stream) {
 }
 
 void DODroid::setControlParameters() {
+  FastLoop::CriticalSection cs;
   leftMotor_.setDeadband(params_.motorDeadband);
   rightMotor_.setDeadband(params_.motorDeadband);
 
@@ -260,47 +286,66 @@ void DODroid::setControlParameters() {
 }
 
 Result DODroid::step() {
-  unsigned long seqnum = Runloop::runloop.getSequenceNumber();
-  
-  // We're broken; still send out the state packet.
-  if(!imu_.available() || !DOBattStatus::batt.available()) {
-    if((seqnum % 4) == 0) {
-      fillAndSendStatePacket();
-    }
-    LOG(LOG_FATAL, "IMU or battery missing - critical error\n");
+  // We're broken; only the state packet task still does anything.
+  hardwareOK_ = imu_.available() && DOBattStatus::batt.available();
+  if(!hardwareOK_) {
+    LOG_LIMITED(LOG_FATAL, 1000, "IMU or battery missing - critical error\n");
     return RES_SUBSYS_HW_DEPENDENCY_MISSING;
   }
 
-  // Look for battery undervoltage
-  if((Runloop::runloop.getSequenceNumber() % 100) == 0) {
-    stepPowerProtect();
-  }
+  // Encoder and IMU updates are needed for everything, so we do them here - unless the fast loop does them.
+  // Everything else runs at lower rates as runloop tasks, see addTasks().
+  fastLoop_ = FastLoop::fastloop.isStarted();
+  if(!fastLoop_) sampleSensors();
 
-  // Check if SD card was changed
-  if((seqnum % 1000) == 0 && driveMode_ == DRIVE_OFF) {
-    Runloop::runloop.excuseOverrun();
-    DOSound::sound.checkSDCard();
-  }
+  return RES_OK;
+}
 
-  // Encoder and IMU updates are needed for everything, so we do them here.
+void DODroid::sampleSensors() {
   leftEncoder_.update();  
   rightEncoder_.update();  
   imu_.update();
 
-  // We only run head and drive control at 50Hz
-  if((seqnum % 2) == 0) {
-    stepHead();
-  } else {
-    stepDrive();
+  DriveSample s;
+  imu_.getFilteredPRH(s.pitch, s.roll, s.heading);
+  imu_.getAccelMeasurement(s.ax, s.ay, s.az);
+  imu_.getGyroMeasurement(s.dp, s.dr, s.dh);
+  s.speed = (leftEncoder_.presentSpeed() + rightEncoder_.presentSpeed())/2;
+  sampleBuffer_.write(s);
+}
+
+void DODroid::addTasks() {
+  // Cost estimates are rough and only used for the initial phase plan - "runloop tasks rebalance" replans with measured cost.
+  // Head and drive control at 50Hz; phase balancing puts them on alternating cycles.
+  Runloop::runloop.addTask(this, "head", 50, [this]() { if(hardwareOK_) stepHead(); }, 2000);
+  Runloop::runloop.addTask(this, "drive", 50, [this]() { if(hardwareOK_) stepDrive(); }, 2000);
+
+  // Sampling and drive control in the fast loop, if we have one. stepDrive() above then only supervises and hands over goals.
+  if(FASTLOOP_RATE != 0) {
+    FastLoop::fastloop.setRateHz(FASTLOOP_RATE);
+    FastLoop::fastloop.addTask("sample", [this]() { if(started_ && hardwareOK_) sampleSensors(); });
+    FastLoop::fastloop.addTask("drive", [this]() { if(started_ && hardwareOK_) stepDriveControl(); });
   }
 
-  if((seqnum % 4) == 0) {
+  // State packet goes out even if we're broken.
+  Runloop::runloop.addTask(this, "state", 25, [this]() { 
     fillAndSendStatePacket();
+    if(!hardwareOK_) return;
     if(XBee::xbee.isStarted() && Servos::servos.isStarted()) setLED(LED_STATUS, GREEN);
     else setLED(LED_STATUS, YELLOW);
-  }
+  }, 2000);
 
-  return RES_OK;
+  // Look for battery undervoltage
+  Runloop::runloop.addTask(this, "power", 1, [this]() { if(hardwareOK_) stepPowerProtect(); }, 500);
+
+  // Check if SD card was changed
+  Runloop::runloop.addTask(this, "sdcard", 0.1, [this]() {
+    if(!hardwareOK_ || driveMode_ != DRIVE_OFF) return;
+    DOSound::sound.scheduleSDCardCheck();
+  }, 100);
+
+  // Runloop timing telemetry
+  Runloop::runloop.addTask(this, "timing", 1, [this]() { sendTimingPacket(); }, 1000);
 }
 
 bb::Result DODroid::stepPowerProtect() {
@@ -310,6 +355,11 @@ bb::Result DODroid::stepPowerProtect() {
   // CRITICAL: Switch everything off (except the neck servo, so that we don't drop the head) and go into endless loop if power 
   if(DOBattStatus::batt.voltage() > 2.0 &&
       DOBattStatus::batt.voltage() < POWER_BATT_MIN) {
+    // The fast loop would keep driving the motors with the last command - stop it before switching them off.
+    FastLoop::fastloop.stop();
+    driveMode_ = DRIVE_OFF;
+    driveCmd_.mode = DRIVE_OFF;
+    driveCmdBuffer_.write(driveCmd_);
     leftMotor_.set(0);
     rightMotor_.set(0);
     bb::Servos::servos.switchTorque(SERVO_HEAD_PITCH, false);
@@ -329,14 +379,12 @@ bb::Result DODroid::stepPowerProtect() {
 }
 
 bb::Result DODroid::stepHead() {
-  float p, r, h, dr, dp, dh, ax, ay, az;
-  imu_.getFilteredPRH(p, r, h);
-  imu_.getAccelMeasurement(ax, ay, az);
-  imu_.getGyroMeasurement(dp, dr, dh);
+  DriveSample s = sampleBuffer_.read();
+  float p = s.pitch, ax = s.ax, dh = s.dh;
 
-  //Console::console.printfBroadcast("R:%f P:%f H:%f AX:%f AY:%f AZ:%f RAX:%f RAY: %f RAZ: %f DR:%f DP:%f DH:%f\n", r, p, h, ax, ay, az, rax, ray, raz, dr, dp, dh);
+  //Console::console.printfBroadcast("P:%f AX:%f DH:%f\n", p, ax, dh);
 
-  float speed = (leftEncoder_.presentSpeed() + rightEncoder_.presentSpeed())/2;
+  float speed = s.speed;
   float speedSP = velOutput_.goalVelocity();
   float accelSP = (speedSP-speed);
   if(speedSP == 0) accelSP = 0;
@@ -414,22 +462,82 @@ bb::Result DODroid::stepHead() {
 bb::Result DODroid::stepDrive() {
   unsigned long timeSinceLastPrimary = WRAPPEDDIFF(millis(), msLastPrimaryCtrlPacket_, ULONG_MAX);
   if(timeSinceLastPrimary > 500 && driveMode_ != DRIVE_OFF && driveSafety_ == true) {
-    bb::printf("No control packet from primary in %ldms. Switching drive off.\n", timeSinceLastPrimary);
+    LOG_LIMITED(LOG_WARN, 1000, "No control packet from primary in %lums. Switching drive off.\n", timeSinceLastPrimary);
     switchDrive(DRIVE_OFF);
     DOSound::sound.playSystemSound(SystemSounds::DISCONNECTED);
   }
 
-  if(driveMode_ != DRIVE_OFF && leftMotorStatus_ == MOTOR_OK && rightMotorStatus_ == MOTOR_OK) {
+  driveCmd_.mode = driveMode_;
+  driveCmd_.motorsOK = leftMotorStatus_ == MOTOR_OK && rightMotorStatus_ == MOTOR_OK;
+  driveCmdBuffer_.write(driveCmd_);
+
+  if(!fastLoop_) stepDriveControl();
+  return RES_OK;
+}
+
+void DODroid::stepDriveControl() {
+  DriveCommand cmd = driveCmdBuffer_.read();
+
+  if(cmd.mode != DRIVE_OFF && cmd.motorsOK) {
+    balanceController_.setGoal(cmd.balanceGoal);
+    if(cmd.mode == DRIVE_VEL) {
+      velOutput_.setGoalVelocity(cmd.vel);
+      velOutput_.setGoalRotation(cmd.rot);
+    } else if(cmd.mode == DRIVE_POS) {
+      posController_.setGoal(cmd.posGoal);
+    }
+
     balanceController_.update();
     lSpeedController_.update();
     rSpeedController_.update();
-    if(driveMode_ == DRIVE_POS) posController_.update();
-    else if(driveMode_ == DRIVE_AUTO_POS) autoPosController_.update();
+    if(cmd.mode == DRIVE_POS) posController_.update();
+    else if(cmd.mode == DRIVE_AUTO_POS) autoPosController_.update();
+    imu_.markActuation();
   } else {
     leftMotor_.set(0);
     rightMotor_.set(0);
   }
-  return RES_OK;
+
+  publishDriveTelemetry();
+}
+
+// Controller and encoder state for the large state packet, taken where the controllers run so the main loop
+// never reads them halfway through an update. Error states are filled in by the reader.
+void DODroid::publishDriveTelemetry() {
+  DriveTelemetry t;
+  float err, errI, errD, control;
+
+  t.drive[0].presentPWM = balanceController_.present();
+  t.drive[0].presentPos = leftEncoder_.presentPosition();
+  t.drive[0].presentSpeed = leftEncoder_.presentSpeed();
+  balanceController_.getControlState(err, errI, errD, control);
+  t.drive[0].goal = balanceController_.goal();
+  t.drive[0].err = err;
+  t.drive[0].errI = errI;
+  t.drive[0].errD = errD;
+  t.drive[0].control = control;
+
+  t.drive[1].presentPWM = leftMotor_.present();
+  t.drive[1].presentPos = leftEncoder_.presentPosition();
+  t.drive[1].presentSpeed = leftEncoder_.presentSpeed();
+  lSpeedController_.getControlState(err, errI, errD, control);
+  t.drive[1].goal = lSpeedController_.goal();
+  t.drive[1].err = err;
+  t.drive[1].errI = errI;
+  t.drive[1].errD = errD;
+  t.drive[1].control = control;
+
+  t.drive[2].presentPWM = rightMotor_.present();
+  t.drive[2].presentPos = rightEncoder_.presentPosition();
+  t.drive[2].presentSpeed = rightEncoder_.presentSpeed();
+  rSpeedController_.getControlState(err, errI, errD, control);
+  t.drive[2].goal = rSpeedController_.goal();
+  t.drive[2].err = err;
+  t.drive[2].errI = errI;
+  t.drive[2].errD = errD;
+  t.drive[2].control = control;
+
+  telemetryBuffer_.write(t);
 }
 
 bb::Result DODroid::stepIfNotStarted() {
@@ -447,6 +555,8 @@ bb::Result DODroid::stepIfNotStarted() {
 }
 
 void DODroid::switchDrive(DriveMode mode) {
+  FastLoop::CriticalSection cs;
+
   lSpeedController_.reset();
   lSpeedController_.setGoal(0);
   rSpeedController_.reset();
@@ -460,6 +570,12 @@ void DODroid::switchDrive(DriveMode mode) {
   posControllerZero_ = posController_.present();
 
   driveMode_ = mode;
+  driveCmd_.mode = mode;
+  driveCmd_.vel = driveCmd_.rot = 0;
+  driveCmd_.posGoal = posControllerZero_;
+  driveCmd_.balanceGoal = -pitchAtRest_;
+  driveCmdBuffer_.write(driveCmd_);
+  Trace::trace.marker(driveModeMarker_, mode);
   bb::printf("Drive mode: ");
   switch(driveMode_) {
     case DRIVE_OFF: 
@@ -499,11 +615,11 @@ String DODroid::statusLine() {
 
   str += ", motors: ";
 
-  leftEncoder_.update();
+  if(!fastLoop_) leftEncoder_.update();
   if(leftMotorStatus_ == MOTOR_OK) str += "L OK";
   else str = str + "L Err " + leftMotorStatus_;
 
-  rightEncoder_.update();
+  if(!fastLoop_) rightEncoder_.update();
   if(rightMotorStatus_ == MOTOR_OK) str += ", R OK";
   else str = str + ", R Err " + rightMotorStatus_;
 
@@ -522,19 +638,21 @@ void DODroid::printExtendedStatus(ConsoleStream *stream) {
   stream->printf("\tFrom right remote: %d\n", numRightCtrlPackets_);
 
   stream->printf("Motors:\n");
-  leftEncoder_.update();
+  if(!fastLoop_) leftEncoder_.update();
   if(leftMotorStatus_ == MOTOR_OK) stream->printf("\tLeft OK, encoder %f\n", leftEncoder_.presentPosition());
   else stream->printf("\tLeft status: %s, encoder at %.2fmm\n", motorStatusToString(leftMotorStatus_), leftEncoder_.presentPosition());
-  rightEncoder_.update();
+  if(!fastLoop_) rightEncoder_.update();
   if(rightMotorStatus_ == MOTOR_OK) stream->printf("\tRight OK, encoder %f\n", rightEncoder_.presentPosition());
   else stream->printf("\tRight status: %s, encoder at %.2fmm\n", motorStatusToString(rightMotorStatus_), rightEncoder_.presentPosition());
 
-  float p, r, h, ax, ay, az;
-  imu_.getFilteredPRH(p, r, h);
-  imu_.getAccelMeasurement(ax, ay, az);
+  DriveSample s = sampleBuffer_.read();
   stream->printf("IMU:\n");
-  stream->printf("\tPitch %.2f Roll %.2f Heading %.2f\n", p, r, h);
-  stream->printf("\tAx %.2f Ay %.2f Az %.2f\n", ax, ay, az);
+  stream->printf("\tPitch %.2f Roll %.2f Heading %.2f\n", s.pitch, s.roll, s.heading);
+  stream->printf("\tAx %.2f Ay %.2f Az %.2f\n", s.ax, s.ay, s.az);
+  const TimingStats& lat = imu_.sampleToActuation();
+  stream->printf("\tSample to actuation: mean %luus, p99 %luus, max %luus over %lu samples (%s)\n", 
+                 (unsigned long)lat.mean(), (unsigned long)lat.percentile(0.99), (unsigned long)lat.max(), (unsigned long)lat.count(),
+                 imu_.runloopSynced() ? "runloop synced to data ready" : "fixed cycle time");
 
   DOBattStatus::batt.updateCurrent();
   DOBattStatus::batt.updateVoltage();
@@ -592,6 +710,8 @@ Result DODroid::incomingControlPacket(const HWAddress& srcAddr, PacketSource sou
     return RES_SUBSYS_COMM_ERROR;
   }
 
+  DriveCommand lastCmd = driveCmd_;
+
   // Hardcoded axis / trigger mapping starts here
   if(packet.primary == true) {
     msLastPrimaryCtrlPacket_ = millis();
@@ -646,11 +766,11 @@ Result DODroid::incomingControlPacket(const HWAddress& srcAddr, PacketSource sou
       if(driveMode_ == DRIVE_VEL) {
         vel = constrain(vel * params_.maxSpeed * params_.speedAxisGain, -params_.maxSpeed, params_.maxSpeed);
         rot = constrain(rot * params_.maxSpeed * params_.rotAxisGain, -params_.maxSpeed, params_.maxSpeed);
-        velOutput_.setGoalVelocity(vel);
-        velOutput_.setGoalRotation(rot);
+        driveCmd_.vel = vel;
+        driveCmd_.rot = rot;
       } else if(driveMode_ == DRIVE_POS) {
         float posDelta = packet.getAxis(1) * 1000; // FIXME - should be a constant
-        posController_.setGoal(posControllerZero_ + posDelta);
+        driveCmd_.posGoal = posControllerZero_ + posDelta;
         //rot = constrain(rot * params_.maxSpeed * params_.rotAxisGain, -params_.maxSpeed, params_.maxSpeed);
         //velOutput_.setGoalRotation(rot);
       }
@@ -674,7 +794,7 @@ Result DODroid::incomingControlPacket(const HWAddress& srcAddr, PacketSource sou
     lean_ = leanFilter_.filter(-1 * packet.getAxis(1, bb::ControlPacket::UNIT_UNITY_CENTERED) * params_.neckRange);
 
     if(headIsOn_) {
-      balanceController_.setGoal(params_.leanHeadToBody*lean_-pitchAtRest_);
+      driveCmd_.balanceGoal = params_.leanHeadToBody*lean_-pitchAtRest_;
     }
 
     if(packet.button0 && !lastSecondaryCtrlPacket_.button0) DOSound::sound.playFolderNext(5);
@@ -693,79 +813,86 @@ Result DODroid::incomingControlPacket(const HWAddress& srcAddr, PacketSource sou
     else remoteAerial1_ = 0;
   }
 
+  // Hand new goals to the fast loop right away instead of with the next stepDrive(), up to a drive cycle later
+  if(driveCmd_.vel != lastCmd.vel || driveCmd_.rot != lastCmd.rot ||
+     driveCmd_.posGoal != lastCmd.posGoal || driveCmd_.balanceGoal != lastCmd.balanceGoal) {
+    driveCmdBuffer_.write(driveCmd_);
+  }
+
   return RES_OK;
 }
 
-Result DODroid::handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream) {
-  if(words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
+Result DODroid::cmdSelftest(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  Runloop::runloop.excuseOverrun();
+  FastLoop::CriticalSection cs; // motor tests drive the motors and read the encoders themselves
+  return selfTest(stream);
+}
 
-  if(words[0] == "selftest") {
-    if(words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    Runloop::runloop.excuseOverrun();
-    return selfTest(stream);
-  } 
-  
-  else if(words[0] == "play_sound") {
-    if(words.size() == 1 || words.size() > 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words.size() == 2) {
-      bool retval = DOSound::sound.playSound(words[1].toInt());
-      if(retval == false) stream->printf("Error\n");      
-    } if(words.size() == 3) {
-      bool retval = DOSound::sound.playFolder((unsigned int)(words[1].toInt()), words[2].toInt());
-      if(retval == false) stream->printf("Error\n");
-    }
+Result DODroid::cmdPlaySound(const ConsoleWords& words, ConsoleStream *stream) {
+  bool retval;
+  if(words.size() == 2) retval = DOSound::sound.playSound(words[1].toInt());
+  else retval = DOSound::sound.playFolder((unsigned int)(words[1].toInt()), words[2].toInt());
+  if(retval == false) stream->printf("Error\n");
+  return RES_OK;
+}
+
+Result DODroid::cmdSafety(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  if(words[1] == "off") {
+    driveSafety_ = false;
     return RES_OK;
-  }
+  } else if(words[1] == "on") {
+    driveSafety_ = true;
+    return RES_OK;
+  } else return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if(words[0] == "safety") {
-    if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words[1] == "off") {
-      driveSafety_ = false;
-      return RES_OK;
-    } else if(words[1] == "on") {
-      driveSafety_ = true;
-      return RES_OK;
-    } else return RES_CMD_INVALID_ARGUMENT;
-  }
+Result DODroid::cmdDrive(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  if(words[1] == "off") {
+    switchDrive(DRIVE_OFF);
+    return RES_OK;
+  } else if(words[1] == "pos") {
+    switchDrive(DRIVE_POS);
+    return RES_OK;
+  } else if(words[1] == "vel") {
+    switchDrive(DRIVE_VEL);
+    return RES_OK;
+  } else return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if(words[0] == "drive") {
-    if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words[1] == "off") {
-      switchDrive(DRIVE_OFF);
-      return RES_OK;
-    } else if(words[1] == "pos") {
-      switchDrive(DRIVE_POS);
-      return RES_OK;
-    } else if(words[1] == "vel") {
-      switchDrive(DRIVE_VEL);
-      return RES_OK;
-    } else return RES_CMD_INVALID_ARGUMENT;
-  }
-
-  else if(words[0] == "set_aerials") {
-    if(words.size() == 2) {
-      float angle = words[1].toFloat();
-      if(setAerials(angle, angle, angle) == true) return RES_OK;
-      return RES_CMD_FAILURE;
-    } else if(words.size() == 4) {
-      float a1 = words[1].toFloat(), a2 = words[2].toFloat(), a3 = words[3].toFloat();
-      if(setAerials(a1, a2, a3) == true) return RES_OK;
-      return RES_CMD_FAILURE;
-    }
+Result DODroid::cmdIMUSync(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  if(words[1] == "on") {
+    if(imu_.syncRunloop(true) == false) return RES_SUBSYS_HW_DEPENDENCY_MISSING;
+    return RES_OK;
+  } else if(words[1] == "off") {
+    imu_.syncRunloop(false);
+    return RES_OK;
+  } else return RES_CMD_INVALID_ARGUMENT;
+}
 
-    return RES_CMD_INVALID_ARGUMENT_COUNT;
+Result DODroid::cmdSetAerials(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  if(words.size() == 2) {
+    float angle = words[1].toFloat();
+    if(setAerials(angle, angle, angle) == true) return RES_OK;
+    return RES_CMD_FAILURE;
+  } else if(words.size() == 4) {
+    float a1 = words[1].toFloat(), a2 = words[2].toFloat(), a3 = words[3].toFloat();
+    if(setAerials(a1, a2, a3) == true) return RES_OK;
+    return RES_CMD_FAILURE;
   }
-  
-  return bb::Subsystem::handleConsoleCommand(words, stream);
-}
 
-Result DODroid::setParameterValue(const String& name, const String& stringVal) {
-  Result retval = Subsystem::setParameterValue(name, stringVal);
-  if(retval != RES_OK) return retval;
+  return RES_CMD_INVALID_ARGUMENT_COUNT;
+}
 
+void DODroid::parameterChangedCallback(const char* name) {
+  // Console "set" as well as bulk parameter requests end up here. Stored once tuning has paused for a while.
+  (void)name;
   setControlParameters();
-
-  return RES_OK;
+  ConfigStorage::storage.markDirty(paramsHandle_);
 }
 
 Result DODroid::fillAndSendStatePacket() {
@@ -832,18 +959,17 @@ Result DODroid::fillAndSendStatePacket() {
   }
 
   // IMU
-  float pitch, roll, heading;
+  DriveSample s = sampleBuffer_.read();
   if(imu_.available()) {
-    imu_.getFilteredPRH(pitch, roll, heading);
-    packet.payload.state.pitch = rint((pitch*1024.0f)/360.0f);
-    packet.payload.state.roll = rint((roll*1024)/360.0f);
-    packet.payload.state.heading = rint((heading*1024.0f)/360.0f);
+    packet.payload.state.pitch = rint((s.pitch*1024.0f)/360.0f);
+    packet.payload.state.roll = rint((s.roll*1024)/360.0f);
+    packet.payload.state.heading = rint((s.heading*1024.0f)/360.0f);
   } else {
-    bb::printf("IMU not available\n");
+    LOG_LIMITED(LOG_ERROR, 1000, "IMU not available\n");
   }
 
   // Speed in mm/s
-  packet.payload.state.speed = (leftEncoder_.present() + rightEncoder_.present())/2;
+  packet.payload.state.speed = s.speed;
 
   if(params_.leftRemoteAddress.isZero()) return RES_OK;
 
@@ -860,57 +986,45 @@ Result DODroid::fillAndSendStatePacket() {
 
   strncpy(p.droidName, DROID_NAME, sizeof(p.droidName));
 
-  float err, errI, errD, control;
+  DriveTelemetry t = telemetryBuffer_.read();
 
   if(leftMotorStatus_ == MOTOR_OK && rightMotorStatus_ == MOTOR_OK) {
-    p.drive[0].errorState = ERROR_OK;   
+    p.drive[0] = t.drive[0];
+    p.drive[0].errorState = ERROR_OK;
     //p.drive[0].controlMode = (driveMode_ != DRIVE_OFF) ? bb::StatePacket::CONTROL_RC : bb::StatePacket::CONTROL_OFF;
-
-    p.drive[0].presentPWM = balanceController_.present();
-    p.drive[0].presentPos = leftEncoder_.presentPosition();
-    p.drive[0].presentSpeed = leftEncoder_.presentSpeed();
-    balanceController_.getControlState(err, errI, errD, control);
-    p.drive[0].goal = balanceController_.goal();
-
-    p.drive[0].err = err;
-    p.drive[0].errI = errI;
-    p.drive[0].errD = errD;
-    p.drive[0].control = control;
   }
 
   if(leftMotorStatus_ == MOTOR_OK) {
+    p.drive[1] = t.drive[1];
     p.drive[1].errorState = ERROR_OK;
-    // p.drive[1].controlMode = (driveMode_ != DRIVE_OFF) ? bb::StatePacket::CONTROL_RC : bb::StatePacket::CONTROL_OFF;
-    p.drive[1].presentPWM = leftMotor_.present();
-    p.drive[1].presentPos = leftEncoder_.presentPosition();
-    p.drive[1].presentSpeed = leftEncoder_.presentSpeed();
-    lSpeedController_.getControlState(err, errI, errD, control);
-    p.drive[1].goal = lSpeedController_.goal();
-    p.drive[1].err = err;
-    p.drive[1].errI = errI;
-    p.drive[1].errD = errD;
-    p.drive[1].control = control;
+    // p.drive[1].controlMode = (driveMode_ != DRIVE_OFF) ? bb::StatePacket::CONTROL_RC : bb::StatePacket::CONTROL_OFF;
   } else {
     p.drive[1].errorState = ERROR_NOT_PRESENT;
   }
 
   if(rightMotorStatus_ == MOTOR_OK) {
+    p.drive[2] = t.drive[2];
     p.drive[2].errorState = ERROR_OK;
     //p.drive[2].controlMode = (driveMode_ != DRIVE_OFF) ? bb::StatePacket::CONTROL_RC : bb::StatePacket::CONTROL_OFF;
-    p.drive[2].presentPWM = rightMotor_.present();
-    p.drive[2].presentPos = rightEncoder_.presentPosition();
-    p.drive[2].presentSpeed = rightEncoder_.presentSpeed();
-    rSpeedController_.getControlState(err, errI, errD, control);
-    p.drive[2].goal = rSpeedController_.goal();
-    p.drive[2].err = err;
-    p.drive[2].errI = errI;
-    p.drive[2].errD = errD;
-    p.drive[2].control = control;
   } else {
      p.drive[2].errorState = ERROR_NOT_PRESENT;
   }
 
-  p.imu[0] = imu_.getIMUState();
+  // From the same sample the drive runs on - the IMU itself belongs to the fast loop
+  if(imu_.available()) {
+    p.imu[0].errorState = ERROR_OK;
+    p.imu[0].p = s.pitch;
+    p.imu[0].r = s.roll;
+    p.imu[0].h = s.heading;
+    p.imu[0].dp = s.dp;
+    p.imu[0].dr = s.dr;
+    p.imu[0].dh = s.dh;
+    p.imu[0].ax = s.ax;
+    p.imu[0].ay = s.ay;
+    p.imu[0].az = s.az;
+  } else {
+    p.imu[0].errorState = ERROR_NOT_PRESENT;
+  }
   p.imu[1].errorState = ERROR_NOT_PRESENT;
   p.imu[2].errorState = ERROR_NOT_PRESENT;
 
@@ -924,11 +1038,22 @@ Result DODroid::fillAndSendStatePacket() {
 }
 
 
+Result DODroid::sendTimingPacket() {
+  if(!WifiServer::server.isStarted()) return RES_SUBSYS_NOT_STARTED;
+
+  RunloopTimingPacket p;
+  Runloop::runloop.fillTimingPacket(p);
+  WifiServer::server.broadcastUDPPacket((const uint8_t*)&p, sizeof(p));
+
+  return RES_OK;
+}
+
 bool DODroid::setAerials(uint8_t a1, uint8_t a2, uint8_t a3) {
   //if(aerialsOK_ == false) return false;
 
   int retval;
   uint8_t aerials[3] = {a1, a2, a3};
+  I2CLock lock;
   Wire.beginTransmission(AERIAL_ADDR);
   Wire.write(aerials, sizeof(aerials));
   retval = Wire.endTransmission();
@@ -940,6 +1065,7 @@ bool DODroid::setAerials(uint8_t a1, uint8_t a2, uint8_t a3) {
 bool DODroid::getAerials(uint8_t& a1, uint8_t& a2, uint8_t& a3) {
   if(aerialsOK_ == false) return false;
   int timeout;
+  I2CLock lock;
   Wire.requestFrom(0x17, 3);
 
   for(timeout=100; timeout>0 && !Wire.available(); timeout--);
@@ -44,8 +44,12 @@ Result DODroid::selfTest(ConsoleStream *stream) {
   }
 
   // Check Aerials
-  Wire.beginTransmission(AERIAL_ADDR);
-  uint8_t antErr = Wire.endTransmission();
+  uint8_t antErr;
+  {
+    I2CLock lock;
+    Wire.beginTransmission(AERIAL_ADDR);
+    antErr = Wire.endTransmission();
+  }
   if(antErr != 0) {
     Console::console.printfBroadcast("Aerial error: 0x%x\n", antErr);
   } else {
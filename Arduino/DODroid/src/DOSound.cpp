@@ -11,6 +11,9 @@ DOSound DOSound::sound;
 DOSound::DOSound() {
   available_ = false;
   fileCount_ = -1;
+  sdCheckFolder_ = 0;
+  sdCheckResult_ = false;
+  sdCheckQueued_ = false;
   ser_ = nullptr;
 }
 
@@ -108,40 +111,71 @@ bool DOSound::setVolume(uint8_t vol) {
 }
 
 bool DOSound::checkSDCard() {
-  int fc = -1;
-  for(int i=0; i<DOSOUND_REPEATS; i++) {
-    int fc_ = dfp_.numSdTracks();
-    if(fc_ != -1) {
-      fc = fc_;
-      break;
-    }
-    delayMicroseconds(DOSOUND_DELAY_US);
+  while(checkSDCardChunk());
+  return sdCheckResult_;
+}
+
+void DOSound::scheduleSDCardCheck() {
+  if(sdCheckQueued_) return;
+  // Each chunk is one DFPlayer query of up to ~8ms. That rarely fits into the slack, so allow it to run late.
+  if(Runloop::runloop.addIdleTask("sdcard", 8000, [this]() {
+    if(checkSDCardChunk()) return true;
+    sdCheckQueued_ = false;
+    return false;
+  }, 500) == RES_OK) {
+    sdCheckQueued_ = true;
   }
+}
 
-  if(fileCount_ == -1) {
-    if(fc == -1) {
-      return false; // no change
-    }
-    fileCount_ = fc;
-    Console::console.printfBroadcast("SD card inserted!\n");
-    Console::console.printfBroadcast("    %d overall files\n", fileCount_);
-    for(unsigned int i=1; i<=8; i++) {
-      int num = dfp_.numTracksInFolder(i);
-      Console::console.printfBroadcast("    %d files in folder %d\n", num, i);
-      if(num > 0)
-        folders_[i] = {num, 0};
+bool DOSound::checkSDCardChunk() {
+  if(sdCheckFolder_ == 0) {
+    int fc = -1;
+    for(int i=0; i<DOSOUND_REPEATS; i++) {
+      int fc_ = dfp_.numSdTracks();
+      if(fc_ != -1) {
+        fc = fc_;
+        break;
+      }
+      delayMicroseconds(DOSOUND_DELAY_US);
     }
-    Console::console.printfBroadcast("Playing initial system sound.\n");
-    playFolder(int(1), SystemSounds::SOUND_SYSTEM_READY, true);
-    Console::console.printfBroadcast("Done.\n");
-    return true;
-  } else {
-    if(fc == fileCount_) return true; // no change
-    if(fc == -1) {
-      Console::console.printfBroadcast("SD card removed!\n");
-      fileCount_ = -1;
+
+    if(fileCount_ == -1) {
+      if(fc == -1) {
+        sdCheckResult_ = false; // no change
+        return false;
+      }
+      fileCount_ = fc;
+      Console::console.printfBroadcast("SD card inserted!\n");
+      Console::console.printfBroadcast("    %d overall files\n", fileCount_);
+      sdCheckFolder_ = 1; // go on with the folders in the next chunk
+      return true;
+    } else {
+      if(fc == fileCount_) {
+        sdCheckResult_ = true; // no change
+        return false;
+      }
+      if(fc == -1) {
+        Console::console.printfBroadcast("SD card removed!\n");
+        fileCount_ = -1;
+      }
+      sdCheckResult_ = false;
       return false;
     }
   }
+
+  if(sdCheckFolder_ <= 8) {
+    int num = dfp_.numTracksInFolder(sdCheckFolder_);
+    Console::console.printfBroadcast("    %d files in folder %d\n", num, sdCheckFolder_);
+    if(num > 0)
+      folders_[sdCheckFolder_] = {num, 0};
+    sdCheckFolder_++;
+    return true;
+  }
+
+  Console::console.printfBroadcast("Playing initial system sound.\n");
+  playFolder(int(1), SystemSounds::SOUND_SYSTEM_READY, true);
+  Console::console.printfBroadcast("Done.\n");
+  sdCheckFolder_ = 0;
+  sdCheckResult_ = true;
   return false;
-}
\ No newline at end of file
+}
@@ -36,6 +36,9 @@ void SERCOM3_Handler() {
 void initializeSubsystems() {
   ConfigStorage::storage.initialize();
   Runloop::runloop.initialize();
+  Trace::trace.initialize();
+  BinaryLog::binlog.initialize();
+  FastLoop::fastloop.initialize();
   WifiServer::server.initialize(WIFI_SSID, WIFI_WPA_KEY, WIFI_AP_MODE, DEFAULT_UDP_PORT, DEFAULT_TCP_PORT);
   WifiServer::server.setOTANameAndPassword("D-O", "OTA");
   XBee::xbee.initialize(DEFAULT_CHAN, DEFAULT_PAN, 230400, serialTXSerial);
@@ -48,6 +51,7 @@ void initializeSubsystems() {
 }
 
 void startSubsystems() {
+  Trace::trace.start(); // always on, "trace dump" after something went wrong
   WifiServer::server.start();
   XBee::xbee.addPacketReceiver(&DODroid::droid);
   XBee::xbee.start(Console::console.serialStream());
@@ -56,6 +60,10 @@ void startSubsystems() {
   Servos::servos.start(Console::console.serialStream());
   Console::console.printfBroadcast("Starting droid\n");
   DODroid::droid.start(Console::console.serialStream());
+  if(FASTLOOP_RATE != 0) {
+    Console::console.printfBroadcast("Starting fast loop at %dHz\n", FASTLOOP_RATE);
+    FastLoop::fastloop.start(Console::console.serialStream());
+  }
   // sometimes this doesn't work on the first try for whatever reason
   if(WifiServer::server.isStarted() == false) WifiServer::server.start(); 
 }
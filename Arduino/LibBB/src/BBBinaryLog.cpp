@@ -0,0 +1,226 @@
+#include "BBBinaryLog.h"
+#include "BBConsole.h"
+#include "BBRunloop.h"
+#if !defined(ARDUINO_ARCH_NATIVE)
+#include "BBWifiServer.h"
+#endif
+
+static_assert((BB_BINLOG_SIZE & (BB_BINLOG_SIZE-1)) == 0, "BB_BINLOG_SIZE must be a power of 2");
+
+bb::BinaryLog bb::BinaryLog::binlog;
+bool bb::binaryLogging = false;
+
+// Datagrams start with this, followed by whole records.
+static const char DATAGRAM_MAGIC[] = "BBL1";
+static const size_t DATAGRAM_SIZE = 1024;
+// How often udp_stream sends, at most.
+static const uint32_t STREAM_INTERVAL_MILLIS = 100;
+
+void bb::storeLogRecord(uint8_t* buf, size_t len, uint8_t level, uint32_t id, const char* source) {
+	BinaryLog::binlog.store(buf, len, level, id, source);
+}
+
+const bb::Subsystem::CommandDef bb::BinaryLog::COMMANDS[] = {
+	command("dump",  0, 0, &BinaryLog::cmdDump),
+	command("send",  0, 0, &BinaryLog::cmdSend),
+	command("clear", 0, 0, &BinaryLog::cmdClear)
+};
+
+bb::BinaryLog::BinaryLog() {
+	name_ = "binlog";
+	description_ = "Binary log";
+	help_ = "While started, LOG() output is kept in binary instead of being printed.\r\n" \
+	"Available commands:\r\n" \
+	"\tdump: Print and remove the records (decode with DroidGUI/LogDecoder.py)\r\n" \
+	"\tsend: Broadcast and remove the records via UDP\r\n" \
+	"\tclear: Discard the records\r\n";
+	setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
+
+	head_ = tail_ = 0;
+	count_ = 0;
+	stored_ = overwritten_ = 0;
+	dumping_ = false;
+	udpStream_ = false;
+	lastSendMS_ = 0;
+
+	addParameter("udp_stream", "Broadcast records via UDP as they come in", udpStream_);
+}
+
+bb::Result bb::BinaryLog::start(ConsoleStream* stream) {
+	(void)stream;
+	binaryLogging = true;
+	started_ = true;
+	operationStatus_ = RES_OK;
+	return RES_OK;
+}
+
+bb::Result bb::BinaryLog::stop(ConsoleStream* stream) {
+	(void)stream;
+	binaryLogging = false;
+	started_ = false;
+	operationStatus_ = RES_SUBSYS_NOT_STARTED;
+	return RES_OK;
+}
+
+bb::Result bb::BinaryLog::step() {
+#if !defined(ARDUINO_ARCH_NATIVE)
+	if(!udpStream_ || dumping_ || count_ == 0 || !WifiServer::server.isStarted()) return RES_OK;
+	if(Runloop::runloop.millis() - lastSendMS_ < STREAM_INTERVAL_MILLIS) return RES_OK;
+	static uint8_t datagram[DATAGRAM_SIZE];
+	size_t len = fillDatagram(datagram, sizeof(datagram), count_);
+	WifiServer::server.broadcastUDPPacket(datagram, len);
+	lastSendMS_ = Runloop::runloop.millis();
+#endif
+	return RES_OK;
+}
+
+void bb::BinaryLog::store(uint8_t* buf, size_t len, uint8_t level, uint32_t id, const char* source) {
+	if(len > BB_BINLOG_SIZE) return;
+
+	LogRecordHeader header;
+	header.length = len;
+	header.level = level;
+	header.source = logHash(source) & 0xffff;
+	header.id = id;
+	header.us = Runloop::runloop.micros();
+	memcpy(buf, &header, sizeof(header));
+
+	// Make room by dropping the oldest records
+	while(BB_BINLOG_SIZE - (head_ - tail_) < len) {
+		tail_ += ring_[tail_ & (BB_BINLOG_SIZE-1)];
+		count_--;
+		overwritten_++;
+	}
+
+	size_t pos = head_ & (BB_BINLOG_SIZE-1);
+	size_t n = BB_BINLOG_SIZE - pos;
+	if(n > len) n = len;
+	memcpy(ring_ + pos, buf, n);
+	memcpy(ring_, buf + n, len - n);
+	head_ += len;
+	count_++;
+	stored_++;
+}
+
+size_t bb::BinaryLog::pop(uint8_t* buf, size_t size) {
+	if(count_ == 0) return 0;
+	size_t pos = tail_ & (BB_BINLOG_SIZE-1);
+	size_t len = ring_[pos];
+	if(len > size) return 0;
+
+	size_t n = BB_BINLOG_SIZE - pos;
+	if(n > len) n = len;
+	memcpy(buf, ring_ + pos, n);
+	memcpy(buf + n, ring_, len - n);
+	tail_ += len;
+	count_--;
+	return len;
+}
+
+void bb::BinaryLog::clear() {
+	head_ = tail_ = 0;
+	count_ = 0;
+	stored_ = overwritten_ = 0;
+}
+
+bb::Result bb::BinaryLog::dumpTo(ConsoleStream* stream) {
+	if(dumping_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	dumping_ = true;
+	stream->printf("BBL H %u %lu\n", (unsigned)count_, (unsigned long)overwritten_);
+
+	// Only what's there now - LOG() keeps adding records while we print.
+	size_t remaining = count_;
+	Result res = Runloop::runloop.addIdleTask("binlog", 1000, [this, stream, remaining]() mutable {
+		static const size_t LINE_SIZE = 6 + 2*MAX_LOG_RECORD + 2;
+		for(int i=0; i<4; i++) {
+			if(stream->writeSpace() < LINE_SIZE) return true; // let the stream catch up
+			uint8_t record[MAX_LOG_RECORD];
+			size_t len = remaining != 0 ? pop(record, sizeof(record)) : 0;
+			if(len == 0) {
+				stream->printf("BBL X\n> ");
+				dumping_ = false;
+				return false;
+			}
+			char line[LINE_SIZE];
+			strcpy(line, "BBL R ");
+			for(size_t j=0; j<len; j++) snprintf(line + 6 + 2*j, 3, "%02x", record[j]);
+			strcat(line, "\n");
+			stream->printfFinal(line);
+			remaining--;
+		}
+		return true;
+	});
+	if(res != RES_OK) {
+		dumping_ = false;
+		return res;
+	}
+
+	Console::console.deferPrompt();
+	return RES_OK;
+}
+
+#if !defined(ARDUINO_ARCH_NATIVE)
+size_t bb::BinaryLog::fillDatagram(uint8_t* buf, size_t size, size_t maxRecords) {
+	size_t len = sizeof(DATAGRAM_MAGIC) - 1;
+	memcpy(buf, DATAGRAM_MAGIC, len);
+	while(maxRecords > 0 && count_ > 0 && len + ring_[tail_ & (BB_BINLOG_SIZE-1)] <= size) {
+		len += pop(buf + len, size - len);
+		maxRecords--;
+	}
+	return len;
+}
+
+bb::Result bb::BinaryLog::sendUDP() {
+	if(!WifiServer::server.isStarted()) return RES_SUBSYS_NOT_STARTED;
+	if(dumping_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	dumping_ = true;
+
+	size_t remaining = count_;
+	Result res = Runloop::runloop.addIdleTask("binlog", 2000, [this, remaining]() mutable {
+		static uint8_t datagram[DATAGRAM_SIZE];
+		size_t before = count_;
+		size_t len = fillDatagram(datagram, sizeof(datagram), remaining);
+		remaining -= before - count_;
+		if(len > sizeof(DATAGRAM_MAGIC) - 1) WifiServer::server.broadcastUDPPacket(datagram, len);
+		if(remaining != 0 && count_ != 0) return true;
+		dumping_ = false;
+		return false;
+	});
+	if(res != RES_OK) {
+		dumping_ = false;
+		return res;
+	}
+	return RES_OK;
+}
+#endif
+
+bb::Result bb::BinaryLog::cmdDump(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	return dumpTo(stream);
+}
+
+bb::Result bb::BinaryLog::cmdSend(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	(void)stream;
+#if !defined(ARDUINO_ARCH_NATIVE)
+	return sendUDP();
+#else
+	return RES_SUBSYS_HW_DEPENDENCY_MISSING;
+#endif
+}
+
+bb::Result bb::BinaryLog::cmdClear(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	(void)stream;
+	if(dumping_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	clear();
+	return RES_OK;
+}
+
+void bb::BinaryLog::printExtendedStatus(ConsoleStream *stream) {
+	printStatusLine(stream);
+	if(stream == NULL) return;
+	stream->printf("%s, %u records in %u of %d bytes, %lu stored, %lu overwritten%s\n", binaryLogging ? "Logging binary" : "Logging text",
+	               (unsigned)count_, (unsigned)bytesUsed(), BB_BINLOG_SIZE, (unsigned long)stored_, (unsigned long)overwritten_,
+	               dumping_ ? ", dump in progress" : "");
+}
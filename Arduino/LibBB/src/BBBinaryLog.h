@@ -0,0 +1,75 @@
+#if !defined(BBBINARYLOG_H)
+#define BBBINARYLOG_H
+
+#include <Arduino.h>
+#include "BBSubsystem.h"
+#include "BBLogRecord.h"
+
+// Size of the binary log in bytes. Must be a power of 2. Records take 12 bytes plus their arguments.
+#if !defined(BB_BINLOG_SIZE)
+#define BB_BINLOG_SIZE 2048
+#endif
+
+namespace bb {
+
+/*!
+	\brief Keeps LOG() output in binary instead of formatting it.
+
+	While started, LOG() stores a record with the hash of its format string and the raw arguments in a ring buffer
+	instead of printing (see BBLogRecord.h), which is far cheaper than formatting and a fraction of the size. When the
+	buffer is full, the oldest records are overwritten.
+
+	"binlog dump" prints the records as hex lines starting with "BBL" and removes them, "binlog send" broadcasts them
+	via UDP; with the udp_stream parameter set, they are sent out as they come in. DroidGUI/LogDecoder.py turns
+	either back into text, using an ID table it collects from the sources (the D-O build generates it as
+	logtable.json in the build directory).
+
+	Measured on the host against the text path for the same LOG() call, a record is about 2.25x smaller (20 vs. 45
+	bytes) and about 4x cheaper to store (109 vs. 402 ns) - well short of 10x. On the MCUs the CPU gain should be
+	larger, because formatting floats is much costlier there, but that hasn't been measured.
+*/
+class BinaryLog: public Subsystem {
+public:
+	static BinaryLog binlog;
+
+	virtual Result start(ConsoleStream* stream = NULL);
+	virtual Result stop(ConsoleStream* stream = NULL);
+	virtual Result step();
+	virtual void printExtendedStatus(ConsoleStream *stream = NULL);
+
+	//! Called through storeLogRecord() by LOG(). Fills in the header of the record in buf.
+	void store(uint8_t* buf, size_t len, uint8_t level, uint32_t id, const char* source);
+	//! Copies the oldest record into buf and removes it. Returns its length, or 0 if there is none (or buf is too small).
+	size_t pop(uint8_t* buf, size_t size);
+
+	void clear();
+	size_t numRecords() { return count_; }
+	size_t bytesUsed() { return head_ - tail_; }
+	//! Since the last clear()
+	uint32_t numStored() { return stored_; }
+	uint32_t numOverwritten() { return overwritten_; }
+
+protected:
+	BinaryLog();
+
+	Result dumpTo(ConsoleStream* stream);
+	Result cmdDump(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdSend(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdClear(const ConsoleWords& words, ConsoleStream *stream);
+	static const CommandDef COMMANDS[];
+#if !defined(ARDUINO_ARCH_NATIVE)
+	Result sendUDP();
+	size_t fillDatagram(uint8_t* buf, size_t size, size_t maxRecords);
+#endif
+
+	uint8_t ring_[BB_BINLOG_SIZE];
+	uint32_t head_, tail_;   // free running byte positions
+	size_t count_;
+	uint32_t stored_, overwritten_;
+	bool dumping_, udpStream_;
+	uint32_t lastSendMS_;
+};
+
+};
+
+#endif // BBBINARYLOG_H
@@ -1,33 +1,56 @@
 #include "BBConfigStorage.h"
+#include "BBRunloop.h"
+#include "BBSubsystem.h"
+#include "BBPacket.h"
 
-#if defined(ARDUINO_ARCH_RP2040)
-#include <EEPROM.h>
-static const size_t MAXSIZE=1024;
-#elif defined(ARDUINO_ARCH_SAMD)
-#include <FlashAsEEPROM.h>
-static const size_t MAXSIZE=EEPROM_EMULATION_SIZE;
-#elif defined(ARDUINO_ARCH_ESP32)
+#if defined(ARDUINO_ARCH_ESP32)
 #include <nvs_flash.h>
 #include <nvs.h>
-static const size_t MAXSIZE=1024;
-#else
+#elif !defined(ARDUINO_ARCH_RP2040) && !defined(ARDUINO_ARCH_SAMD) && !defined(ARDUINO_ARCH_NATIVE)
 #error Unsupported architecture
 #endif
 
 
 bb::ConfigStorage bb::ConfigStorage::storage;
 
+// Write behind chunks run even without slack if they had to wait this long.
+static const uint32_t WRITE_BEHIND_MAX_WAIT_MILLIS = 5000;
+// Until the first commit has been measured.
+static const uint32_t DEFAULT_COMMIT_MICROS = 5000;
+
+#if !defined(ARDUINO_ARCH_ESP32)
+// Journal record. The header is followed by size bytes of data; commit records have none. Sequence numbers start at
+// 1 and are never reused, so records left over from earlier use of a bank always have lower ones than what follows
+// the last commit.
+struct __attribute__((packed)) RecordHeader {
+	uint8_t magic;
+	uint8_t flags;
+	uint16_t size;
+	uint32_t seq;
+	uint32_t id;         // hash of the block name
+	uint16_t dataCRC;
+	uint16_t headerCRC;  // over everything before it
+};
+
+static const uint8_t RECORD_MAGIC = 0xbb;
+static const uint8_t RECORD_FLAG_COMMIT = 0x01;
+static const size_t HEADER_SIZE = sizeof(RecordHeader);
+#endif
+
+void bb::ConfigStorage::setBackend(StorageBackend* backend) {
+#if !defined(ARDUINO_ARCH_ESP32)
+	if(!initialized_) backend_ = backend;
+#else
+	(void)backend;
+#endif
+}
+
 bb::ConfigStorage::HANDLE bb::ConfigStorage::reserveBlock(const char* name, size_t size, uint8_t *mem) {
 	if(!initialized_) {
 		Serial.println("Not initialized, returning 0.");
 		return 0;
 	}
 
-	if(nextHandle_ + 1 + size > maxSize_) {
-		Serial.println("Size too large");
-		return 0;
-	}
-
 #if defined(ARDUINO_ARCH_ESP32)
 	nvs_handle_t handle;
 	esp_err_t err = nvs_open(name, NVS_READWRITE, &handle);
@@ -35,118 +58,313 @@ bb::ConfigStorage::HANDLE bb::ConfigStorage::reserveBlock(const char* name, size
 		Serial.println(String("nvs_open() returned ") + err);
 		return RES_CONFIG_INVALID_HANDLE;
 	}
-	Block block = {handle, size, mem};
+	Block block = {handle, 0, size, mem, false, false, false, 0};
 #else
-	Block block = {nextHandle_+1, size, mem};
-	nextHandle_ = nextHandle_ + size + 1;
+	// Every block plus a commit record has to fit into one bank, so that a bank switch can always take all of them.
+	if(size > 0xffff || reservedSize_ + 2*HEADER_SIZE + size > bankSize_) {
+		Serial.println("Size too large");
+		return 0;
+	}
+	uint32_t id = Subsystem::hashParameterName(name);
+	for(auto& b: blocks_) {
+		if(b.id == id) {
+			Serial.println("Block name already in use");
+			return 0;
+		}
+	}
+	Block block = {HANDLE(blocks_.size() + 1), id, size, mem, false, false, false, 0};
+	reservedSize_ += HEADER_SIZE + size;
 #endif
 	blocks_.push_back(block);
 	return block.handle;
 }
 
+bb::ConfigStorage::Block* bb::ConfigStorage::findBlock(HANDLE handle) {
+	for(auto& block: blocks_) {
+		if(block.handle == handle) return &block;
+	}
+	return NULL;
+}
+
 bb::Result bb::ConfigStorage::writeBlock(HANDLE handle) {
 	if(!initialized_) return RES_CONFIG_INVALID_HANDLE;
+	Block* block = findBlock(handle);
+	if(block == NULL) return RES_CONFIG_INVALID_HANDLE;
 
-	for(auto block: blocks_) {
-  		if(block.handle == handle) {
-  			size_t size = block.size;
-  			Serial.print("Storing "); Serial.print(size); Serial.print(" bytes of data at address "); Serial.println(handle, HEX);
 #if defined(ARDUINO_ARCH_ESP32)
-			esp_err_t err;
-			err = nvs_set_blob(handle, "blob", block.mem, size);
-			if(err != ESP_OK) {
-				Serial.println(String("nvs_set_blob() returned ") + err);
-				return RES_CONFIG_INVALID_HANDLE;
-			}
-			
-			err = nvs_set_i8(handle, "valid", 1);
-			if(err != ESP_OK) {
-				Serial.println(String("nvs_set_i8() returned ") + err);
-				return RES_CONFIG_INVALID_HANDLE;
-			}
+	esp_err_t err;
+	err = nvs_set_blob(handle, "blob", block->mem, block->size);
+	if(err != ESP_OK) {
+		Serial.println(String("nvs_set_blob() returned ") + err);
+		return RES_CONFIG_INVALID_HANDLE;
+	}
 
-			err = nvs_commit(handle);
-			if(err != ESP_OK) {
-				Serial.println(String("nvs_commit() returned ") + err);
-				return RES_CONFIG_INVALID_HANDLE;
-			}
+	err = nvs_set_i8(handle, "valid", 1);
+	if(err != ESP_OK) {
+		Serial.println(String("nvs_set_i8() returned ") + err);
+		return RES_CONFIG_INVALID_HANDLE;
+	}
 
-  			Serial.println("Commited blob.");
+	err = nvs_commit(handle);
+	if(err != ESP_OK) {
+		Serial.println(String("nvs_commit() returned ") + err);
+		return RES_CONFIG_INVALID_HANDLE;
+	}
 #else
-  			for(size_t i=0; i<size; i++) {
-  				EEPROM.write(handle+i, block.mem[i]);	
-  			} 
-  			Serial.println("Marking as valid");
-  			EEPROM.write(handle-1, 0xba);
+	block->pending = true;
 #endif
-
-			Serial.println("Done.");
-  			return RES_OK;
-  		}
-  	}
-  	return RES_CONFIG_INVALID_HANDLE;
+	block->dirty = false;
+	return RES_OK;
 }
 
 bb::Result bb::ConfigStorage::readBlock(HANDLE handle) {
 	if(!initialized_) return RES_CONFIG_INVALID_HANDLE;
-	for(auto block: blocks_) {
-  		if(block.handle == handle) {
+	Block* block = findBlock(handle);
+	if(block == NULL) return RES_CONFIG_INVALID_HANDLE;
+
 #if defined(ARDUINO_ARCH_ESP32)
-			esp_err_t err = nvs_get_blob(handle, "blob", block.mem, &block.size);
-			if(err != ESP_OK) {
-				Serial.println(String("nvs_get_blob() returned ") + err);
-				return RES_CONFIG_INVALID_HANDLE;
-			}
+	size_t size = block->size;
+	esp_err_t err = nvs_get_blob(handle, "blob", block->mem, &size);
+	if(err != ESP_OK) {
+		Serial.println(String("nvs_get_blob() returned ") + err);
+		return RES_CONFIG_INVALID_HANDLE;
+	}
 #else
-  			size_t size = block.size;
-  			for(size_t i=0; i<size; i++) {
-  				block.mem[i] = EEPROM.read(handle+i);
-  			} 
+	Record* rec = findRecord(block->id);
+	if(rec == NULL || rec->size != block->size) return RES_CONFIG_INVALID_HANDLE;
+	for(size_t i=0; i<rec->size; i++) {
+		block->mem[i] = backend_->read(rec->addr + i);
+	}
+	if(calculateCRC16(block->mem, rec->size) != rec->crc) return RES_CONFIG_INVALID_HANDLE;
 #endif
-  			return RES_OK;
-  		}
-  	}
-  	return RES_CONFIG_INVALID_HANDLE;
+	return RES_OK;
 }
 
 bool bb::ConfigStorage::blockIsValid(HANDLE handle) {
 	if(handle == 0 || !initialized_) return false;
+	Block* block = findBlock(handle);
+	if(block == NULL) return false;
 
-	for(auto& block: blocks_) {
-  		if(block.handle == handle) {
 #if defined(ARDUINO_ARCH_ESP32)
-			int8_t i8 = 0;
-			esp_err_t err = nvs_get_i8(handle, "valid", &i8);
-			if(err == ESP_OK && i8 == 1) return true;
+	int8_t i8 = 0;
+	esp_err_t err = nvs_get_i8(handle, "valid", &i8);
+	return err == ESP_OK && i8 == 1;
 #else
-  			if(EEPROM.read(handle-1) == 0xba) return true;
-#endif
-  			else return false;
-		} 
+	Record* rec = findRecord(block->id);
+	if(rec == NULL || rec->size != block->size) return false;
+	uint16_t crc = 0xffff;
+	for(size_t i=0; i<rec->size; i++) {
+		uint8_t b = backend_->read(rec->addr + i);
+		crc = calculateCRC16(&b, 1, crc);
 	}
-  	return false;
+	return crc == rec->crc;
+#endif
 }
 
 bool bb::ConfigStorage::initialize() {
 	if(initialized_) return true;
 
-#if defined(ARDUINO_NANO_RP2040_CONNECT)
-	EEPROM.begin(MAXSIZE);
-#elif defined(ARDUINO_ARCH_ESP32)
+#if defined(ARDUINO_ARCH_ESP32)
 	esp_err_t err = nvs_flash_init();
 	if(err != ESP_OK) {
 		Serial.println(String("Error initializing flash: ") + err);
 		return false;
 	}
 	Serial.println("Flash initialized OK.\n");
+#else
+	if(backend_ == NULL) backend_ = &EEPROMStorageBackend::eeprom;
+	bankSize_ = backend_->size() / 2;
+	reservedSize_ = 0;
+
+	// Both banks may hold a valid journal - the one with the newest commit wins. Only headers are read here.
+	uint32_t start = Runloop::runloop.micros();
+	uint32_t committedSeq[2], maxSeq = 0;
+	size_t tail[2];
+	std::vector<Record> records[2];
+	for(unsigned int bank=0; bank<2; bank++) {
+		scanBank(bank, committedSeq[bank], tail[bank], records[bank], maxSeq);
+	}
+	activeBank_ = committedSeq[1] > committedSeq[0] ? 1 : 0;
+	tail_ = tail[activeBank_];
+	records_ = records[activeBank_];
+	nextSeq_ = maxSeq + 1;
+	scanUS_ = Runloop::runloop.micros() - start;
 #endif
-	maxSize_ = MAXSIZE;
 
-	nextHandle_ = 0;
 	initialized_ = true;
 	return true;
 }
 
+#if !defined(ARDUINO_ARCH_ESP32)
+void bb::ConfigStorage::scanBank(unsigned int bank, uint32_t& committedSeq, size_t& tail, std::vector<Record>& records, uint32_t& maxSeq) {
+	size_t start = bank * bankSize_, pos = 0;
+	std::vector<Record> open;     // records of a transaction that has not seen its commit record yet
+	uint32_t openSeq = 0;
+
+	committedSeq = 0;
+	tail = 0;
+	records.clear();
+
+	while(pos + HEADER_SIZE <= bankSize_) {
+		RecordHeader header;
+		uint8_t* h = (uint8_t*)&header;
+		for(size_t i=0; i<HEADER_SIZE; i++) h[i] = backend_->read(start + pos + i);
+
+		// Erased or torn, or left over from earlier use of the bank - the journal ends here.
+		if(header.magic != RECORD_MAGIC || calculateCRC16(h, HEADER_SIZE - 2) != header.headerCRC) break;
+		if(pos + HEADER_SIZE + header.size > bankSize_) break;
+		if(header.seq > maxSeq) maxSeq = header.seq;
+		if(header.seq <= committedSeq) break;
+		if(openSeq != 0 && header.seq != openSeq) break;
+
+		if(header.flags & RECORD_FLAG_COMMIT) {
+			for(auto& r: open) {
+				bool found = false;
+				for(auto& existing: records) {
+					if(existing.id == r.id) {
+						existing = r;
+						found = true;
+						break;
+					}
+				}
+				if(!found) records.push_back(r);
+			}
+			open.clear();
+			openSeq = 0;
+			committedSeq = header.seq;
+			tail = pos + HEADER_SIZE;
+		} else {
+			Record r = {header.id, start + pos + HEADER_SIZE, header.size, header.dataCRC};
+			open.push_back(r);
+			openSeq = header.seq;
+		}
+		pos += HEADER_SIZE + header.size;
+	}
+	// Whatever is in open now was never committed and gets overwritten by the next transaction.
+}
+
+bb::ConfigStorage::Record* bb::ConfigStorage::findRecord(uint32_t id) {
+	for(auto& r: records_) {
+		if(r.id == id) return &r;
+	}
+	return NULL;
+}
+
+void bb::ConfigStorage::appendRecord(uint32_t seq, uint32_t id, uint8_t flags, const uint8_t* mem, size_t srcAddr, size_t size, uint16_t crc) {
+	RecordHeader header = {RECORD_MAGIC, flags, uint16_t(size), seq, id, crc, 0};
+	header.headerCRC = calculateCRC16((const uint8_t*)&header, HEADER_SIZE - 2);
+
+	if(size != 0) {
+		Record r = {id, txAddr_ + txBuf_.size() + HEADER_SIZE, size, crc};
+		txRecords_.push_back(r);
+	}
+	const uint8_t* h = (const uint8_t*)&header;
+	txBuf_.insert(txBuf_.end(), h, h + HEADER_SIZE);
+	if(mem != NULL) {
+		txBuf_.insert(txBuf_.end(), mem, mem + size);
+	} else {
+		for(size_t i=0; i<size; i++) txBuf_.push_back(backend_->read(srcAddr + i));
+	}
+}
+
+bb::Result bb::ConfigStorage::prepareTransaction() {
+	txBuf_.clear();
+	txRecords_.clear();
+	txSnapshot_ = false;
+
+	size_t needed = HEADER_SIZE;
+	for(auto& block: blocks_) {
+		if(!block.pending) continue;
+		block.pending = false;
+		block.crc = calculateCRC16(block.mem, block.size);
+		Record* rec = findRecord(block.id);
+		if(rec != NULL && rec->size == block.size && rec->crc == block.crc) continue; // unchanged
+		block.inTx = true;
+		needed += HEADER_SIZE + block.size;
+	}
+	if(needed == HEADER_SIZE) return RES_OK;
+
+	uint32_t seq = nextSeq_++;
+	if(tail_ + needed <= bankSize_) {
+		txAddr_ = activeBank_ * bankSize_ + tail_;
+		for(auto& block: blocks_) {
+			if(block.inTx) appendRecord(seq, block.id, 0, block.mem, 0, block.size, block.crc);
+		}
+	} else {
+		// Active bank is full - start the other one over with all blocks. Unchanged ones are copied from the backend,
+		// not from their memory, which may hold changes that were never meant to be stored.
+		txSnapshot_ = true;
+		txAddr_ = (1 - activeBank_) * bankSize_;
+		for(auto& block: blocks_) {
+			if(block.inTx) {
+				appendRecord(seq, block.id, 0, block.mem, 0, block.size, block.crc);
+			} else {
+				Record* rec = findRecord(block.id);
+				if(rec != NULL && rec->size == block.size) appendRecord(seq, rec->id, 0, NULL, rec->addr, rec->size, rec->crc);
+			}
+		}
+		if(txBuf_.size() + HEADER_SIZE > bankSize_) {
+			abortTransaction();
+			return RES_CONFIG_STORAGE_FULL;
+		}
+	}
+	appendRecord(seq, 0, RECORD_FLAG_COMMIT, NULL, 0, 0, 0xffff);
+
+	txWritten_ = 0;
+	txActive_ = true;
+	return RES_OK;
+}
+
+bool bb::ConfigStorage::writeTransaction(uint32_t budgetUS) {
+	uint32_t start = Runloop::runloop.micros();
+	while(txWritten_ < txBuf_.size()) {
+		backend_->write(txAddr_ + txWritten_, txBuf_[txWritten_]);
+		txWritten_++;
+		if(budgetUS != 0 && (txWritten_ & 0xf) == 0 && Runloop::runloop.micros() - start >= budgetUS) break;
+	}
+	return txWritten_ == txBuf_.size();
+}
+
+bb::Result bb::ConfigStorage::commitTransaction() {
+	uint32_t start = Runloop::runloop.micros();
+	Result res = backend_->commit();
+	lastCommitUS_ = Runloop::runloop.micros() - start;
+
+	if(res != RES_OK) {
+		// Without its commit record, the next boot ignores whatever of the transaction made it to the backend, and
+		// the next transaction overwrites it. The blocks just go into that one again.
+		abortTransaction();
+		return res;
+	}
+
+	if(txSnapshot_) {
+		activeBank_ = 1 - activeBank_;
+		records_.clear();
+	}
+	for(auto& r: txRecords_) {
+		Record* existing = findRecord(r.id);
+		if(existing != NULL) *existing = r;
+		else records_.push_back(r);
+	}
+	tail_ = txAddr_ + txBuf_.size() - activeBank_ * bankSize_;
+	for(auto& block: blocks_) block.inTx = false;
+	txActive_ = false;
+	commits_++;
+	return RES_OK;
+}
+
+void bb::ConfigStorage::abortTransaction() {
+	for(auto& block: blocks_) {
+		if(!block.inTx) continue;
+		block.inTx = false;
+		block.pending = true;
+	}
+	txBuf_.clear();
+	txRecords_.clear();
+	txActive_ = false;
+}
+#endif // !ARDUINO_ARCH_ESP32
+
 bb::Result bb::ConfigStorage::writeAll() {
 	if(!initialized_) return RES_SUBSYS_NOT_INITIALIZED;
 	for(auto& block: blocks_) {
@@ -157,11 +375,158 @@ bb::Result bb::ConfigStorage::writeAll() {
 
 bb::Result bb::ConfigStorage::commit() {
 #if !defined(ARDUINO_ARCH_ESP32)
-	EEPROM.commit();
+	if(!initialized_) return RES_SUBSYS_NOT_INITIALIZED;
+
+	// A transaction the write behind has in flight is committed first if it's complete, and otherwise redone as
+	// part of this one.
+	if(txActive_) {
+		if(txWritten_ == txBuf_.size()) {
+			Result res = commitTransaction();
+			if(res != RES_OK) return res;
+		} else {
+			abortTransaction();
+			if(writeBehindScheduled_) writeBehindAborted_ = true;
+		}
+	}
+
+	Result res = prepareTransaction();
+	if(res != RES_OK || !txActive_) return res;
+	writeTransaction(0);
+	return commitTransaction();
+#else
+	return RES_OK;
 #endif
+}
+
+bb::Result bb::ConfigStorage::markDirty(HANDLE handle) {
+	if(!initialized_) return RES_SUBSYS_NOT_INITIALIZED;
+	Block* block = findBlock(handle);
+	if(block == NULL) return RES_CONFIG_INVALID_HANDLE;
+	block->dirty = true;
+
+	// (Re)start the quiet period. A write behind that is already running stops and waits for it, too.
+	if(quietTimer_ != 0) Runloop::runloop.cancelTimedCallback(quietTimer_);
+	quietTimer_ = Runloop::runloop.scheduleTimedCallback(quietMS_, [this]() {
+		quietTimer_ = 0;
+		startWriteBehind();
+	});
+	if(writeBehindScheduled_) writeBehindAborted_ = true;
 	return RES_OK;
 }
 
+void bb::ConfigStorage::startWriteBehind() {
+	if(writeBehindScheduled_) {
+		// Still running from before the last markDirty() - start over with the current data.
+#if !defined(ARDUINO_ARCH_ESP32)
+		if(writeBehindAborted_) abortTransaction();
+#endif
+		writeBehindAborted_ = false;
+		return;
+	}
+	if(commitScheduled_) return; // the commit task restarts us
+	if(Runloop::runloop.addIdleTask("config write", chunkUS_, [this]() { return writeBehindChunk(); }, WRITE_BEHIND_MAX_WAIT_MILLIS) == RES_OK) {
+		writeBehindScheduled_ = true;
+	}
+}
+
+bool bb::ConfigStorage::hasDirtyBlocks() {
+	for(auto& block: blocks_) {
+		if(block.dirty || block.pending || block.inTx) return true;
+	}
+	return false;
+}
+
+bb::Result bb::ConfigStorage::flush() {
+	if(!initialized_) return RES_SUBSYS_NOT_INITIALIZED;
+	for(auto& block: blocks_) {
+		if(!block.dirty) continue;
+		Result res = writeBlock(block.handle);
+		if(res != RES_OK) return res;
+	}
+	return commit();
+}
+
+void bb::ConfigStorage::setWriteBehind(uint32_t quietMillis, uint32_t chunkMicros) {
+	quietMS_ = quietMillis;
+	chunkUS_ = chunkMicros;
+}
+
+size_t bb::ConfigStorage::bankFree() {
+#if !defined(ARDUINO_ARCH_ESP32)
+	return bankSize_ - tail_;
+#else
+	return 0;
+#endif
+}
+
+bool bb::ConfigStorage::writeBehindChunk() {
+	if(writeBehindAborted_) { // changed again, the quiet period timer starts us over
+#if !defined(ARDUINO_ARCH_ESP32)
+		abortTransaction();
+#endif
+		writeBehindAborted_ = false;
+		writeBehindScheduled_ = false;
+		return false;
+	}
+
+#if defined(ARDUINO_ARCH_ESP32)
+	// NVS writes a blob in one go.
+	for(auto& block: blocks_) {
+		if(block.dirty) {
+			writeBlock(block.handle);
+			return true;
+		}
+	}
+	writeBehindScheduled_ = false;
+	return false;
+#else
+	if(!txActive_) {
+		for(auto& block: blocks_) {
+			if(!block.dirty) continue;
+			block.dirty = false;
+			block.pending = true;
+		}
+		if(prepareTransaction() != RES_OK || !txActive_) {
+			writeBehindScheduled_ = false;
+			return false;
+		}
+		return true; // serializing was this cycle's chunk
+	}
+	if(!writeTransaction(chunkUS_)) return true;
+
+	// The backend commit can't be split. It only starts when a cycle has as much slack as the last one took.
+	writeBehindScheduled_ = false;
+	if(!commitScheduled_) {
+		uint32_t estimate = lastCommitUS_ != 0 ? lastCommitUS_ : DEFAULT_COMMIT_MICROS;
+		if(Runloop::runloop.addIdleTask("config commit", estimate, [this]() {
+			finishWriteBehind();
+			return false;
+		}, WRITE_BEHIND_MAX_WAIT_MILLIS) == RES_OK) {
+			commitScheduled_ = true;
+		}
+	}
+	return false;
+#endif
+}
+
+bb::Result bb::ConfigStorage::finishWriteBehind() {
+	commitScheduled_ = false;
+	Result res = RES_OK;
+#if !defined(ARDUINO_ARCH_ESP32)
+	if(txActive_ && txWritten_ == txBuf_.size()) res = commitTransaction();
+#endif
+	// Blocks marked while we were waiting for slack, after their quiet period already ran out
+	if(quietTimer_ == 0) {
+		for(auto& block: blocks_) {
+			if(block.dirty) {
+				startWriteBehind();
+				break;
+			}
+		}
+	}
+	return res;
+}
+
 bb::Result bb::ConfigStorage::factoryReset() {
 #if defined(ARDUINO_ARCH_ESP32)
 	esp_err_t err = nvs_flash_erase();
@@ -170,11 +535,37 @@ bb::Result bb::ConfigStorage::factoryReset() {
 		return RES_CONFIG_INVALID_HANDLE;
 	}
 #else
-	Serial.println("Factory reset not implemented for current architecture!");
+	if(!initialized_) return RES_SUBSYS_NOT_INITIALIZED;
+	// Invalidating the first record of both banks is enough to lose everything behind it.
+	abortTransaction();
+	for(size_t bank=0; bank<2; bank++) {
+		for(size_t i=0; i<HEADER_SIZE; i++) backend_->write(bank*bankSize_ + i, 0xff);
+	}
+	Result res = backend_->commit();
+	if(res != RES_OK) return res;
+	records_.clear();
+	activeBank_ = 0;
+	tail_ = 0;
 #endif
 	return RES_OK;
 }
 
 bb::ConfigStorage::ConfigStorage() {
 	initialized_ = false;
+#if !defined(ARDUINO_ARCH_ESP32)
+	backend_ = NULL;
+	bankSize_ = reservedSize_ = 0;
+	activeBank_ = 0;
+	tail_ = 0;
+	nextSeq_ = 1;
+	txAddr_ = txWritten_ = 0;
+	txActive_ = txSnapshot_ = false;
+#endif
+	quietMS_ = DEFAULT_QUIET_MILLIS;
+	chunkUS_ = DEFAULT_CHUNK_MICROS;
+	quietTimer_ = 0;
+	writeBehindScheduled_ = writeBehindAborted_ = commitScheduled_ = false;
+	lastCommitUS_ = 0;
+	scanUS_ = 0;
+	commits_ = 0;
 }
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "BBError.h"
+#include "BBStorageBackend.h"
 
 namespace bb {
 
@@ -18,6 +19,16 @@ namespace bb {
 	parameter flash at each software upload. For other architectures, like ESP32, that conveniently keep the parameter 
 	flash across software uploads, the class implements the factoryReset() method.
 
+	Except on ESP32, which uses NVS, blocks are kept in a journal on a StorageBackend. The backend is split into two
+	banks. Every commit() appends one record (header with sequence number and CRCs, followed by the data) per changed
+	block, and then a commit record that makes them valid all at once - a commit interrupted by power loss leaves the
+	previous state intact. When the active bank is full, all blocks are written to the other bank as one commit, so
+	writes wander over the whole backend instead of hitting the same bytes. initialize() only reads record headers.
+
+	Blocks that change often, e.g. while tuning parameters, should be marked with markDirty() rather than written
+	with writeBlock(). Dirty blocks are written behind, once nothing has been marked for a quiet period, by a runloop
+	idle task in chunks that stay within a time budget; an explicit flush() writes them right away.
+
 	This is a singleton class that can be accessed using the static bb::ConfigStorage::storage member.
 */
 class ConfigStorage {
@@ -26,27 +37,96 @@ public:
 
 	static ConfigStorage storage;
 
+	//! Must be called before initialize(). The default is the EEPROM (emulation) of the board.
+	void setBackend(StorageBackend* backend);
 	bool initialize();
 	HANDLE reserveBlock(const char* name, size_t size, uint8_t* mem);
+	//! Schedules the block for the next commit(). Its memory is read at commit time.
 	Result writeBlock(HANDLE);
+	//! Fails with RES_CONFIG_INVALID_HANDLE if the stored data doesn't match its CRC.
 	Result readBlock(HANDLE);
 	bool blockIsValid(HANDLE);
 	Result factoryReset();
 	Result writeAll();
+	//! Writes all blocks given to writeBlock() that changed since they were last stored, atomically.
 	Result commit();
 
+	static const uint32_t DEFAULT_QUIET_MILLIS = 2000;
+	static const uint32_t DEFAULT_CHUNK_MICROS = 500;
+
+	//! Schedules the block to be written behind. Marking it again restarts the quiet period.
+	Result markDirty(HANDLE handle);
+	bool hasDirtyBlocks();
+	//! Writes all dirty blocks and commits now.
+	Result flush();
+	//! Dirty blocks are written once nothing was marked for quietMillis, at most chunkMicros per runloop cycle.
+	//! The final commit can't be split - it only starts when a cycle has as much slack as the last commit took.
+	void setWriteBehind(uint32_t quietMillis, uint32_t chunkMicros);
+	unsigned int numCommits() { return commits_; }
+	uint32_t lastCommitMicros() { return lastCommitUS_; }
+	//! Time the last initialize() took to find the stored blocks.
+	uint32_t scanMicros() { return scanUS_; }
+	//! 0 or 1 - the bank the journal currently appends to.
+	unsigned int activeBank() { return activeBank_; }
+	//! Free bytes in the active bank.
+	size_t bankFree();
+
 protected:
 	ConfigStorage();
+	void startWriteBehind();
+	bool writeBehindChunk();
+	Result finishWriteBehind();
 
 	struct Block {
 		HANDLE handle;
+		uint32_t id;     // hash of the name
 		size_t size;
 		uint8_t *mem;
+		bool dirty;      // marked, waiting for the quiet period
+		bool pending;    // to go into the next transaction
+		bool inTx;       // part of the transaction being written
+		uint16_t crc;    // of mem when it went into the transaction
 	};
 	std::vector<Block> blocks_;
+	Block* findBlock(HANDLE handle);
 	bool initialized_;
-	HANDLE nextHandle_;
-	size_t maxSize_;
+
+#if !defined(ARDUINO_ARCH_ESP32)
+	struct Record {
+		uint32_t id;
+		size_t addr;     // of the data
+		size_t size;
+		uint16_t crc;
+	};
+
+	void scanBank(unsigned int bank, uint32_t& committedSeq, size_t& tail, std::vector<Record>& records, uint32_t& maxSeq);
+	Record* findRecord(uint32_t id);
+	//! Copies the data from mem, or from srcAddr in the backend if mem is NULL.
+	void appendRecord(uint32_t seq, uint32_t id, uint8_t flags, const uint8_t* mem, size_t srcAddr, size_t size, uint16_t crc);
+	Result prepareTransaction();
+	//! Returns true when all of the transaction is written. 0 means no time limit.
+	bool writeTransaction(uint32_t budgetUS);
+	Result commitTransaction();
+	void abortTransaction();
+
+	StorageBackend* backend_;
+	size_t bankSize_, reservedSize_;
+	unsigned int activeBank_;
+	size_t tail_;                     // where the next transaction goes in the active bank
+	uint32_t nextSeq_;
+	std::vector<Record> records_;     // what the stored blocks are, by id
+
+	std::vector<uint8_t> txBuf_;      // the transaction being written
+	std::vector<Record> txRecords_;
+	size_t txAddr_, txWritten_;
+	bool txActive_, txSnapshot_;
+#endif
+
+	uint32_t quietMS_, chunkUS_;
+	uint32_t quietTimer_;             // Runloop::TimedCallbackHandle, 0 if none
+	bool writeBehindScheduled_, writeBehindAborted_, commitScheduled_;
+	uint32_t lastCommitUS_, scanUS_;
+	unsigned int commits_;
 };
 
 };
@@ -1,6 +1,7 @@
 #include "BBConsole.h"
 #include "BBConfigStorage.h"
 #include "BBRunloop.h"
+#include "BBFastLoop.h"
 #include <cstdarg>
 #include <Wire.h>
 
@@ -28,7 +29,7 @@ int bb::printf(const char* format, ...) {
 	return retval;
 }
 
-bb::SerialConsoleStream::SerialConsoleStream(HWSERIAL_CLASS& ser): ser_(ser), opened_(false) {
+bb::SerialConsoleStream::SerialConsoleStream(HWSERIAL_CLASS& ser): QueuedConsoleStream(), ser_(ser), opened_(false) {
 	lastCheck_ = micros();
 	checkInterval_ = 1000000;
 	if(ser_) {
@@ -82,6 +83,11 @@ bool bb::SerialConsoleStream::readStringUntil(HWSERIAL_CLASS& ser, char c, Strin
 	return false;
 }
 
+void bb::SerialConsoleStream::echo(char c) {
+	if(c == '\b') ser_.write((const uint8_t*)"\b \b", 3);
+	else ser_.write((uint8_t)c);
+}
+
 #if 0
 bool bb::SerialConsoleStream::readStringUntil(unsigned char c, String& str) { 
 	if(!opened_) return false;
@@ -108,8 +114,163 @@ bool bb::SerialConsoleStream::readStringUntil(unsigned char c, String& str) {
 }
 #endif
 
-int bb::SerialConsoleStream::printfFinal(const char* buf) {
-	return ser_.print(buf);
+size_t bb::SerialConsoleStream::txSpace() {
+	if(!opened_) return 0;
+	int space = ser_.availableForWrite();
+	return space > 0 ? space : 0;
+}
+
+size_t bb::SerialConsoleStream::txWrite(const uint8_t* buf, size_t len) {
+	return ser_.write(buf, len);
+}
+
+bb::QueuedConsoleStream::QueuedConsoleStream(size_t queueSize) {
+	queue_ = new uint8_t[queueSize];
+	size_ = queueSize;
+	head_ = count_ = maxQueued_ = 0;
+	bytesPerCycle_ = cycleBudget_ = DEFAULT_BYTES_PER_CYCLE;
+	stalledCycles_ = 0;
+	droppedBytes_ = 0;
+	dropPolicy_ = DROP_OLDEST;
+	blocking_ = true;
+	lineLen_ = 0;
+	lineOverflow_ = false;
+}
+
+bb::QueuedConsoleStream::~QueuedConsoleStream() {
+	delete[] queue_;
+}
+
+int bb::QueuedConsoleStream::printfFinal(const char* str) {
+	size_t len = strlen(str);
+	const uint8_t* buf = (const uint8_t*)str;
+
+	if(blocking_) {
+		flushQueue(true);
+		while(len > 0) {
+			size_t n = txWrite(buf, len);
+			if(n == 0) break;
+			buf += n;
+			len -= n;
+		}
+		return strlen(str);
+	}
+
+	// Keep the order - only go straight to the transport if nothing is waiting.
+	flushQueue(false);
+	if(count_ == 0) {
+		size_t n = txSpace();
+		if(n > cycleBudget_) n = cycleBudget_;
+		if(n > len) n = len;
+		if(n > 0) {
+			n = txWrite(buf, n);
+			cycleBudget_ -= n;
+			buf += n;
+			len -= n;
+		}
+	}
+	enqueue(buf, len);
+	return strlen(str);
+}
+
+size_t bb::QueuedConsoleStream::writeSpace() {
+	if(blocking_ || stalled()) return SIZE_MAX;
+	return size_ - count_;
+}
+
+void bb::QueuedConsoleStream::drain() {
+	cycleBudget_ = bytesPerCycle_;
+	size_t before = count_;
+	flushQueue(false);
+	if(before == 0 || count_ != before) stalledCycles_ = 0;
+	else if(stalledCycles_ < STALL_CYCLES) stalledCycles_++;
+}
+
+void bb::QueuedConsoleStream::setBlocking(bool blocking) {
+	blocking_ = blocking;
+	if(blocking_) flushQueue(true);
+}
+
+void bb::QueuedConsoleStream::flushQueue(bool blocking) {
+	while(count_ > 0) {
+		size_t n = size_ - head_;                 // contiguous part
+		if(n > count_) n = count_;
+		if(!blocking) {
+			size_t space = txSpace();
+			if(space > cycleBudget_) space = cycleBudget_;
+			if(space == 0) return;
+			if(n > space) n = space;
+		}
+		size_t written = txWrite(queue_ + head_, n);
+		if(!blocking) cycleBudget_ -= written;
+		head_ = (head_ + written) % size_;
+		count_ -= written;
+		if(written < n) return;
+	}
+	head_ = 0;
+}
+
+void bb::QueuedConsoleStream::enqueue(const uint8_t* buf, size_t len) {
+	size_t free = size_ - count_;
+	if(len > free) {
+		if(dropPolicy_ == DROP_NEWEST) {
+			droppedBytes_ += len - free;
+			len = free;
+		} else {
+			if(len > size_) { // doesn't even fit on its own - keep its end
+				droppedBytes_ += count_ + len - size_;
+				buf += len - size_;
+				len = size_;
+				clearQueue();
+			} else {
+				size_t drop = len - free;
+				droppedBytes_ += drop;
+				head_ = (head_ + drop) % size_;
+				count_ -= drop;
+			}
+		}
+	}
+
+	size_t tail = (head_ + count_) % size_;
+	size_t n = size_ - tail;
+	if(n > len) n = len;
+	memcpy(queue_ + tail, buf, n);
+	memcpy(queue_, buf + n, len - n);
+	count_ += len;
+	if(count_ > maxQueued_) maxQueued_ = count_;
+}
+
+bool bb::QueuedConsoleStream::readLine(char c, char*& line) {
+	int input;
+	while((input = read()) >= 0) {
+		if(input == c) {
+			echo(c);
+			lineBuf_[lineLen_] = '\0';
+			bool overflow = lineOverflow_;
+			clearLine();
+			if(overflow) {
+				line = NULL;
+				return true;
+			}
+			line = lineBuf_;
+			while(isspace(*line)) line++;
+			char* end = line + strlen(line);
+			while(end > line && isspace(end[-1])) *--end = '\0';
+			return true;
+		}
+		if(input == '\b' || input == 0x7f) {
+			if(lineLen_ > 0) {
+				lineLen_--;
+				echo('\b');
+			}
+		} else if(lineLen_ < LINE_MAXLEN) {
+			lineBuf_[lineLen_++] = input;
+			echo(input);
+		} else {
+			lineOverflow_ = true;
+		}
+	}
+	return false;
 }
 
 bb::BroadcastStream bb::BroadcastStream::bc;
@@ -120,16 +281,58 @@ int bb::BroadcastStream::printfFinal(const char* str) {
 	return strlen(str);
 }
 
+size_t bb::BroadcastStream::writeSpace() {
+	size_t space = SIZE_MAX;
+	for(auto* s: Console::console.streams()) {
+		size_t n = s->writeSpace();
+		if(n < space) space = n;
+	}
+	return space;
+}
+
+
+static const char* helpLines[] = {
+	"The following commands are available on top level:\n",
+	"    help                    Print this help text (use '<subsys> help' for help on individual subsystem)\n", 
+	"    status                  Print status on all subsystems (use '<subsys> status' for help on individual subsystem)\n",
+	"    start                   Start all stopped subsystems (use '<subsys> start' to start individual subsystem)\n",
+	"    stop                    Stop all started subsystems (use '<subsys> stop' to stop individual subsystem)\n",
+	"    restart                 Restart (stop, then start) all started subsystems\n",
+	"    store                   Store all parameters oto flash\n",
+	"    scan_i2c                Scan the i2c bus and output all reporting addresses\n",
+	"    script begin            Record a command script, line by line, until \"end\"\n",
+	"    script run|abort        Run the script in the background, reporting every line, or stop it\n",
+	"    script list|clear|status\n",
+	"                            In scripts, \"wait <ms>\" and \"until <subsys> <condition>\" pause, a leading \"-\"\n",
+	"                            ignores failure (e.g. \"until servos idle\", \"until <subsys> started\")\n",
+	"The following standard commands are supported by all subsystems:\n",
+	"    <subsys> help\n",
+	"    <subsys> status\n",
+	"    <subsys> start\n",
+	"    <subsys> stop\n",
+	"    <subsys> restart\n",
+	"Please use '<subsys> help' for additional commands supported by individual subsystems.\n",
+	NULL
+};
 
 bb::Console::Console() {
 	name_ = "console";
 	description_ = "Console interaction facility";
 	help_ = "No help available";
 	firstResponder_ = this;
+	deferPrompt_ = false;
+	recordStream_ = NULL;
+	scriptBudget_ = 2000;
+	scriptTimeout_ = 10000;
+
+	addParameter("script_budget", "Time in us a running script may take per cycle", scriptBudget_);
+	addParameter("script_timeout", "Time in ms after which \"until\" in a script fails", scriptTimeout_);
 }
 
 bb::Result bb::Console::start(ConsoleStream *stream) {
 	if(stream) stream = stream; // make compiler happy
+	// From now on, printing must not hold up the runloop.
+	for(auto s: streams_) s->setBlocking(false);
 	started_ = true;
 	operationStatus_ = RES_OK;
 	return RES_OK;
@@ -145,8 +348,13 @@ bb::Result bb::Console::step() {
 	if(!started_) return RES_SUBSYS_NOT_STARTED;
 
 	for(size_t i=0; i<streams_.size(); i++) {
-		handleStreamInput(streams_[i]);
+		// Script uploads come in line after line - take more than one per cycle.
+		unsigned int lines = recordStream_ == streams_[i] ? MAX_RECORD_LINES_PER_CYCLE : 1;
+		while(lines-- > 0 && handleStreamInput(streams_[i]));
+		streams_[i]->drain();
 	}
+	script_.step(scriptBudget_, scriptTimeout_);
+	LogLimiter::flushAll();
 
 	return RES_OK;
 }
@@ -155,6 +363,7 @@ void bb::Console::addConsoleStream(ConsoleStream* stream) {
 	for(size_t i=0; i<streams_.size(); i++) {
 		if(streams_[i] == stream) return; // already have this
 	}
+	stream->setBlocking(!started_);
 	streams_.push_back(stream);
 }
 
@@ -162,153 +371,286 @@ void bb::Console::removeConsoleStream(ConsoleStream* stream) {
 	for(size_t i=0; i<streams_.size(); i++) {
 		if(streams_[i] == stream) {
 			streams_.erase(streams_.begin()+i);
+			if(recordStream_ == stream) recordStream_ = NULL;
+			if(script_.isRunning() && script_.reportStream() == stream) script_.abort();
 			return;
 		} 
 	}
 }
 
-void bb::Console::handleStreamInput(ConsoleStream* stream) {
-	if(stream->available() == 0) return;
+bool bb::Console::handleStreamInput(ConsoleStream* stream) {
+	if(stream->available() == 0) return false;
 
-	static String str;
-	if(stream->readStringUntil('\n', str) == false) return;
+	char* line;
+	if(stream->readLine('\n', line) == false) return false;
 
 	stream->printf("\r");
-	str.trim();
-	std::vector<String> words = split(str);
-	str = "";
-
-	if(words.size() == 0) {
+	if(line == NULL) {
+		stream->printf("Line too long: %s.\n", errorMessage(RES_CMD_INVALID_ARGUMENT));
+		stream->printf(stream == recordStream_ ? "script> " : "> ");
+		return true;
+	}
+	if(stream == recordStream_) {
+		recordScriptLine(line, stream);
+		return true;
+	}
+	if(line[0] == '\0') {
 		stream->printf("> ");
-		return;
+		return true;
 	}
+	Result res = executeLine(line, stream);
 
-	Result res = firstResponder_->handleConsoleCommand(words, stream);
 	if(res != RES_OK) {
 		stream->printf(errorMessage(res));
 		stream->printf(".\n> ");
-	} else stream->printf("\n> ");
+	} else if(!deferPrompt_) stream->printf("\n> ");
+	return true;
 }
 
-bb::Result bb::Console::handleConsoleCommand(const std::vector<String>& words, ConsoleStream* stream) {
+void bb::Console::recordScriptLine(const char* line, ConsoleStream* stream) {
+	if(!strcmp(line, "end")) {
+		recordStream_ = NULL;
+		stream->printf("%u lines recorded.\n> ", script_.numLines());
+		return;
+	}
 
-	if(words[0] == "help") {
-		bb::Runloop::runloop.excuseOverrun();
-		if(words.size() != 1) {
-			return RES_CMD_INVALID_ARGUMENT_COUNT;
-		}
+	Result res = script_.append(line);
+	if(res != RES_OK) stream->printf("%s.\n", errorMessage(res));
+	stream->printf("script> ");
+}
 
-		printHelpAllSubsystems(stream);
-		return RES_OK;
-	} 
+bb::Result bb::Console::handleCommandLine(const char* line, ConsoleStream* stream) {
+	if(strlen(line) > LINE_MAXLEN) return RES_CMD_INVALID_ARGUMENT;
+	strcpy(line_, line);
+	return executeLine(line_, stream);
+}
 
-	else if(words[0] == "status") {
-		bb::Runloop::runloop.excuseOverrun();
-		if(words.size() != 1) {
-			return RES_CMD_INVALID_ARGUMENT_COUNT;
-		}
+bb::Result bb::Console::executeLine(char* line, ConsoleStream* stream) {
+	ConsoleWord words[MAX_WORDS];
+	size_t num = tokenize(line, words, MAX_WORDS);
+	if(num == 0) return RES_OK;
+	if(num > MAX_WORDS) return RES_CMD_INVALID_ARGUMENT_COUNT;
 
-		printStatusAllSubsystems(stream);
-		return RES_OK;
-	} 
+	deferPrompt_ = false;
+	return firstResponder_->handleConsoleCommand(ConsoleWords(words, num), stream);
+}
 
-	else if(words[0] == "start") {
-		bb::Runloop::runloop.excuseOverrun();
-		if(words.size() != 1) {
-			return RES_CMD_INVALID_ARGUMENT_COUNT;
-		} 
+const bb::Subsystem::CommandDef bb::Console::COMMANDS[] = {
+	command("help",     0, 0, &Console::cmdHelpAll),
+	command("status",   0, 0, &Console::cmdStatusAll),
+	command("start",    0, 0, &Console::cmdStartAll),
+	command("stop",     0, 0, &Console::cmdStopAll),
+	command("store",    0, 0, &Console::cmdStore),
+	command("scan_i2c", 0, 0, &Console::cmdScanI2C),
+	command("script",   1, 1, &Console::cmdScript)
+};
+
+const bb::Subsystem::CommandDef bb::Console::SCRIPT_COMMANDS[] = {
+	command("begin",  0, 0, &Console::cmdScriptBegin),
+	command("run",    0, 0, &Console::cmdScriptRun),
+	command("abort",  0, 0, &Console::cmdScriptAbort),
+	command("list",   0, 0, &Console::cmdScriptList),
+	command("clear",  0, 0, &Console::cmdScriptClear),
+	command("status", 0, 0, &Console::cmdScriptStatus)
+};
+
+bb::Result bb::Console::handleConsoleCommand(const ConsoleWords& words, ConsoleStream* stream) {
+	if(words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
+
+	const CommandDef* cmd = findCommand(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]), words[0]);
+	if(cmd != NULL) return runCommand(*cmd, words, stream);
+
+	Subsystem *subsys = SubsystemManager::manager.subsystemWithName(words[0].c_str());
+	if(subsys == NULL) return RES_CMD_UNKNOWN_COMMAND;
+	if(subsys == this) return Subsystem::handleConsoleCommand(words.skip(), stream); // "console set ..." and the like
+	return subsys->handleConsoleCommand(words.skip(), stream);
+}
 
-		stream->printf("Starting all stopped subsystems\n");
-		for(auto& s: SubsystemManager::manager.subsystems()) {
-			if(!s->isStarted()) {
-				stream->printf("Starting %s... ", s->name());
-				stream->printf(errorMessage(s->start(stream)));
-				stream->printf("\n");
-			}
+// help and status produce too much output to push through a serial port within one cycle, so they print
+// line by line in the runloop's idle time, followed by the prompt.
+bb::Result bb::Console::cmdHelpAll(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	unsigned int line = 0;
+	bb::Runloop::runloop.addIdleTask("help", 1000, [stream, line]() mutable {
+		const char* text = helpLines[line] != NULL ? helpLines[line] : "\n> ";
+		if(stream->writeSpace() < strlen(text)) return true; // wait for the stream to catch up
+		stream->printf("%s", text);
+		return helpLines[line++] != NULL;
+	}, 100);
+	deferPrompt();
+	return RES_OK;
+}
+
+bb::Result bb::Console::cmdStatusAll(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	stream->printf("System status:\n");
+	size_t index = 0;
+	bb::Runloop::runloop.addIdleTask("status", 1000, [stream, index]() mutable {
+		if(stream->writeSpace() < ConsoleStream::PRINTF_MAXLEN) return true;
+		const std::vector<Subsystem*>& subsystems = SubsystemManager::manager.subsystems();
+		if(index < subsystems.size()) subsystems[index++]->printStatusLine(stream);
+		if(index < subsystems.size()) return true;
+		stream->printf("\n> ");
+		return false;
+	}, 100);
+	deferPrompt();
+	return RES_OK;
+}
+
+bb::Result bb::Console::cmdStartAll(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	bb::Runloop::runloop.excuseOverrun();
+	stream->printf("Starting all stopped subsystems\n");
+	for(auto& s: SubsystemManager::manager.subsystems()) {
+		if(!s->isStarted()) {
+			stream->printf("Starting %s... ", s->name());
+			stream->printf(errorMessage(s->start(stream)));
+			stream->printf("\n");
 		}
-		return RES_OK;
 	}
-		
-	else if(words[0] == "stop") {
-		bb::Runloop::runloop.excuseOverrun();
-		if(words.size() != 1) {
-			return RES_CMD_INVALID_ARGUMENT_COUNT;
-		}
+	return RES_OK;
+}
 
-		stream->printf("Stopping all running subsystems\n");
-		std::vector<Subsystem*> subsystems = SubsystemManager::manager.subsystems();
-		for(auto& s: SubsystemManager::manager.subsystems()) {
-			if(s->isStarted()) {
-				stream->printf("Stopping %s... ", s->name());
-				stream->printf(errorMessage(s->stop(stream)));
-				stream->printf("\n");
-			}
+bb::Result bb::Console::cmdStopAll(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	bb::Runloop::runloop.excuseOverrun();
+	stream->printf("Stopping all running subsystems\n");
+	for(auto& s: SubsystemManager::manager.subsystems()) {
+		if(s->isStarted()) {
+			stream->printf("Stopping %s... ", s->name());
+			stream->printf(errorMessage(s->stop(stream)));
+			stream->printf("\n");
 		}
-		return RES_OK;
 	}
+	return RES_OK;
+}
 
-	else if(words[0] == "store") {
-		ConfigStorage::storage.writeAll();
-		ConfigStorage::storage.commit();
-		return RES_OK;
-	} 
-
-	else if(words[0] == "scan_i2c") {
-		bb::Runloop::runloop.excuseOverrun();
-		for(uint8_t addr=0x8; addr<=0x77; addr++) {
-		Wire.beginTransmission(addr);
-		uint8_t result = Wire.endTransmission();
-		if(result == 0) stream->printf("Found device at 0x%x\n", addr);
+bb::Result bb::Console::cmdStore(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	(void)stream;
+	ConfigStorage::storage.writeAll();
+	ConfigStorage::storage.commit();
+	return RES_OK;
+}
+
+bb::Result bb::Console::cmdScanI2C(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	bb::Runloop::runloop.excuseOverrun();
+	for(uint8_t addr=0x8; addr<=0x77; addr++) {
+		uint8_t result;
+		{
+			I2CLock lock;
+			Wire.beginTransmission(addr);
+			result = Wire.endTransmission();
 		}
-		return RES_OK;
+		if(result == 0) stream->printf("Found device at 0x%x\n", addr);
 	}
+	return RES_OK;
+}
 
-	else {
-		Subsystem *subsys = SubsystemManager::manager.subsystemWithName(words[0]);
-		if(subsys == NULL) {
-			return RES_CMD_UNKNOWN_COMMAND;
-		} else {
-			std::vector<String> wordsminusone = words;
-			wordsminusone.erase(wordsminusone.begin());
-			return subsys->handleConsoleCommand(wordsminusone, stream);
+bb::Result bb::Console::cmdScript(const ConsoleWords& words, ConsoleStream* stream) {
+	const CommandDef* cmd = findCommand(SCRIPT_COMMANDS, sizeof(SCRIPT_COMMANDS)/sizeof(SCRIPT_COMMANDS[0]), words[1]);
+	if(cmd == NULL) return RES_CMD_UNKNOWN_COMMAND;
+	return runCommand(*cmd, words.skip(), stream);
+}
+
+bb::Result bb::Console::cmdScriptBegin(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	if(stream == NULL || script_.isRunning() || recordStream_ != NULL) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	script_.clear();
+	recordStream_ = stream;
+	stream->printf("Enter the script, one command per line, and \"end\" when done.\nscript> ");
+	deferPrompt();
+	return RES_OK;
+}
+
+bb::Result bb::Console::cmdScriptRun(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	Result res = script_.run(stream);
+	if(res == RES_OK) deferPrompt(); // printed with the summary
+	return res;
+}
+
+bb::Result bb::Console::cmdScriptAbort(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	(void)stream;
+	if(!script_.isRunning()) return RES_SUBSYS_NOT_STARTED;
+	script_.abort();
+	return RES_OK;
+}
+
+bb::Result bb::Console::cmdScriptList(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	size_t offset = 0;
+	unsigned int num = 0;
+	Result res = bb::Runloop::runloop.addIdleTask("script", 1000, [this, stream, offset, num]() mutable {
+		if(stream->writeSpace() < ConsoleStream::PRINTF_MAXLEN) return true;
+		const char* line = script_.nextLine(offset);
+		if(line == NULL) {
+			stream->printf("\n> ");
+			return false;
 		}
+		stream->printf("%3u %s\n", ++num, line);
+		return true;
+	}, 100);
+	if(res == RES_OK) deferPrompt();
+	return res;
+}
+
+bb::Result bb::Console::cmdScriptClear(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	(void)stream;
+	if(script_.isRunning()) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	script_.clear();
+	return RES_OK;
+}
+
+bb::Result bb::Console::cmdScriptStatus(const ConsoleWords& words, ConsoleStream* stream) {
+	(void)words;
+	script_.printStatus(stream);
+	return RES_OK;
+}
+
+bb::Result bb::Console::handleScriptPacket(const uint8_t* buf, size_t len) {
+	if(len == 0) return RES_PACKET_TOO_SHORT;
+
+	Result res;
+	switch(buf[0]) {
+	case 'C':
+		if(script_.isRunning()) res = RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+		else {
+			script_.clear();
+			res = RES_OK;
+		}
+		break;
+	case 'A':
+		res = script_.appendText((const char*)buf + 1, len - 1);
+		break;
+	case 'R':
+		res = script_.run(NULL);
+		break;
+	case 'X':
+		if(script_.isRunning()) script_.abort();
+		res = RES_OK;
+		break;
+	default:
+		res = RES_PACKET_INVALID_PACKET;
+		break;
 	}
 
-	return RES_CMD_UNKNOWN_COMMAND;
+	if(res != RES_OK) printfBroadcast("Script packet '%c': %s.\n", buf[0], errorMessage(res));
+	return res;
 }
 
-#define PRINTF_MAXLEN 254
 void bb::Console::printfBroadcast(const char* format, ...) {
-	char str[PRINTF_MAXLEN+1];
-
 	va_list args;
 	va_start(args, format);
-	int len = vsnprintf(NULL, 0, format, args)+1;
-	if(len > PRINTF_MAXLEN) len = PRINTF_MAXLEN;
-	memset(str, 0, len);
-	vsnprintf(str, len, format, args);
+	BroadcastStream::bc.vprintf(format, args);
 	va_end(args);
-	for(auto& s: streams_) {
-		s->printf(str);
-	}
 }
 
 void bb::Console::printHelpAllSubsystems(ConsoleStream* stream) {
-	stream->printf("The following commands are available on top level:\n");
-	stream->printf("    help                    Print this help text (use '<subsys> help' for help on individual subsystem)\n"); 
-	stream->printf("    status                  Print status on all subsystems (use '<subsys> status' for help on individual subsystem)\n");
-	stream->printf("    start                   Start all stopped subsystems (use '<subsys> start' to start individual subsystem)\n");
-	stream->printf("    stop                    Stop all started subsystems (use '<subsys> stop' to stop individual subsystem)\n");
-	stream->printf("    restart                 Restart (stop, then start) all started subsystems\n");
-	stream->printf("    store                   Store all parameters oto flash\n");
-	stream->printf("    scan_i2c                Scan the i2c bus and output all reporting addresses\n");
-	stream->printf("The following standard commands are supported by all subsystems:\n");
-	stream->printf("    <subsys> help\n");
-	stream->printf("    <subsys> status\n");
-	stream->printf("    <subsys> start\n");
-	stream->printf("    <subsys> stop\n");
-	stream->printf("    <subsys> restart\n");
-	stream->printf("Please use '<subsys> help' for additional commands supported by individual subsystems.\n");
+	for(unsigned int i=0; helpLines[i] != NULL; i++) stream->printf("%s", helpLines[i]);
 }
 
 void bb::Console::printStatusAllSubsystems(ConsoleStream* stream) {
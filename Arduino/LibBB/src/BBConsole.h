@@ -2,9 +2,11 @@
 #define BBCONSOLE_H
 
 #include "BBSubsystem.h"
+#include "BBConsoleScript.h"
 
 #include <vector>
 #include <cstdarg>
+#include <cstdint>
 
 
 namespace bb {
@@ -21,11 +23,25 @@ int printf(const char* format, ...);
 /*!
 	\brief Base class for console streams.
 
+	printf() formats into a buffer owned by the stream, in a single pass and without allocating. Output longer than
+	PRINTF_MAXLEN is truncated - print long constant text with printfFinal().
 */
 class ConsoleStream {
 public:
+	static const size_t PRINTF_MAXLEN = 254;
+	static const size_t LINE_MAXLEN = 255;
+
 	virtual bool available() = 0;
-	virtual bool readStringUntil(unsigned char c, String& str) = 0;
+
+	/*!
+		\brief Collects input up to c, as far as it has come in. Never waits, never allocates.
+
+		Returns true once c has come in. line then points to the line, NUL terminated and with leading and trailing
+		whitespace removed; it may be modified in place (e.g. tokenized) and is valid until the next call. A line
+		longer than LINE_MAXLEN is discarded up to c, and line is NULL. Streams that can't be read from never return
+		true - the ones that can keep the line in a buffer of their own (see QueuedConsoleStream).
+	*/
+	virtual bool readLine(char c, char*& line) { (void)c; (void)line; return false; }
 
 	int printf(const char* format, ...) {
 		int retval;
@@ -37,19 +53,28 @@ public:
 	}
 
 	int vprintf(const char* format, va_list args) {
-		int len = vsnprintf(NULL, 0, format, args) + 1;
-		char *buf = new char[len];
-		vsnprintf(buf, len, format, args);
-		printfFinal(buf);
-		free(buf);
-		return len;
+		int len = vsnprintf(printfBuf_, sizeof(printfBuf_), format, args);
+		if(len < 0) return len;
+		printfFinal(printfBuf_);
+		return len < int(sizeof(printfBuf_)) ? len : int(sizeof(printfBuf_)) - 1;
 	}
 
 	virtual int printfFinal(const char* str) = 0;
 
+	//! How many bytes can be printed right now without any of them being dropped. Producers of long output, like
+	//! idle tasks printing line by line, wait for this. Streams without a TX queue block instead of dropping.
+	virtual size_t writeSpace() { return SIZE_MAX; }
+	//! Writes out what's queued, as far as the transport takes it without blocking. Called by Console every cycle.
+	virtual void drain() {}
+	//! In blocking mode (the default until Console is started), output is written out completely right away.
+	virtual void setBlocking(bool blocking) { (void)blocking; }
+
 	void printGreeting() {
 		printfFinal("Console ready. Type \"help\" for instructions.\n> ");
 	}
+
+protected:
+	char printfBuf_[PRINTF_MAXLEN+1];
 };
 
 #if defined(ARDUINO_ARCH_ESP32)
@@ -58,12 +83,84 @@ public:
 #define HWSERIAL_CLASS HardwareSerial
 #endif
 
+/*!
+	\brief Console stream with a bounded TX queue, so that printing never blocks the runloop.
+
+	Output goes straight to the transport as far as it takes it without blocking, the rest is queued and written out
+	by drain(), at most bytesPerCycle per cycle. When the queue is full, either the oldest queued or the newest
+	output is dropped, and counted.
+
+	If the transport hasn't taken anything for STALL_CYCLES drains while output is waiting (e.g. a TCP client that
+	stopped reading), the stream counts as stalled: writeSpace() stops holding up producers, and their output goes
+	by the drop policy until the transport takes bytes again.
+
+	Input is read byte by byte from the transport into a line buffer of LINE_MAXLEN owned by the stream.
+*/
+class QueuedConsoleStream: public ConsoleStream {
+public:
+	enum DropPolicy {
+		DROP_OLDEST, //!< Make room by dropping what has waited longest (default) - the newest output is the most relevant.
+		DROP_NEWEST  //!< Drop what doesn't fit anymore.
+	};
+
+	static const size_t DEFAULT_QUEUE_SIZE = 512;
+	static const size_t DEFAULT_BYTES_PER_CYCLE = 256;
+	static const unsigned int STALL_CYCLES = 100;
+
+	QueuedConsoleStream(size_t queueSize = DEFAULT_QUEUE_SIZE);
+	virtual ~QueuedConsoleStream();
+
+	virtual int printfFinal(const char* str);
+	virtual size_t writeSpace();
+	virtual void drain();
+	virtual void setBlocking(bool blocking);
+
+	//! Next input byte, or -1 if there is none right now. Never waits.
+	virtual int read() = 0;
+	virtual bool readLine(char c, char*& line);
+
+	void setDropPolicy(DropPolicy policy) { dropPolicy_ = policy; }
+	DropPolicy dropPolicy() { return dropPolicy_; }
+	void setBytesPerCycle(size_t bytes) { bytesPerCycle_ = bytes; }
+	size_t queueSize() { return size_; }
+	size_t queued() { return count_; }
+	size_t maxQueued() { return maxQueued_; }
+	unsigned long droppedBytes() { return droppedBytes_; }
+	bool stalled() { return stalledCycles_ >= STALL_CYCLES; }
+	void resetCounters() { maxQueued_ = count_; droppedBytes_ = 0; }
+
+protected:
+	//! How many bytes the transport takes right now without blocking.
+	virtual size_t txSpace() = 0;
+	//! Returns the number of bytes written. Never called with more than txSpace(), except in blocking mode.
+	virtual size_t txWrite(const uint8_t* buf, size_t len) = 0;
+
+	void flushQueue(bool blocking);
+	void enqueue(const uint8_t* buf, size_t len);
+	void clearQueue() { head_ = count_ = 0; }
+	//! Called by readLine() for every byte it takes, and with '\b' for every byte backspace removes.
+	virtual void echo(char c) { (void)c; }
+	void clearLine() { lineLen_ = 0; lineOverflow_ = false; }
+
+	uint8_t* queue_;
+	size_t size_, head_, count_, maxQueued_;
+	size_t bytesPerCycle_, cycleBudget_;
+	unsigned int stalledCycles_;
+	unsigned long droppedBytes_;
+	DropPolicy dropPolicy_;
+	bool blocking_;
+
+	char lineBuf_[LINE_MAXLEN+1];
+	size_t lineLen_;
+	bool lineOverflow_;
+};
+
 /*!
 	\brief Console stream interacting with a serial port. 
 	
 	One of these is created by default on the Serial line.
 */
-class SerialConsoleStream: public ConsoleStream {
+class SerialConsoleStream: public QueuedConsoleStream {
 public:
 	SerialConsoleStream(HWSERIAL_CLASS& ser);
 
@@ -72,11 +169,16 @@ public:
 	unsigned long checkInterval() { return checkInterval_; }
 
 	virtual bool available();
+	virtual int read() { return opened_ ? ser_.read() : -1; }
+	//! Blocking line input with echo, for utilities that don't run a Console.
 	static bool readStringUntil(HWSERIAL_CLASS& ser, char c, String& str);
-	virtual bool readStringUntil(unsigned char c, String& str) { return readStringUntil(ser_, c, str); }
 
-	virtual int printfFinal(const char* str);
 protected:
+	//! Echoes right away, ahead of any queued output, like a terminal would.
+	virtual void echo(char c);
+	virtual size_t txSpace();
+	virtual size_t txWrite(const uint8_t* buf, size_t len);
+
 	HWSERIAL_CLASS& ser_;
 	bool opened_;
 	unsigned long checkInterval_, lastCheck_;
@@ -92,8 +194,9 @@ public:
 	static BroadcastStream bc;
 
 	virtual bool available() { return false; }
-	virtual bool readStringUntil(unsigned char c, String& str) { return false; }
 	virtual int printfFinal(const char* str);
+	//! The least of all streams, not counting stalled ones.
+	virtual size_t writeSpace();
 };
 
 /*!
@@ -109,11 +212,19 @@ public:
 	need to be prefixed with a subsystem name, and will then be forwarded to that subsystem's handleConsoleCommand()
 	method. The stream the command was entered on is passed to the command handler to be able to output
 
+	Console also runs command scripts (see ConsoleScript), recorded with "script begin" ... "end" on any console
+	stream or uploaded via UDP (see handleScriptPacket()), within script_budget microseconds per cycle.
 */
 class Console: public Subsystem {
 public:
 	static Console console;
 
+	static const size_t LINE_MAXLEN = ConsoleStream::LINE_MAXLEN;
+	static const size_t MAX_WORDS = 16;
+	//! While recording a script, that many lines per cycle are taken from the recording stream.
+	static const unsigned int MAX_RECORD_LINES_PER_CYCLE = 8;
+
+	//! Allocates a String per word - the console itself uses tokenize() (see BBConsoleWords.h).
 	static std::vector<String> split(const String& str);
 
 	//! Initialize, opening the Serial port using Serial.begin(bps)
@@ -137,20 +248,61 @@ public:
 	ConsoleStream* broadcastStream() { return &BroadcastStream::bc; }
 	const std::vector<ConsoleStream*>& streams() { return streams_; }
 
-	void handleStreamInput(ConsoleStream* stream);
-	Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream* stream);
+	//! Returns true if a complete line came in. Tokenizes it in the stream's own line buffer.
+	bool handleStreamInput(ConsoleStream* stream);
+	//! Tokenizes line into the console's line buffer and runs it through the first responder. Never allocates.
+	Result handleCommandLine(const char* line, ConsoleStream* stream);
+	Result handleConsoleCommand(const ConsoleWords& words, ConsoleStream* stream);
+
+	ConsoleScript& script() { return script_; }
+	/*!
+		\brief Script upload without a console connection, e.g. via UDP (see DroidGUI/RunScript.py).
+
+		buf[0] is the operation - 'C' to clear the script, 'A' to append the lines in the rest of buf, 'R' to run it
+		and 'X' to abort it. The report goes to all console streams.
+	*/
+	Result handleScriptPacket(const uint8_t* buf, size_t len);
 	
 	void printfBroadcast(const char* format, ...);
 	void printHelpAllSubsystems(ConsoleStream* stream);
 	void printStatusAllSubsystems(ConsoleStream* stream);
 
 	void setFirstResponder(Subsystem* subsys);
+	//! For commands that print their output later, e.g. from an idle task. The command prints "\n> " itself when done.
+	void deferPrompt() { deferPrompt_ = true; }
 
 protected:
 	Console();
+
+	Result cmdHelpAll(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdStatusAll(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdStartAll(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdStopAll(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdStore(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScanI2C(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScript(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScriptBegin(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScriptRun(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScriptAbort(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScriptList(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScriptClear(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdScriptStatus(const ConsoleWords& words, ConsoleStream* stream);
+	static const CommandDef COMMANDS[];
+	static const CommandDef SCRIPT_COMMANDS[];
+
+	void recordScriptLine(const char* line, ConsoleStream* stream);
+	//! Tokenizes line in place and runs it through the first responder.
+	Result executeLine(char* line, ConsoleStream* stream);
+
+	char line_[LINE_MAXLEN+1];
 	ConsoleStream *serialStream_;
 	std::vector<ConsoleStream*> streams_;
 	Subsystem* firstResponder_;
+	bool deferPrompt_; // set by commands whose output is still being printed in the runloop's idle time
+
+	ConsoleScript script_;
+	ConsoleStream* recordStream_; // lines from here go into the script until "end"
+	unsigned int scriptBudget_, scriptTimeout_;
 };
 
 };
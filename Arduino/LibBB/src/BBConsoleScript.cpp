@@ -0,0 +1,197 @@
+#include "BBConsoleScript.h"
+#include "BBConsole.h"
+#include "BBRunloop.h"
+
+static_assert(bb::ConsoleScript::LINE_MAXLEN == bb::Console::LINE_MAXLEN, "Script lines must fit the console's line buffer");
+
+bb::ConsoleScript::ConsoleScript() {
+	used_ = 0;
+	numLines_ = 0;
+	running_ = false;
+	stream_ = NULL;
+	pos_ = 0;
+	current_ = "";
+	lineNum_ = numRun_ = numFailed_ = 0;
+	commandMicros_ = 0;
+	startMS_ = 0;
+	numWords_ = 0;
+	mayFail_ = false;
+	wait_ = WAIT_NONE;
+	waitStartMS_ = waitMS_ = 0;
+	waitSubsys_ = NULL;
+}
+
+void bb::ConsoleScript::clear() {
+	used_ = 0;
+	numLines_ = 0;
+}
+
+bb::Result bb::ConsoleScript::append(const char* line) {
+	size_t len = strlen(line);
+	if(len > LINE_MAXLEN) return RES_CMD_INVALID_ARGUMENT;
+	if(len == 0 || line[0] == '#') return RES_OK;
+	if(used_ + len + 1 > BB_SCRIPT_SIZE) return RES_CMD_SCRIPT_FULL;
+
+	memcpy(buf_ + used_, line, len + 1);
+	used_ += len + 1;
+	numLines_++;
+	return RES_OK;
+}
+
+bb::Result bb::ConsoleScript::appendText(const char* text, size_t len) {
+	char line[LINE_MAXLEN+1];
+	const char* end = text + len;
+
+	while(text < end) {
+		const char* eol = (const char*)memchr(text, '\n', end - text);
+		if(eol == NULL) eol = end;
+
+		// Trim
+		const char* first = text;
+		const char* last = eol;
+		while(first < last && isspace(*first)) first++;
+		while(last > first && isspace(*(last-1))) last--;
+
+		if(size_t(last - first) > LINE_MAXLEN) return RES_CMD_INVALID_ARGUMENT;
+		memcpy(line, first, last - first);
+		line[last - first] = '\0';
+		Result res = append(line);
+		if(res != RES_OK) return res;
+
+		text = eol + 1;
+	}
+
+	return RES_OK;
+}
+
+const char* bb::ConsoleScript::nextLine(size_t& offset) {
+	if(offset >= used_) return NULL;
+	const char* line = buf_ + offset;
+	offset += strlen(line) + 1;
+	return line;
+}
+
+bb::Result bb::ConsoleScript::run(ConsoleStream* stream) {
+	if(running_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+
+	stream_ = stream != NULL ? stream : &BroadcastStream::bc;
+	pos_ = 0;
+	lineNum_ = numRun_ = numFailed_ = 0;
+	commandMicros_ = 0;
+	wait_ = WAIT_NONE;
+	startMS_ = Runloop::runloop.millis();
+	running_ = true;
+	return RES_OK;
+}
+
+void bb::ConsoleScript::abort() {
+	if(!running_) return;
+	running_ = false;
+	wait_ = WAIT_NONE;
+	stream_->printf("Script aborted at line %u.\n", lineNum_);
+}
+
+void bb::ConsoleScript::step(uint32_t budgetMicros, uint32_t timeoutMillis) {
+	if(!running_) return;
+
+	uint32_t start = Runloop::runloop.micros();
+	do {
+		if(wait_ != WAIT_NONE && !waitDone(timeoutMillis)) return;
+		if(!running_) return;
+		if(stream_->writeSpace() < ConsoleStream::PRINTF_MAXLEN) return; // let the report catch up
+
+		const char* line = nextLine(pos_);
+		if(line == NULL) {
+			finish();
+			return;
+		}
+		runLine(line);
+	} while(running_ && Runloop::runloop.micros() - start < budgetMicros);
+}
+
+void bb::ConsoleScript::runLine(const char* line) {
+	lineNum_++;
+	mayFail_ = line[0] == '-';
+	if(mayFail_) line++;
+	current_ = line;
+
+	strcpy(line_, line);
+	numWords_ = tokenize(line_, words_, MAX_WORDS);
+	if(numWords_ != 0 && (words_[0] == "wait" || words_[0] == "until")) {
+		Result res = startWait();
+		if(res != RES_OK) report(res, 0, "ms");
+		return; // reported by waitDone()
+	}
+
+	uint32_t start = Runloop::runloop.micros();
+	Result res = Console::console.handleCommandLine(line, stream_);
+	unsigned long duration = Runloop::runloop.micros() - start;
+	commandMicros_ += duration;
+	report(res, duration, "us");
+}
+
+bb::Result bb::ConsoleScript::startWait() {
+	if(numWords_ > MAX_WORDS) return RES_CMD_INVALID_ARGUMENT_COUNT;
+
+	if(words_[0] == "wait") {
+		if(numWords_ != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
+		long ms = words_[1].toInt();
+		if(ms < 0) return RES_CMD_INVALID_ARGUMENT;
+		waitMS_ = ms;
+		wait_ = WAIT_TIME;
+	} else {
+		if(numWords_ < 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
+		waitSubsys_ = SubsystemManager::manager.subsystemWithName(words_[1].c_str());
+		if(waitSubsys_ == NULL) return RES_SUBSYS_NO_SUCH_SUBSYS;
+		bool met;
+		Result res = waitSubsys_->checkCondition(ConsoleWords(words_ + 2, numWords_ - 2), met); // catch typos right away
+		if(res != RES_OK) return res;
+		wait_ = WAIT_CONDITION;
+	}
+
+	waitStartMS_ = Runloop::runloop.millis();
+	return RES_OK;
+}
+
+bool bb::ConsoleScript::waitDone(uint32_t timeoutMillis) {
+	uint32_t waited = Runloop::runloop.millis() - waitStartMS_;
+	Result res = RES_OK;
+
+	if(wait_ == WAIT_TIME) {
+		if(waited < waitMS_) return false;
+	} else {
+		bool met = false;
+		res = waitSubsys_->checkCondition(ConsoleWords(words_ + 2, numWords_ - 2), met);
+		if(res == RES_OK && !met) {
+			if(waited < timeoutMillis) return false;
+			res = RES_CMD_WAIT_TIMEOUT;
+		}
+	}
+
+	wait_ = WAIT_NONE;
+	report(res, waited, "ms");
+	return true;
+}
+
+void bb::ConsoleScript::report(Result res, unsigned long duration, const char* unit) {
+	numRun_++;
+	if(res != RES_OK) numFailed_++;
+	stream_->printf("%u %s: %s, %lu %s\n", lineNum_, current_, errorMessage(res), duration, unit);
+
+	if(res != RES_OK && !mayFail_) {
+		stream_->printf("Script stopped at line %u.\n> ", lineNum_);
+		running_ = false;
+	}
+}
+
+void bb::ConsoleScript::finish() {
+	stream_->printf("Script done: %u lines, %u failed, %lu us in commands, %lu ms total.\n> ", numRun_, numFailed_,
+	                commandMicros_, (unsigned long)(Runloop::runloop.millis() - startMS_));
+	running_ = false;
+}
+
+void bb::ConsoleScript::printStatus(ConsoleStream* stream) {
+	stream->printf("Script: %u lines, %u of %d bytes", numLines_, (unsigned)used_, BB_SCRIPT_SIZE);
+	if(running_) stream->printf(", running line %u%s\n", lineNum_, wait_ != WAIT_NONE ? " (waiting)" : "");
+	else stream->printf(", not running\n");
+}
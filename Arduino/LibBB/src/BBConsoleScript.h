@@ -0,0 +1,97 @@
+#if !defined(BBCONSOLESCRIPT_H)
+#define BBCONSOLESCRIPT_H
+
+#include <Arduino.h>
+#include "BBError.h"
+#include "BBConsoleWords.h"
+
+// Size of the script buffer in bytes, part of Console::console. Lines take their length plus 1.
+#if !defined(BB_SCRIPT_SIZE)
+#define BB_SCRIPT_SIZE 1024
+#endif
+
+namespace bb {
+
+class ConsoleStream;
+class Subsystem;
+
+/*!
+	\brief A batch of console commands that Console runs across runloop cycles.
+
+	Every line is a console command, as it would be typed, or one of
+	- "wait <ms>": pauses the script for that long
+	- "until <subsys> <condition> [<args>]": pauses until the subsystem reports the condition as met, e.g.
+	  "until servos idle" (see Subsystem::checkCondition()), or fails after Console's script_timeout.
+
+	The script stops at the first failing line, unless that line starts with "-". Empty lines and lines starting
+	with "#" are dropped when loading.
+
+	Every line is reported with its result and how long it took. Lines run back to back until the per-cycle budget
+	is used up - at least one per cycle - and only while the report stream can take the output.
+*/
+class ConsoleScript {
+public:
+	static const size_t LINE_MAXLEN = 255;
+	static const size_t MAX_WORDS = 16;
+
+	ConsoleScript();
+
+	void clear();
+	//! Returns RES_CMD_SCRIPT_FULL if the line doesn't fit, RES_CMD_INVALID_ARGUMENT if it's longer than LINE_MAXLEN.
+	Result append(const char* line);
+	//! Appends several lines, separated by '\n'. text needn't be NUL-terminated.
+	Result appendText(const char* text, size_t len);
+
+	//! Starts at the first line. The report goes to stream.
+	Result run(ConsoleStream* stream);
+	void abort();
+	//! Runs lines for up to budgetMicros. Called by Console every cycle.
+	void step(uint32_t budgetMicros, uint32_t timeoutMillis);
+
+	bool isRunning() { return running_; }
+	ConsoleStream* reportStream() { return stream_; }
+	unsigned int numLines() { return numLines_; }
+	size_t bytesUsed() { return used_; }
+	//! For going through the lines - start with offset 0. Returns NULL after the last line.
+	const char* nextLine(size_t& offset);
+
+	void printStatus(ConsoleStream* stream);
+
+protected:
+	enum WaitKind {
+		WAIT_NONE,
+		WAIT_TIME,
+		WAIT_CONDITION
+	};
+
+	void runLine(const char* line);
+	Result startWait();
+	bool waitDone(uint32_t timeoutMillis);
+	void report(Result res, unsigned long duration, const char* unit);
+	void finish();
+
+	char buf_[BB_SCRIPT_SIZE];    // the lines, each NUL-terminated
+	size_t used_;
+	unsigned int numLines_;
+
+	bool running_;
+	ConsoleStream* stream_;
+	size_t pos_;
+	const char* current_;
+	unsigned int lineNum_, numRun_, numFailed_;
+	unsigned long commandMicros_;
+	uint32_t startMS_;
+
+	// The line being run - directives keep their words here while waiting.
+	char line_[LINE_MAXLEN+1];
+	ConsoleWord words_[MAX_WORDS];
+	size_t numWords_;
+	bool mayFail_;
+	WaitKind wait_;
+	uint32_t waitStartMS_, waitMS_;
+	Subsystem* waitSubsys_;
+};
+
+};
+
+#endif // BBCONSOLESCRIPT_H
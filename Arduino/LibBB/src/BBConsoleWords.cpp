@@ -0,0 +1,43 @@
+#include "BBConsoleWords.h"
+
+static bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+size_t bb::tokenize(char* line, ConsoleWord* words, size_t maxWords) {
+	size_t num = 0;
+	const char* r = line; // reading ahead of...
+	char* w = line;       // ...writing, which drops the quotes and terminates words
+
+	while(true) {
+		while(isBlank(*r)) r++;
+		if(*r == '\0') break;
+
+		char* start = w;
+		bool quoted = false;
+		while(*r != '\0') {
+			if(*r == '"') {
+				quoted = !quoted;
+				r++;
+				continue;
+			}
+			if(!quoted && isBlank(*r)) break;
+			*w++ = *r++;
+		}
+
+		size_t len = w - start;
+		bool last = *r == '\0';
+		*w++ = '\0'; // may overwrite the blank r stands on, so step over it below
+		if(!last) r++;
+
+		if(len == 0) { // ""
+			w = start;
+		} else {
+			if(num < maxWords) words[num] = ConsoleWord(start, len);
+			num++;
+		}
+		if(last) break;
+	}
+
+	return num;
+}
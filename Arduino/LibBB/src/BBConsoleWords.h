@@ -0,0 +1,72 @@
+#if !defined(BBCONSOLEWORDS_H)
+#define BBCONSOLEWORDS_H
+
+#include <Arduino.h>
+
+namespace bb {
+
+/*!
+	\brief One word of a console command line.
+
+	Points into the line buffer it was tokenized from (see tokenize()), which has been NUL-terminated after the word,
+	so c_str() can be handed on as is. Valid for as long as the line buffer is - don't keep it beyond the command
+	handler. Converts to String for code that needs one, but that allocates.
+*/
+class ConsoleWord {
+public:
+	ConsoleWord(): str_(""), len_(0) {}
+	ConsoleWord(const char* str, size_t len): str_(str), len_(len) {}
+
+	const char* c_str() const { return str_; }
+	size_t length() const { return len_; }
+	char charAt(size_t i) const { return i < len_ ? str_[i] : '\0'; }
+	char operator[](size_t i) const { return charAt(i); }
+
+	bool operator==(const char* str) const { return strcmp(str_, str) == 0; }
+	bool operator!=(const char* str) const { return strcmp(str_, str) != 0; }
+
+	long toInt() const { return strtol(str_, NULL, 10); }
+	float toFloat() const { return strtof(str_, NULL); }
+
+	operator String() const { return String(str_); }
+
+protected:
+	const char* str_;
+	size_t len_;
+};
+
+/*!
+	\brief The words of a command line, as passed to Subsystem::handleConsoleCommand().
+
+	A view on an array of ConsoleWords that someone else owns; copying it copies two pointers' worth.
+*/
+class ConsoleWords {
+public:
+	ConsoleWords(): words_(NULL), size_(0) {}
+	ConsoleWords(const ConsoleWord* words, size_t size): words_(words), size_(size) {}
+
+	size_t size() const { return size_; }
+	const ConsoleWord& operator[](size_t i) const { return words_[i]; }
+	const ConsoleWord* begin() const { return words_; }
+	const ConsoleWord* end() const { return words_ + size_; }
+
+	//! All but the first n words - e.g. the command after the subsystem name.
+	ConsoleWords skip(size_t n = 1) const { return n < size_ ? ConsoleWords(words_ + n, size_ - n) : ConsoleWords(); }
+
+protected:
+	const ConsoleWord* words_;
+	size_t size_;
+};
+
+/*!
+	\brief Splits line into words, in place.
+
+	Words are separated by blanks; double quotes group blanks into a word (and are removed). Writes a NUL after
+	every word and fills in at most maxWords entries of words. Returns the number of words in the line, which can be
+	more than maxWords. Never allocates.
+*/
+size_t tokenize(char* line, ConsoleWord* words, size_t maxWords);
+
+};
+
+#endif // BBCONSOLEWORDS_H
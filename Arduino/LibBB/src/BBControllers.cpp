@@ -27,17 +27,13 @@ bb::PIDController::PIDController(ControlInput& input, ControlOutput& output):
 
 void bb::PIDController::reset() {
   lastErr_ = errI_ = lastErrD_ = lastControl_ = 0.0f;
-  lastCycleUS_ = micros();
+  lastCycleUS_ = Runloop::runloop.micros();
 }
 
 void bb::PIDController::update(void) {
-  unsigned long us = micros();
-  unsigned long timediffUS;
-  if (us < lastCycleUS_) {
-    timediffUS = (ULONG_MAX - lastCycleUS_) + us;
-  } else {
-    timediffUS = us - lastCycleUS_;
-  }
+  uint32_t us = Runloop::runloop.micros();
+  uint32_t timediffUS = us - lastCycleUS_;
+  if(timediffUS == 0) return; // can happen on a virtual clock - nothing to integrate or differentiate
   lastCycleUS_ = us;
 
   if(autoupdate_) input_.update();
@@ -86,7 +86,7 @@ protected:
   float deadbandMin_, deadbandMax_;
   float errDeadbandMin_, errDeadbandMax_;
   float goal_, ramp_, curSetpoint_;
-  unsigned long lastCycleUS_;
+  uint32_t lastCycleUS_;
   float controlOffset_;
   bb::LowPassFilter differentialFilter_;
 };
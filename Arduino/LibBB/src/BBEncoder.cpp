@@ -2,6 +2,7 @@
 
 #include <BBEncoder.h>
 #include <BBConsole.h>
+#include <BBRunloop.h>
 
 bb::Encoder::Encoder(uint8_t pin_enc_a, uint8_t pin_enc_b, InputMode mode, Unit unit): 
   enc_(pin_enc_a, pin_enc_b),
@@ -10,7 +11,7 @@ bb::Encoder::Encoder(uint8_t pin_enc_a, uint8_t pin_enc_b, InputMode mode, Unit
   mode_ = mode;
   unit_ = unit;
   mmPT_ = 1.0;
-  lastCycleUS_ = micros();
+  lastCycleUS_ = Runloop::runloop.micros();
   presentPos_ = enc_.read();
 }
 
@@ -28,13 +29,8 @@ bb::Result bb::Encoder::update() {
   presentPos_ = ticks;
   presentPosFiltered_ = filtPos_.filter(presentPos_);
 
-  unsigned long us = micros();
-  unsigned long dt;
-  if (us < lastCycleUS_) {
-    dt = (ULONG_MAX - lastCycleUS_) + us;
-  } else {
-    dt = us - lastCycleUS_;
-  }
+  uint32_t us = Runloop::runloop.micros();
+  uint32_t dt = us - lastCycleUS_;
   lastCycleUS_ = us;
 
   presentSpeed_ = ((double)lastCycleTicks_ / (double)dt)*1e6;
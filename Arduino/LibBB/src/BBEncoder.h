@@ -52,7 +52,7 @@ protected:
 
   float mmPT_;
   long lastCycleTicks_;
-  unsigned long lastCycleUS_;
+  uint32_t lastCycleUS_;
   long presentPos_;    // internally always in encoder ticks
   long presentPosFiltered_;
   float presentSpeed_; // internally always in encoder ticks per second
@@ -43,12 +43,22 @@ static const char* messages[] = {
 	"Voltage too low", // 31
 	"Voltage too high", // 32
 	"Current too high", // 33
-	"Wrong direction" // 34¨
+	"Wrong direction", // 34
+
+	"Packet handled internally", // 35
+
+	"Config write failed", // 36
+	"Config storage full", // 37
+
+	"Script full", // 38
+	"Timeout waiting for condition", // 39
+
+	"Packet incomplete" // 40
 };
 
 static const char* UnknownError = "Unknown Error";
 
-static size_t numMessages = 35;
+static size_t numMessages = 41;
 
 const char* bb::errorMessage(Result res) {
 	if((size_t)res >= numMessages) return UnknownError;
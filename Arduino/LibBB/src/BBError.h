@@ -59,7 +59,17 @@ typedef enum {
 	RES_DROID_VOLTAGE_TOO_LOW = 31,
 	RES_DROID_VOLTAGE_TOO_HIGH = 32,
 	RES_DROID_CURRENT_TOO_HIGH = 33,
-	RES_DROID_WRONG_DIRECTION = 34
+	RES_DROID_WRONG_DIRECTION = 34,
+
+	RES_PACKET_CONSUMED = 35,
+
+	RES_CONFIG_WRITE_FAILED = 36,
+	RES_CONFIG_STORAGE_FULL = 37,
+
+	RES_CMD_SCRIPT_FULL = 38,
+	RES_CMD_WAIT_TIMEOUT = 39,
+
+	RES_PACKET_INCOMPLETE = 40
 } Result;
 
 const char* errorMessage(Result res);
@@ -0,0 +1,244 @@
+#include "BBFastLoop.h"
+#include "BBRunloop.h"
+#include "BBConsole.h"
+
+bb::FastLoop bb::FastLoop::fastloop;
+
+#if defined(ARDUINO_ARCH_SAMD)
+// TC5 in match frequency mode, clocked from GCLK0 (48MHz) / 64 = 750kHz. Lowest interrupt priority, so that
+// UART and I2C interrupts can still preempt the fast loop.
+static const uint32_t FASTLOOP_TIMER_CLOCK = 48000000 / 64;
+
+static void tc5Sync() {
+	while(TC5->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+}
+
+void TC5_Handler() {
+	TC5->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+	bb::FastLoop::fastloop.tick();
+}
+#endif
+
+const bb::Subsystem::CommandDef bb::FastLoop::COMMANDS[] = {
+	command("rate",         0, 1, &FastLoop::cmdRate),
+	command("reset_timing", 0, 0, &FastLoop::cmdResetTiming)
+};
+
+bb::FastLoop::FastLoop() {
+	name_ = "fastloop";
+	description_ = "Timer driven fast control loop";
+	help_ = "Runs control tasks from a timer interrupt, independent of the main runloop.\r\n" \
+	"Available commands:\r\n" \
+	"\trate [<hz>]: Print or set the fast loop rate\r\n" \
+	"\treset_timing: Reset timing statistics\r\n";
+	setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
+
+	rate_ = DEFAULT_RATE;
+	lockDepth_ = 0;
+	pending_ = false;
+	haveLastTick_ = false;
+	lastTick_ = 0;
+	maxPeriodJitter_ = 0;
+	ticks_ = overruns_ = 0;
+	reportedOverruns_ = 0;
+}
+
+bb::Result bb::FastLoop::start(ConsoleStream* stream) {
+	(void)stream;
+	if(started_) return RES_SUBSYS_ALREADY_STARTED;
+#if !defined(ARDUINO_ARCH_SAMD) && !defined(ARDUINO_ARCH_NATIVE)
+	return RES_SUBSYS_HW_DEPENDENCY_MISSING;
+#else
+	haveLastTick_ = false;
+	started_ = true;
+	operationStatus_ = RES_OK;
+	startTimer();
+	return RES_OK;
+#endif
+}
+
+bb::Result bb::FastLoop::stop(ConsoleStream* stream) {
+	(void)stream;
+	if(!started_) return RES_SUBSYS_NOT_STARTED;
+	stopTimer();
+	started_ = false;
+	operationStatus_ = RES_SUBSYS_NOT_STARTED;
+	return RES_OK;
+}
+
+bb::Result bb::FastLoop::step() {
+	// Report overruns from here - can't print from the interrupt.
+	uint32_t overruns = overruns_;
+	if(overruns != reportedOverruns_) {
+		Console::console.printfBroadcast("Fast loop overran %lu times (%luus max for %luus period)\n",
+			(unsigned long)(overruns - reportedOverruns_), (unsigned long)loopTiming_.max(), periodMicros());
+		reportedOverruns_ = overruns;
+	}
+	return RES_OK;
+}
+
+bb::Result bb::FastLoop::setRateHz(unsigned int rate) {
+	if(rate == 0 || rate > MAX_RATE) return RES_COMMON_OUT_OF_RANGE;
+	rate_ = rate;
+	if(started_) {
+		stopTimer();
+		haveLastTick_ = false;
+		startTimer();
+	}
+	resetTimingStats();
+	return RES_OK;
+}
+
+bb::Result bb::FastLoop::addTask(const char* name, std::function<void(void)> fn) {
+	for(auto& t: tasks_) {
+		if(!strcmp(t.name, name)) return RES_COMMON_DUPLICATE_IN_LIST;
+	}
+	Task t;
+	t.name = name;
+	t.fn = fn;
+	CriticalSection cs;
+	tasks_.push_back(t);
+	return RES_OK;
+}
+
+void bb::FastLoop::tick() {
+	if(!started_) return; // host build - the periodic event may outlive stop()
+	if(lockDepth_ != 0) { // can only happen on the host build, the timer is masked on hardware
+		pending_ = true;
+		return;
+	}
+
+	uint32_t start = Runloop::runloop.micros();
+	if(haveLastTick_) {
+		uint32_t period = start - lastTick_;
+		periodTiming_.add(period);
+		uint32_t p = periodMicros();
+		uint32_t jitter = period > p ? period - p : p - period;
+		if(jitter > maxPeriodJitter_) maxPeriodJitter_ = jitter;
+	}
+	lastTick_ = start;
+	haveLastTick_ = true;
+
+	uint32_t taskStart = start;
+	for(auto& t: tasks_) {
+		t.fn();
+		uint32_t end = Runloop::runloop.micros();
+		t.timing.add(end - taskStart);
+		taskStart = end;
+	}
+
+	uint32_t busy = taskStart - start;
+	loopTiming_.add(busy);
+	if(busy > periodMicros()) {
+		loopTiming_.addOverrun();
+		overruns_ = overruns_ + 1;
+	}
+	ticks_ = ticks_ + 1;
+}
+
+void bb::FastLoop::lock() {
+#if defined(ARDUINO_ARCH_SAMD)
+	NVIC_DisableIRQ(TC5_IRQn);
+	__DSB();
+	__ISB();
+#endif
+	lockDepth_ = lockDepth_ + 1;
+}
+
+void bb::FastLoop::unlock() {
+	if(lockDepth_ == 0) return;
+	lockDepth_ = lockDepth_ - 1;
+#if defined(ARDUINO_ARCH_SAMD)
+	// A tick that became due meanwhile is still pending and runs right away.
+	if(lockDepth_ == 0) NVIC_EnableIRQ(TC5_IRQn);
+#else
+	// Same on the host build - run the tick that fell into the critical section now.
+	if(lockDepth_ == 0 && pending_) {
+		pending_ = false;
+		tick();
+	}
+#endif
+}
+
+void bb::FastLoop::startTimer() {
+#if defined(ARDUINO_ARCH_SAMD)
+	GCLK->CLKCTRL.reg = (uint16_t)(GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID(GCM_TC4_TC5));
+	while(GCLK->STATUS.bit.SYNCBUSY);
+
+	TC5->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+	tc5Sync();
+	while(TC5->COUNT16.CTRLA.bit.SWRST);
+
+	TC5->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV64;
+	tc5Sync();
+	TC5->COUNT16.CC[0].reg = (uint16_t)(FASTLOOP_TIMER_CLOCK / rate_ - 1);
+	tc5Sync();
+	TC5->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+
+	NVIC_ClearPendingIRQ(TC5_IRQn);
+	NVIC_SetPriority(TC5_IRQn, (1 << __NVIC_PRIO_BITS) - 1);
+	if(lockDepth_ == 0) NVIC_EnableIRQ(TC5_IRQn);
+
+	TC5->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+	tc5Sync();
+#endif
+}
+
+void bb::FastLoop::stopTimer() {
+#if defined(ARDUINO_ARCH_SAMD)
+	NVIC_DisableIRQ(TC5_IRQn);
+	TC5->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+	tc5Sync();
+#endif
+}
+
+void bb::FastLoop::resetTimingStats() {
+	CriticalSection cs;
+	for(auto& t: tasks_) t.timing.reset();
+	periodTiming_.reset();
+	loopTiming_.reset();
+	maxPeriodJitter_ = 0;
+}
+
+bb::Result bb::FastLoop::cmdRate(const ConsoleWords& words, ConsoleStream *stream) {
+	if(words.size() == 1) {
+		if(stream != NULL) stream->printf("%uHz\n", rate_);
+		return RES_OK;
+	}
+	return setRateHz(words[1].toInt());
+}
+
+bb::Result bb::FastLoop::cmdResetTiming(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	(void)stream;
+	resetTimingStats();
+	return RES_OK;
+}
+
+void bb::FastLoop::printExtendedStatus(ConsoleStream *stream) {
+	printStatusLine(stream);
+	if(stream == NULL) return;
+
+	// Take a consistent snapshot - the stats are written from the interrupt.
+	TimingStats period, loop;
+	uint32_t maxJitter, ticks, overruns;
+	std::vector<TimingStats> taskTiming;
+	taskTiming.reserve(tasks_.size());
+	{
+		CriticalSection cs;
+		period = periodTiming_;
+		loop = loopTiming_;
+		maxJitter = maxPeriodJitter_;
+		ticks = ticks_;
+		overruns = overruns_;
+		for(auto& t: tasks_) taskTiming.push_back(t.timing);
+	}
+
+	stream->printf("%uHz (%luus period), %lu cycles, %lu overruns\n", rate_, periodMicros(), (unsigned long)ticks, (unsigned long)overruns);
+	stream->printf("Period mean %luus, stddev %.1fus, max jitter %luus\n", (unsigned long)period.mean(), period.stddev(), (unsigned long)maxJitter);
+	stream->printf("Busy mean %luus, max %luus (%lu%% of period)\n", (unsigned long)loop.mean(), (unsigned long)loop.max(),
+		(unsigned long)(loop.mean() * 100 / periodMicros()));
+	for(size_t i=0; i<tasks_.size(); i++) {
+		stream->printf("\t%-12s mean %5luus max %5luus\n", tasks_[i].name, (unsigned long)taskTiming[i].mean(), (unsigned long)taskTiming[i].max());
+	}
+}
@@ -0,0 +1,141 @@
+#if !defined(BBFASTLOOP_H)
+#define BBFASTLOOP_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include "BBSubsystem.h"
+
+namespace bb {
+
+/*!
+	\brief Single-writer, single-reader buffer for handing data between the fast loop and the main runloop.
+
+	The writer fills the back buffer and then publishes it, so it never waits. The reader copies the front buffer and
+	retries if something was published while it was copying. Meant for a single core with one side running in an
+	interrupt; works in both directions.
+*/
+template<class T> class DoubleBuffer {
+public:
+	DoubleBuffer(): front_(0), generation_(0) {}
+	DoubleBuffer(const T& initial): front_(0), generation_(0) { buf_[0] = buf_[1] = initial; }
+
+	void write(const T& val) {
+		uint8_t back = front_ ^ 1;
+		buf_[back] = val;
+		std::atomic_signal_fence(std::memory_order_release);
+		front_ = back;
+		generation_ = generation_ + 1;
+	}
+
+	T read() const {
+		T val;
+		uint32_t gen;
+		do {
+			gen = generation_;
+			std::atomic_signal_fence(std::memory_order_acquire);
+			val = buf_[front_];
+			std::atomic_signal_fence(std::memory_order_acquire);
+		} while(gen != generation_);
+		return val;
+	}
+
+	//! Number of write()s so far - lets the reader see whether there is anything new.
+	uint32_t generation() const { return generation_; }
+
+protected:
+	T buf_[2];
+	volatile uint8_t front_;
+	volatile uint32_t generation_;
+};
+
+/*!
+	\brief Fast control tier, running from a periodic hardware timer interrupt, independent of the main runloop.
+
+	Tasks registered here run at a fixed rate regardless of what the subsystems in the main runloop are doing, so
+	a slow console command or WiFi step doesn't add jitter to control loops. Tasks run in interrupt context: they
+	must be short, must not print, allocate or use anything the main loop uses at the same time. Hand data back
+	and forth through DoubleBuffer, and wrap main loop code that has to touch the same hardware in a CriticalSection
+	(or an I2CLock for the I2C bus).
+
+	On SAMD, the tier runs on TC5 (which is then no longer available for tone()). On the host build there is no
+	timer; call tick() from a VirtualTimeSource periodic event instead. Other architectures are not supported yet.
+*/
+class FastLoop: public Subsystem {
+public:
+	static FastLoop fastloop;
+
+	static const unsigned int DEFAULT_RATE = 200;
+	static const unsigned int MAX_RATE = 2000;
+
+	virtual Result start(ConsoleStream* stream = NULL);
+	virtual Result stop(ConsoleStream* stream = NULL);
+	virtual Result step();
+	virtual void printExtendedStatus(ConsoleStream *stream = NULL);
+
+	//! Takes effect immediately if running.
+	Result setRateHz(unsigned int rate);
+	unsigned int rateHz() { return rate_; }
+	unsigned long periodMicros() { return 1000000UL / rate_; }
+
+	//! name must point to static storage. Tasks run in the order they were added.
+	Result addTask(const char* name, std::function<void(void)> fn);
+
+	//! Run one fast loop cycle. Called from the timer interrupt; only call yourself on the host build.
+	void tick();
+
+	//! Keeps the fast loop from running while in scope, e.g. while the main loop uses a bus the fast tasks also use.
+	//! Nests. Fast loop cycles that fall into the critical section are delayed until it ends, adding jitter - keep it short.
+	class CriticalSection {
+	public:
+		CriticalSection() { fastloop.lock(); }
+		~CriticalSection() { fastloop.unlock(); }
+	};
+
+	void resetTimingStats();
+	const TimingStats& periodTiming() { return periodTiming_; }
+	uint32_t maxPeriodJitter() { return maxPeriodJitter_; }
+	uint32_t overruns() { return overruns_; }
+
+protected:
+	FastLoop();
+	Result cmdRate(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdResetTiming(const ConsoleWords& words, ConsoleStream *stream);
+	static const CommandDef COMMANDS[];
+
+	void lock();
+	void unlock();
+	void startTimer();
+	void stopTimer();
+
+	struct Task {
+		const char* name;
+		std::function<void(void)> fn;
+		TimingStats timing;
+	};
+	std::vector<Task> tasks_;
+
+	unsigned int rate_;
+	volatile unsigned int lockDepth_;
+	bool pending_;
+	bool haveLastTick_;
+	uint32_t lastTick_;
+	TimingStats periodTiming_, loopTiming_;
+	uint32_t maxPeriodJitter_;
+	volatile uint32_t ticks_, overruns_;
+	uint32_t reportedOverruns_;
+};
+
+/*!
+	\brief Hold this around every use of Wire from the main loop.
+
+	The IMU is read over I2C from the fast loop, so no other transfer may run on the bus at the same time. Keep the
+	scope to single transfers, not to loops with delays in between. Don't take it from fast loop tasks themselves.
+*/
+class I2CLock: public FastLoop::CriticalSection {
+};
+
+};
+
+#endif // BBFASTLOOP_H
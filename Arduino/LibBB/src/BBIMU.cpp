@@ -1,3 +1,5 @@
+#if !defined(ARDUINO_ARCH_NATIVE) // hardware-only, not part of the host build
+
 #include "BBIMU.h"
 
 #include <LibBB.h>
@@ -51,10 +53,22 @@ bb::IMU::IMU(uint8_t addr) {
   intRunning_ = false;
   addr_ = addr;
   rot_ = ROTATE_0;
+  drdyPin_ = -1;
+  drdyUS_ = sampleUS_ = 0;
+  syncRunloop_ = false;
+}
+
+bb::IMU* bb::IMU::drdyIMU_ = NULL;
+
+void bb::IMU::dataReadyISR() {
+  if(drdyIMU_ == NULL) return;
+  drdyIMU_->drdyUS_ = Runloop::runloop.micros();
+  if(drdyIMU_->syncRunloop_) Runloop::runloop.triggerCycle();
 }
 
-bool bb::IMU::begin() {
+bool bb::IMU::begin(int drdyPin) {
   if(available_) return true;
+  I2CLock lock;
 
   // Check whether we exist
   int err;
@@ -93,6 +107,14 @@ bool bb::IMU::begin() {
   Runloop::runloop.setCycleTimeMicros(1000000/dataRate_);
   madgwick_.begin(dataRate_);
 
+  if(drdyPin >= 0) {
+    imu_.configInt1(false, true, false); // gyro data ready
+    drdyPin_ = drdyPin;
+    drdyIMU_ = this;
+    pinMode(drdyPin_, INPUT);
+    attachInterrupt(digitalPinToInterrupt(drdyPin_), dataReadyISR, RISING);
+  }
+
   available_ = true;
   return true;
 }
@@ -121,12 +143,25 @@ bool bb::IMU::update(bool block) {
   
   imu_.readGyroscope(lastP_, lastR_, lastH_);
   imu_.readAcceleration(lastX_, lastY_, lastZ_);
+  sampleUS_ = drdyPin_ >= 0 ? drdyUS_ : Runloop::runloop.micros();
 
   madgwick_.updateIMU(lastP_+calP_, lastR_+calR_, lastH_+calH_, lastX_, lastY_, lastZ_);
 
   return true;
 }
 
+bool bb::IMU::syncRunloop(bool yesno) {
+  if(yesno && drdyPin_ < 0) return false;
+  syncRunloop_ = yesno;
+  Runloop::runloop.setSyncMode(yesno ? Runloop::SYNC_EXTERNAL : Runloop::SYNC_TIMER);
+  sampleToActuation_.reset();
+  return true;
+}
+
+void bb::IMU::markActuation() {
+  sampleToActuation_.add(Runloop::runloop.micros() - sampleUS_);
+}
+
 bool bb::IMU::getFilteredPRH(float &p, float &r, float &h) {
   if(!available_) return false;
 
@@ -221,10 +256,12 @@ bool bb::IMU::calibrate(ConsoleStream *stream, int milliseconds, int step) {
 
   for(int ms = milliseconds; ms>0; ms -= step, count++) {
     float r, p, h, x, y, z;
-    if(imu_.gyroscopeAvailable()) imu_.readGyroscope(p, r, h);
-    if(imu_.accelerationAvailable()) imu_.readAcceleration(x, y, z);
-
-    temp_->getEvent(&t);
+    {
+      I2CLock lock;
+      if(imu_.gyroscopeAvailable()) imu_.readGyroscope(p, r, h);
+      if(imu_.accelerationAvailable()) imu_.readAcceleration(x, y, z);
+      temp_->getEvent(&t);
+    }
 
     avgTemp += t.temperature;
     avgP += p; avgR += r; avgH += h;
@@ -269,3 +306,5 @@ bb::IMUState bb::IMU::getIMUState() {
 
   return imuState;
 }
+
+#endif // !ARDUINO_ARCH_NATIVE
@@ -5,6 +5,7 @@
 #include "BBControllers.h"
 #include "BBLowPassFilter.h"
 #include "BBPacket.h"
+#include "BBTimingStats.h"
 
 #include <math.h>
 #include <Adafruit_ISM330DHCX.h>
@@ -42,7 +43,8 @@ class IMU {
 public:
   IMU(uint8_t addr);
 
-  bool begin();
+  //! If drdyPin is given, INT1 is configured as gyro data-ready and its rising edge timestamps every sample.
+  bool begin(int drdyPin = -1);
   bool available() { return available_; }
   bool calibrate(ConsoleStream *stream=NULL, int milliseconds = 2000, int step = 10);
 
@@ -51,6 +53,18 @@ public:
   bool getGravCorrectedAccel(float& ax, float& ay, float& az);
   float dataRate() { return dataRate_; }
 
+  //! Start every runloop cycle right after a fresh sample (Runloop::SYNC_EXTERNAL) instead of on the fixed
+  //! cycle time grid. Needs the data-ready pin; returns false if there is none.
+  bool syncRunloop(bool yesno);
+  bool runloopSynced() { return syncRunloop_; }
+
+  //! Call right after control output derived from the latest sample has been written, to track the time from
+  //! sample to actuation. Sample time is the data-ready edge if there is a data-ready pin, otherwise the read time
+  //! (which hides up to one sample period of latency).
+  void markActuation();
+  const TimingStats& sampleToActuation() { return sampleToActuation_; }
+  void resetSampleToActuation() { sampleToActuation_.reset(); }
+
   virtual bool update(bool block=false);
   bool getFilteredPRH(float& p, float& r, float& h);
 
@@ -80,6 +94,14 @@ private:
   int32_t intLastTS_;
   bool intRunning_ = false;
   uint8_t addr_;
+
+  static void dataReadyISR();
+  static IMU* drdyIMU_;
+  int drdyPin_;
+  volatile uint32_t drdyUS_;
+  uint32_t sampleUS_;
+  bool syncRunloop_;
+  TimingStats sampleToActuation_;
   
   RotationAroundZ rot_;
 };
@@ -1,3 +1,5 @@
+#if !defined(ARDUINO_ARCH_NATIVE) // hardware-only, not part of the host build
+
 #include "BBLinAlg.h"
 #include "LibBB.h"
 #include "BBConsole.h"
@@ -74,3 +76,5 @@ void bb::transformVector(float xIn, float yIn, float zIn, float pXf, float rXf,
 
     xOut = c(0); yOut = c(1); zOut = c(2);
 }
+
+#endif // !ARDUINO_ARCH_NATIVE
@@ -0,0 +1,62 @@
+#include "BBLinkQuality.h"
+#include "BBPacket.h"
+
+bb::LinkQuality::LinkQuality(float alpha, uint32_t timeoutMS) {
+	alpha_ = alpha;
+	timeoutMS_ = timeoutMS;
+	reset();
+}
+
+void bb::LinkQuality::reset() {
+	ratio_ = 1.0f;
+	rssi_ = 0;
+	lastSeqnum_ = 0;
+	lastMS_ = 0;
+	samples_ = 0;
+	received_ = lost_ = 0;
+}
+
+void bb::LinkQuality::packetReceived(uint8_t seqnum, uint8_t rssi, uint32_t ms) {
+	seqnum %= MAX_SEQUENCE_NUMBER;
+
+	// After a timeout, the gap since the last packet may have wrapped the sequence numbers any number of times -
+	// only pick them up again.
+	if(samples_ != 0 && ms - lastMS_ <= timeoutMS_) {
+		uint8_t gap = (seqnum + MAX_SEQUENCE_NUMBER - lastSeqnum_) % MAX_SEQUENCE_NUMBER;
+		if(gap == 0) return; // duplicate
+		for(uint8_t i=1; i<gap; i++) addSample(0.0f);
+		lost_ += gap - 1;
+	}
+
+	addSample(1.0f);
+	received_++;
+	float alpha = 1.0f/received_ > alpha_ ? 1.0f/received_ : alpha_;
+	rssi_ += alpha * (float(rssi) - rssi_);
+	lastSeqnum_ = seqnum;
+	lastMS_ = ms;
+}
+
+void bb::LinkQuality::addSample(float delivered) {
+	samples_++;
+	// The plain mean until there are enough samples - else the first ones would only pull the start value a bit.
+	float alpha = 1.0f/samples_ > alpha_ ? 1.0f/samples_ : alpha_;
+	ratio_ += alpha * (delivered - ratio_);
+}
+
+bool bb::LinkQuality::hasEstimate(uint32_t ms) const {
+	return samples_ >= SETTLE_PACKETS && ms - lastMS_ <= timeoutMS_;
+}
+
+uint8_t bb::LinkQuality::repeatsFor(float targetLoss, uint8_t maxRepeats, uint8_t fallback, uint32_t ms) const {
+	if(!hasEstimate(ms)) return fallback < maxRepeats ? fallback : maxRepeats;
+
+	float loss = 1.0f - ratio_;
+	float allLost = loss;
+	uint8_t repeats = 0;
+	while(allLost > targetLoss && repeats < maxRepeats) {
+		allLost *= loss;
+		repeats++;
+	}
+	if(rssi_ > WEAK_RSSI && repeats < maxRepeats) repeats++;
+	return repeats;
+}
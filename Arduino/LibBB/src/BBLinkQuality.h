@@ -0,0 +1,64 @@
+#if !defined(BBLINKQUALITY_H)
+#define BBLINKQUALITY_H
+
+#include <stdint.h>
+
+namespace bb {
+
+/*!
+	\brief Estimates how well packets from one station get through, from their sequence numbers and RSSI.
+
+	Feed it every packet received from the station. Gaps in the 3 bit sequence numbers count as lost packets, which
+	only works for stations that send every packet once - e.g. the droid's state packets, at 25Hz. The delivery ratio
+	and the RSSI are exponentially weighted averages, so the estimate follows a changing link within a few dozen
+	packets; until there are enough packets for that, they are plain means. Before the first SETTLE_PACKETS have come
+	in, and after timeoutMS without packets, there is no estimate.
+
+	The default timeout is 25 packets at 25Hz - even at 50% loss, a run of that many lost packets is very unlikely.
+	After a timeout the sequence numbers can't tell how many packets were lost, so they are picked up afresh, but
+	the estimate is kept and is back as soon as the next packet comes in.
+
+	Assumes the link is about as good in the other direction, which lets repeatsFor() pick the send repeats for
+	packets going to the station.
+*/
+class LinkQuality {
+public:
+	static const unsigned int SETTLE_PACKETS = 16;
+	//! Average RSSI (in -dBm, as the XBee reports it) above which the signal counts as weak, and repeatsFor() adds one.
+	static const uint8_t WEAK_RSSI = 85;
+
+	LinkQuality(float alpha = 1.0f/32, uint32_t timeoutMS = 1000);
+	void reset();
+
+	void packetReceived(uint8_t seqnum, uint8_t rssi, uint32_t ms);
+
+	bool hasEstimate(uint32_t ms) const;
+	//! Fraction of packets that get through, 0..1.
+	float deliveryRatio() const { return ratio_; }
+	float rssi() const { return rssi_; }
+	unsigned long packetsReceived() const { return received_; }
+	unsigned long packetsLost() const { return lost_; }
+
+	/*!
+		\brief Fewest repeats that bring the chance of losing every copy of a packet down to targetLoss.
+
+		With a loss ratio of l, all of r+1 copies get lost with a chance of l^(r+1). One more if the signal is weak.
+		Returns fallback if there's no estimate, and never more than maxRepeats.
+	*/
+	uint8_t repeatsFor(float targetLoss, uint8_t maxRepeats, uint8_t fallback, uint32_t ms) const;
+
+protected:
+	void addSample(float delivered);
+
+	float alpha_;
+	uint32_t timeoutMS_;
+	float ratio_, rssi_;
+	uint8_t lastSeqnum_;
+	uint32_t lastMS_;
+	unsigned int samples_;
+	unsigned long received_, lost_;
+};
+
+};
+
+#endif // BBLINKQUALITY_H
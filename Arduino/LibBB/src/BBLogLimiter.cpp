@@ -0,0 +1,53 @@
+#include "BBLogLimiter.h"
+#include "BBLogRecord.h"
+#include "BBConsole.h"
+#include "BBRunloop.h"
+
+bb::LogLimiter* bb::LogLimiter::first_ = NULL;
+
+// LogDecoder.py knows this one, too.
+#define REPEATED_FMT "... repeated %lu times\n"
+
+bool bb::LogLimiter::admit(const char* source, unsigned int level) {
+	if(!registered_) {
+		next_ = first_;
+		first_ = this;
+		registered_ = true;
+	}
+
+	uint32_t now = Runloop::runloop.millis();
+	source_ = source;
+	level_ = level;
+	if(printed_ && now - lastMS_ < intervalMS_) {
+		suppressed_++;
+		return false;
+	}
+
+	flush();
+	printed_ = true;
+	lastMS_ = now;
+	return true;
+}
+
+void bb::LogLimiter::flush() {
+	if(suppressed_ == 0) return;
+	if(source_ == NULL) {
+		bb::printf(REPEATED_FMT, (unsigned long)suppressed_);
+	} else if(binaryLogging) {
+		logBinary(level_, logHash(REPEATED_FMT), source_, (unsigned long)suppressed_);
+	} else {
+		bb::printf("%s(%d):" REPEATED_FMT, source_, level_, (unsigned long)suppressed_);
+	}
+	suppressed_ = 0;
+}
+
+void bb::LogLimiter::flushAll() {
+	uint32_t now = Runloop::runloop.millis();
+	for(LogLimiter* l = first_; l != NULL; l = l->next_) {
+		if(l->suppressed_ != 0 && now - l->lastMS_ >= l->intervalMS_) {
+			l->flush();
+			// Nothing got through in this interval - the next message should go out right away.
+			l->printed_ = false;
+		}
+	}
+}
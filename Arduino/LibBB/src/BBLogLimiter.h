@@ -0,0 +1,53 @@
+#if !defined(BBLOGLIMITER_H)
+#define BBLOGLIMITER_H
+
+#include <stdint.h>
+
+namespace bb {
+
+/*!
+	\brief Rate limit for a single log call site.
+
+	Used through LOG_LIMITED() and PRINTF_LIMITED(), which keep one of these as a static at the call site - no
+	allocation, ever. The first message goes out, repeats within the interval are only counted. The count is printed
+	as "... repeated N times" before the next message that gets through, or by flushAll() (called from
+	Console::step()) once the interval has passed, so a message that stops repeating doesn't leave its count behind.
+*/
+class LogLimiter {
+public:
+	LogLimiter(uint32_t intervalMS): intervalMS_(intervalMS), lastMS_(0), suppressed_(0), source_(0), level_(0),
+	                                 printed_(false), registered_(false), next_(0) {}
+
+	//! Returns true if the message should go out now. source is the subsystem name (or NULL), level its log level.
+	bool admit(const char* source, unsigned int level);
+	uint32_t suppressed() const { return suppressed_; }
+
+	//! Prints pending repeat counts of all call sites whose interval has passed.
+	static void flushAll();
+
+protected:
+	void flush();
+
+	uint32_t intervalMS_, lastMS_, suppressed_;
+	const char* source_;
+	unsigned int level_;
+	bool printed_, registered_;
+	LogLimiter* next_;
+	static LogLimiter* first_;
+};
+
+};
+
+//! LOG(), but at most once per intervalMS per call site, with repeats collapsed into a count. For use in Subsystems.
+#define LOG_LIMITED(level, intervalMS, fmt, args...) if(int(level)>=BB_LOG_MIN_LEVEL && level>=loglevel_) { \
+		static bb::LogLimiter limiter__(intervalMS); \
+		if(limiter__.admit(name_, level)) { LOG(level, fmt, ##args); } \
+	}
+
+//! bb::printf(), but at most once per intervalMS per call site, with repeats collapsed into a count.
+#define PRINTF_LIMITED(intervalMS, fmt, args...) { \
+		static bb::LogLimiter limiter__(intervalMS); \
+		if(limiter__.admit(NULL, 0)) { bb::printf(fmt, ##args); } \
+	}
+
+#endif // BBLOGLIMITER_H
@@ -0,0 +1,129 @@
+#if !defined(BBLOGRECORD_H)
+#define BBLOGRECORD_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+// Log levels below this are compiled out of LOG() / LOGS() altogether, e.g. -DBB_LOG_MIN_LEVEL=2 removes debug output.
+#if !defined(BB_LOG_MIN_LEVEL)
+#define BB_LOG_MIN_LEVEL 0
+#endif
+
+namespace bb {
+
+/*
+ * Binary log records, as written by LOG() while BinaryLog is started (see BBBinaryLog.h).
+ *
+ * Instead of the formatted text, a record holds a hash of the format string and the raw arguments. The format
+ * strings never leave the build: DroidGUI/LogDecoder.py collects them from the sources into an ID table and
+ * rebuilds the messages from that. Little endian throughout.
+ */
+
+//! FNV-1a. Evaluated by the compiler for the format strings in LOG(); the decoder uses the same function.
+static constexpr uint32_t logHash(const char* str, uint32_t hash = 2166136261UL) {
+	return *str == '\0' ? hash : logHash(str+1, (hash ^ uint8_t(*str)) * 16777619UL);
+}
+
+struct __attribute__((packed)) LogRecordHeader {
+	uint8_t length;      // of the whole record, including this header
+	uint8_t level;
+	uint16_t source;     // lower 16 bits of logHash() of the subsystem name
+	uint32_t id;         // logHash() of the format string
+	uint32_t us;         // Runloop::runloop.micros()
+};
+
+//! Every argument starts with one of these.
+enum LogArgTag {
+	LOGARG_INT    = 0, // zigzag varint
+	LOGARG_UINT   = 1, // varint
+	LOGARG_FLOAT  = 2, // 4 bytes
+	LOGARG_STRING = 3, // length byte, then that many chars
+	LOGARG_CUT    = 4  // the record was full, remaining arguments are missing
+};
+
+static const size_t MAX_LOG_RECORD = 64;
+
+//! Set while BinaryLog is started.
+extern bool binaryLogging;
+
+//! Timestamps the record in buf (header plus len - sizeof(LogRecordHeader) bytes of arguments) and stores it.
+void storeLogRecord(uint8_t* buf, size_t len, uint8_t level, uint32_t id, const char* source);
+
+// Argument encoders. Each writes at most what fits into MAX_LOG_RECORD and returns false when it didn't fit.
+
+static inline bool logPutVarint(uint8_t* buf, size_t& len, uint64_t val) {
+	do {
+		if(len >= MAX_LOG_RECORD) return false;
+		uint8_t b = val & 0x7f;
+		val >>= 7;
+		buf[len++] = val != 0 ? (b | 0x80) : b;
+	} while(val != 0);
+	return true;
+}
+
+static inline bool logPutTag(uint8_t* buf, size_t& len, LogArgTag tag) {
+	if(len >= MAX_LOG_RECORD) return false;
+	buf[len++] = tag;
+	return true;
+}
+
+template<typename T> typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, bool>::type
+logPutArg(uint8_t* buf, size_t& len, T val) {
+	int64_t v = val;
+	return logPutTag(buf, len, LOGARG_INT) && logPutVarint(buf, len, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+template<typename T> typename std::enable_if<(std::is_integral<T>::value && !std::is_signed<T>::value) || std::is_enum<T>::value, bool>::type
+logPutArg(uint8_t* buf, size_t& len, T val) {
+	return logPutTag(buf, len, LOGARG_UINT) && logPutVarint(buf, len, uint64_t(val));
+}
+
+template<typename T> typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+logPutArg(uint8_t* buf, size_t& len, T val) {
+	if(len + 1 + sizeof(float) > MAX_LOG_RECORD) return false;
+	float f = val;
+	buf[len++] = LOGARG_FLOAT;
+	memcpy(buf + len, &f, sizeof(f));
+	len += sizeof(f);
+	return true;
+}
+
+static inline bool logPutArg(uint8_t* buf, size_t& len, const char* str) {
+	if(len + 2 > MAX_LOG_RECORD) return false;
+	if(str == NULL) str = "(null)";
+	size_t n = strnlen(str, MAX_LOG_RECORD - len - 2);
+	buf[len++] = LOGARG_STRING;
+	buf[len++] = n;
+	memcpy(buf + len, str, n);
+	len += n;
+	return true;
+}
+
+static inline bool logPutArg(uint8_t* buf, size_t& len, char* str) { return logPutArg(buf, len, (const char*)str); }
+
+template<typename T> bool logPutArg(uint8_t* buf, size_t& len, const T* ptr) {
+	return logPutTag(buf, len, LOGARG_UINT) && logPutVarint(buf, len, uintptr_t(ptr));
+}
+
+static inline void logPutArgs(uint8_t* buf, size_t& len) { (void)buf; (void)len; }
+
+template<typename T, typename... Rest> void logPutArgs(uint8_t* buf, size_t& len, T first, Rest... rest) {
+	size_t before = len;
+	if(!logPutArg(buf, len, first)) {
+		len = before;
+		if(len < MAX_LOG_RECORD) buf[len++] = LOGARG_CUT;
+		return;
+	}
+	logPutArgs(buf, len, rest...);
+}
+
+template<typename... Args> void logBinary(uint8_t level, uint32_t id, const char* source, Args... args) {
+	uint8_t buf[MAX_LOG_RECORD];
+	size_t len = sizeof(LogRecordHeader);
+	logPutArgs(buf, len, args...);
+	storeLogRecord(buf, len, level, id, source);
+}
+
+};
+
+#endif // BBLOGRECORD_H
@@ -1,4 +1,5 @@
 #include <BBLowPassFilter.h>
+#include <BBRunloop.h>
 #include <Arduino.h>
 
 bb::LowPassFilter::LowPassFilter(float cutoff, float sampleFreq, bool adaptive) {
@@ -9,7 +10,8 @@ bb::LowPassFilter::LowPassFilter(float cutoff, float sampleFreq, bool adaptive)
     needsRecalc_ = true;
 
     dt_ = 1.0/sampleFreq_;
-    tn1_ = -dt_;
+    lastUS_ = 0;
+    haveLastUS_ = false;
     for(int k = 0; k < 3; k++){
         x_[k] = 0;
         y_[k] = 0;        
@@ -25,7 +27,7 @@ void bb::LowPassFilter::setCutoff(float cutoff) {
 void bb::LowPassFilter::setSampleFrequency(float sampleFreq) {
 	sampleFreq_ = sampleFreq;
     dt_ = 1.0/sampleFreq_;
-    tn1_ = -dt_;
+    haveLastUS_ = false;
 	needsRecalc_ = true;
 }
 
@@ -39,9 +41,12 @@ void bb::LowPassFilter::computeCoefficients() {
 	omega0_ = 6.28318530718*cutoff_;
 
 	if(adapt_){
-        float t = micros()/1.0e6;
-        dt_ = t - tn1_;
-        tn1_ = t;
+        // Integer difference - a float timestamp loses too much precision after a few minutes of uptime.
+        // The first sample uses the nominal sample frequency.
+        uint32_t us = Runloop::runloop.micros();
+        if(haveLastUS_) dt_ = (us - lastUS_)/1.0e6;
+        lastUS_ = us;
+        haveLastUS_ = true;
 	}
       
 	float alpha = omega0_*dt_;
@@ -1,6 +1,8 @@
 #if !defined(BBFILTER_H)
 #define BBFILTER_H
 
+#include <stdint.h>
+
 namespace bb {
 
 // Taken from the tutorial and example code of the EXCELLENT Curio Res (https://www.youtube.com/@curiores111, 
@@ -27,7 +29,8 @@ protected:
 	float omega0_;
 	float dt_;
 	bool adapt_;
-	float tn1_ = 0;
+	uint32_t lastUS_;   // adaptive mode: time of the last sample, from Runloop::runloop.micros()
+	bool haveLastUS_;
 	float x_[3], y_[3];
 
 	float cutoff_, sampleFreq_;
@@ -48,6 +48,131 @@ uint8_t bb::Packet::calculateCRC() const {
 	return calcCRC7((const uint8_t*)this, sizeof(Packet)-1);
 }
 
+uint8_t bb::ControlFEC::calculateCRC() const {
+	return calcCRC7((const uint8_t*)this, sizeof(ControlFEC)-1);
+}
+
+bb::ControlFECEncoder::ControlFECEncoder(uint8_t span) {
+	setSpan(span);
+	reset();
+}
+
+void bb::ControlFECEncoder::reset() {
+	frame_ = 0;
+	count_ = 0;
+}
+
+void bb::ControlFECEncoder::setSpan(uint8_t span) {
+	if(span < 1) span = 1;
+	if(span > MAX_FEC_SPAN) span = MAX_FEC_SPAN;
+	span_ = span;
+}
+
+void bb::ControlFECEncoder::encode(Packet& packet, ControlFEC& fec) {
+	packet.fec = true;
+
+	memset(&fec, 0, sizeof(fec));
+	fec.frame = frame_;
+	fec.span = count_ < span_ ? count_ : span_;
+	for(uint8_t i=0; i<fec.span; i++) {
+		for(uint8_t j=0; j<sizeof(fec.parity); j++) fec.parity[j] ^= history_[i][j];
+	}
+	fec.crc = fec.calculateCRC();
+
+	memmove(history_[1], history_[0], (MAX_FEC_SPAN-1)*sizeof(history_[0]));
+	memcpy(history_[0], &packet, sizeof(history_[0]));
+	if(count_ < MAX_FEC_SPAN) count_++;
+	frame_++;
+}
+
+bb::ControlFECDecoder::ControlFECDecoder(uint32_t timeoutMS) {
+	timeoutMS_ = timeoutMS;
+	received_ = missed_ = recovered_ = late_ = 0;
+	reset();
+}
+
+void bb::ControlFECDecoder::reset() {
+	started_ = false;
+	last_ = 0;
+	lastMS_ = 0;
+	memset(valid_, 0, sizeof(valid_));
+}
+
+bool bb::ControlFECDecoder::known(uint8_t frame) const {
+	uint8_t i = frame % HISTORY;
+	return valid_[i] && frames_[i] == frame;
+}
+
+void bb::ControlFECDecoder::store(uint8_t frame, const uint8_t* bytes) {
+	uint8_t i = frame % HISTORY;
+	frames_[i] = frame;
+	valid_[i] = true;
+	memcpy(history_[i], bytes, sizeof(history_[i]));
+}
+
+bool bb::ControlFECDecoder::decode(const Packet& packet, const ControlFEC& fec, uint32_t ms, Packet& recovered) {
+	uint8_t gap = fec.frame - last_;
+	bool fresh = !started_ || ms - lastMS_ > timeoutMS_;
+	if(!fresh && (gap == 0 || gap >= 128)) return false; // a repeat, or a straggler
+
+	if(fresh || gap > MAX_GAP) {
+		reset();
+		started_ = true;
+		fresh = true;
+	} else {
+		missed_ += gap - 1;
+	}
+	received_++;
+
+	bool retval = false;
+	uint8_t unknown = 0, numUnknown = 0;
+	for(uint8_t i=1; i<=fec.span && !fresh; i++) {
+		uint8_t f = fec.frame - i;
+		if(!known(f)) {
+			unknown = f;
+			numUnknown++;
+		}
+	}
+
+	if(numUnknown == 1) {
+		uint8_t bytes[sizeof(fec.parity)];
+		memcpy(bytes, fec.parity, sizeof(bytes));
+		for(uint8_t i=1; i<=fec.span; i++) {
+			uint8_t f = fec.frame - i;
+			if(f == unknown) continue;
+			const uint8_t* h = history_[f % HISTORY];
+			for(uint8_t j=0; j<sizeof(bytes); j++) bytes[j] ^= h[j];
+		}
+		store(unknown, bytes);
+		recovered_++;
+
+		// Only hand it back if it's newer than the last frame we had, which makes it the one right before packet
+		if(gap > 1 && uint8_t(fec.frame - unknown) < gap) {
+			memcpy((void*)&recovered, bytes, sizeof(bytes));
+			recovered.crc = recovered.calculateCRC();
+			retval = true;
+		} else {
+			late_++;
+		}
+	}
+
+	store(fec.frame, (const uint8_t*)&packet);
+	last_ = fec.frame;
+	lastMS_ = ms;
+	return retval;
+}
+
+uint16_t bb::calculateCRC16(const uint8_t* buf, size_t len, uint16_t crc) {
+	while(len--) {
+		crc ^= (uint16_t)(*buf++) << 8;
+		for(int i=0; i<8; i++) {
+			if(crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+			else crc <<= 1;
+		}
+	}
+	return crc;
+}
+
 bb::Result bb::PacketReceiver::incomingPacket(const HWAddress& station, uint8_t rssi, Packet& packet) {
 	Result res;
 	ConfigPacket::ConfigReplyType reply = packet.payload.config.reply;
@@ -200,8 +200,9 @@ struct __attribute__((packed)) RemoteConfigPacket {
 	bool leftIsPrimary       : 1;
 	uint8_t ledBrightness    : 3;
 	uint8_t sendRepeats      : 3;
-	uint8_t reserved         : 1;
+	bool adaptiveRepeats     : 1; // sendRepeats is only the fallback, see RRemote::chooseRepeats()
 	uint8_t deadbandPercent  : 4;
+	uint8_t fecSpan          : 2; // 0 - control packets to the droid go without ControlFEC trailer
 };
 
 struct __attribute__ ((packed)) ConfigPacket {
@@ -264,7 +265,7 @@ struct __attribute__ ((packed)) Packet {
 	PacketType type     : 2;
 	PacketSource source : 2;
 	uint8_t seqnum      : 3; // automatically set by Runloop
-	uint8_t reserved    : 1; 
+	bool fec            : 1; // a ControlFEC trailer follows - control packets only, see below
 
 	union {
 		ControlPacket control;
@@ -279,7 +280,7 @@ struct __attribute__ ((packed)) Packet {
 		type = t;
 		source = s;
 		seqnum = seq%8;
-		reserved = 0;
+		fec = false;
 	}
 	Packet() { }
 	uint8_t calculateCRC() const;
@@ -292,6 +293,93 @@ struct PacketFrame {
 	uint8_t crc;
 };
 
+/*
+ * FORWARD ERROR CORRECTION FOR CONTROL PACKETS
+ *
+ * Optional, instead of or on top of sending repeats. A control packet with the fec bit set is followed by a ControlFEC
+ * trailer in the same frame, which holds the XOR of the previous span control frames the station sent to the same
+ * destination (header and payload, not the CRC). If exactly one of those got lost, the receiver rebuilds it from the
+ * parity and the others - so a single lost frame is recovered from the next one, for about a quarter of the airtime
+ * a repeat costs. Frames are counted separately from the Runloop sequence number, which skips values when the
+ * sender doesn't send every cycle.
+ *
+ * Receivers that don't know the extension refuse the longer frame, so the sender has to turn it on explicitly.
+ *
+ * Senders use a span of 1. A longer span can only rebuild a frame once all the others it covers are known, i.e.
+ * after newer frames have been handled - and then the rebuilt frame is stale. So longer spans lose more than span 1
+ * and aren't sent, but the format and the decoder still take up to 3.
+ */
+
+static const uint8_t MAX_FEC_SPAN = 1;
+
+struct __attribute__ ((packed)) ControlFEC {
+	uint8_t frame;              // counts up by one with every control frame sent to this destination
+	uint8_t span     : 2;       // parity covers frames frame-span..frame-1; 0 if there are none yet, at most 3
+	uint8_t reserved : 6;
+	uint8_t parity[sizeof(Packet)-1];
+	uint8_t crc;
+
+	uint8_t calculateCRC() const;
+};
+
+/*!
+	\brief Keeps the last control frames sent to one destination and computes the ControlFEC trailer for the next.
+*/
+class ControlFECEncoder {
+public:
+	ControlFECEncoder(uint8_t span = 1);
+	void reset();
+	void setSpan(uint8_t span);
+	uint8_t span() const { return span_; }
+
+	//! Sets packet.fec and fills in fec, including the CRC. Then adds packet to the frames the next parities cover.
+	void encode(Packet& packet, ControlFEC& fec);
+
+protected:
+	uint8_t span_, frame_, count_;
+	uint8_t history_[MAX_FEC_SPAN][sizeof(Packet)-1]; // newest first
+};
+
+/*!
+	\brief Rebuilds lost control frames from one source from the ControlFEC trailers that follow.
+
+	Feed it every control packet from the source that comes with a trailer, in the order they arrive. A frame is
+	rebuilt when the next parity that covers it has no other gaps. It's only handed back if nothing newer has been
+	handled yet, because an old frame would set the droid back to stale stick values - frames rebuilt later still
+	fill in gaps for later parities, but only count as late. Starts over after timeoutMS without frames, or if the
+	frame counter jumps too far.
+*/
+class ControlFECDecoder {
+public:
+	ControlFECDecoder(uint32_t timeoutMS = 250);
+	void reset();
+
+	//! Returns true if it rebuilt the frame right before packet, which should be handled before packet is.
+	bool decode(const Packet& packet, const ControlFEC& fec, uint32_t ms, Packet& recovered);
+
+	unsigned long framesReceived() const { return received_; }
+	//! Frames that never arrived, whether they were rebuilt or not.
+	unsigned long framesMissed() const { return missed_; }
+	unsigned long framesRecovered() const { return recovered_; }
+	//! Rebuilt only after a newer frame was handled, so not handed back.
+	unsigned long framesLate() const { return late_; }
+
+protected:
+	static const uint8_t HISTORY = 8;
+	static const uint8_t MAX_GAP = 16;
+
+	bool known(uint8_t frame) const;
+	void store(uint8_t frame, const uint8_t* bytes);
+
+	uint32_t timeoutMS_, lastMS_;
+	bool started_;
+	uint8_t last_;
+	uint8_t frames_[HISTORY];
+	bool valid_[HISTORY];
+	uint8_t history_[HISTORY][sizeof(Packet)-1];
+	unsigned long received_, missed_, recovered_, late_;
+};
+
 /*!
 	\class PacketReceiver
 	\brief Subclass for communication packet receivers.
@@ -375,6 +463,79 @@ struct __attribute__ ((packed)) LargeStatePacket {
 	BatteryState battery[3];
 };
 
+struct __attribute__ ((packed)) SubsystemTimingState {
+	char name[12];
+	uint32_t count, overruns;
+	uint32_t minUS, meanUS, maxUS, p99US;
+	uint16_t histogram[TimingStats::NUM_BUCKETS]; // share of samples per log2 bucket, in 1/10000
+};
+
+static const uint8_t MAX_TIMING_SUBSYSTEMS = 12;
+
+struct __attribute__ ((packed)) RunloopTimingPacket {
+	float timestamp;
+	uint32_t cycleTimeUS;
+	uint8_t numSubsystems;
+
+	SubsystemTimingState total;
+	SubsystemTimingState subsys[MAX_TIMING_SUBSYSTEMS];
+};
+
+/*
+ * BULK PARAMETER PROTOCOL
+ *
+ * Reads or writes a whole group of a subsystem's parameters in one round trip, instead of one "set" console command
+ * per value. A request is a ParamBlockHeader followed by numEntries ParamEntry structs; the reply has the same layout,
+ * with PARAM_OP_REPLY set in op and every entry's result and value filled in. Parameters are addressed by the FNV-1a
+ * hash of their name (Subsystem::hashParameterName()), values are sent with their type. Little endian throughout.
+ *
+ * Served by SubsystemManager::handleParameterBlock(), which WifiServer calls for UDP datagrams and XBee for 64 bit
+ * addressed API frames that start with PARAM_BLOCK_MAGIC. See DroidGUI/ParamTool.py for a host side client.
+ */
+
+static const uint32_t PARAM_BLOCK_MAGIC = 0x4d504242; // "BBPM"
+static const uint8_t PARAM_BLOCK_VERSION = 1;
+
+enum ParamOp {
+	PARAM_OP_GET           = 0, // Fill in the value of every entry
+	PARAM_OP_SET           = 1, // Set every entry, reply with the resulting values
+	PARAM_OP_SET_AND_STORE = 2, // Like PARAM_OP_SET, then write the configuration to flash once
+	PARAM_OP_LIST          = 3, // Reply with up to numEntries parameters, starting at first
+	PARAM_OP_REPLY         = 0x80
+};
+
+struct __attribute__ ((packed)) ParamEntry {
+	uint32_t hash;   // Subsystem::hashParameterName() of the parameter name
+	uint8_t type;    // Subsystem::ParameterType; string parameters can't be transferred this way
+	uint8_t result;  // Result, filled in by the reply
+	union {
+		int32_t i;
+		uint32_t u;  // also used for PARAMETER_BOOL
+		float f;
+	} value;
+};
+
+struct __attribute__ ((packed)) ParamBlockHeader {
+	uint32_t magic;      // PARAM_BLOCK_MAGIC
+	uint8_t version;     // PARAM_BLOCK_VERSION
+	uint8_t op;          // ParamOp
+	uint8_t seqnum;      // Copied to the reply
+	uint8_t result;      // Result for the block as a whole, filled in by the reply
+	uint8_t first;       // PARAM_OP_LIST: index of the first parameter
+	uint8_t total;       // PARAM_OP_LIST reply: number of parameters the subsystem has
+	uint8_t numEntries;
+	char subsystem[8];   // Subsystem name, NUL padded; not terminated if it is 8 characters long
+	uint16_t crc;        // calculateCRC16() over header (with crc set to 0) and entries
+};
+
+//! Fits into a single UDP datagram on all our platforms.
+static const uint8_t MAX_PARAM_ENTRIES = 48;
+//! Fits into a single 802.15.4 / DigiMesh RF payload together with the header.
+static const uint8_t MAX_XBEE_PARAM_ENTRIES = 5;
+
+//! CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xffff). Pass the previous result as crc to continue a CRC.
+uint16_t calculateCRC16(const uint8_t* buf, size_t len, uint16_t crc = 0xffff);
+
 };
 
 #endif // BBPACKETRECEIVER_H
\ No newline at end of file
@@ -1,21 +1,50 @@
 #include <Arduino.h>
 #include <limits.h>
+#include <algorithm>
 #include "BBRunloop.h"
 #include "BBConsole.h"
+#include "BBPacket.h"
+#include "BBTrace.h"
 
 bb::Runloop bb::Runloop::runloop;
 
+const bb::Subsystem::CommandDef bb::Runloop::COMMANDS[] = {
+	command("running_status",   1, 1, &Runloop::cmdRunningStatus),
+	command("suppress_overrun", 1, 1, &Runloop::cmdSuppressOverrun),
+	command("overrun_policy",   1, 1, &Runloop::cmdOverrunPolicy),
+	command("timing",           0, 1, &Runloop::cmdTiming),
+	command("tasks",            0, 1, &Runloop::cmdTasks)
+};
+
 bb::Runloop::Runloop() {
 	name_ = "runloop";
 	description_ = "Main runloop";
 	help_ = "Started once after all subsystems are added. Its start() only returns if stop() is called.\n"\
 "Commands:\n"\
 "\trunning_status [on|off]:    Print running status on timing\n"\
-"\tsuppress_overrun [on|off]:  Suppress overrun messages";
+"\tsuppress_overrun [on|off]:  Suppress overrun messages\n"\
+"\toverrun_policy [skip|catchup]: Drop missed cycles, or run them back to back to catch up\n"\
+"\ttiming [reset]:             Print (or reset) per-subsystem step() timing statistics\n"\
+"\ttasks [rebalance]:          Print periodic tasks and their planned load (or replan phases using measured cost)";
+	setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
+	timeSource_ = &HardwareTimeSource::hardware;
 	cycleTime_ = DEFAULT_CYCLETIME;
+	seqnum_ = 0;
+	running_ = false;
+	timedCallbackGeneration_ = 0;
 	runningStatus_ = false;
 	suppressOverrun_ = false;
 	excuseOverrun_ = false;
+	plannedWorstLoad_ = 0;
+	overrunPolicy_ = OVERRUN_SKIP;
+	deadlineValid_ = false;
+	deadline_ = lastCycleStart_ = 0;
+	maxPeriodJitter_ = skippedCycles_ = 0;
+	syncMode_ = SYNC_TIMER;
+	triggered_ = false;
+	syncTimeouts_ = 0;
+	nextIdleTask_ = 0;
+	idleChunks_ = starvedIdleChunks_ = 0;
 }
 
 bb::Result bb::Runloop::start(ConsoleStream* stream) {
@@ -25,73 +54,187 @@ bb::Result bb::Runloop::start(ConsoleStream* stream) {
 	operationStatus_ = RES_OK;
 	seqnum_ = 0;
 	startTime_ = millis();
+	deadlineValid_ = false;
 
 	while(running_) {
-		unsigned long micros_start_loop = micros();
-		seqnum_++;
-
-		// First of all run any timed callbacks...
-		uint64_t m = millis();
-		for(std::vector<TimedCallback>::iterator iter = timedCallbacks_.begin(); iter != timedCallbacks_.end(); iter++) {
-			if(iter->triggerMS < m) { // FIXME there is highly likely an integer wrap in here...?
-				iter->cb();
-				if(true == iter->oneshot) {
-					iter = timedCallbacks_.erase(iter);
-					if(iter == timedCallbacks_.end()) break;
-				} else {
-					iter->triggerMS = m + iter->deltaMS;
-				}
-			}
-		}
+		cycle();
+	}
 
-		// ...then run step() on all subsystems...
-		std::vector<String> timingInfo;
-
-		std::vector<Subsystem*> subsys = SubsystemManager::manager.subsystems();
-		for(auto& s: subsys) {
-			unsigned long us = micros();
-			if(s->isStarted() && s->operationStatus() == RES_OK) {
-				//Console::console.printfBroadcast("Calling step() in %s...", s->name());
-				s->step();
-				//¨Console::console.printfBroadcast("done.\n");
-			} else {
-				s->stepIfNotStarted();
-			}
-			String str = String(s->name())  + ": " + (micros()-us) + "us ";
-			timingInfo.push_back(str);
-			if(runningStatus_) Console::console.printfBroadcast(str.c_str());
-		}
+	started_ = false;
+	operationStatus_ = RES_SUBSYS_NOT_STARTED;
+	return RES_OK;
+}
+
+void bb::Runloop::cycle() {
+	uint32_t cycleStart = micros();
+	seqnum_++;
 
-		// ...find out how long we took...
-		unsigned long micros_end_loop = micros();
-		unsigned long looptime;
-		if(micros_end_loop >= micros_start_loop) {
-			looptime = micros_end_loop - micros_start_loop;
+	if(deadlineValid_) {
+		uint32_t period = cycleStart - lastCycleStart_;
+		periodTiming_.add(period);
+		uint32_t jitter = period > cycleTime_ ? period - cycleTime_ : cycleTime_ - period;
+		if(jitter > maxPeriodJitter_) maxPeriodJitter_ = jitter;
+	} else {
+		deadline_ = cycleStart;
+		deadlineValid_ = true;
+	}
+	lastCycleStart_ = cycleStart;
+	Trace::trace.record(cycleStart, Trace::EVENT_CYCLE, 0, seqnum_ & 0xffff);
+
+	// First of all run any timed callbacks...
+	runTimedCallbacks(millis());
+
+	// ...then run step() on all subsystems...
+	// (Indexed access, because a subsystem may register another one from within step().)
+	const std::vector<Subsystem*>& subsys = SubsystemManager::manager.subsystems();
+	for(size_t i=0; i<subsys.size(); i++) {
+		Subsystem* s = subsys[i];
+		uint32_t us = micros();
+		Trace::trace.record(us, Trace::EVENT_STEP_BEGIN, i);
+		if(s->isStarted() && s->operationStatus() == RES_OK) {
+			//Console::console.printfBroadcast("Calling step() in %s...", s->name());
+			s->step();
+			//¨Console::console.printfBroadcast("done.\n");
+			if(tasks_.size() != 0) runTasks(s);
 		} else {
-			looptime = ULONG_MAX - micros_start_loop + micros_end_loop;
+			s->stepIfNotStarted();
+		}
+		uint32_t end = micros();
+		Trace::trace.record(end, Trace::EVENT_STEP_END, i);
+		s->stepTiming().add(end-us);
+		if(runningStatus_) Console::console.printfBroadcast("%s: %luus ", s->name(), (unsigned long)s->stepTiming().last());
+	}
+	if(tasks_.size() != 0) runTasks(NULL);
+
+	// ...find out how long we took...
+	uint32_t looptime = micros() - cycleStart;
+	loopTiming_.add(looptime);
+	if(runningStatus_) Console::console.printfBroadcast("Total: %dus", looptime);
+
+	// ...bicker if we overran the allotted time...
+	if(looptime > cycleTime_) {
+		// Blame the overrun on the subsystem that took longest in this cycle.
+		loopTiming_.addOverrun();
+		size_t worst = 0;
+		for(size_t i=1; i<subsys.size(); i++) {
+			if(subsys[i]->stepTiming().last() > subsys[worst]->stepTiming().last()) worst = i;
 		}
-		if(runningStatus_) Console::console.printfBroadcast("Total: %dus", looptime);
+		if(subsys.size() != 0) subsys[worst]->stepTiming().addOverrun();
+		Trace::trace.record(Trace::EVENT_OVERRUN, worst, looptime > 0xffff ? 0xffff : looptime);
 
-		// ...and bicker if we overran the allotted time.
-		if(looptime <= cycleTime_) {
-			delayMicroseconds(cycleTime_-looptime);
-		} else if(excuseOverrun_ == false && suppressOverrun_ == false) {
+		if(excuseOverrun_ == false && suppressOverrun_ == false) {
 			Console::console.printfBroadcast("%d/%dus spent in loop: ", looptime, cycleTime_);
-			for(auto& t: timingInfo) {
-				Console::console.printfBroadcast(t.c_str());
-				Console::console.printfBroadcast(" ");
+			for(auto& s: subsys) {
+				Console::console.printfBroadcast("%s: %luus  ", s->name(), (unsigned long)s->stepTiming().last());
 			}
 			Console::console.printfBroadcast("\n");
 		}
+	}
+
+	// ...and wait for the next cycle's deadline.
+	waitForNextCycle();
 
-		excuseOverrun_ = false;
+	excuseOverrun_ = false;
+}
+
+void bb::Runloop::waitForNextCycle() {
+	if(syncMode_ == SYNC_EXTERNAL) {
+		// The next trigger is due about one cycle time after this cycle started - leave a bit of margin.
+		if(idleTasks_.size() != 0 && !triggered_) runIdleTasks(lastCycleStart_ + cycleTime_ - cycleTime_/16);
+		while(!triggered_) {
+			if(micros() - lastCycleStart_ > cycleTime_ + cycleTime_/2) {
+				syncTimeouts_++;
+				break;
+			}
+			delayMicroseconds(SYNC_POLL_MICROS);
+		}
+		triggered_ = false;
+		return;
 	}
 
-	started_ = false;
-	operationStatus_ = RES_SUBSYS_NOT_STARTED;
+	if(cycleTime_ == 0) {
+		deadlineValid_ = false;
+		return;
+	}
+
+	deadline_ += cycleTime_;
+	if(idleTasks_.size() != 0) runIdleTasks(deadline_);
+	uint32_t now = micros();
+	int32_t remaining = int32_t(deadline_ - now);
+	if(remaining >= 0) { // right on the deadline is not late
+		if(remaining > 0) delayMicroseconds(remaining);
+		return;
+	}
+
+	// We're late. Either start the next cycle right away, or give up on the cycles we missed.
+	uint32_t behind = uint32_t(-remaining) / cycleTime_ + 1;
+	if(overrunPolicy_ == OVERRUN_CATCHUP && behind <= MAX_CATCHUP_CYCLES) return;
+	deadline_ += behind * cycleTime_;
+	skippedCycles_ += behind;
+	delayMicroseconds(deadline_ - now);
+}
+
+bb::Result bb::Runloop::addIdleTask(const char* name, uint32_t chunkMicros, std::function<bool(void)> fn, uint32_t maxWaitMillis) {
+	if(name == NULL || fn == nullptr) return RES_CMD_INVALID_ARGUMENT;
+	IdleTask t;
+	t.name = name;
+	t.chunkUS = t.lastChunkUS = chunkMicros;
+	t.maxWaitMS = maxWaitMillis;
+	t.lastRunMS = millis();
+	t.fn = fn;
+	idleTasks_.push_back(t);
 	return RES_OK;
 }
 
+void bb::Runloop::runIdleTasks(uint32_t until) {
+	// Go round robin until none of the tasks fits into what's left.
+	size_t skipped = 0;
+	while(idleTasks_.size() != 0 && skipped < idleTasks_.size()) {
+		if(nextIdleTask_ >= idleTasks_.size()) nextIdleTask_ = 0;
+		IdleTask& t = idleTasks_[nextIdleTask_];
+
+		uint32_t now = micros();
+		uint32_t needed = t.lastChunkUS > t.chunkUS ? t.lastChunkUS : t.chunkUS;
+		bool starved = t.maxWaitMS != 0 && millis() - t.lastRunMS > t.maxWaitMS;
+		if(int32_t(until - now) < int32_t(needed) && !starved) {
+			nextIdleTask_++;
+			skipped++;
+			continue;
+		}
+
+		// Move fn out while it runs - it may add idle tasks and thereby reallocate idleTasks_.
+		std::function<bool()> fn = std::move(t.fn);
+		Trace::trace.record(now, Trace::EVENT_IDLE_BEGIN);
+		bool more = fn();
+		uint32_t end = micros();
+		Trace::trace.record(end, Trace::EVENT_IDLE_END);
+		IdleTask& u = idleTasks_[nextIdleTask_];
+		u.lastChunkUS = end - now;
+		u.lastRunMS = millis();
+		idleChunks_++;
+		if(starved) starvedIdleChunks_++;
+
+		if(more) {
+			u.fn = std::move(fn);
+			nextIdleTask_++;
+		} else {
+			idleTasks_.erase(idleTasks_.begin() + nextIdleTask_);
+		}
+		skipped = 0;
+		if(starved) break; // that one most likely blew the budget already
+	}
+}
+
+void bb::Runloop::setSyncMode(SyncMode mode) {
+	syncMode_ = mode;
+	triggered_ = false;
+	deadlineValid_ = false;
+}
+
+void bb::Runloop::triggerCycle() {
+	triggered_ = true;
+}
+
 bb::Result bb::Runloop::stop(ConsoleStream *stream) {
 	stream = stream; // make compiler happy
 	if(!started_) return RES_SUBSYS_NOT_STARTED;
@@ -102,23 +245,120 @@ bb::Result bb::Runloop::step() {
 	return RES_OK;
 }
 
-bb::Result bb::Runloop::handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream) {
-	if(words[0] == "running_status") {
-		if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		runningStatus_ = words[1] == "on" ? true : false;
+bb::Result bb::Runloop::cmdRunningStatus(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)stream;
+	runningStatus_ = words[1] == "on" ? true : false;
+	return RES_OK;
+}
+
+bb::Result bb::Runloop::cmdSuppressOverrun(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)stream;
+	suppressOverrun_ = words[1] == "on" ? true : false;
+	return RES_OK;
+}
+
+bb::Result bb::Runloop::cmdOverrunPolicy(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)stream;
+	if(words[1] == "skip") setOverrunPolicy(OVERRUN_SKIP);
+	else if(words[1] == "catchup") setOverrunPolicy(OVERRUN_CATCHUP);
+	else return RES_CMD_INVALID_ARGUMENT;
+	return RES_OK;
+}
+
+bb::Result bb::Runloop::cmdTiming(const ConsoleWords& words, ConsoleStream *stream) {
+	if(words.size() == 1) {
+		excuseOverrun();
+		printTimingStats(stream);
 		return RES_OK;
 	}
-	if(words[0] == "suppress_overrun") {
-		if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		suppressOverrun_ = words[1] == "on" ? true : false;
-		return RES_OK;
+	if(words[1] != "reset") return RES_CMD_INVALID_ARGUMENT;
+	resetTimingStats();
+	return RES_OK;
+}
+
+bb::Result bb::Runloop::cmdTasks(const ConsoleWords& words, ConsoleStream *stream) {
+	if(words.size() == 2) {
+		if(words[1] != "rebalance") return RES_CMD_INVALID_ARGUMENT;
+		rebalanceTasks(true);
+	}
+	excuseOverrun();
+	printTasks(stream);
+	return RES_OK;
+}
+
+static void printTimingStatsLine(bb::ConsoleStream* stream, const char* name, const bb::TimingStats& t) {
+	stream->printf("%-12.12s %9lu %7lu %7lu %7lu %7lu %8lu  ", name, (unsigned long)t.count(), (unsigned long)t.min(), 
+		(unsigned long)t.mean(), (unsigned long)t.max(), (unsigned long)t.percentile(0.99), (unsigned long)t.overruns());
+	for(unsigned int i=0; i<bb::TimingStats::NUM_BUCKETS; i++) {
+		if(t.bucket(i) == 0) continue;
+		stream->printf(" <%lu:%lu%%", (unsigned long)bb::TimingStats::bucketUpperBound(i)+1, (unsigned long)((t.bucket(i)*100ULL)/t.count()));
 	}
+	stream->printf("\n");
+}
+
+void bb::Runloop::printTimingStats(ConsoleStream* stream) {
+	if(stream == NULL) return;
+	stream->printf("Cycle time %luus. All times in us; histogram buckets are \"<upper bound:share\".\n", cycleTime_);
+	stream->printf("%-12s %9s %7s %7s %7s %7s %8s  %s\n", "Subsystem", "Count", "Min", "Mean", "Max", "p99", "Overruns", "Histogram");
+	for(auto& s: SubsystemManager::manager.subsystems()) {
+		printTimingStatsLine(stream, s->name(), s->stepTiming());
+	}
+	printTimingStatsLine(stream, "TOTAL", loopTiming_);
+	printTimingStatsLine(stream, "PERIOD", periodTiming_);
+	stream->printf("Period stddev %.1fus, max jitter %luus, %lu cycles skipped (overrun policy %s).\n", periodTiming_.stddev(), 
+		(unsigned long)maxPeriodJitter_, (unsigned long)skippedCycles_, overrunPolicy_ == OVERRUN_SKIP ? "skip" : "catchup");
+	if(syncMode_ == SYNC_EXTERNAL) stream->printf("Synced to external trigger, %lu sync timeouts.\n", (unsigned long)syncTimeouts_);
+	stream->printf("%lu idle tasks pending, %lu idle chunks run (%lu of them starved).\n", (unsigned long)idleTasks_.size(),
+		(unsigned long)idleChunks_, (unsigned long)starvedIdleChunks_);
+}
 
-	return bb::Subsystem::handleConsoleCommand(words, stream);;
+void bb::Runloop::resetTimingStats() {
+	for(auto& s: SubsystemManager::manager.subsystems()) s->stepTiming().reset();
+	loopTiming_.reset();
+	periodTiming_.reset();
+	maxPeriodJitter_ = skippedCycles_ = 0;
+	syncTimeouts_ = 0;
+	idleChunks_ = starvedIdleChunks_ = 0;
+}
+
+static void fillTimingState(bb::SubsystemTimingState& state, const char* name, const bb::TimingStats& t) {
+	memset(&state, 0, sizeof(state));
+	strncpy(state.name, name, sizeof(state.name)-1);
+	state.count = t.count();
+	state.overruns = t.overruns();
+	state.minUS = t.min();
+	state.meanUS = t.mean();
+	state.maxUS = t.max();
+	state.p99US = t.percentile(0.99);
+	if(t.count() == 0) return;
+	for(unsigned int i=0; i<bb::TimingStats::NUM_BUCKETS; i++) {
+		state.histogram[i] = (t.bucket(i) * 10000ULL) / t.count();
+	}
+}
+
+void bb::Runloop::fillTimingPacket(RunloopTimingPacket& packet) {
+	memset(&packet, 0, sizeof(packet));
+	packet.timestamp = millisSinceStart() / 1000.0;
+	packet.cycleTimeUS = cycleTime_;
+
+	const std::vector<Subsystem*>& subsys = SubsystemManager::manager.subsystems();
+	for(size_t i=0; i<subsys.size() && i<MAX_TIMING_SUBSYSTEMS; i++) {
+		fillTimingState(packet.subsys[i], subsys[i]->name(), subsys[i]->stepTiming());
+		packet.numSubsystems++;
+	}
+	fillTimingState(packet.total, "TOTAL", loopTiming_);
 }
 
 void bb::Runloop::setCycleTimeMicros(unsigned long t) {
  	cycleTime_ = t;
+	deadlineValid_ = false;
+	rebalanceTasks();
+}
+
+void bb::Runloop::setTimeSource(TimeSource* source) {
+	timeSource_ = source != NULL ? source : &HardwareTimeSource::hardware;
+	startTime_ = millis();
+	deadlineValid_ = false;
 }
 
 unsigned long bb::Runloop::cycleTimeMicros() {
@@ -130,24 +370,226 @@ void bb::Runloop::excuseOverrun() {
 }
 
 uint64_t bb::Runloop::millisSinceStart() {
-	return millis() - startTime_;
+	return uint32_t(millis() - startTime_);
+}
+
+bb::Runloop::TimedCallbackHandle bb::Runloop::scheduleTimedCallback(uint32_t ms, std::function<void(void)> cb, bool oneshot) {
+	uint16_t slot;
+	if(freeTimedCallbacks_.size() != 0) {
+		slot = freeTimedCallbacks_.back();
+		freeTimedCallbacks_.pop_back();
+	} else {
+		if(timedCallbacks_.size() > 0xffff) return 0;
+		slot = timedCallbacks_.size();
+		timedCallbacks_.push_back(TimedCallback());
+	}
+
+	// Upper 16 bits are a generation counter, so a stale handle never matches a reused slot.
+	timedCallbackGeneration_++;
+	if(timedCallbackGeneration_ == 0) timedCallbackGeneration_ = 1;
+	TimedCallbackHandle handle = (TimedCallbackHandle(timedCallbackGeneration_) << 16) | slot;
+
+	TimedCallback& c = timedCallbacks_[slot];
+	c.handle = handle;
+	c.deltaMS = ms;
+	c.oneshot = oneshot;
+	c.cb = cb;
+
+	deadlines_.push_back({uint32_t(millis()) + ms, handle});
+	std::push_heap(deadlines_.begin(), deadlines_.end(), deadlineLater);
+
+	return handle;
 }
 
-void* bb::Runloop::scheduleTimedCallback(uint64_t ms, std::function<void(void)> cb, bool oneshot) {
-	TimedCallback c = {millis() + ms, ms, oneshot, cb};
-	timedCallbacks_.push_back(c);
-	return (void*)&(*timedCallbacks_.end());
+bb::Result bb::Runloop::cancelTimedCallback(TimedCallbackHandle handle) {
+	uint16_t slot = handle & 0xffff;
+	if(handle == 0 || slot >= timedCallbacks_.size() || timedCallbacks_[slot].handle != handle) {
+		Console::console.printfBroadcast("Callback not found!\n");
+		return RES_COMMON_NOT_IN_LIST;
+	}
+
+	// The heap entry stays behind and is dropped when it comes up, or when there are too many of them.
+	timedCallbacks_[slot].handle = 0;
+	timedCallbacks_[slot].cb = nullptr;
+	freeTimedCallbacks_.push_back(slot);
+	if(deadlines_.size() > 2*numTimedCallbacks() + 16) compactTimedCallbackHeap();
+
+	return RES_OK;
 }
 
-bb::Result bb::Runloop::cancelTimedCallback(void* handle) {
-	for(std::vector<TimedCallback>::iterator iter = timedCallbacks_.begin(); iter != timedCallbacks_.end(); iter++) {
-		if(handle == (void*)&(*iter)) {
-			iter = timedCallbacks_.erase(iter);
+void bb::Runloop::runTimedCallbacks(uint32_t now) {
+	// Bounded so that a callback rescheduling itself with 0ms can't keep us here forever.
+	size_t budget = deadlines_.size();
+
+	while(deadlines_.size() != 0 && budget-- > 0 && deadlineDue(deadlines_.front().triggerMS, now)) {
+		TimedCallbackDeadline d = deadlines_.front();
+		std::pop_heap(deadlines_.begin(), deadlines_.end(), deadlineLater);
+		deadlines_.pop_back();
+
+		uint16_t slot = d.handle & 0xffff;
+		if(timedCallbacks_[slot].handle != d.handle) continue; // cancelled
+
+		// Move the callback out of its slot - it may schedule new callbacks and thereby reallocate timedCallbacks_.
+		std::function<void()> cb = std::move(timedCallbacks_[slot].cb);
+		Trace::trace.record(Trace::EVENT_CALLBACK_BEGIN, 0, slot);
+		cb();
+		Trace::trace.record(Trace::EVENT_CALLBACK_END, 0, slot);
+
+		if(timedCallbacks_[slot].handle != d.handle) continue; // cancelled from within the callback
+		if(timedCallbacks_[slot].oneshot) {
+			timedCallbacks_[slot].handle = 0;
+			freeTimedCallbacks_.push_back(slot);
+			continue;
+		}
+
+		// Recurring - put it back and re-arm.
+		TimedCallback& c = timedCallbacks_[slot];
+		c.cb = std::move(cb);
+		uint32_t next = d.triggerMS + c.deltaMS;
+		if(deadlineDue(next, now)) next = now + (c.deltaMS != 0 ? c.deltaMS : 1); // fell behind - don't try to catch up
+		deadlines_.push_back({next, d.handle});
+		std::push_heap(deadlines_.begin(), deadlines_.end(), deadlineLater);
+	}
+}
+
+void bb::Runloop::compactTimedCallbackHeap() {
+	std::vector<TimedCallbackDeadline>::iterator end = std::remove_if(deadlines_.begin(), deadlines_.end(), [this](const TimedCallbackDeadline& d) {
+		return timedCallbacks_[d.handle & 0xffff].handle != d.handle;
+	});
+	deadlines_.erase(end, deadlines_.end());
+	std::make_heap(deadlines_.begin(), deadlines_.end(), deadlineLater);
+}
+
+bb::Result bb::Runloop::addTask(Subsystem* owner, const char* name, float rateHz, std::function<void(void)> fn, unsigned long costUS, int phase) {
+	if(name == NULL || fn == nullptr) return RES_CMD_INVALID_ARGUMENT;
+	if(rateHz <= 0) return RES_COMMON_OUT_OF_RANGE;
+	for(auto& t: tasks_) {
+		if(t.owner == owner && !strcmp(t.name, name)) return RES_COMMON_DUPLICATE_IN_LIST;
+	}
+
+	Task t;
+	t.owner = owner;
+	t.name = name;
+	t.rateHz = rateHz;
+	t.costUS = costUS;
+	t.fixedPhase = phase < 0 ? PHASE_AUTO : phase;
+	t.divider = 1;
+	t.phase = 0;
+	t.fn = fn;
+	tasks_.push_back(t);
+
+	rebalanceTasks();
+	return RES_OK;
+}
+
+bb::Result bb::Runloop::removeTask(Subsystem* owner, const char* name) {
+	for(std::vector<Task>::iterator iter = tasks_.begin(); iter != tasks_.end(); iter++) {
+		if(iter->owner == owner && !strcmp(iter->name, name)) {
+			tasks_.erase(iter);
+			rebalanceTasks();
 			return RES_OK;
 		}
 	}
-	Console::console.printfBroadcast("Callback not found!\n");
 	return RES_COMMON_NOT_IN_LIST;
 }
 
+void bb::Runloop::runTasks(Subsystem* owner) {
+	for(size_t i=0; i<tasks_.size(); i++) {
+		Task& t = tasks_[i];
+		if(t.owner != owner || (seqnum_ % t.divider) != t.phase) continue;
+		uint32_t us = micros();
+		t.fn();
+		tasks_[i].timing.add(micros()-us); // fn() may have added tasks and thereby moved t
+	}
+}
+
+static unsigned long gcd(unsigned long a, unsigned long b) {
+	while(b != 0) {
+		unsigned long r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+void bb::Runloop::rebalanceTasks(bool useMeasuredCost) {
+	plannedWorstLoad_ = 0;
+	if(tasks_.size() == 0) return;
+
+	// Turn rates into dividers, and find the hyperperiod after which the schedule repeats. If that gets too
+	// long (e.g. a task running every 1040 cycles next to one running every 4), the plan only looks at the
+	// first MAX_HYPERPERIOD cycles, which is still a good approximation.
+	float loopHz = cycleTime_ != 0 ? 1e6 / cycleTime_ : 0;
+	unsigned long hyper = 1;
+	for(auto& t: tasks_) {
+		long divider = loopHz > 0 ? lroundf(loopHz / t.rateHz) : 1;
+		t.divider = constrain(divider, 1L, 65535L);
+		if(t.divider > MAX_HYPERPERIOD) continue;
+		hyper = hyper / gcd(hyper, t.divider) * t.divider;
+		if(hyper > MAX_HYPERPERIOD) hyper = MAX_HYPERPERIOD;
+	}
 
+	// Greedy: pinned tasks first, then the most expensive (and among equally expensive, the most frequent)
+	// ones, each taking the phase that spreads the load best.
+	std::vector<unsigned long> cost(tasks_.size());
+	std::vector<uint16_t> order(tasks_.size());
+	for(size_t i=0; i<tasks_.size(); i++) {
+		const Task& t = tasks_[i];
+		cost[i] = t.costUS;
+		if(useMeasuredCost && t.timing.count() != 0 && t.timing.mean() > cost[i]) cost[i] = t.timing.mean();
+		if(cost[i] == 0) cost[i] = 1;
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [this, &cost](uint16_t a, uint16_t b) {
+		const Task& ta = tasks_[a];
+		const Task& tb = tasks_[b];
+		if((ta.fixedPhase >= 0) != (tb.fixedPhase >= 0)) return ta.fixedPhase >= 0;
+		if(cost[a] != cost[b]) return cost[a] > cost[b];
+		return ta.divider < tb.divider;
+	});
+
+	std::vector<uint16_t> load(hyper, 0);
+	for(uint16_t i: order) {
+		Task& t = tasks_[i];
+		unsigned long span = hyper > t.divider ? hyper : t.divider;
+
+		if(t.fixedPhase >= 0) {
+			t.phase = t.fixedPhase % t.divider;
+		} else {
+			// Mean of the squared loads the task would add to - plain minimax lets a rare but heavy task
+			// (like the SD card check) push everything else onto the same phase.
+			float bestScore = -1;
+			for(unsigned int p=0; p<t.divider; p++) {
+				float score = 0;
+				unsigned int n = 0;
+				for(unsigned long x=p; x<span; x+=t.divider, n++) {
+					float l = load[x % hyper] + cost[i];
+					score += l*l;
+				}
+				score /= n;
+				if(bestScore < 0 || score < bestScore) {
+					bestScore = score;
+					t.phase = p;
+				}
+			}
+		}
+
+		for(unsigned long x=t.phase; x<span; x+=t.divider) {
+			unsigned long l = load[x % hyper] + cost[i];
+			load[x % hyper] = l > 0xffff ? 0xffff : l;
+		}
+	}
+
+	for(auto l: load) if(l > plannedWorstLoad_) plannedWorstLoad_ = l;
+}
+
+void bb::Runloop::printTasks(ConsoleStream* stream) {
+	if(stream == NULL) return;
+	stream->printf("%-12s %-12s %8s %7s %5s %7s %7s %7s\n", "Owner", "Task", "Rate", "Divider", "Phase", "Cost", "Mean", "Max");
+	for(auto& t: tasks_) {
+		stream->printf("%-12.12s %-12.12s %7.2fHz %7u %5u %7lu %7lu %7lu\n", t.owner != NULL ? t.owner->name() : "-", t.name, 
+			t.rateHz, t.divider, t.phase, t.costUS, (unsigned long)t.timing.mean(), (unsigned long)t.timing.max());
+	}
+	stream->printf("Worst-case planned task load: %luus per cycle (%lu%% of %luus cycle time).\n", plannedWorstLoad_, 
+		cycleTime_ != 0 ? (plannedWorstLoad_*100)/cycleTime_ : 0, cycleTime_);
+}
@@ -2,12 +2,15 @@
 #define BBRUNLOOP_H
 
 #include "BBSubsystem.h"
+#include "BBTimeSource.h"
 
 #include <vector>
 #include <functional>
 
 namespace bb {
 
+struct RunloopTimingPacket;
+
 class Runloop: public Subsystem {
 public:
 	static Runloop runloop;
@@ -18,7 +21,34 @@ public:
 	virtual Result stop(ConsoleStream* stream = NULL);
 	virtual Result step();
 
-	virtual Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream);
+	//! Run a single cycle: timed callbacks, step() on all subsystems, then wait for the next cycle's deadline.
+	//! start() just calls this in a loop; exposed separately so host builds can drive the loop cycle by cycle.
+	void cycle();
+
+	//! What to do when a cycle ends after the next one should already have started.
+	enum OverrunPolicy {
+		OVERRUN_SKIP,    //!< Drop the missed cycles and wait for the next deadline on the original grid (default).
+		OVERRUN_CATCHUP  //!< Start missed cycles right away until back on schedule, but skip if more than MAX_CATCHUP_CYCLES behind.
+	};
+	static const unsigned int MAX_CATCHUP_CYCLES = 4;
+	void setOverrunPolicy(OverrunPolicy policy) { overrunPolicy_ = policy; }
+	OverrunPolicy overrunPolicy() { return overrunPolicy_; }
+
+	//! How cycles are started. SYNC_TIMER runs them on the cycle time grid. SYNC_EXTERNAL starts each cycle as soon
+	//! as possible after triggerCycle() was called, e.g. from a sensor's data-ready interrupt, so that the cycle
+	//! always works on a fresh sample. If no trigger comes within 1.5 cycle times, the cycle starts anyway and
+	//! is counted as a sync timeout. The cycle time should still be set to the nominal trigger period.
+	enum SyncMode {
+		SYNC_TIMER,
+		SYNC_EXTERNAL
+	};
+	static const unsigned int SYNC_POLL_MICROS = 10;
+	void setSyncMode(SyncMode mode);
+	SyncMode syncMode() { return syncMode_; }
+	//! Interrupt-safe.
+	void triggerCycle();
+	uint32_t syncTimeouts() { return syncTimeouts_; }
+
 
 	unsigned long getSequenceNumber() { return seqnum_; }
 
@@ -32,32 +62,148 @@ public:
 
 	uint64_t millisSinceStart();
 
+	//! Where the runloop, timed callbacks and everything that measures time between updates (PIDController, 
+	//! Encoder, adaptive LowPassFilter, ...) get their time from. Defaults to HardwareTimeSource::hardware.
+	//! Host builds can plug in a VirtualTimeSource to run deterministically and faster than realtime.
+	void setTimeSource(TimeSource* source);
+	TimeSource& timeSource() { return *timeSource_; }
+	// Objects constructed statically may ask for the time before the runloop itself is constructed, hence the check.
+	uint32_t micros() { return timeSource_ != NULL ? timeSource_->micros() : ::micros(); }
+	uint32_t millis() { return timeSource_ != NULL ? timeSource_->millis() : ::millis(); }
+	void delayMicroseconds(uint32_t us) { if(timeSource_ != NULL) timeSource_->delayMicroseconds(us); else ::delayMicroseconds(us); }
+
+	//! Timing of the whole loop body. Per-subsystem timing is in Subsystem::stepTiming().
+	const TimingStats& loopTiming() { return loopTiming_; }
+	//! Time between the starts of consecutive cycles - ideally always cycleTimeMicros(). Its stddev() is the period jitter.
+	const TimingStats& periodTiming() { return periodTiming_; }
+	//! Largest deviation of a single period from cycleTimeMicros().
+	uint32_t maxPeriodJitter() { return maxPeriodJitter_; }
+	uint32_t skippedCycles() { return skippedCycles_; }
+	void printTimingStats(ConsoleStream* stream);
+	void resetTimingStats();
+	//! Fill a telemetry packet with the current timing statistics, e.g. for WifiServer::broadcastUDPPacket().
+	void fillTimingPacket(RunloopTimingPacket& packet);
+
+
+	//! Handle to a scheduled timed callback. Stays valid until the callback is cancelled or a oneshot has run; 0 is never a valid handle.
+	typedef uint32_t TimedCallbackHandle;
 
 	// Schedule a timed callback (oneshot or recurring). Please note that this is currently only working within
 	// the runloop granularity. E.g. if you're running a runloop with a cycle time of 10,000us or 10ms, timed
 	// callback execution will have a granularity of 10ms. Do not use for high precision events obviously... :-)
-	virtual void* scheduleTimedCallback(uint64_t milliseconds, std::function<void(void)> cb, bool oneshot = true);
-	virtual Result cancelTimedCallback(void* handle);
-
+	// Callbacks are kept in a deadline-ordered heap, so a cycle with nothing due costs O(1) no matter how many
+	// are pending. Deadlines survive the millis() wraparound as long as they are less than ~24 days out.
+	// Callbacks may schedule or cancel other callbacks, including themselves.
+	virtual TimedCallbackHandle scheduleTimedCallback(uint32_t milliseconds, std::function<void(void)> cb, bool oneshot = true);
+	virtual Result cancelTimedCallback(TimedCallbackHandle handle);
+	size_t numTimedCallbacks() { return timedCallbacks_.size() - freeTimedCallbacks_.size(); }
+
+	//! Phase value for addTask() that lets the runloop pick the phase.
+	static const int PHASE_AUTO = -1;
+
+	// Periodic tasks. Instead of hand-rolling "if(seqnum % N == M)" inside step(), a subsystem registers a
+	// task with a rate in Hz. The runloop turns that into a cycle divider and runs the task right after
+	// the owner's step(), but only if the owner is started and OK (owner may be NULL for free-standing tasks).
+	// Unless a phase is given, phases are assigned so that the estimated per-cycle load is as even as
+	// possible; tasks are replanned when tasks are added or removed, or when the cycle time changes.
+	// costUS is the initial cost estimate; "runloop tasks rebalance" replans with measured costs.
+	// name must point to static storage.
+	Result addTask(Subsystem* owner, const char* name, float rateHz, std::function<void(void)> fn, unsigned long costUS = 0, int phase = PHASE_AUTO);
+	Result removeTask(Subsystem* owner, const char* name);
+	void rebalanceTasks(bool useMeasuredCost = false);
+	//! Worst-case estimated task load over all cycles, as planned by the last rebalanceTasks().
+	unsigned long plannedWorstCaseTaskLoadMicros() { return plannedWorstLoad_; }
+	void printTasks(ConsoleStream* stream);
+
+	// Idle tasks. Low priority background work that runs in the slack between the end of a cycle and the next
+	// deadline, instead of in step() with excuseOverrun(). fn does one bounded chunk of work per call and returns
+	// true while there is more to do; once it returns false, the task is removed. A chunk is only started if there is
+	// at least chunkMicros (or what the last chunk actually took, if that was longer) left until the deadline.
+	// If maxWaitMillis is not 0 and the task has not been able to run for that long, it runs anyway, even if that
+	// makes the cycle overrun - use for chunks that will never fit into the slack. Idle tasks run round robin.
+	Result addIdleTask(const char* name, uint32_t chunkMicros, std::function<bool(void)> fn, uint32_t maxWaitMillis = 0);
+	size_t numIdleTasks() { return idleTasks_.size(); }
 
 protected:
+	struct Task {
+		Subsystem* owner;
+		const char* name;
+		float rateHz;
+		unsigned long costUS;
+		int fixedPhase;
+		unsigned int divider, phase;
+		std::function<void()> fn;
+		TimingStats timing;
+	};
+
+	static const unsigned int MAX_HYPERPERIOD = 1024;
+
+	void runTasks(Subsystem* owner);
+	void waitForNextCycle();
+	std::vector<Task> tasks_;
+	unsigned long plannedWorstLoad_;
+
+	struct IdleTask {
+		const char* name;
+		uint32_t chunkUS, lastChunkUS, maxWaitMS, lastRunMS;
+		std::function<bool()> fn;
+	};
+	void runIdleTasks(uint32_t until);
+	std::vector<IdleTask> idleTasks_;
+	size_t nextIdleTask_;
+	uint32_t idleChunks_, starvedIdleChunks_;
 
 	struct TimedCallback {
-		uint64_t triggerMS, deltaMS;
+		TimedCallbackHandle handle; // 0 if slot is free
+		uint32_t deltaMS;
 		bool oneshot;
 		std::function<void()> cb;
 	};
 
-	std::vector<TimedCallback> timedCallbacks_;
+	struct TimedCallbackDeadline {
+		uint32_t triggerMS;
+		TimedCallbackHandle handle;
+	};
+
+	// Ordering on the heap, and "is it due" test - both wrap-safe.
+	static bool deadlineLater(const TimedCallbackDeadline& a, const TimedCallbackDeadline& b) { return int32_t(a.triggerMS - b.triggerMS) > 0; }
+	static bool deadlineDue(uint32_t triggerMS, uint32_t now) { return int32_t(now - triggerMS) >= 0; }
+	void runTimedCallbacks(uint32_t now);
+	void compactTimedCallbackHeap();
 
+	std::vector<TimedCallback> timedCallbacks_;       // slots, indexed by the lower 16 bits of the handle
+	std::vector<uint16_t> freeTimedCallbacks_;        // free slot indices
+	std::vector<TimedCallbackDeadline> deadlines_;    // min-heap on triggerMS; cancelled entries are dropped lazily
+	uint16_t timedCallbackGeneration_;
 
 	Runloop();
+	Result cmdRunningStatus(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdSuppressOverrun(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdOverrunPolicy(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdTiming(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdTasks(const ConsoleWords& words, ConsoleStream *stream);
+	static const CommandDef COMMANDS[];
+
 	bool running_;
 	unsigned long seqnum_;
 	unsigned long cycleTime_;
 	unsigned long startTime_;
 	bool runningStatus_, suppressOverrun_;
 	bool excuseOverrun_;
+	TimingStats loopTiming_;
+	TimeSource* timeSource_;
+
+	// Cycles are scheduled on an absolute grid, so errors in a single wait don't add up to drift.
+	OverrunPolicy overrunPolicy_;
+	bool deadlineValid_;
+	uint32_t deadline_;       // scheduled start of the current cycle
+	uint32_t lastCycleStart_;
+	TimingStats periodTiming_;
+	uint32_t maxPeriodJitter_, skippedCycles_;
+
+	SyncMode syncMode_;
+	volatile bool triggered_;
+	uint32_t syncTimeouts_;
 };
 
 };
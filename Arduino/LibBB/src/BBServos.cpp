@@ -1,3 +1,5 @@
+#if !defined(ARDUINO_ARCH_NATIVE) // hardware-only, not part of the host build
+
 #include <Wire.h>
 #include <LibBB.h>
 
@@ -44,6 +46,7 @@ float bb::ServoControlOutput::present() {
 }
 
 bb::Servos::Servos() {
+  setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
   infoXelsSrPresent = NULL;
   infoXelsSrLoad = NULL;
   infoXelsSwGoal = NULL;
@@ -245,99 +248,116 @@ Result bb::Servos::step() {
   return RES_OK;
 }
 
-Result bb::Servos::handleConsoleCommand(const std::vector<String>& words, ConsoleStream* stream) {
+const bb::Subsystem::CommandDef bb::Servos::COMMANDS[] = {
+  command("move",             2, 2, &Servos::cmdMove),
+  command("set_vel",          2, 2, &Servos::cmdSetVel),
+  command("set_goal_current", 2, 2, &Servos::cmdSetGoalCurrent),
+  command("home",             1, 1, &Servos::cmdHome),
+  command("torque",           2, 2, &Servos::cmdTorque),
+  command("info",             1, 1, &Servos::cmdInfo),
+  command("reboot",           1, 1, &Servos::cmdReboot)
+};
+
+Result bb::Servos::cmdMove(const ConsoleWords& words, ConsoleStream* stream) {
   (void)stream;
-  if (words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
+  unsigned int id = words[1] == "all" ? ID_ALL : words[1].toInt();
+  float angle = words[2].toFloat();
+  if(angle < 0 || angle > 360.0) return RES_CMD_INVALID_ARGUMENT;
+  if(setGoal(id, angle)) return RES_OK;
+  return RES_CMD_INVALID_ARGUMENT;
+}
 
-  if (words[0] == "move") {
-    if (words.size() != 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    unsigned int id = words[1] == "all" ? ID_ALL : words[1].toInt();
-    float angle = words[2].toFloat();
-    if(angle < 0 || angle > 360.0) return RES_CMD_INVALID_ARGUMENT;
-    if(setGoal(id, angle)) return RES_OK;
-    return RES_CMD_INVALID_ARGUMENT;
-  }
+Result bb::Servos::cmdSetVel(const ConsoleWords& words, ConsoleStream* stream) {
+  (void)stream;
+  unsigned int id = words[1] == "all" ? ID_ALL : words[1].toInt();
+  float vel = words[2].toFloat();
+  if(vel < 0) return RES_CMD_INVALID_ARGUMENT;
+  if(setProfileVelocity(id, vel)) return RES_OK;
+  return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if (words[0] == "set_vel") {
-    if (words.size() != 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    unsigned int id = words[1] == "all" ? ID_ALL : words[1].toInt();
-    float vel = words[2].toFloat();
-    if(vel < 0) return RES_CMD_INVALID_ARGUMENT;
-    if(setProfileVelocity(id, vel)) return RES_OK;
-    return RES_CMD_INVALID_ARGUMENT;
-  }
+Result bb::Servos::cmdSetGoalCurrent(const ConsoleWords& words, ConsoleStream* stream) {
+  (void)stream;
+  unsigned int id = words[1] == "all" ? ID_ALL : words[1].toInt();
+  int current = words[2].toInt();
+  if(current < 0 || current > 100) return RES_CMD_INVALID_ARGUMENT;
+  if(setCompliantMode(id, current)) return RES_OK;
+  return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if (words[0] == "set_goal_current") {
-    if (words.size() != 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    unsigned int id = words[1] == "all" ? ID_ALL : words[1].toInt();
-    int current = words[2].toInt();
-    if(current < 0 || current > 100) return RES_CMD_INVALID_ARGUMENT;
-    if(setCompliantMode(id, current)) return RES_OK;
-    return RES_CMD_INVALID_ARGUMENT;
-  }
+Result bb::Servos::cmdHome(const ConsoleWords& words, ConsoleStream* stream) {
+  if(words[1] == "all") return home(ID_ALL, SLOW_VEL, 50, stream);
+  else return home(words[1].toInt(), SLOW_VEL, 50, stream);
+}
 
-  else if (words[0] == "home") {
-    if (words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
+Result bb::Servos::cmdTorque(const ConsoleWords& words, ConsoleStream* stream) {
+  (void)stream;
+  uint8_t id;
+  if (words[1] == "all") id = ID_ALL;
+  else id = words[1].toInt();
+  return switchTorque(id, words[2] == "on" ? true : false);
+}
 
-    if(words[1] == "all") return home(ID_ALL, SLOW_VEL, 50, stream);
-    else return home(words[1].toInt(), SLOW_VEL, 50, stream);
+Result bb::Servos::cmdInfo(const ConsoleWords& words, ConsoleStream* stream) {
+  Runloop::runloop.excuseOverrun();
+  if(words[1] == "all") {
+    for(auto& s: servos_) printStatus(stream, s.id);
+    return RES_OK;
   }
+  int id = words[1].toInt();
+  printStatus(stream, id);
+  return RES_OK;
+}
 
-  else if (words[0] == "torque") {
-    if (words.size() != 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    uint8_t id;
-    if (words[1] == "all") id = ID_ALL;
-    else id = words[1].toInt();
-    return switchTorque(id, words[2] == "on" ? true : false);
+Result bb::Servos::cmdReboot(const ConsoleWords& words, ConsoleStream* stream) {
+  Runloop::runloop.excuseOverrun();
+  if(words[1] == "all") {
+    for (auto& s : servos_) {
+      if (stream) {
+        stream->printf("Rebooting %d... ", s.id);
+      }
+      dxl_.reboot(s.id);
+    }
+  } else {
+    uint8_t id = words[1].toInt();
+    if(servoWithID(id) == NULL) return RES_CMD_INVALID_ARGUMENT;
+    dxl_.reboot(id);
   }
 
-  else if (words[0] == "info") {
-    Runloop::runloop.excuseOverrun();
+  delay(1000);
 
-    if (words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words[1] == "all") {
-      for(auto& s: servos_) printStatus(stream, s.id);
-      return RES_OK;
-    }
-    int id = words[1].toInt();
-    printStatus(stream, id);
-    return RES_OK;
-  }
+  return RES_OK;
+}
 
-  else if (words[0] == "reboot") {
-    Runloop::runloop.excuseOverrun();
+Result bb::Servos::handleConsoleCommand(const ConsoleWords& words, ConsoleStream* stream) {
+  if (words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
 
-    if (words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words[1] == "all") {
-      for (auto& s : servos_) {
-        if (stream) {
-          stream->printf("Rebooting %d... ", s.id);
-        }
-        dxl_.reboot(s.id);
-      }
-    } else {
-      uint8_t id = words[1].toInt();
-      if(servoWithID(id) == NULL) return RES_CMD_INVALID_ARGUMENT;
-      dxl_.reboot(id);
+  for(int i=0; i<strToCtrlTableLen_; i++) {
+    if(words[0] == strToCtrlTable_[i].str) {
+      return handleCtrlTableCommand(strToCtrlTable_[i].idx, words, stream);
     }
+  }
 
-    delay(1000);
+  return bb::Subsystem::handleConsoleCommand(words, stream);
+}
 
-    return RES_OK;
-  }
+Result bb::Servos::checkCondition(const ConsoleWords& words, bool& met) {
+  if(words.size() == 0 || words[0] != "idle") return bb::Subsystem::checkCondition(words, met);
+  if(words.size() > 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
 
-  else {
-    for(int i=0; i<strToCtrlTableLen_; i++) {
-      if(words[0] == strToCtrlTable_[i].str) {
-        return handleCtrlTableCommand(strToCtrlTable_[i].idx, words, stream);
-      }
+  uint32_t tolerance = computeRawValue(words.size() == 2 ? words[1].toFloat() : 2.0f);
+  met = true;
+  for(auto& s: servos_) {
+    uint32_t diff = s.present > s.goal ? s.present - s.goal : s.goal - s.present;
+    if(diff > tolerance) {
+      met = false;
+      break;
     }
   }
-
-  return bb::Subsystem::handleConsoleCommand(words, stream);
+  return RES_OK;
 }
 
-Result bb::Servos::handleCtrlTableCommand(ControlTableItem::ControlTableItemIndex idx, const std::vector<String>& words, ConsoleStream* stream) {
+Result bb::Servos::handleCtrlTableCommand(ControlTableItem::ControlTableItemIndex idx, const ConsoleWords& words, ConsoleStream* stream) {
   if (words.size() < 2 || words.size() > 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
   int id = words[1].toInt();
   if (words.size() == 2) {
@@ -832,3 +852,5 @@ Result bb::Servos::syncWriteInfo(ConsoleStream* stream) {
 
   return RES_OK;
 }
+
+#endif // !ARDUINO_ARCH_NATIVE
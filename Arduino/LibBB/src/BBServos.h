@@ -34,8 +34,11 @@ public:
 	virtual Result start(ConsoleStream *stream = NULL);
 	virtual Result stop(ConsoleStream *stream = NULL);
 	virtual Result step();
-  virtual Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream);
-  Result handleCtrlTableCommand(ControlTableItem::ControlTableItemIndex idx, const std::vector<String>& words, ConsoleStream *stream);
+  //! Control table items (see strToCtrlTable_) are commands, too.
+  virtual Result handleConsoleCommand(const ConsoleWords& words, ConsoleStream *stream);
+  //! "idle [<tolerance>]": every servo is within tolerance degrees (default 2) of its goal.
+  virtual Result checkCondition(const ConsoleWords& words, bool& met);
+  Result handleCtrlTableCommand(ControlTableItem::ControlTableItemIndex idx, const ConsoleWords& words, ConsoleStream *stream);
 
   void setRequiredIds(const std::vector<uint8_t>& ids) { requiredIds_ = ids; }
 
@@ -76,6 +79,14 @@ public:
 
 protected:
   Servos();
+  Result cmdMove(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSetVel(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSetGoalCurrent(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdHome(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdTorque(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdInfo(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdReboot(const ConsoleWords& words, ConsoleStream *stream);
+  static const CommandDef COMMANDS[];
   DynamixelShield dxl_;
 
   struct Servo {
@@ -0,0 +1,107 @@
+#include "BBStorageBackend.h"
+
+#if defined(ARDUINO_ARCH_RP2040)
+#include <EEPROM.h>
+static const size_t EEPROM_SIZE=1024;
+#elif defined(ARDUINO_ARCH_SAMD)
+#include <FlashAsEEPROM.h>
+static const size_t EEPROM_SIZE=EEPROM_EMULATION_SIZE;
+#elif defined(ARDUINO_ARCH_NATIVE)
+#include <EEPROM.h>
+#include <unistd.h>
+static const size_t EEPROM_SIZE=1024;
+#endif
+
+#if !defined(ARDUINO_ARCH_ESP32)
+bb::EEPROMStorageBackend bb::EEPROMStorageBackend::eeprom;
+
+void bb::EEPROMStorageBackend::begin() {
+	if(begun_) return;
+#if defined(ARDUINO_NANO_RP2040_CONNECT)
+	EEPROM.begin(EEPROM_SIZE);
+#endif
+	begun_ = true;
+}
+
+size_t bb::EEPROMStorageBackend::size() {
+	return EEPROM_SIZE;
+}
+
+uint8_t bb::EEPROMStorageBackend::read(size_t addr) {
+	begin();
+	return EEPROM.read(addr);
+}
+
+void bb::EEPROMStorageBackend::write(size_t addr, uint8_t val) {
+	begin();
+	if(EEPROM.read(addr) != val) EEPROM.write(addr, val);
+}
+
+bb::Result bb::EEPROMStorageBackend::commit() {
+	begin();
+	EEPROM.commit();
+	return RES_OK;
+}
+#endif // !ARDUINO_ARCH_ESP32
+
+#if defined(ARDUINO_ARCH_NATIVE)
+bb::FileStorageBackend::FileStorageBackend(const char* path, size_t size) {
+	size_ = size;
+	mem_ = new uint8_t[size];
+	writeCounts_ = new unsigned long[size];
+	memset(mem_, 0xff, size);
+	memset(writeCounts_, 0, size*sizeof(unsigned long));
+	dirtyFrom_ = size;
+	dirtyTo_ = 0;
+	failAfter_ = SIZE_MAX;
+	powerLost_ = false;
+
+	file_ = fopen(path, "r+b");
+	if(file_ != NULL) {
+		size_t len = fread(mem_, 1, size, file_);
+		(void)len; // a short file is padded with 0xff
+	} else {
+		file_ = fopen(path, "w+b");
+		if(file_ != NULL) {
+			fwrite(mem_, 1, size, file_);
+			fflush(file_);
+		}
+	}
+}
+
+bb::FileStorageBackend::~FileStorageBackend() {
+	if(file_ != NULL) fclose(file_);
+	delete[] mem_;
+	delete[] writeCounts_;
+}
+
+void bb::FileStorageBackend::write(size_t addr, uint8_t val) {
+	if(addr >= size_ || mem_[addr] == val) return;
+	mem_[addr] = val;
+	if(addr < dirtyFrom_) dirtyFrom_ = addr;
+	if(addr + 1 > dirtyTo_) dirtyTo_ = addr + 1;
+}
+
+bb::Result bb::FileStorageBackend::commit() {
+	if(file_ == NULL || powerLost_) return RES_CONFIG_WRITE_FAILED;
+	if(dirtyFrom_ >= dirtyTo_) return RES_OK;
+
+	size_t len = dirtyTo_ - dirtyFrom_;
+	bool fail = failAfter_ < len;
+	if(fail) len = failAfter_;
+
+	fseek(file_, dirtyFrom_, SEEK_SET);
+	if(fwrite(mem_ + dirtyFrom_, 1, len, file_) != len) return RES_CONFIG_WRITE_FAILED;
+	fflush(file_);
+	fsync(fileno(file_));
+	for(size_t i=dirtyFrom_; i<dirtyFrom_+len; i++) writeCounts_[i]++;
+
+	dirtyFrom_ = size_;
+	dirtyTo_ = 0;
+	if(fail) {
+		powerLost_ = true;
+		return RES_CONFIG_WRITE_FAILED;
+	}
+	return RES_OK;
+}
+#endif // ARDUINO_ARCH_NATIVE
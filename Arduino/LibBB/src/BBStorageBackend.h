@@ -0,0 +1,85 @@
+#if !defined(BBSTORAGEBACKEND_H)
+#define BBSTORAGEBACKEND_H
+
+#include <Arduino.h>
+#include "BBError.h"
+
+namespace bb {
+
+/*!
+	\brief Raw persistent memory that ConfigStorage keeps its journal in.
+
+	Byte addressed. write()s are buffered and only become persistent with commit(), which must write the changed bytes
+	in ascending address order - ConfigStorage relies on that to tell complete transactions from torn ones after a
+	power loss.
+*/
+class StorageBackend {
+public:
+	virtual ~StorageBackend() {}
+
+	virtual size_t size() = 0;
+	virtual uint8_t read(size_t addr) = 0;
+	virtual void write(size_t addr, uint8_t val) = 0;
+	virtual Result commit() = 0;
+};
+
+#if !defined(ARDUINO_ARCH_ESP32)
+/*!
+	\brief Backend on top of the Arduino EEPROM (or EEPROM emulation) API. The default on everything but ESP32.
+
+	Note that on SAMD, the EEPROM emulation erases and rewrites its whole flash area on every commit.
+*/
+class EEPROMStorageBackend: public StorageBackend {
+public:
+	static EEPROMStorageBackend eeprom;
+
+	virtual size_t size();
+	virtual uint8_t read(size_t addr);
+	virtual void write(size_t addr, uint8_t val);
+	virtual Result commit();
+
+protected:
+	EEPROMStorageBackend(): begun_(false) {}
+	void begin();
+	bool begun_;
+};
+#endif
+
+#if defined(ARDUINO_ARCH_NATIVE)
+/*!
+	\brief File backed storage for the host build, with power loss simulation.
+
+	The file is created (erased, i.e. all 0xff) if it doesn't exist. commit() writes the changed range to the file
+	front to back, like flash would be programmed.
+*/
+class FileStorageBackend: public StorageBackend {
+public:
+	FileStorageBackend(const char* path, size_t size);
+	virtual ~FileStorageBackend();
+
+	virtual size_t size() { return size_; }
+	virtual uint8_t read(size_t addr) { return addr < size_ ? mem_[addr] : 0xff; }
+	virtual void write(size_t addr, uint8_t val);
+	virtual Result commit();
+
+	//! Simulates losing power during the next commit(): only the first bytes of its changes reach the file, and
+	//! commit() fails. Everything written afterwards is lost, too - construct a new backend on the file to "reboot".
+	void failCommitAfter(size_t bytes) { failAfter_ = bytes; }
+	bool powerLost() { return powerLost_; }
+	//! Number of bytes written to the file so far, per address - for wear statistics.
+	unsigned long writeCount(size_t addr) { return addr < size_ ? writeCounts_[addr] : 0; }
+
+protected:
+	FILE* file_;
+	size_t size_;
+	uint8_t* mem_;
+	unsigned long* writeCounts_;
+	size_t dirtyFrom_, dirtyTo_;
+	size_t failAfter_;
+	bool powerLost_;
+};
+#endif
+
+};
+
+#endif // BBSTORAGEBACKEND_H
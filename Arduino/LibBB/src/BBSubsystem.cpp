@@ -1,5 +1,6 @@
 #include "BBSubsystem.h"
 #include "BBConsole.h"	
+#include "BBPacket.h"
 
 #if defined(ARDUINO_ARCH_RP2040)
 #include <EEPROM.h>
@@ -18,9 +19,9 @@ bb::Result bb::SubsystemManager::registerSubsystem(Subsystem* subsys) {
 	return RES_OK;
 }
 	
-bb::Subsystem* bb::SubsystemManager::subsystemWithName(const String& name) {
+bb::Subsystem* bb::SubsystemManager::subsystemWithName(const char* name) {
 	for(size_t i=0; i<subsys_.size(); i++) {
-		if(name == subsys_[i]->name()) return subsys_[i];
+		if(!strcmp(name, subsys_[i]->name())) return subsys_[i];
 	}
 	return NULL;
 }
@@ -29,58 +30,146 @@ const std::vector<bb::Subsystem*>& bb::SubsystemManager::subsystems() {
 	return subsys_;
 }
 
-bb::Result bb::Subsystem::handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream) {
-	if(words[0] == "help") {
-		if(words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		printHelp(stream);
-		return RES_OK;
-	} 
-
-	else if(words[0] == "status") {
-		if(words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		printExtendedStatus(stream);
-		return RES_OK;
-	} 
-
-	else if(words[0] == "start") {
-		if(words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		if(isStarted()) stream->printf("%s is already running.", name());
-		else {
-			stream->printf("Starting %s...", name());
-			stream->printf(errorMessage(start(stream)));
-			stream->printf("\n");
-		}
-		return RES_OK;
-	} 
-
-	else if(words[0] == "stop") {
-		if(words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		if(!isStarted()) stream->printf("%s is not running.", name());
-		else {
-			stream->printf("Stopping %s...", name());
-			stream->printf(errorMessage(stop(stream)));
-			stream->printf("\n");
+size_t bb::SubsystemManager::handleParameterBlock(uint8_t* buf, size_t len, size_t maxLen) {
+	if(len < sizeof(ParamBlockHeader) || maxLen < len) return 0;
+	ParamBlockHeader* header = (ParamBlockHeader*)buf;
+	ParamEntry* entries = (ParamEntry*)(buf + sizeof(ParamBlockHeader));
+	if(header->magic != PARAM_BLOCK_MAGIC || (header->op & PARAM_OP_REPLY) != 0) return 0;
+	if(len != sizeof(ParamBlockHeader) + header->numEntries*sizeof(ParamEntry)) return 0;
+	uint16_t crc = header->crc;
+	header->crc = 0;
+	if(calculateCRC16(buf, len) != crc) return 0;
+
+	// The subsystem field is not necessarily NUL terminated.
+	Subsystem* subsys = NULL;
+	size_t nameLen = 0;
+	while(nameLen < sizeof(header->subsystem) && header->subsystem[nameLen] != '\0') nameLen++;
+	for(auto s: subsys_) {
+		if(strlen(s->name()) == nameLen && !strncmp(s->name(), header->subsystem, nameLen)) {
+			subsys = s;
+			break;
 		}
-		return RES_OK;
-	} 
-
-	else if(words[0] == "get") {
-		if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		for(auto& p: parameters_) {
-			if(p->name() == words[1]) {
-				p->print(stream);
-				return RES_OK;
-			}
+	}
+
+	uint8_t op = header->op;
+	header->op |= PARAM_OP_REPLY;
+	header->result = RES_OK;
+	header->total = subsys != NULL ? subsys->numParameters() : 0;
+
+	if(header->version != PARAM_BLOCK_VERSION) {
+		header->version = PARAM_BLOCK_VERSION;
+		header->result = RES_SUBSYS_PROTOCOL_ERROR;
+		header->numEntries = 0;
+	} else if(subsys == NULL) {
+		header->result = RES_SUBSYS_NO_SUCH_SUBSYS;
+		header->numEntries = 0;
+	} else if(op == PARAM_OP_GET) {
+		for(unsigned int i=0; i<header->numEntries; i++) subsys->getParameterEntry(entries[i]);
+	} else if(op == PARAM_OP_SET || op == PARAM_OP_SET_AND_STORE) {
+		for(unsigned int i=0; i<header->numEntries; i++) subsys->setParameterEntry(entries[i]);
+		if(op == PARAM_OP_SET_AND_STORE) {
+			// Once for the whole block, not once per parameter.
+			header->result = ConfigStorage::storage.writeAll();
+			if(header->result == RES_OK) header->result = ConfigStorage::storage.commit();
 		}
-		return RES_PARAM_NO_SUCH_PARAMETER;
+	} else if(op == PARAM_OP_LIST) {
+		unsigned int num = (maxLen - sizeof(ParamBlockHeader)) / sizeof(ParamEntry);
+		if(header->numEntries != 0 && header->numEntries < num) num = header->numEntries;
+		if(header->first >= header->total) num = 0;
+		else if(header->first + num > header->total) num = header->total - header->first;
+		for(unsigned int i=0; i<num; i++) subsys->getParameterEntryAt(header->first + i, entries[i]);
+		header->numEntries = num;
+	} else {
+		header->result = RES_CMD_UNKNOWN_COMMAND;
+		header->numEntries = 0;
+	}
+
+	len = sizeof(ParamBlockHeader) + header->numEntries*sizeof(ParamEntry);
+	header->crc = calculateCRC16(buf, len);
+	return len;
+}
+
+const bb::Subsystem::CommandDef bb::Subsystem::COMMON_COMMANDS[] = {
+	command("help",   0, 0, &Subsystem::cmdHelp),
+	command("status", 0, 0, &Subsystem::cmdStatus),
+	command("start",  0, 0, &Subsystem::cmdStart),
+	command("stop",   0, 0, &Subsystem::cmdStop),
+	command("get",    1, 1, &Subsystem::cmdGet),
+	command("set",    2, 2, &Subsystem::cmdSet)
+};
+
+const bb::Subsystem::CommandDef* bb::Subsystem::findCommand(const CommandDef* table, size_t size, const ConsoleWord& name) {
+	for(size_t i=0; i<size; i++) {
+		if(name == table[i].name) return &table[i];
+	}
+	return NULL;
+}
+
+bb::Result bb::Subsystem::runCommand(const CommandDef& cmd, const ConsoleWords& words, ConsoleStream* stream) {
+	if(words.size() - 1 < cmd.minArgs || words.size() - 1 > cmd.maxArgs) return RES_CMD_INVALID_ARGUMENT_COUNT;
+	return (this->*cmd.handler)(words, stream);
+}
+
+bb::Result bb::Subsystem::handleConsoleCommand(const ConsoleWords& words, ConsoleStream *stream) {
+	if(words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
+
+	const CommandDef* cmd = findCommand(cmdTable_, cmdTableSize_, words[0]);
+	if(cmd == NULL) cmd = findCommand(COMMON_COMMANDS, sizeof(COMMON_COMMANDS)/sizeof(COMMON_COMMANDS[0]), words[0]);
+	if(cmd == NULL) return RES_CMD_UNKNOWN_COMMAND;
+	return runCommand(*cmd, words, stream);
+}
+
+bb::Result bb::Subsystem::checkCondition(const ConsoleWords& words, bool& met) {
+	if(words.size() == 0 || (words[0] != "started" && words[0] != "stopped")) return RES_CMD_UNKNOWN_COMMAND;
+	if(words.size() != 1) return RES_CMD_INVALID_ARGUMENT_COUNT;
+	met = words[0] == "started" ? isStarted() : !isStarted();
+	return RES_OK;
+}
+
+bb::Result bb::Subsystem::cmdHelp(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	printHelp(stream);
+	return RES_OK;
+}
+
+bb::Result bb::Subsystem::cmdStatus(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	printExtendedStatus(stream);
+	return RES_OK;
+}
+
+bb::Result bb::Subsystem::cmdStart(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	if(isStarted()) stream->printf("%s is already running.", name());
+	else {
+		stream->printf("Starting %s...", name());
+		stream->printf(errorMessage(start(stream)));
+		stream->printf("\n");
 	}
+	return RES_OK;
+}
 
-	else if(words[0] == "set") {
-		if(words.size() != 3) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		return setParameterValue(words[1], words[2]);
+bb::Result bb::Subsystem::cmdStop(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	if(!isStarted()) stream->printf("%s is not running.", name());
+	else {
+		stream->printf("Stopping %s...", name());
+		stream->printf(errorMessage(stop(stream)));
+		stream->printf("\n");
 	}
+	return RES_OK;
+}
+
+bb::Result bb::Subsystem::cmdGet(const ConsoleWords& words, ConsoleStream *stream) {
+	const ParameterDef* p = findParameter(words[1].c_str());
+	if(p == NULL) return RES_PARAM_NO_SUCH_PARAMETER;
+	printParameter(*p, stream);
+	return RES_OK;
+}
 
-	return RES_CMD_UNKNOWN_COMMAND;
+bb::Result bb::Subsystem::cmdSet(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)stream;
+	return setParameterValue(words[1].c_str(), words[2].c_str());
 }
 
 bb::Result bb::Subsystem::initialize() { 
@@ -120,8 +209,8 @@ void bb::Subsystem::printExtendedStatus(ConsoleStream* stream) {
 }
 
 void bb::Subsystem::printHelp(ConsoleStream* stream) {
-	stream->printf(help());
-	if(parameters_.size()) {
+	stream->printfFinal(help());
+	if(numParameters()) {
 		stream->printf("Parameters:\n");
 		printParameters(stream);
 	} else {
@@ -130,60 +219,276 @@ void bb::Subsystem::printHelp(ConsoleStream* stream) {
 }
 
 void bb::Subsystem::printParameters(ConsoleStream* stream) {
-	for(auto &p: parameters_) {
-		p->print(stream);
-	}	
+	for(size_t i=0; i<paramTableSize_; i++) {
+		printParameter(paramTable_[i], stream);
+	}
+	for(auto& p: parameters_) {
+		printParameter(p, stream);
+	}
 }
 
-bb::Subsystem::Parameter* bb::Subsystem::findParameter(const String& name) {
-	for(auto p: parameters_) {
-		if(p->name() == name) return p;
+void bb::Subsystem::printParameter(const ParameterDef& p, ConsoleStream* stream) {
+	if(stream == NULL) return;
+	switch(p.type) {
+	case PARAMETER_INT:
+		stream->printf("%s: %d [", p.name, *(int*)p.value);
+		break;
+	case PARAMETER_UINT:
+		stream->printf("%s: %u [", p.name, *(unsigned int*)p.value);
+		break;
+	case PARAMETER_FLOAT:
+		stream->printf("%s: %g [", p.name, *(float*)p.value);
+		break;
+	case PARAMETER_BOOL:
+		stream->printf("%s: %s", p.name, *(bool*)p.value ? "true" : "false");
+		break;
+	case PARAMETER_STRING:
+		stream->printf("%s: %s", p.name, ((String*)p.value)->c_str());
+		if(p.max != 0) stream->printf(" (max length %d)", int(p.max));
+		break;
+	}
+
+	if(p.type == PARAMETER_INT || p.type == PARAMETER_UINT || p.type == PARAMETER_FLOAT) {
+		if(p.min <= -INT_MAX) stream->printf("-inf"); else stream->printf("%g", p.min);
+		stream->printf("..");
+		if(p.max >= INT_MAX) stream->printf("inf]"); else stream->printf("%g]", p.max);
 	}
+
+	if(p.help != NULL && p.help[0] != '\0') stream->printf(": %s\n", p.help);
+	else stream->printf("\n");
+}
+
+const bb::Subsystem::ParameterDef* bb::Subsystem::findParameter(const char* name) {
+	const ParameterDef* p = findParameterByHash(hashParameterName(name));
+	if(p != NULL && !strcmp(p->name, name)) return p;
 	return NULL;
 }
 
-bb::Result bb::Subsystem::addParameter(const String& name, const String& help, int& val, int min, int max) {
-	if(findParameter(name) != NULL) return RES_COMMON_DUPLICATE_IN_LIST;
-	parameters_.push_back(new IntParameter(name, val, help, min, max));
-	return RES_OK;
+const bb::Subsystem::ParameterDef* bb::Subsystem::findParameterByHash(uint32_t hash) {
+	if(paramIndex_.size() != 0) {
+		size_t mask = paramIndex_.size() - 1;
+		for(size_t i = hash & mask; paramIndex_[i] != 0; i = (i+1) & mask) {
+			const ParameterDef& p = paramTable_[paramIndex_[i]-1];
+			if(p.hash == hash) return &p;
+		}
+	}
+	for(auto& p: parameters_) {
+		if(p.hash == hash) return &p;
+	}
+	return NULL;
 }
 
-bb::Result bb::Subsystem::addParameter(const String& name, const String& help, unsigned int& val, int max) {
-	if(findParameter(name) != NULL) return RES_COMMON_DUPLICATE_IN_LIST;
-	parameters_.push_back(new UIntParameter(name, val, help, max));
+bb::Result bb::Subsystem::setParameterTable(const ParameterDef* table, size_t size) {
+	if(size > 254) return RES_COMMON_OUT_OF_RANGE;
+	size_t slots = 1;
+	while(slots < 2*size) slots <<= 1;
+
+	paramTable_ = table;
+	paramTableSize_ = size;
+	paramIndex_.assign(slots, 0);
+	for(size_t i=0; i<size; i++) {
+		if(findParameterByHash(table[i].hash) != NULL) {
+			paramTable_ = NULL;
+			paramTableSize_ = 0;
+			paramIndex_.clear();
+			return RES_COMMON_DUPLICATE_IN_LIST;
+		}
+		size_t slot = table[i].hash & (slots-1);
+		while(paramIndex_[slot] != 0) slot = (slot+1) & (slots-1);
+		paramIndex_[slot] = i+1;
+	}
 	return RES_OK;
 }
 
-bb::Result bb::Subsystem::addParameter(const String& name, const String& help, float& val, float min, float max) {
-	if(findParameter(name) != NULL) return RES_COMMON_DUPLICATE_IN_LIST;
-	parameters_.push_back(new FloatParameter(name, val, help, min, max));
+bb::Result bb::Subsystem::insertParameter(const ParameterDef& def) {
+	if(findParameterByHash(def.hash) != NULL) return RES_COMMON_DUPLICATE_IN_LIST;
+	parameters_.push_back(def);
 	return RES_OK;
 }
 
-bb::Result bb::Subsystem::addParameter(const String& name, const String& help, String& val, int maxlen) {
-	if(findParameter(name) != NULL) return RES_COMMON_DUPLICATE_IN_LIST;
-	parameters_.push_back(new StringParameter(name, val, help, maxlen));
-	return RES_OK;
+bb::Result bb::Subsystem::addParameter(const char* name, const char* help, int& val, int min, int max) {
+	return insertParameter(parameter(name, help, val, min, max));
 }
 
-bb::Result bb::Subsystem::addParameter(const String& name, const String& help, bool& val) {
-	if(findParameter(name) != NULL) return RES_COMMON_DUPLICATE_IN_LIST;
-	parameters_.push_back(new BoolParameter(name, val, help));
-	return RES_OK;	
+bb::Result bb::Subsystem::addParameter(const char* name, const char* help, unsigned int& val, int max) {
+	return insertParameter(parameter(name, help, val, max));
 }
 
+bb::Result bb::Subsystem::addParameter(const char* name, const char* help, float& val, float min, float max) {
+	return insertParameter(parameter(name, help, val, min, max));
+}
+
+bb::Result bb::Subsystem::addParameter(const char* name, const char* help, String& val, int maxlen) {
+	return insertParameter(parameter(name, help, val, maxlen));
+}
 
-bb::Result bb::Subsystem::setParameterValue(const String& name, const String& stringval) {
-	Parameter* p = findParameter(name);
+bb::Result bb::Subsystem::addParameter(const char* name, const char* help, bool& val) {
+	return insertParameter(parameter(name, help, val));
+}
+
+bb::Result bb::Subsystem::setParameterValue(const char* name, const char* str) {
+	const ParameterDef* p = findParameter(name);
 	if(p == NULL) return RES_PARAM_NO_SUCH_PARAMETER;
-	bb::Result retval = p->fromString(stringval);
-	if(retval == RES_OK) {
-		parameterChangedCallback(name);
+	ConsoleWord stringval(str, strlen(str));
+
+	bb::Result retval = RES_OK;
+	switch(p->type) {
+	case PARAMETER_INT:
+		retval = setParameter(p->name, int(stringval.toInt()));
+		break;
+	case PARAMETER_UINT:
+		if(stringval.toInt() < 0) return RES_COMMON_OUT_OF_RANGE;
+		retval = setParameter(p->name, (unsigned int)stringval.toInt());
+		break;
+	case PARAMETER_FLOAT:
+		retval = setParameter(p->name, stringval.toFloat());
+		break;
+	case PARAMETER_BOOL:
+		if(stringval == "true" || stringval == "yes" || stringval == "1") retval = setParameter(p->name, true);
+		else if(stringval == "false" || stringval == "no" || stringval == "0") retval = setParameter(p->name, false);
+		else retval = RES_COMMON_OUT_OF_RANGE;
+		break;
+	case PARAMETER_STRING:
+		if(p->max != 0 && stringval.length() > p->max) return RES_COMMON_OUT_OF_RANGE;
+		*(String*)p->value = str;
+		parameterChangedCallback(p->name);
+		break;
 	}
 	return retval;
 }
 
-void bb::Subsystem::Parameter::print(ConsoleStream* stream) {
-	if(stream) stream->printf("%s: %s\n", name_.c_str(), description().c_str());
+template<class T> static bb::Result getTyped(const bb::Subsystem::ParameterDef* p, bb::Subsystem::ParameterType type, T& val) {
+	if(p == NULL) return bb::RES_PARAM_NO_SUCH_PARAMETER;
+	if(p->type != type) return bb::RES_PARAM_INVALID_TYPE;
+	val = *(T*)p->value;
+	return bb::RES_OK;
 }
 
+bb::Result bb::Subsystem::getParameter(const char* name, int& val) {
+	return getTyped(findParameter(name), PARAMETER_INT, val);
+}
+
+bb::Result bb::Subsystem::getParameter(const char* name, unsigned int& val) {
+	return getTyped(findParameter(name), PARAMETER_UINT, val);
+}
+
+bb::Result bb::Subsystem::getParameter(const char* name, float& val) {
+	return getTyped(findParameter(name), PARAMETER_FLOAT, val);
+}
+
+bb::Result bb::Subsystem::getParameter(const char* name, bool& val) {
+	return getTyped(findParameter(name), PARAMETER_BOOL, val);
+}
+
+bb::Result bb::Subsystem::setParameter(const char* name, int val) {
+	const ParameterDef* p = findParameter(name);
+	if(p == NULL) return RES_PARAM_NO_SUCH_PARAMETER;
+	if(p->type != PARAMETER_INT) return RES_PARAM_INVALID_TYPE;
+	if(val < p->min || val > p->max) return RES_COMMON_OUT_OF_RANGE;
+	*(int*)p->value = val;
+	parameterChangedCallback(p->name);
+	return RES_OK;
+}
+
+bb::Result bb::Subsystem::setParameter(const char* name, unsigned int val) {
+	const ParameterDef* p = findParameter(name);
+	if(p == NULL) return RES_PARAM_NO_SUCH_PARAMETER;
+	if(p->type != PARAMETER_UINT) return RES_PARAM_INVALID_TYPE;
+	if(val > p->max) return RES_COMMON_OUT_OF_RANGE;
+	*(unsigned int*)p->value = val;
+	parameterChangedCallback(p->name);
+	return RES_OK;
+}
+
+bb::Result bb::Subsystem::setParameter(const char* name, float val) {
+	const ParameterDef* p = findParameter(name);
+	if(p == NULL) return RES_PARAM_NO_SUCH_PARAMETER;
+	if(p->type != PARAMETER_FLOAT) return RES_PARAM_INVALID_TYPE;
+	if(val < p->min || val > p->max) return RES_COMMON_OUT_OF_RANGE;
+	*(float*)p->value = val;
+	parameterChangedCallback(p->name);
+	return RES_OK;
+}
+
+bb::Result bb::Subsystem::setParameter(const char* name, bool val) {
+	const ParameterDef* p = findParameter(name);
+	if(p == NULL) return RES_PARAM_NO_SUCH_PARAMETER;
+	if(p->type != PARAMETER_BOOL) return RES_PARAM_INVALID_TYPE;
+	*(bool*)p->value = val;
+	parameterChangedCallback(p->name);
+	return RES_OK;
+}
+
+void bb::Subsystem::fillParameterEntry(const ParameterDef& p, ParamEntry& entry) {
+	entry.hash = p.hash;
+	entry.type = p.type;
+	entry.result = RES_OK;
+	entry.value.u = 0;
+	switch(p.type) {
+	case PARAMETER_INT:
+		entry.value.i = *(int*)p.value;
+		break;
+	case PARAMETER_UINT:
+		entry.value.u = *(unsigned int*)p.value;
+		break;
+	case PARAMETER_FLOAT:
+		entry.value.f = *(float*)p.value;
+		break;
+	case PARAMETER_BOOL:
+		entry.value.u = *(bool*)p.value ? 1 : 0;
+		break;
+	case PARAMETER_STRING:
+		entry.result = RES_PARAM_INVALID_TYPE;
+		break;
+	}
+}
+
+void bb::Subsystem::getParameterEntry(ParamEntry& entry) {
+	const ParameterDef* p = findParameterByHash(entry.hash);
+	if(p == NULL) {
+		entry.result = RES_PARAM_NO_SUCH_PARAMETER;
+		return;
+	}
+	fillParameterEntry(*p, entry);
+}
+
+void bb::Subsystem::setParameterEntry(ParamEntry& entry) {
+	const ParameterDef* p = findParameterByHash(entry.hash);
+	if(p == NULL) {
+		entry.result = RES_PARAM_NO_SUCH_PARAMETER;
+		return;
+	}
+	if(entry.type != p->type) {
+		entry.result = RES_PARAM_INVALID_TYPE;
+		return;
+	}
+
+	Result res = RES_PARAM_INVALID_TYPE;
+	switch(p->type) {
+	case PARAMETER_INT:
+		res = setParameter(p->name, int(entry.value.i));
+		break;
+	case PARAMETER_UINT:
+		res = setParameter(p->name, (unsigned int)entry.value.u);
+		break;
+	case PARAMETER_FLOAT:
+		res = setParameter(p->name, entry.value.f);
+		break;
+	case PARAMETER_BOOL:
+		res = setParameter(p->name, entry.value.u != 0);
+		break;
+	case PARAMETER_STRING:
+		break;
+	}
+
+	// Reply with the value now in effect, so the sender sees what a rejected value was left at.
+	fillParameterEntry(*p, entry);
+	if(res != RES_OK) entry.result = res;
+}
+
+bb::Result bb::Subsystem::getParameterEntryAt(unsigned int index, ParamEntry& entry) {
+	if(index < paramTableSize_) fillParameterEntry(paramTable_[index], entry);
+	else if(index < numParameters()) fillParameterEntry(parameters_[index - paramTableSize_], entry);
+	else return RES_COMMON_OUT_OF_RANGE;
+	return RES_OK;
+}
@@ -7,19 +7,32 @@
 #include <vector>
 #include "BBError.h"
 #include "BBConfigStorage.h"
+#include "BBTimingStats.h"
+#include "BBLogRecord.h"
+#include "BBLogLimiter.h"
+#include "BBConsoleWords.h"
 
 namespace bb {
 
 class Subsystem;
 class ConsoleStream;
+struct ParamEntry;
 
 class SubsystemManager {
 public:
 	static SubsystemManager manager;
 	Result registerSubsystem(Subsystem* subsys);
-	Subsystem* subsystemWithName(const String& name);
+	Subsystem* subsystemWithName(const char* name);
 	const std::vector<Subsystem*>& subsystems();
 
+	/*!
+		\brief Handles a bulk parameter request (see ParamBlockHeader in BBPacket.h) in place.
+
+		buf holds a request of len bytes and must have room for maxLen bytes; it is overwritten with the reply.
+		Returns the length of the reply, or 0 if buf does not hold a valid request (wrong magic or CRC, or a reply).
+	*/
+	size_t handleParameterBlock(uint8_t* buf, size_t len, size_t maxLen);
+
 protected:
 	SubsystemManager();
 	std::vector<Subsystem*> subsys_;
@@ -34,13 +47,32 @@ public:
 	static const unsigned int LOG_ERROR = 4;
 	static const unsigned int LOG_FATAL = 5;
 
-#define LOGS(stream, level, args...) if(level>=loglevel_) { bb::printf(stream, "%s(%d):", name_, level); bb::printf(stream, args); }
-#define LOG(level, args...) if(level>=loglevel_) { bb::printf("%s(%d):", name_, level); bb::printf(args); }
+// LOG() goes to all consoles, or into the binary log while BinaryLog is started. LOGS() always prints to stream.
+// With BB_LOG_BINARY_ONLY defined, LOG() only ever logs binary, and its format strings don't end up in the firmware.
+#define LOGS(stream, level, fmt, args...) if(int(level)>=BB_LOG_MIN_LEVEL && level>=loglevel_) { bb::printf(stream, "%s(%d):" fmt, name_, level, ##args); }
+#if defined(BB_LOG_BINARY_ONLY)
+#define LOG(level, fmt, args...) if(int(level)>=BB_LOG_MIN_LEVEL && level>=loglevel_) { \
+		bb::logBinary(level, std::integral_constant<uint32_t, bb::logHash(fmt)>::value, name_, ##args); \
+	}
+#else
+#define LOG(level, fmt, args...) if(int(level)>=BB_LOG_MIN_LEVEL && level>=loglevel_) { \
+		if(bb::binaryLogging) bb::logBinary(level, std::integral_constant<uint32_t, bb::logHash(fmt)>::value, name_, ##args); \
+		else bb::printf("%s(%d):" fmt, name_, level, ##args); \
+	}
+#endif
 
 	virtual const char* name() { return name_; }
 	virtual const char* description() { return description_; }
 	virtual const char* help() { return help_; }
-	virtual Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream);
+	//! Looks words[0] up in the command table (see setCommandTable()), then in the commands every subsystem has.
+	virtual Result handleConsoleCommand(const ConsoleWords& words, ConsoleStream *stream);
+	/*!
+		\brief Checks a condition that console scripts can wait for ("until <subsys> <condition> [<args>]").
+
+		words[0] is the condition, the rest its arguments. Sets met and returns RES_OK if the condition is known.
+		Every subsystem knows "started" and "stopped"; subclasses add their own, like "servos idle".
+	*/
+	virtual Result checkCondition(const ConsoleWords& words, bool& met);
 
 	virtual Result initialize();
 	virtual Result start(ConsoleStream *stream) = 0;
@@ -53,6 +85,9 @@ public:
 
 	void setLogLevel(unsigned int lvl) { loglevel_ = lvl; }
 
+	//! Time spent in step() / stepIfNotStarted(), maintained by the Runloop.
+	TimingStats& stepTiming() { return stepTiming_; }
+
 	virtual Result registerWithManager() { return SubsystemManager::manager.registerSubsystem(this); }
 
 	virtual String statusLine();
@@ -61,160 +96,144 @@ public:
 	virtual void printHelp(ConsoleStream *stream);
 	virtual void printParameters(ConsoleStream *stream);
 
-	virtual Result addParameter(const String& name, const String& help, unsigned int& param, int max = INT_MAX);
-	virtual Result addParameter(const String& name, const String& help, int& param, int min = INT_MIN, int max = INT_MAX);
-	virtual Result addParameter(const String& name, const String& help, float& param, float min = INT_MIN, float max = INT_MAX);
-	virtual Result addParameter(const String& name, const String& help, String& param, int maxlen = 0);
-	virtual Result addParameter(const String& name, const String& help, bool& val);
-
-	virtual Result setParameterValue(const String& name, const String& stringVal);
-	virtual void parameterChangedCallback(const String& name) {} // override if you want to do something if the parameter was changed
-
-protected:
-	class Parameter {
-	public:
-		virtual Result fromString(const String& str) = 0;
-		virtual String toString() const = 0;
-		virtual String description() const = 0;
-		virtual const String& name() const { return name_; }
-		virtual void print(ConsoleStream* stream);
-	protected:
-		String name_;
+	enum ParameterType {
+		PARAMETER_INT,
+		PARAMETER_UINT,
+		PARAMETER_FLOAT,
+		PARAMETER_BOOL,
+		PARAMETER_STRING
 	};
 
-	virtual Parameter* findParameter(const String& name);
-
-	class IntParameter: public Parameter {
-	public:
-		IntParameter(const String& name, int& val, String help, int min=INT_MIN, int max=INT_MAX): 
-			val_(val), help_(help), min_(min), max_(max) {name_ = name;}
-		virtual Result fromString(const String& str) {
-			int v = str.toInt();
-			if(v<min_ || v>max_) return RES_COMMON_OUT_OF_RANGE;
-			val_ = v;
-			return RES_OK;
-		}
-		virtual String toString() const { return String(val_); }
-		virtual String description() const { 
-			String str = toString() + " [";
-			if(min_==INT_MAX) str+="-inf"; else str+=min_;
-			str += "..";
-			if(max_==INT_MAX) str+="inf"; else str+=max_;
-			str += "]";
-			if(help_.length() != 0) str = str + ": " + help_; 
-			return str;
-		}
-	protected:
-		int& val_;
-		String help_;
-		int min_, max_;
+	/*!
+		\brief One entry in a parameter table.
+
+		Holds no copies - name and help must point to static storage, value to the variable the parameter controls.
+		min and max are limits for numeric types (-INT_MAX / INT_MAX print as -inf / inf), max is the maximum length
+		for strings (0 is unlimited). Create entries with the parameter() functions below, which also hash the name.
+	*/
+	struct ParameterDef {
+		const char* name;
+		const char* help;
+		ParameterType type;
+		void* value;
+		float min, max;
+		uint32_t hash;
 	};
 
-	class UIntParameter: public Parameter {
-	public:
-		UIntParameter(const String& name, unsigned int& val, String help, int max=INT_MAX): 
-			val_(val), help_(help), max_(max) { name_ = name; }
-		virtual Result fromString(const String& str) {
-			int v = str.toInt();
-			if(v<0 || v>int(max_)) return RES_COMMON_OUT_OF_RANGE;
-			val_ = v;
-			return RES_OK;
-		}
-		virtual String toString() const { return String(val_); }
-		virtual String description() const { 
-			String str = toString() + " [0..";
-			if(max_==INT_MAX) str+="inf"; else str+=max_;
-			str += "]";
-			if(help_.length() != 0) str = str + ": " + help_; 
-			return str;
-		}
-	protected:
-		unsigned int& val_;
-		String help_;
-		unsigned int max_;
+	//! FNV-1a, evaluated at compile time for constexpr tables.
+	static constexpr uint32_t hashParameterName(const char* name, uint32_t hash = 2166136261UL) {
+		return *name == '\0' ? hash : hashParameterName(name+1, (hash ^ uint8_t(*name)) * 16777619UL);
+	}
+
+	static constexpr ParameterDef parameter(const char* name, const char* help, int& val, int min = INT_MIN, int max = INT_MAX) {
+		return ParameterDef{name, help, PARAMETER_INT, &val, float(min), float(max), hashParameterName(name)};
+	}
+	static constexpr ParameterDef parameter(const char* name, const char* help, unsigned int& val, int max = INT_MAX) {
+		return ParameterDef{name, help, PARAMETER_UINT, &val, 0, float(max), hashParameterName(name)};
+	}
+	static constexpr ParameterDef parameter(const char* name, const char* help, float& val, float min = INT_MIN, float max = INT_MAX) {
+		return ParameterDef{name, help, PARAMETER_FLOAT, &val, min, max, hashParameterName(name)};
+	}
+	static constexpr ParameterDef parameter(const char* name, const char* help, bool& val) {
+		return ParameterDef{name, help, PARAMETER_BOOL, &val, 0, 1, hashParameterName(name)};
+	}
+	static constexpr ParameterDef parameter(const char* name, const char* help, String& val, int maxlen = 0) {
+		return ParameterDef{name, help, PARAMETER_STRING, &val, 0, float(maxlen), hashParameterName(name)};
+	}
+
+	/*!
+		\brief Use a constant table of parameters.
+
+		Define the table as a constexpr array of parameter() entries, so that it stays in flash. Builds a small hash
+		index in RAM (one byte per slot, at most 50% full) for constant time lookup. Can be combined with addParameter().
+	*/
+	virtual Result setParameterTable(const ParameterDef* table, size_t size);
+
+	//! Adds a single parameter at runtime. name and help must point to static storage. Costs RAM - prefer setParameterTable().
+	virtual Result addParameter(const char* name, const char* help, unsigned int& param, int max = INT_MAX);
+	virtual Result addParameter(const char* name, const char* help, int& param, int min = INT_MIN, int max = INT_MAX);
+	virtual Result addParameter(const char* name, const char* help, float& param, float min = INT_MIN, float max = INT_MAX);
+	virtual Result addParameter(const char* name, const char* help, String& param, int maxlen = 0);
+	virtual Result addParameter(const char* name, const char* help, bool& val);
+
+	virtual Result setParameterValue(const char* name, const char* stringVal);
+	virtual void parameterChangedCallback(const char* name) { (void)name; } // override if you want to do something if the parameter was changed
+
+	//! Typed access. Fails with RES_PARAM_INVALID_TYPE if the parameter has a different type; the setters check the limits.
+	Result getParameter(const char* name, int& val);
+	Result getParameter(const char* name, unsigned int& val);
+	Result getParameter(const char* name, float& val);
+	Result getParameter(const char* name, bool& val);
+	Result setParameter(const char* name, int val);
+	Result setParameter(const char* name, unsigned int val);
+	Result setParameter(const char* name, float val);
+	Result setParameter(const char* name, bool val);
+
+	unsigned int numParameters() { return paramTableSize_ + parameters_.size(); }
+
+	//! Bulk parameter protocol access by name hash. Fill in entry's value and result; string parameters are not supported.
+	virtual void getParameterEntry(ParamEntry& entry);
+	virtual void setParameterEntry(ParamEntry& entry);
+	//! Fills entry with the index'th parameter - the table entries first, then the ones added at runtime.
+	Result getParameterEntryAt(unsigned int index, ParamEntry& entry);
+
+	//! Console command handler. words[0] is the command itself.
+	typedef Result (Subsystem::*CommandHandler)(const ConsoleWords& words, ConsoleStream* stream);
+
+	//! One entry in a command table. minArgs and maxArgs don't count the command itself.
+	struct CommandDef {
+		const char* name;
+		uint8_t minArgs, maxArgs;
+		CommandHandler handler;
 	};
 
-	class FloatParameter: public Parameter {
-	public:
-		FloatParameter(const String& name, float& val, String help, float min=INT_MIN, float max=INT_MAX): 
-			val_(val), help_(help), min_(min), max_(max) {name_ = name;}
-		virtual Result fromString(const String& str) {
-			float v = str.toFloat();
-			if(v<min_ || v>max_) return RES_COMMON_OUT_OF_RANGE;
-			val_ = v;
-			return RES_OK;
-		}
-		virtual String toString() const { return String(val_, 10); }
-		virtual String description() const { 
-			String str = toString() + " [";
-			if(min_==INT_MAX) str+="-inf"; else str+=min_;
-			str += "..";
-			if(max_==INT_MAX) str+="inf"; else str+=max_;
-			str += "]";
-			if(help_.length() != 0) str = str + ": " + help_; 
-			return str;
-		}
-	protected:
-		float& val_;
-		String help_;
-		float min_, max_;
-	};
+	template<class T> static constexpr CommandDef command(const char* name, uint8_t minArgs, uint8_t maxArgs,
+	                                                      Result (T::*handler)(const ConsoleWords&, ConsoleStream*)) {
+		return CommandDef{name, minArgs, maxArgs, static_cast<CommandHandler>(handler)};
+	}
 
-	class StringParameter: public Parameter {
-	public:
-		StringParameter(const String& name, String& val, String help, int maxlen=0): val_(val), help_(help), maxlen_(maxlen) {name_ = name;}
-		virtual Result fromString(const String& str) { 
-			if(maxlen_ > 0 && str.length() <= maxlen_) {
-				val_ = str; 
-				return RES_OK; 
-			} 
-			return RES_COMMON_OUT_OF_RANGE;
-		}
-		virtual String toString() const { return val_; }
-		virtual String description() const { 
-			String str = toString();
-			if(maxlen_ != 0) str = str + " (max length " + maxlen_ + ")";
-			if(help_.length() != 0) str = str + ": " + help_; 
-			return str;
-		}
-	protected:
-		String& val_;
-		String help_;
-		unsigned int maxlen_;
-	};	
-
-	class BoolParameter: public Parameter {
-	public:
-		BoolParameter(const String& name, bool& val, String help): val_(val), help_(help) {name_ = name;}
-		virtual Result fromString(const String& str) { 
-			if(str == "true" || str == "yes" || str == "1") {
-				val_ = true;
-				return RES_OK;
-			} else if(str == "false" || str == "no" || str == "0") {
-				val_ = false;
-				return RES_OK;
-			}
-			return RES_COMMON_OUT_OF_RANGE;
-		}
-		virtual String toString() const { return val_ ? "true" : "false"; }
-		virtual String description() const { 
-			String str = toString();
-			if(help_.length() != 0) str = str + ": " + help_; 
-			return str;
-		}
-	protected:
-		bool& val_;
-		String help_;
-	};
+	/*!
+		\brief Use a constant table of console commands.
 
-	std::vector<Parameter*> parameters_;
+		Define the table as a const array of command() entries, e.g. as a static member so that it can name protected
+		handlers. handleConsoleCommand() checks the argument count before calling the handler, and returns
+		RES_CMD_INVALID_ARGUMENT_COUNT without calling it if it's off.
+	*/
+	void setCommandTable(const CommandDef* table, size_t size) { cmdTable_ = table; cmdTableSize_ = size; }
+
+protected:
+	static const CommandDef* findCommand(const CommandDef* table, size_t size, const ConsoleWord& name);
+	Result runCommand(const CommandDef& cmd, const ConsoleWords& words, ConsoleStream* stream);
+
+	Result cmdHelp(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdStatus(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdStart(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdStop(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdGet(const ConsoleWords& words, ConsoleStream* stream);
+	Result cmdSet(const ConsoleWords& words, ConsoleStream* stream);
+	static const CommandDef COMMON_COMMANDS[];
+
+	virtual const ParameterDef* findParameter(const char* name);
+	//! Parameter hashes are unique within a subsystem - setParameterTable() and addParameter() refuse collisions.
+	const ParameterDef* findParameterByHash(uint32_t hash);
+	void fillParameterEntry(const ParameterDef& def, ParamEntry& entry);
+	Result insertParameter(const ParameterDef& def);
+	void printParameter(const ParameterDef& def, ConsoleStream* stream);
+
+	const ParameterDef* paramTable_;
+	size_t paramTableSize_;
+	std::vector<uint8_t> paramIndex_; // open addressing into paramTable_, 0 is empty, else index+1
+	std::vector<ParameterDef> parameters_; // added at runtime
+	const CommandDef* cmdTable_;
+	size_t cmdTableSize_;
 	bool started_;
 	Result operationStatus_;
 	const char *name_, *description_, *help_;
 	unsigned long seqnum_;
 	unsigned int loglevel_;
+	TimingStats stepTiming_;
 
-	Subsystem(): started_(false), operationStatus_(RES_SUBSYS_NOT_INITIALIZED), name_(""), description_(""), help_(""), seqnum_(0), loglevel_(LOG_INFO) {}
+	Subsystem(): paramTable_(NULL), paramTableSize_(0), cmdTable_(NULL), cmdTableSize_(0), started_(false), operationStatus_(RES_SUBSYS_NOT_INITIALIZED), name_(""), description_(""), help_(""), seqnum_(0), loglevel_(LOG_INFO) {}
 	virtual ~Subsystem() { }
 };
 
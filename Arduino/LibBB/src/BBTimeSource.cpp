@@ -0,0 +1,34 @@
+#include "BBTimeSource.h"
+
+#include <Arduino.h>
+
+bb::HardwareTimeSource bb::HardwareTimeSource::hardware;
+
+uint32_t bb::HardwareTimeSource::micros() {
+	return ::micros();
+}
+
+uint32_t bb::HardwareTimeSource::millis() {
+	return ::millis();
+}
+
+void bb::HardwareTimeSource::delayMicroseconds(uint32_t us) {
+	::delayMicroseconds(us);
+}
+
+void bb::VirtualTimeSource::advance(uint32_t us) {
+	uint64_t target = us_ + us;
+	// Events see the clock at the time they fire.
+	while(eventPeriod_ > 0 && nextEvent_ <= target) {
+		us_ = uint64_t(nextEvent_);
+		nextEvent_ += eventPeriod_;
+		eventFn_();
+	}
+	us_ = target;
+}
+
+void bb::VirtualTimeSource::setPeriodicEvent(uint32_t firstUS, double periodUS, std::function<void(void)> fn) {
+	eventPeriod_ = fn != nullptr ? periodUS : 0;
+	nextEvent_ = us_ + firstUS;
+	eventFn_ = fn;
+}
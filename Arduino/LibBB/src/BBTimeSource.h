@@ -0,0 +1,58 @@
+#if !defined(BBTIMESOURCE_H)
+#define BBTIMESOURCE_H
+
+#include <stdint.h>
+#include <functional>
+
+namespace bb {
+
+/*!
+	\brief Where the Runloop, and everything that measures time between updates, gets its time from.
+
+	Normally that's the hardware clock (HardwareTimeSource). Host builds can plug a VirtualTimeSource into 
+	Runloop::setTimeSource() to run the whole loop deterministically and faster than realtime.
+	micros() and millis() wrap like their Arduino counterparts; always compare them by unsigned 32bit difference.
+*/
+class TimeSource {
+public:
+	virtual ~TimeSource() {}
+	virtual uint32_t micros() = 0;
+	virtual uint32_t millis() = 0;
+	virtual void delayMicroseconds(uint32_t us) = 0;
+};
+
+//! The Arduino clock. This is the default time source.
+class HardwareTimeSource: public TimeSource {
+public:
+	static HardwareTimeSource hardware;
+
+	virtual uint32_t micros();
+	virtual uint32_t millis();
+	virtual void delayMicroseconds(uint32_t us);
+};
+
+//! A clock that only moves when told to. delayMicroseconds() returns immediately, having advanced the clock.
+class VirtualTimeSource: public TimeSource {
+public:
+	VirtualTimeSource(uint32_t startMicros = 0) { us_ = startMicros; eventPeriod_ = 0; nextEvent_ = 0; }
+
+	virtual uint32_t micros() { return uint32_t(us_); }
+	virtual uint32_t millis() { return uint32_t(us_ / 1000); }
+	virtual void delayMicroseconds(uint32_t us) { advance(us); }
+
+	//! Simulate time spent working, e.g. in a subsystem's step().
+	void advance(uint32_t us);
+
+	//! Call fn every periodUS (fractions allowed), the first time firstUS from now, as the clock advances past it.
+	//! Simulates a periodic interrupt such as a sensor's data-ready line. A period of 0 switches it off.
+	void setPeriodicEvent(uint32_t firstUS, double periodUS, std::function<void(void)> fn);
+
+protected:
+	uint64_t us_;
+	double eventPeriod_, nextEvent_;
+	std::function<void(void)> eventFn_;
+};
+
+};
+
+#endif // BBTIMESOURCE_H
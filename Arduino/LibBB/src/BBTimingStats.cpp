@@ -0,0 +1,51 @@
+#include "BBTimingStats.h"
+
+#include <string.h>
+#include <math.h>
+
+void bb::TimingStats::reset() {
+	count_ = overruns_ = 0;
+	last_ = max_ = 0;
+	min_ = UINT32_MAX;
+	sum_ = sumSq_ = 0;
+	memset(hist_, 0, sizeof(hist_));
+}
+
+void bb::TimingStats::add(uint32_t us) {
+	last_ = us;
+	if(us < min_) min_ = us;
+	if(us > max_) max_ = us;
+	sum_ += us;
+	sumSq_ += uint64_t(us)*us;
+	count_++;
+
+	unsigned int b = 0;
+	if(us >= 2) b = 31 - __builtin_clz(us);
+	if(b >= NUM_BUCKETS) b = NUM_BUCKETS-1;
+	hist_[b]++;
+}
+
+uint32_t bb::TimingStats::percentile(float p) const {
+	if(count_ == 0) return 0;
+
+	uint32_t target = uint32_t(p * count_);
+	if(target >= count_) target = count_-1;
+
+	uint32_t cumulative = 0;
+	for(unsigned int i=0; i<NUM_BUCKETS; i++) {
+		cumulative += hist_[i];
+		if(cumulative > target) {
+			uint32_t upper = bucketUpperBound(i);
+			return upper < max_ ? upper : max_;
+		}
+	}
+	return max_;
+}
+
+float bb::TimingStats::stddev() const {
+	if(count_ < 2) return 0;
+	// Double, because for long periods with little jitter the two terms are large and nearly equal.
+	double mean = double(sum_) / count_;
+	double var = double(sumSq_) / count_ - mean*mean;
+	return var > 0 ? sqrt(var) : 0;
+}
@@ -0,0 +1,49 @@
+#if !defined(BBTIMINGSTATS_H)
+#define BBTIMINGSTATS_H
+
+#include <stdint.h>
+
+namespace bb {
+
+/*!
+	\brief Fixed-size timing statistics for a recurring operation, e.g. a subsystem's step().
+
+	Keeps min / mean / max / standard deviation, an overrun counter and a log2-scale histogram from which percentiles
+	can be estimated. add() never allocates and is cheap enough to call every cycle.
+	Bucket 0 holds samples below 2us, bucket i (i>0) holds samples in [2^i, 2^(i+1)) us, the last
+	bucket also holds everything above.
+*/
+class TimingStats {
+public:
+	static const unsigned int NUM_BUCKETS = 16;
+
+	TimingStats() { reset(); }
+
+	void reset();
+	void add(uint32_t us);
+	void addOverrun() { overruns_++; }
+
+	uint32_t count() const { return count_; }
+	uint32_t overruns() const { return overruns_; }
+	uint32_t last() const { return last_; }
+	uint32_t min() const { return count_ ? min_ : 0; }
+	uint32_t max() const { return max_; }
+	uint32_t mean() const { return count_ ? uint32_t(sum_ / count_) : 0; }
+	float stddev() const;
+
+	//! Upper bound of the histogram bucket the given percentile (0..1) falls into, clamped to max().
+	uint32_t percentile(float p) const;
+
+	uint32_t bucket(unsigned int i) const { return i < NUM_BUCKETS ? hist_[i] : 0; }
+	static uint32_t bucketUpperBound(unsigned int i) { return (uint32_t(2) << i) - 1; }
+
+protected:
+	uint32_t count_, overruns_;
+	uint32_t last_, min_, max_;
+	uint64_t sum_, sumSq_;
+	uint32_t hist_[NUM_BUCKETS];
+};
+
+};
+
+#endif // BBTIMINGSTATS_H
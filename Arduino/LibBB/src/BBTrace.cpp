@@ -0,0 +1,220 @@
+#include "BBTrace.h"
+#include "BBConsole.h"
+#if !defined(ARDUINO_ARCH_NATIVE)
+#include "BBWifiServer.h"
+#endif
+
+static_assert((BB_TRACE_EVENTS & (BB_TRACE_EVENTS-1)) == 0, "BB_TRACE_EVENTS must be a power of 2");
+
+bb::Trace bb::Trace::trace;
+
+const bb::Subsystem::CommandDef bb::Trace::COMMANDS[] = {
+	command("dump",  0, 0, &Trace::cmdDump),
+	command("send",  0, 0, &Trace::cmdSend),
+	command("clear", 0, 0, &Trace::cmdClear)
+};
+
+bb::Trace::Trace() {
+	name_ = "trace";
+	description_ = "Runloop event trace";
+	help_ = "Records subsystem steps, callbacks, packets, overruns and markers while started.\r\n" \
+	"Available commands:\r\n" \
+	"\tdump: Print the recorded events (convert with DroidGUI/TraceToChrome.py)\r\n" \
+	"\tsend: Broadcast the recorded events via UDP\r\n" \
+	"\tclear: Discard the recorded events\r\n";
+	setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
+
+	head_ = 0;
+	recording_ = false;
+	numMarkers_ = 0;
+	dumping_ = false;
+	wasRecording_ = false;
+	dumpHead_ = dumpPos_ = 0;
+	dumpSubsys_ = dumpMarker_ = 0;
+	dumpState_ = DUMP_DONE;
+}
+
+bb::Result bb::Trace::start(ConsoleStream* stream) {
+	(void)stream;
+	if(dumping_) wasRecording_ = true;
+	else recording_ = true;
+	started_ = true;
+	operationStatus_ = RES_OK;
+	return RES_OK;
+}
+
+bb::Result bb::Trace::stop(ConsoleStream* stream) {
+	(void)stream;
+	recording_ = false;
+	wasRecording_ = false;
+	started_ = false;
+	operationStatus_ = RES_SUBSYS_NOT_STARTED;
+	return RES_OK;
+}
+
+uint8_t bb::Trace::registerMarker(const char* name) {
+	for(uint8_t i=0; i<numMarkers_; i++) {
+		if(!strcmp(markers_[i], name)) return i;
+	}
+	if(numMarkers_ >= MAX_MARKERS) return 0xff;
+	markers_[numMarkers_] = name;
+	return numMarkers_++;
+}
+
+void bb::Trace::beginDump() {
+	if(!dumping_) {
+		wasRecording_ = recording_;
+		recording_ = false;
+		dumping_ = true;
+	}
+	dumpHead_ = head_;
+	dumpPos_ = head_ > BB_TRACE_EVENTS ? head_ - BB_TRACE_EVENTS : 0;
+	dumpSubsys_ = dumpMarker_ = 0;
+	dumpState_ = DUMP_HEADER;
+}
+
+bool bb::Trace::nextDumpLine(char* buf, size_t size) {
+	const std::vector<Subsystem*>& subsys = SubsystemManager::manager.subsystems();
+
+	switch(dumpState_) {
+	case DUMP_HEADER:
+		snprintf(buf, size, "BBT H %lu %lu %lu\n", (unsigned long)(dumpHead_ - dumpPos_), (unsigned long)dumpPos_,
+		         (unsigned long)Runloop::runloop.cycleTimeMicros());
+		dumpState_ = DUMP_SUBSYSTEMS;
+		return true;
+
+	case DUMP_SUBSYSTEMS:
+		if(dumpSubsys_ < subsys.size()) {
+			snprintf(buf, size, "BBT S %u %s\n", dumpSubsys_, subsys[dumpSubsys_]->name());
+			dumpSubsys_++;
+			return true;
+		}
+		dumpState_ = DUMP_MARKERS;
+		// fall through
+
+	case DUMP_MARKERS:
+		if(dumpMarker_ < numMarkers_) {
+			snprintf(buf, size, "BBT M %u %s\n", dumpMarker_, markers_[dumpMarker_]);
+			dumpMarker_++;
+			return true;
+		}
+		dumpState_ = DUMP_EVENTS;
+		// fall through
+
+	case DUMP_EVENTS:
+		if(dumpPos_ != dumpHead_) {
+			const Event& e = events_[dumpPos_ & (BB_TRACE_EVENTS-1)];
+			snprintf(buf, size, "BBT E %lu %u %u %u\n", (unsigned long)e.us, e.type, e.id, e.arg);
+			dumpPos_++;
+			return true;
+		}
+		dumpState_ = DUMP_END;
+		// fall through
+
+	case DUMP_END:
+		snprintf(buf, size, "BBT X\n");
+		dumpState_ = DUMP_DONE;
+		return true;
+
+	case DUMP_DONE:
+	default:
+		return false;
+	}
+}
+
+void bb::Trace::endDump() {
+	if(!dumping_) return;
+	dumping_ = false;
+	recording_ = wasRecording_;
+	dumpState_ = DUMP_DONE;
+}
+
+bb::Result bb::Trace::dumpTo(ConsoleStream* stream) {
+	if(dumping_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	beginDump();
+
+	// A full dump is several kB - print it a few lines at a time in the runloop's idle time.
+	Result res = Runloop::runloop.addIdleTask("trace", 1000, [this, stream]() {
+		char buf[48];
+		if(stream != NULL && stream->writeSpace() < 8*sizeof(buf)) return true; // let the stream catch up
+		for(int i=0; i<8; i++) {
+			if(!nextDumpLine(buf, sizeof(buf))) {
+				endDump();
+				if(stream != NULL) stream->printf("\n> ");
+				return false;
+			}
+			if(stream != NULL) stream->printf("%s", buf);
+		}
+		return true;
+	});
+	if(res != RES_OK) {
+		endDump();
+		return res;
+	}
+
+	Console::console.deferPrompt();
+	return RES_OK;
+}
+
+#if !defined(ARDUINO_ARCH_NATIVE)
+bb::Result bb::Trace::sendUDP() {
+	if(!WifiServer::server.isStarted()) return RES_SUBSYS_NOT_STARTED;
+	if(dumping_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	beginDump();
+
+	// One datagram of whole lines per idle chunk.
+	Result res = Runloop::runloop.addIdleTask("trace", 2000, [this]() {
+		static const size_t DATAGRAM_SIZE = 1024;
+		static const size_t MAX_LINE = 48;
+		static uint8_t datagram[DATAGRAM_SIZE];
+		size_t len = 0;
+		bool more = true;
+		while(len + MAX_LINE <= DATAGRAM_SIZE) {
+			if(!nextDumpLine((char*)datagram + len, MAX_LINE)) {
+				more = false;
+				break;
+			}
+			len += strlen((char*)datagram + len);
+		}
+		if(len != 0) WifiServer::server.broadcastUDPPacket(datagram, len);
+		if(!more) endDump();
+		return more;
+	});
+	if(res != RES_OK) {
+		endDump();
+		return res;
+	}
+
+	return RES_OK;
+}
+#endif
+
+bb::Result bb::Trace::cmdDump(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	return dumpTo(stream);
+}
+
+bb::Result bb::Trace::cmdSend(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	(void)stream;
+#if !defined(ARDUINO_ARCH_NATIVE)
+	return sendUDP();
+#else
+	return RES_SUBSYS_HW_DEPENDENCY_MISSING;
+#endif
+}
+
+bb::Result bb::Trace::cmdClear(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	(void)stream;
+	if(dumping_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	clear();
+	return RES_OK;
+}
+
+void bb::Trace::printExtendedStatus(ConsoleStream *stream) {
+	printStatusLine(stream);
+	if(stream == NULL) return;
+	stream->printf("%s, %lu events recorded, buffer holds %d (%d bytes), %d markers%s\n", recording_ ? "Recording" : "Not recording",
+	               (unsigned long)head_, BB_TRACE_EVENTS, int(sizeof(events_)), numMarkers_, dumping_ ? ", dump in progress" : "");
+}
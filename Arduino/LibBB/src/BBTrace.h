@@ -0,0 +1,113 @@
+#if !defined(BBTRACE_H)
+#define BBTRACE_H
+
+#include <Arduino.h>
+#include "BBSubsystem.h"
+#include "BBRunloop.h"
+
+// Number of events kept. Must be a power of 2. Each event takes 8 bytes.
+#if !defined(BB_TRACE_EVENTS)
+#define BB_TRACE_EVENTS 256
+#endif
+
+namespace bb {
+
+/*!
+	\brief Flight recorder for the runloop.
+
+	Keeps the last BB_TRACE_EVENTS events (subsystem steps, timed callbacks, idle tasks, packets, overruns and
+	user-defined markers) in a ring buffer in RAM, so that after something went wrong we can look at what happened
+	in the cycles before. Recording an event is a flag check and an 8 byte store, so the trace can stay on all the time.
+
+	"trace dump" prints the buffer as text lines starting with "BBT", "trace send" broadcasts the same lines via UDP.
+	DroidGUI/TraceToChrome.py turns either into a Chrome trace (chrome://tracing or ui.perfetto.dev).
+	Recording is paused while a dump is running.
+*/
+class Trace: public Subsystem {
+public:
+	static Trace trace;
+
+	enum EventType {
+		EVENT_CYCLE          = 0, //!< arg: lower 16 bits of the runloop sequence number
+		EVENT_STEP_BEGIN     = 1, //!< id: subsystem index
+		EVENT_STEP_END       = 2, //!< id: subsystem index
+		EVENT_CALLBACK_BEGIN = 3, //!< arg: callback slot
+		EVENT_CALLBACK_END   = 4, //!< arg: callback slot
+		EVENT_IDLE_BEGIN     = 5,
+		EVENT_IDLE_END       = 6,
+		EVENT_PACKET_RX      = 7, //!< id: packet source, arg: packet type
+		EVENT_PACKET_TX      = 8, //!< id: packet source, arg: packet type
+		EVENT_OVERRUN        = 9, //!< id: index of the slowest subsystem, arg: loop time in us (saturated)
+		EVENT_MARKER         = 10 //!< id: marker from registerMarker(), arg: user defined
+	};
+
+	struct Event {
+		uint32_t us;
+		uint8_t type;
+		uint8_t id;
+		uint16_t arg;
+	};
+
+	static const uint8_t MAX_MARKERS = 16;
+
+	virtual Result start(ConsoleStream* stream = NULL);
+	virtual Result stop(ConsoleStream* stream = NULL);
+	virtual Result step() { return RES_OK; }
+	virtual void printExtendedStatus(ConsoleStream *stream = NULL);
+
+	//! Record with a timestamp the caller already has at hand.
+	void record(uint32_t us, EventType type, uint8_t id = 0, uint16_t arg = 0) {
+		if(!recording_) return;
+		Event& e = events_[head_++ & (BB_TRACE_EVENTS-1)];
+		e.us = us;
+		e.type = type;
+		e.id = id;
+		e.arg = arg;
+	}
+	void record(EventType type, uint8_t id = 0, uint16_t arg = 0) {
+		if(recording_) record(Runloop::runloop.micros(), type, id, arg);
+	}
+
+	//! Returns the marker id for name, or 0xff if the marker table is full. name must point to static storage.
+	uint8_t registerMarker(const char* name);
+	void marker(uint8_t id, uint16_t arg = 0) { record(EVENT_MARKER, id, arg); }
+
+	bool isRecording() { return recording_; }
+	void clear() { head_ = 0; }
+	//! Number of events recorded since the last clear(), including those that have been overwritten.
+	uint32_t numRecorded() { return head_; }
+
+	//! Formats the trace one line at a time. Call beginDump() first, then nextDumpLine() until it returns false.
+	void beginDump();
+	bool nextDumpLine(char* buf, size_t size);
+	void endDump();
+	bool isDumping() { return dumping_; }
+
+protected:
+	Trace();
+
+	Result dumpTo(ConsoleStream* stream);
+	Result cmdDump(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdSend(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdClear(const ConsoleWords& words, ConsoleStream *stream);
+	static const CommandDef COMMANDS[];
+#if !defined(ARDUINO_ARCH_NATIVE)
+	Result sendUDP();
+#endif
+
+	Event events_[BB_TRACE_EVENTS];
+	uint32_t head_;
+	bool recording_;
+
+	const char* markers_[MAX_MARKERS];
+	uint8_t numMarkers_;
+
+	bool dumping_, wasRecording_;
+	uint32_t dumpHead_, dumpPos_;
+	unsigned int dumpSubsys_, dumpMarker_;
+	enum { DUMP_HEADER, DUMP_SUBSYSTEMS, DUMP_MARKERS, DUMP_EVENTS, DUMP_END, DUMP_DONE } dumpState_;
+};
+
+};
+
+#endif // BBTRACE_H
@@ -1,3 +1,5 @@
+#if !defined(ARDUINO_ARCH_NATIVE) // hardware-only, not part of the host build
+
 #include <BBWifiServer.h>
 #include <BBRunloop.h>
 #if !defined(ARDUINO_PICO_VERSION_STR)
@@ -19,6 +21,8 @@ bb::WifiConsoleStream::WifiConsoleStream() {
 
 void bb::WifiConsoleStream::setClient(const WiFiClient& client) {
 	client_ = client;
+	clearQueue(); // was meant for the previous client
+	clearLine();
 	printGreeting();
 }
 
@@ -30,24 +34,18 @@ bool bb::WifiConsoleStream::available() {
 	}
 }
 
-bool bb::WifiConsoleStream::readStringUntil(unsigned char c, String& str) {
-	int timeout = 0;
-	while(true) {
-		if(client_.available()) {
-			unsigned char data = client_.read();
-			str += (char)data;
-			if(data == c) return true;
-		} else {
-			delay(1);
-			timeout++;
-			if(timeout >= 2) return false;
-		}
-	}
+int bb::WifiConsoleStream::read() {
+	if(!client_.available()) return -1;
+	return client_.read();
+}
+
+size_t bb::WifiConsoleStream::txSpace() {
+	// WiFiClient can't tell how much it takes without blocking; the per cycle limit keeps each write short.
+	return client_.connected() ? bytesPerCycle_ : 0;
 }
 
-int bb::WifiConsoleStream::printfFinal(const char* str) {
-	client_.print(str);
-	return strlen(str);
+size_t bb::WifiConsoleStream::txWrite(const uint8_t* buf, size_t len) {
+	return client_.write(buf, len);
 }
 
 bb::WifiServer::WifiServer(): tcp_(DEFAULT_TCP_PORT) {
@@ -83,6 +81,10 @@ bb::Result bb::WifiServer::initialize(const String& ssid, const String& wpakey,
 
 	setOTANameAndPassword(ssid, wpakey);
 
+#if !defined(ARDUINO_PICO_VERSION_STR) && !defined(ARDUINO_ARCH_ESP32)
+	Runloop::runloop.addTask(this, "ota", 4, []() { ArduinoOTA.poll(); });
+#endif
+
 	operationStatus_ = RES_SUBSYS_NOT_STARTED;
 	return Subsystem::initialize();
 }
@@ -190,6 +192,9 @@ bb::Result bb::WifiServer::stop(ConsoleStream* stream) {
 	return RES_OK;
 }
 
+static const char SCRIPT_MAGIC[] = "BBS1";
+static const size_t SCRIPT_MAGIC_LEN = sizeof(SCRIPT_MAGIC) - 1;
+
 bb::Result bb::WifiServer::step() {
 #if !defined(ARDUINO_ARCH_ESP32)
 	int status = WiFi.status();
@@ -200,17 +205,6 @@ bb::Result bb::WifiServer::step() {
 	}
 #endif
 
-	static int seqnum = 0;
-
-	if(seqnum == (1e6/Runloop::runloop.cycleTimeMicros())/4) {
-#if !defined(ARDUINO_PICO_VERSION_STR) && !defined(ARDUINO_ARCH_ESP32)
-		ArduinoOTA.poll();
-#endif
-		seqnum = 0;
-	}
-
-	seqnum++;
-
 	//Console::console.printfBroadcast("Checking for client\n");
 #if defined(ARDUINO_ARCH_ESP32)
 	if(client_ == true) {
@@ -230,35 +224,48 @@ bb::Result bb::WifiServer::step() {
 		Console::console.addConsoleStream(&consoleStream_);
 	}
 
+	// Bulk parameter requests - answered to wherever they came from, not to the remote port. Script uploads
+	// (see Console::handleScriptPacket()) come in the same way.
+	IPAddress remoteIP;
+	uint16_t remotePort;
+	unsigned int len = readDataIfAvailable(paramBlockBuf_, sizeof(paramBlockBuf_), remoteIP, remotePort);
+	if(len > SCRIPT_MAGIC_LEN && len <= sizeof(paramBlockBuf_) && !memcmp(paramBlockBuf_, SCRIPT_MAGIC, SCRIPT_MAGIC_LEN)) {
+		Console::console.handleScriptPacket(paramBlockBuf_ + SCRIPT_MAGIC_LEN, len - SCRIPT_MAGIC_LEN);
+	} else if(len != 0 && len <= sizeof(paramBlockBuf_)) {
+		size_t replyLen = SubsystemManager::manager.handleParameterBlock(paramBlockBuf_, len, sizeof(paramBlockBuf_));
+		if(replyLen != 0) sendUDPPacket(remoteIP, remotePort, paramBlockBuf_, replyLen);
+	}
+
 	return RES_OK;
 }
 
-bb::Result bb::WifiServer::setParameterValue(const String& name, const String& value) {
+bb::Result bb::WifiServer::setParameterValue(const char* name, const char* str) {
+	ConsoleWord value(str, strlen(str));
 	Result res = RES_PARAM_NO_SUCH_PARAMETER;
 
-	if(name == "ssid") { 
+	if(!strcmp(name, "ssid")) { 
 		strncpy(params_.ssid, value.c_str(), MAX_STRLEN);
 		res = RES_OK;
-	} else if(name == "wpa_key") {
+	} else if(!strcmp(name, "wpa_key")) {
 		strncpy(params_.wpaKey, value.c_str(), MAX_STRLEN);
 		res = RES_OK;
-	} else if(name == "ap") {
+	} else if(!strcmp(name, "ap")) {
 		if(value == "1") { params_.ap = true; res = RES_OK; }
 		else if(value == "0") { params_.ap = false; res = RES_OK; }
 		else res = RES_PARAM_INVALID_TYPE;
-	} else if(name == "terminal_port") {
+	} else if(!strcmp(name, "terminal_port")) {
 		int v = value.toInt();
 		if(v < 0 || v > 65536) return RES_PARAM_INVALID_VALUE;
 		params_.tcpPort = v;
 		res = RES_OK;
-	} else if(name == "remote_port") {
+	} else if(!strcmp(name, "remote_port")) {
 		int v = value.toInt();
 		if(v < 0 || v > 65536) return RES_PARAM_INVALID_VALUE;
 		params_.udpPort = v;
 		res = RES_OK;
 	} 
 
-	if(res == RES_OK) ConfigStorage::storage.writeBlock(paramsHandle_);
+	if(res == RES_OK) ConfigStorage::storage.markDirty(paramsHandle_);
 
 	return res;
 }
@@ -288,6 +295,10 @@ bool bb::WifiServer::broadcastUDPPacket(const uint8_t* packet, size_t len) {
 }
 
 bool bb::WifiServer::sendUDPPacket(const IPAddress& addr, const uint8_t* packet, size_t len) {
+	return sendUDPPacket(addr, params_.udpPort, packet, len);
+}
+
+bool bb::WifiServer::sendUDPPacket(const IPAddress& addr, uint16_t port, const uint8_t* packet, size_t len) {
 	static unsigned int failures = 0;
 
 #if defined(ARDUINO_ARCH_ESP32)
@@ -297,7 +308,7 @@ bool bb::WifiServer::sendUDPPacket(const IPAddress& addr, const uint8_t* packet,
 #endif
 		return false;
 	}
-	if(udp_.beginPacket(addr, params_.udpPort) == false) {
+	if(udp_.beginPacket(addr, port) == false) {
 		Console::console.printfBroadcast("beginPacket() failed!\n");
 		return false;
 	}
@@ -322,12 +333,13 @@ bool bb::WifiServer::sendUDPPacket(const IPAddress& addr, const uint8_t* packet,
 }
 
 
-unsigned int bb::WifiServer::readDataIfAvailable(uint8_t *buf, unsigned int maxsize, IPAddress& remoteIP) {
-	if(udp_.available() == false) return 0;
+unsigned int bb::WifiServer::readDataIfAvailable(uint8_t *buf, unsigned int maxsize, IPAddress& remoteIP, uint16_t& remotePort) {
+	// available() only counts the bytes of the packet parsePacket() has already opened, so parse first.
 	unsigned int len = udp_.parsePacket();
 	if(!len) return 0;
 	remoteIP = udp_.remoteIP();
-	if(len > maxsize) return len;
+	remotePort = udp_.remotePort();
+	if(len > maxsize) return len; // the rest is discarded by the next parsePacket()
 	if((unsigned int)(udp_.read(buf, maxsize)) != len) { 
 		Serial.print("Huh? Differing sizes?!\n"); 
 		return 0;
@@ -393,4 +405,5 @@ void bb::WifiServer::printStatus(ConsoleStream *stream) {
 	}
 
 	stream->printf(".\n");
-}
\ No newline at end of file
+}
+#endif // !ARDUINO_ARCH_NATIVE
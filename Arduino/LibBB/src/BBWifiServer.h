@@ -10,6 +10,7 @@
 #include "BBSubsystem.h"
 #include "BBConfigStorage.h"
 #include "BBConsole.h"
+#include "BBPacket.h"
 
 #define DEFAULT_SSID      "BB8WifiServer-$MAC"
 #define DEFAULT_WPAKEY    "BB8WifiKey"
@@ -20,14 +21,15 @@
 
 namespace bb {
 
-class WifiConsoleStream: public ConsoleStream {
+class WifiConsoleStream: public QueuedConsoleStream {
 public:
 	WifiConsoleStream();
 	void setClient(const WiFiClient& client);
 	virtual bool available();
-	virtual bool readStringUntil(unsigned char c, String& str);
-	virtual int printfFinal(const char* str);
+	virtual int read();
 protected:
+	virtual size_t txSpace();
+	virtual size_t txWrite(const uint8_t* buf, size_t len);
 	WiFiClient client_;
 };
 
@@ -45,7 +47,7 @@ public:
 
 	virtual void printStatus(ConsoleStream *stream);
 
-	virtual Result setParameterValue(const String& name, const String& value);
+	virtual Result setParameterValue(const char* name, const char* value);
 
 	bool tryToStartAP(const String& ssid, const String& key);
 	bool isAPStarted();
@@ -54,11 +56,12 @@ public:
 
 	bool broadcastUDPPacket(const uint8_t* packet, size_t len);
 	bool sendUDPPacket(const IPAddress& addr, const uint8_t* packet, size_t len);
+	bool sendUDPPacket(const IPAddress& addr, uint16_t port, const uint8_t* packet, size_t len);
 
 protected:
 	WifiServer();
 
-	unsigned int readDataIfAvailable(uint8_t* buf, unsigned int maxsize, IPAddress& remoteIP);
+	unsigned int readDataIfAvailable(uint8_t* buf, unsigned int maxsize, IPAddress& remoteIP, uint16_t& remotePort);
 
 	WiFiUDP udp_;
 	WiFiServer tcp_;
@@ -76,6 +79,9 @@ protected:
 	} WifiServerParams;
 	WifiServerParams params_;
 	ConfigStorage::HANDLE paramsHandle_;
+
+	// Bulk parameter requests are handled in place - big enough for MAX_PARAM_ENTRIES.
+	uint8_t paramBlockBuf_[sizeof(ParamBlockHeader) + MAX_PARAM_ENTRIES*sizeof(ParamEntry)];
 };
 
 };
@@ -1,16 +1,37 @@
 #include <limits.h> // for ULONG_MAX
 #include <inttypes.h> // for uint64_t format string
 #include <vector>
+#include <algorithm>
 
 #include "BBXBee.h"
 #include "BBError.h"
 #include "BBConsole.h"
 #include "BBRunloop.h"
+#include "BBTrace.h"
 
 bb::XBee bb::XBee::xbee;
 
 static std::vector<unsigned int> baudRatesToTry = { 230400, 115200, 9600, 57600, 19200, 28800, 38400, 76800 }; // start with 115200, then try 9600
 
+const bb::Subsystem::CommandDef bb::XBee::COMMANDS[] = {
+	command("send",     1, 1, &XBee::cmdSend),
+	command("api_mode", 1, 1, &XBee::cmdAPIMode),
+	command("tx_reset", 0, 0, &XBee::cmdTXReset)
+};
+
+static const char* TX_CLASS_NAMES[] = {"control", "state", "config", "diagnostic"};
+
+// 802.15.4 at 2.4GHz sends 250kbps, so a byte takes 32us.
+static const uint32_t MICROS_PER_BYTE = 32;
+// Preamble, start delimiter and length; frame control, sequence number, PAN ID, 64bit addresses and FCS.
+static const uint32_t FRAME_OVERHEAD_BYTES = 6 + 23;
+// Long interframe space, 40 symbols.
+static const uint32_t IFS_MICROS = 640;
+// Turnaround, 12 symbols, and the 11 byte ACK frame.
+static const uint32_t ACK_MICROS = 192 + 11*MICROS_PER_BYTE;
+// Unused airtime piles up to this fraction of a second's budget.
+static const uint32_t AIRTIME_BURST_DIVIDER = 10;
+
 bb::XBee::XBee() {
 	uart_ = &Serial1;
 	debug_ = (XBee::DebugFlags)(DEBUG_PROTOCOL);
@@ -19,9 +40,24 @@ bb::XBee::XBee() {
 	atmode_millis_ = 0;
 	atmode_timeout_ = 10000;
 	currentBPS_ = 0;
-	memset(packetBuf_, 0, sizeof(packetBuf_));
-	packetBufPos_ = 0;
 	apiMode_ = false;
+	discovering_ = false;
+	rxHasFEC_ = false;
+	discoveryStartMS_ = 0;
+
+	static_assert(PACKET_SLOT_SIZE <= MAX_PAYLOAD, "FEC frames must fit into a diagnostic slot too");
+	memset(txQueues_, 0, sizeof(txQueues_));
+	for(int c=0; c<TX_NUM_CLASSES; c++) {
+		TXQueue& q = txQueues_[c];
+		q.slotSize = c == TX_DIAGNOSTIC ? MAX_PAYLOAD : PACKET_SLOT_SIZE;
+		for(int i=0; i<BB_XBEE_TX_QUEUE_DEPTH; i++) {
+			q.entries[i].payload = c == TX_DIAGNOSTIC ? diagnosticSlots_[i] : packetSlots_[c][i];
+		}
+	}
+	airtimeBudget_ = 500000;
+	airtimeTokens_ = airtimeBudget_ / AIRTIME_BURST_DIVIDER;
+	airtimeRefillMicros_ = 0;
+	airtimeUsed_ = budgetDeferrals_ = 0;
 
 	name_ = "xbee";
 	description_ = "Communication via XBee 802.5.14";
@@ -29,11 +65,15 @@ bb::XBee::XBee() {
 	"Available commands:\r\n" \
 	"\tpacket_mode on|off: Switch to packet mode\r\n" \
 	"\tapi_mode on|off: Enter / leave API mode\r\n" \
-	"\tsend_api_packet <dest>: Send zero control packet to destination\r\n";
+	"\tsend_api_packet <dest>: Send zero control packet to destination\r\n" \
+	"\ttx_reset: Reset the transmit queue statistics\r\n";
+
+	setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
 
 	addParameter("channel", "Communication channel (between 11 and 26, usually 12)", params_.chan, 11, 26);
 	addParameter("pan", "Personal Area Network ID (16bit, 65535 is broadcast)", params_.pan, 0, 65535);
 	addParameter("bps", "Communication bps rate", params_.bps, 0, 200000);
+	addParameter("airtime_budget", "Airtime in us per second for sending (0 is unlimited)", airtimeBudget_, 1000000);
 }
 
 bb::XBee::~XBee() {
@@ -52,7 +92,10 @@ bb::Result bb::XBee::initialize(uint8_t chan, uint16_t pan, uint32_t bps, Hardwa
 		params_.chan = chan;
 		params_.pan = pan;
 		params_.bps = bps;
+		params_.airtimeBudget = airtimeBudget_;
 	}
+	airtimeBudget_ = params_.airtimeBudget;
+	airtimeTokens_ = airtimeBudget_ / AIRTIME_BURST_DIVIDER;
 
 	uart_ = uart;
 
@@ -206,6 +249,9 @@ bb::Result bb::XBee::stop(ConsoleStream *stream) {
 }
 
 bb::Result bb::XBee::step() {
+	flushTXQueue();
+	if(discovering_) return RES_OK; // discovery idle task is reading the UART
+
 	int packetsHandled = 0;
 	while(available()) {
 		if(apiMode_) {
@@ -218,6 +264,14 @@ bb::Result bb::XBee::step() {
 				continue;
 			}
 			//Console::console.printfBroadcast("Received packet from %lx:%lx type %d\n", srcAddr.addrHi, srcAddr.addrLo, packet.type);
+			Packet recovered;
+			if(rxHasFEC_ && fecDecoders_[packet.source].decode(packet, rxFEC_, Runloop::runloop.millis(), recovered)) {
+				Trace::trace.record(Trace::EVENT_PACKET_RX, recovered.source, recovered.type);
+				for(auto& r: receivers_) {
+					r->incomingPacket(srcAddr, rssi, recovered);
+				}
+			}
+			Trace::trace.record(Trace::EVENT_PACKET_RX, packet.source, packet.type);
 			for(auto& r: receivers_) {
 				r->incomingPacket(srcAddr, rssi, packet);
 			}
@@ -242,49 +296,54 @@ bb::Result bb::XBee::parameterValue(const String& name, String& value) {
 	return RES_PARAM_NO_SUCH_PARAMETER;
 }
 
-bb::Result bb::XBee::setParameterValue(const String& name, const String& value) {
+bb::Result bb::XBee::setParameterValue(const char* name, const char* str) {
+	ConsoleWord value(str, strlen(str));
 	Result res = RES_PARAM_NO_SUCH_PARAMETER;
 
-	if(name == "channel") { 
+	if(!strcmp(name, "channel")) { 
 		params_.chan = value.toInt();
 		res = setConnectionInfo(params_.chan, params_.pan, false);
-	} else if(name == "pan") {
+	} else if(!strcmp(name, "pan")) {
 		params_.pan = value.toInt();
 		res = setConnectionInfo(params_.chan, params_.pan, false);
-	} else if(name == "bps") {
+	} else if(!strcmp(name, "bps")) {
 		params_.bps = value.toInt();
 		res = RES_OK;
 	}
 
 	if(res == RES_OK) {
-		ConfigStorage::storage.writeBlock(paramsHandle_);
+		ConfigStorage::storage.markDirty(paramsHandle_);
+	} else if(res == RES_PARAM_NO_SUCH_PARAMETER) {
+		return Subsystem::setParameterValue(name, str);
 	}
 
 	return res;
 }
 
-bb::Result bb::XBee::handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream) {
-	if(words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
-	
-	if(words[0] == "send") {
-		if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		return send(words[1]);
-	} 
-
-	else if(words[0] == "api_mode") {
-		if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-		else {
-			if(words[1] == "on" || words[1] == "true") {
-				return setAPIMode(true);
-			}
-			else if(words[1] == "off" || words[1] == "false") {
-				return setAPIMode(false);
-			}
-			else return RES_CMD_INVALID_ARGUMENT;	
-		}		
+void bb::XBee::parameterChangedCallback(const char* name) {
+	if(!strcmp(name, "airtime_budget")) {
+		params_.airtimeBudget = airtimeBudget_;
+		ConfigStorage::storage.markDirty(paramsHandle_);
 	}
+}
+
+bb::Result bb::XBee::cmdSend(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)stream;
+	return send((const uint8_t*)words[1].c_str(), words[1].length());
+}
 
-	return bb::Subsystem::handleConsoleCommand(words, stream);
+bb::Result bb::XBee::cmdAPIMode(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)stream;
+	if(words[1] == "on" || words[1] == "true") return setAPIMode(true);
+	else if(words[1] == "off" || words[1] == "false") return setAPIMode(false);
+	return RES_CMD_INVALID_ARGUMENT;
+}
+
+bb::Result bb::XBee::cmdTXReset(const ConsoleWords& words, ConsoleStream *stream) {
+	(void)words;
+	(void)stream;
+	resetTXStatistics();
+	return RES_OK;
 }
 
 bb::Result bb::XBee::setAPIMode(bool onoff) {
@@ -297,6 +356,7 @@ bb::Result bb::XBee::setAPIMode(bool onoff) {
 		enterATModeIfNecessary();
 		if(sendStringAndWaitForOK("ATAP=2") == true) {
 			apiMode_ = true;
+			rx_.reset();
 			leaveATMode();
 			return RES_OK;
 		} else {
@@ -532,47 +592,86 @@ bb::Result bb::XBee::discoverNodes(std::vector<bb::XBee::Node>& nodes) {
 		timeout--;
 
 		if(available()) {
-			Result res;
-			APIFrame response;
-			res = receive(response);
-			if(res != RES_OK) {
-				Console::console.printfBroadcast("Error receiving response: %s\n", errorMessage(res));
-				continue;
-			}
+			Node n;
+			if(receiveNodeDiscoveryResponse(n) == RES_OK) nodes.push_back(n);
+		}
+	}
 
-			uint8_t frameID, status;
-			uint16_t command, length;
-			uint8_t *data;
+	return RES_OK;
+}
 
-			res = response.unpackATResponse(frameID, command, status, &data, length);
-			if(res != RES_OK) {
-				continue;
-			}
+bb::Result bb::XBee::discoverNodesAsync(std::function<void(Result, const std::vector<Node>&)> done) {
+	if(discovering_) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
 
-			if(status != 0) {
-				Console::console.printfBroadcast("Response with status %d\"", status);
-				continue;
-			}	
+	Result res;
+	APIFrame request = APIFrame::atRequest(0x5, ('N'<<8 | 'D'));
+	res = send(request);
+	if(res != RES_OK) return res;
 
-			if(length < APIFrame::ATResponseNDMinLength) {
-				Console::console.printfBroadcast("Expected >=%d bytes, found %d\n", APIFrame::ATResponseNDMinLength, length);
-				continue;
-			}
+	discoveredNodes_.clear();
+	discoveryDone_ = done;
+	discoveryStartMS_ = Runloop::runloop.millis();
 
-			APIFrame::ATResponseND *r = (APIFrame::ATResponseND*)data;
-			Node n;
-			n.address = {r->addrHi, r->addrLo};
-			n.rssi = r->rssi;
-			memset(n.name, 0, sizeof(n.name));
-			if(length > APIFrame::ATResponseNDMinLength) {
-				strncpy(n.name, r->name, strlen(r->name));
+	// One response per chunk. Must not starve for long, or the XBee's UART buffer overflows.
+	res = Runloop::runloop.addIdleTask("discover", 1000, [this]() {
+		if(Runloop::runloop.millis() - discoveryStartMS_ < 10000) {
+			if(available()) {
+				Node n;
+				if(receiveNodeDiscoveryResponse(n) == RES_OK) discoveredNodes_.push_back(n);
 			}
-
-			Console::console.printfBroadcast("Discovered station at address 0x%lx:%lx, RSSI %d, name \"%s\"\n", n.address.addrHi, n.address.addrLo, n.rssi, n.name);
-			nodes.push_back(n);	
+			return true;
 		}
+		discovering_ = false;
+		std::function<void(Result, const std::vector<Node>&)> cb = discoveryDone_;
+		discoveryDone_ = nullptr;
+		if(cb) cb(RES_OK, discoveredNodes_);
+		return false;
+	}, 100);
+	if(res != RES_OK) return res;
+
+	discovering_ = true;
+	return RES_OK;
+}
+
+bb::Result bb::XBee::receiveNodeDiscoveryResponse(Node& n) {
+	Result res;
+	APIFrame response;
+	res = receive(response);
+	if(res == RES_PACKET_INCOMPLETE) return res;
+	if(res != RES_OK) {
+		Console::console.printfBroadcast("Error receiving response: %s\n", errorMessage(res));
+		return res;
+	}
+
+	uint8_t frameID, status;
+	uint16_t command, length;
+	uint8_t *data;
+
+	res = response.unpackATResponse(frameID, command, status, &data, length);
+	if(res != RES_OK) {
+		return res;
+	}
+
+	if(status != 0) {
+		Console::console.printfBroadcast("Response with status %d\"", status);
+		return RES_SUBSYS_COMM_ERROR;
+	}	
+
+	if(length < APIFrame::ATResponseNDMinLength) {
+		Console::console.printfBroadcast("Expected >=%d bytes, found %d\n", APIFrame::ATResponseNDMinLength, length);
+		return RES_PACKET_TOO_SHORT;
 	}
 
+	APIFrame::ATResponseND *r = (APIFrame::ATResponseND*)data;
+	n.address = {r->addrHi, r->addrLo};
+	n.rssi = r->rssi;
+	memset(n.name, 0, sizeof(n.name));
+	if(length > APIFrame::ATResponseNDMinLength) {
+		size_t maxLen = std::min(size_t(length - APIFrame::ATResponseNDMinLength), sizeof(n.name) - 1);
+		memcpy(n.name, r->name, strnlen(r->name, maxLen));
+	}
+
+	Console::console.printfBroadcast("Discovered station at address 0x%lx:%lx, RSSI %d, name \"%s\"\n", n.address.addrHi, n.address.addrLo, n.rssi, n.name);
 	return RES_OK;
 }
 
@@ -613,12 +712,188 @@ bb::Result bb::XBee::send(const bb::Packet& packet) {
 	frame.crc = frame.packet.calculateCRC();
 
 	uart_->write((uint8_t*)&frame, sizeof(frame));
+	Trace::trace.record(Trace::EVENT_PACKET_TX, packet.source, packet.type);
 
 	return RES_OK;
 }
 
+bb::XBee::TXClass bb::XBee::txClassFor(const Packet& packet) {
+	switch(packet.type) {
+	case PACKET_TYPE_CONTROL:
+		return TX_CONTROL;
+	case PACKET_TYPE_STATE:
+		return TX_STATE;
+	default:
+		return TX_CONFIG;
+	}
+}
+
+uint32_t bb::XBee::airtimeMicros(size_t payloadLen, bool ack) {
+	return (FRAME_OVERHEAD_BYTES + payloadLen) * MICROS_PER_BYTE + IFS_MICROS + (ack ? ACK_MICROS : 0);
+}
+
+bb::XBee::TXEntry* bb::XBee::enqueue(TXClass cls, const HWAddress& dest, const Packet* packet) {
+	TXQueue& q = txQueues_[cls];
+	q.queued++;
+
+	if(packet != NULL && (cls == TX_CONTROL || cls == TX_STATE)) {
+		for(unsigned int i=0; i<q.count; i++) {
+			TXEntry& e = q.entries[i];
+			const Packet* queued = (const Packet*)e.payload;
+			if(e.isPacket && e.dest == dest && queued->type == packet->type && queued->source == packet->source) {
+				q.superseded++;
+				return &e;
+			}
+		}
+	}
+
+	if(q.count == BB_XBEE_TX_QUEUE_DEPTH) {
+		q.dropped++;
+		if(cls != TX_CONTROL && cls != TX_STATE) return NULL;
+		removeEntry(q, 0);
+	}
+
+	q.count++;
+	if(q.count > q.maxCount) q.maxCount = q.count;
+	return &q.entries[q.count-1];
+}
+
+void bb::XBee::removeEntry(TXQueue& q, unsigned int index) {
+	uint8_t* slot = q.entries[index].payload;
+	memmove(q.entries+index, q.entries+index+1, (q.count-index-1)*sizeof(TXEntry));
+	q.count--;
+	q.entries[q.count].payload = slot;
+}
+
+bb::Result bb::XBee::sendTo(const HWAddress& dest, const Packet& packet, bool ack, uint8_t repeats) {
+	if(apiMode_ == false) return RES_SUBSYS_WRONG_MODE;
+
+	TXEntry* e = enqueue(txClassFor(packet), dest, &packet);
+	if(e == NULL) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	packet.crc = packet.calculateCRC();
+	e->dest = dest;
+	e->len = sizeof(packet);
+	e->ack = ack;
+	e->isPacket = true;
+	e->sent = false;
+	e->repeats = repeats;
+	memcpy(e->payload, &packet, sizeof(packet));
+
+	flushTXQueue();
+	return RES_OK;
+}
+
+bb::Result bb::XBee::sendTo(const HWAddress& dest, const Packet& packet, const ControlFEC& fec, bool ack, uint8_t repeats) {
+	if(apiMode_ == false) return RES_SUBSYS_WRONG_MODE;
+	if(packet.type != PACKET_TYPE_CONTROL || !packet.fec) return RES_CMD_INVALID_ARGUMENT;
+
+	TXEntry* e = enqueue(TX_CONTROL, dest, &packet);
+	if(e == NULL) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	packet.crc = packet.calculateCRC();
+	e->dest = dest;
+	e->len = sizeof(packet) + sizeof(fec);
+	e->ack = ack;
+	e->isPacket = true;
+	e->sent = false;
+	e->repeats = repeats;
+	memcpy(e->payload, &packet, sizeof(packet));
+	memcpy(e->payload + sizeof(packet), &fec, sizeof(fec));
+
+	flushTXQueue();
+	return RES_OK;
+}
+
+bb::Result bb::XBee::sendTo(const HWAddress& dest, const uint8_t* payload, size_t len, bool ack, TXClass cls) {
+	if(cls >= TX_NUM_CLASSES) return RES_CMD_INVALID_ARGUMENT;
+	if(len > txQueues_[cls].slotSize) return RES_PACKET_TOO_LONG;
+	if(apiMode_ == false) return RES_SUBSYS_WRONG_MODE;
+
+	TXEntry* e = enqueue(cls, dest, NULL);
+	if(e == NULL) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	e->dest = dest;
+	e->len = len;
+	e->ack = ack;
+	e->isPacket = false;
+	e->sent = false;
+	e->repeats = 0;
+	memcpy(e->payload, payload, len);
+
+	flushTXQueue();
+	return RES_OK;
+}
+
+void bb::XBee::flushTXQueue() {
+	while(true) {
+		// First copies by class, then repeats by class
+		TXQueue* q = NULL;
+		unsigned int index = 0;
+		for(int pass=0; pass<2 && q == NULL; pass++) {
+			for(int c=0; c<TX_NUM_CLASSES && q == NULL; c++) {
+				for(unsigned int i=0; i<txQueues_[c].count; i++) {
+					if(txQueues_[c].entries[i].sent == (pass == 1)) {
+						q = &txQueues_[c];
+						index = i;
+						break;
+					}
+				}
+			}
+		}
+		if(q == NULL) return;
+
+		if(!airtimeAvailable()) {
+			budgetDeferrals_++;
+			return;
+		}
+
+		TXEntry& e = q->entries[index];
+		Result res;
+		const Packet* packet = (const Packet*)e.payload;
+		if(e.isPacket && e.len == sizeof(Packet)) {
+			res = sendToXBee(e.dest, *packet, e.ack);
+		} else {
+			if(e.isPacket) Trace::trace.record(Trace::EVENT_PACKET_TX, packet->source, packet->type); // with FEC trailer
+			res = sendToXBee(e.dest, e.payload, e.len, e.ack);
+		}
+		if(res == RES_OK) q->sent++;
+		else q->dropped++;
+
+		if(e.sent) e.repeats--;
+		e.sent = true;
+		if(res != RES_OK || e.repeats == 0) removeEntry(*q, index);
+	}
+}
+
+bool bb::XBee::airtimeAvailable() {
+	if(airtimeBudget_ == 0) return true;
+
+	int32_t max = airtimeBudget_ / AIRTIME_BURST_DIVIDER;
+	uint32_t now = Runloop::runloop.micros();
+	uint64_t refill = uint64_t(now - airtimeRefillMicros_) * airtimeBudget_ / 1000000;
+	if(refill != 0) {
+		airtimeTokens_ = refill >= uint64_t(max - airtimeTokens_) ? max : airtimeTokens_ + int32_t(refill);
+		airtimeRefillMicros_ = now;
+	}
+	if(airtimeTokens_ > max) airtimeTokens_ = max; // budget was lowered
+	return airtimeTokens_ >= 0;
+}
+
+void bb::XBee::chargeAirtime(uint32_t micros) {
+	airtimeUsed_ += micros;
+	if(airtimeBudget_ != 0) airtimeTokens_ -= micros;
+}
+
+void bb::XBee::resetTXStatistics() {
+	for(auto& q: txQueues_) {
+		q.maxCount = q.count;
+		q.queued = q.sent = q.superseded = q.dropped = 0;
+	}
+	airtimeUsed_ = budgetDeferrals_ = 0;
+}
+
 bb::Result bb::XBee::sendToXBee3(const HWAddress& dest, const bb::Packet& packet, bool ack) {
-	uint8_t buf[14+sizeof(packet)];
+	APIFrame frame(14+sizeof(packet));
+	uint8_t *buf = frame.data();
+	if(buf == NULL) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
 
 	packet.crc = packet.calculateCRC();
 
@@ -645,15 +920,25 @@ bb::Result bb::XBee::sendToXBee3(const HWAddress& dest, const bb::Packet& packet
 	}
 
 	memcpy(&(buf[14]), &packet, sizeof(packet));
+	Trace::trace.record(Trace::EVENT_PACKET_TX, packet.source, packet.type);
 	
-	APIFrame frame(buf, 14+sizeof(packet));
-	return send(frame);
+	frame.calcChecksum();
+	Result res = send(frame);
+	if(res == RES_OK) chargeAirtime(airtimeMicros(sizeof(packet), ack));
+	return res;
 }
 
 bb::Result bb::XBee::sendToXBee(const HWAddress& dest, const bb::Packet& packet, bool ack) {
-	uint8_t buf[11+sizeof(packet)];
-
 	packet.crc = packet.calculateCRC();
+	Trace::trace.record(Trace::EVENT_PACKET_TX, packet.source, packet.type);
+	return sendToXBee(dest, (const uint8_t*)&packet, sizeof(packet), ack);
+}
+
+bb::Result bb::XBee::sendToXBee(const HWAddress& dest, const uint8_t* payload, size_t len, bool ack) {
+	if(len > MAX_PAYLOAD) return RES_PACKET_TOO_LONG;
+	APIFrame frame(11+len);
+	uint8_t *buf = frame.data();
+	if(buf == NULL) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
 
 	buf[0] = 0x0;  // transmit request - 64bit frame. This is deprecated.
 	buf[1] = 0x0;  // no response frame
@@ -676,10 +961,12 @@ bb::Result bb::XBee::sendToXBee(const HWAddress& dest, const bb::Packet& packet,
 		buf[10] = 0;						// Use default value of TO
 	}
 
-	memcpy(&(buf[11]), &packet, sizeof(packet));
+	memcpy(&(buf[11]), payload, len);
 	
-	APIFrame frame(buf, 11+sizeof(packet));
-	return send(frame);
+	frame.calcChecksum();
+	Result res = send(frame);
+	if(res == RES_OK) chargeAirtime(airtimeMicros(len, ack));
+	return res;
 }
 
 bb::Result bb::XBee::sendConfigPacket(const HWAddress& dest,  
@@ -690,9 +977,9 @@ bb::Result bb::XBee::sendConfigPacket(const HWAddress& dest,
 	if(waitForReply == false) sPacket.payload.config.reply = ConfigPacket::CONFIG_TRANSMIT_NOREPLY;
 	else sPacket.payload.config.reply = ConfigPacket::CONFIG_TRANSMIT_REPLY;
 
-	Result res = sendTo(dest, sPacket, false);
+	Result res = sendToXBee(dest, sPacket, false); // not queued - we block for the reply below
 	if(res != RES_OK) {
-		Console::console.printfBroadcast("sendConfigPacket(): sendTo(): %s\n", errorMessage(res));
+		Console::console.printfBroadcast("sendConfigPacket(): sendToXBee(): %s\n", errorMessage(res));
 		return res;
 	}
 
@@ -712,6 +999,7 @@ bb::Result bb::XBee::sendConfigPacket(const HWAddress& dest,
 		uint8_t rssi;
 		Packet rPacket;
 		Result res = receiveAPIMode(srcAddr, rssi, rPacket);
+		if(res == RES_PACKET_CONSUMED || res == RES_PACKET_INCOMPLETE) continue;
 		if(res != RES_OK) {
 			Console::console.printfBroadcast("sendConfigPacket(): receiveAPIMode(): %s\n", errorMessage(res));
 			return res;
@@ -741,9 +1029,9 @@ bb::Result bb::XBee::sendPairingPacket(const HWAddress& dest, bb::PacketSource s
 	sPacket.payload.pairing = pairing;
 
 	bb::printf("Sending pairing packet to 0x%lx:%lx\n", dest.addrHi, dest.addrLo);
-	Result res = sendTo(dest, sPacket, false);
+	Result res = sendToXBee(dest, sPacket, false); // not queued - we block for the reply below
 	if(res != RES_OK) {
-		bb::printf("sendPairingPacket(): sendTo(): %s\n", errorMessage(res));
+		bb::printf("sendPairingPacket(): sendToXBee(): %s\n", errorMessage(res));
 		return res;
 	}
 
@@ -761,6 +1049,7 @@ bb::Result bb::XBee::sendPairingPacket(const HWAddress& dest, bb::PacketSource s
 		uint8_t rssi;
 		Packet rPacket;
 		Result res = receiveAPIMode(srcAddr, rssi, rPacket);
+		if(res == RES_PACKET_CONSUMED || res == RES_PACKET_INCOMPLETE) continue;
 		if(res != RES_OK) {
 			bb::printf("sendPairingPacket(): receiveAPIMode(): %s\n", errorMessage(res));
 			return res;
@@ -793,6 +1082,28 @@ int bb::XBee::numFailedACKs() {
 }
 
 
+void bb::XBee::printExtendedStatus(ConsoleStream *stream) {
+	printStatusLine(stream);
+	if(stream == NULL) return;
+	stream->printf("RX: %lu frames, %lu framing errors, %lu checksum errors, %lu bytes discarded%s\n", rx_.frames(),
+	               rx_.framingErrors(), rx_.checksumErrors(), rx_.discardedBytes(), rx_.inFrame() ? ", frame in progress" : "");
+	stream->printf("TX: %u of %u frame buffers in use, %lu frames without buffer\n", APIFrame::poolInUse(), APIFrame::POOL_SIZE,
+	               APIFrame::poolFailures());
+	stream->printf("Airtime: %lu us used, %ld us available of %u us/s budget%s, %lu deferrals\n", airtimeUsed_,
+	               (long)airtimeTokens_, airtimeBudget_, airtimeBudget_ == 0 ? " (unlimited)" : "", budgetDeferrals_);
+	for(int c=0; c<TX_NUM_CLASSES; c++) {
+		const TXQueue& q = txQueues_[c];
+		stream->printf("%s: %u of %d queued (max %u), %lu queued, %lu sent, %lu superseded, %lu dropped\n", TX_CLASS_NAMES[c],
+		               q.count, BB_XBEE_TX_QUEUE_DEPTH, q.maxCount, q.queued, q.sent, q.superseded, q.dropped);
+	}
+	for(int s=0; s<4; s++) {
+		const ControlFECDecoder& d = fecDecoders_[s];
+		if(d.framesReceived() == 0) continue;
+		stream->printf("FEC from source %d: %lu frames, %lu missed, %lu rebuilt (%lu too late)\n", s, d.framesReceived(),
+		               d.framesMissed(), d.framesRecovered(), d.framesLate());
+	}
+}
+
 bool bb::XBee::available() {
 	if(operationStatus_ != RES_OK) return false;
 	if(isInATMode()) leaveATMode();
@@ -816,40 +1127,46 @@ bb::Result bb::XBee::receiveAPIMode(HWAddress& srcAddr, uint8_t& rssi, Packet& p
 		return RES_SUBSYS_WRONG_MODE;
 	} 
 
-	APIFrame frame;
-	Result retval;
-
-	retval = receive(frame);
+	rxHasFEC_ = false;
+	Result retval = receiveFrame();
 	if(retval != RES_OK) return retval;
+	const uint8_t* data = rx_.data();
+	uint16_t length = rx_.length();
+	size_t payloadLen = 0;
 
-	//Console::console.printfBroadcast("Received frame of length %d, first char 0x%x\n", frame.length(), frame.data()[0]);
+	//Console::console.printfBroadcast("Received frame of length %d, first char 0x%x\n", length, data[0]);
 
-	if(frame.is16BitRXPacket()) { // 16bit address frame
+	if(data[0] == APIFrame::RECEIVE16BIT && length > 5) { // 16bit address frame
 		bb::printf("16bit address packet!\n");
-		if(frame.length() != sizeof(bb::Packet) + 5) {
-			Console::console.printfBroadcast("Invalid API Mode 16bit addr packet size %d (expected %d)\n", frame.length(), sizeof(bb::Packet) + 5);
+		payloadLen = length - 5;
+		if(payloadLen != sizeof(bb::Packet) && payloadLen != sizeof(bb::Packet) + sizeof(ControlFEC)) {
+			Console::console.printfBroadcast("Invalid API Mode 16bit addr packet size %d (expected %d)\n", length, sizeof(bb::Packet) + 5);
 			return RES_SUBSYS_COMM_ERROR;
 		}
-		srcAddr = {0, uint32_t(frame.data()[1] << 8) | frame.data()[2]};
-		rssi = frame.data()[3];
-		memcpy(&packet, &(frame.data()[5]), sizeof(packet));
-	} else if(frame.is64BitRXPacket()) { // 64bit address frame
-		if(frame.length() != sizeof(bb::Packet) + 11) {
-			Console::console.printfBroadcast("Invalid API Mode 64bit addr packet size %d (expected %d)\n", frame.length(), sizeof(bb::Packet) + 11);
+		srcAddr = {0, uint32_t(data[1] << 8) | data[2]};
+		rssi = data[3];
+		memcpy(&packet, &(data[5]), sizeof(packet));
+	} else if(data[0] == APIFrame::RECEIVE64BIT && length > 11) { // 64bit address frame
+		srcAddr.addrHi = (uint32_t(data[1]) << 24) | (uint32_t(data[2]) << 16) |
+				         (uint32_t(data[3]) <<  8) | uint32_t(data[4]);
+		srcAddr.addrLo = (uint32_t(data[5]) << 24) | (uint32_t(data[6]) << 16) |
+				         (uint32_t(data[7]) <<  8) | uint32_t(data[8]);
+		rssi = data[9];
+		if(length > 11 && handleParameterBlock(srcAddr, &(data[11]), length - 11)) {
+			return RES_PACKET_CONSUMED;
+		}
+		payloadLen = length - 11;
+		if(payloadLen != sizeof(bb::Packet) && payloadLen != sizeof(bb::Packet) + sizeof(ControlFEC)) {
+			Console::console.printfBroadcast("Invalid API Mode 64bit addr packet size %d (expected %d)\n", length, sizeof(bb::Packet) + 11);
 			return RES_SUBSYS_COMM_ERROR;
 		}
-		srcAddr.addrHi = (uint32_t(frame.data()[1]) << 24) | (uint32_t(frame.data()[2]) << 16) |
-				         (uint32_t(frame.data()[3]) <<  8) | uint32_t(frame.data()[4]);
-		srcAddr.addrLo = (uint32_t(frame.data()[5]) << 24) | (uint32_t(frame.data()[6]) << 16) |
-				         (uint32_t(frame.data()[7]) <<  8) | uint32_t(frame.data()[8]);
-		rssi = frame.data()[9];
-		memcpy(&packet, &(frame.data()[11]), sizeof(packet));
+		memcpy(&packet, &(data[11]), sizeof(packet));
 #if 0
 		Console::console.printfBroadcast("Source addr: 0x%0lx:%0lx \n", srcAddr.addrHi, srcAddr.addrLo);
 		Console::console.printfBroadcast("Source: %d Type: %d Seqnum: %d\n", packet.source, packet.type, packet.seqnum);
 #endif
 	} else {
-		Console::console.printfBroadcast("Unknown frame type 0x%x\n", frame.data()[0]);
+		Console::console.printfBroadcast("Unknown frame type 0x%x\n", data[0]);
 		return RES_SUBSYS_COMM_ERROR;
 	}
 
@@ -859,9 +1176,29 @@ bb::Result bb::XBee::receiveAPIMode(HWAddress& srcAddr, uint8_t& rssi, Packet& p
 		return RES_SUBSYS_COMM_ERROR;
 	}
 
+	if(payloadLen != sizeof(bb::Packet)) {
+		if(packet.type != PACKET_TYPE_CONTROL || !packet.fec) {
+			Console::console.printfBroadcast("Packet of type %d with FEC trailer\n", packet.type);
+			return RES_SUBSYS_COMM_ERROR;
+		}
+		memcpy(&rxFEC_, data + length - sizeof(ControlFEC), sizeof(ControlFEC));
+		// The packet itself is fine even if the trailer isn't
+		rxHasFEC_ = rxFEC_.calculateCRC() == rxFEC_.crc;
+	}
+
 	return RES_OK;
 }
 
+bool bb::XBee::handleParameterBlock(const HWAddress& srcAddr, const uint8_t* payload, size_t len) {
+	if(len < sizeof(ParamBlockHeader) || len > sizeof(paramBlockBuf_)) return false;
+	if(((const ParamBlockHeader*)payload)->magic != PARAM_BLOCK_MAGIC) return false;
+
+	memcpy(paramBlockBuf_, payload, len);
+	size_t replyLen = SubsystemManager::manager.handleParameterBlock(paramBlockBuf_, len, sizeof(paramBlockBuf_));
+	if(replyLen != 0) sendTo(srcAddr, paramBlockBuf_, replyLen, false);
+	return true;
+}
+
 String bb::XBee::sendStringAndWaitForResponse(const String& str, int predelay, bool cr) {
   	if(debug_ & DEBUG_XBEE_COMM) {
     	Console::console.printfBroadcast("Sending \"%s\"...", str.c_str());
@@ -939,7 +1276,11 @@ bb::Result bb::XBee::sendAPIModeATCommand(uint8_t frameID, const char* cmd, uint
 	bool received = false;
 	for(int i=0; i<10 && received == false; i++) {
 		if(uart_->available()) {
-			if(receive(frame) != RES_OK) return RES_SUBSYS_COMM_ERROR;
+			Result res = receive(frame);
+			if(res == RES_PACKET_INCOMPLETE) {
+				delay(1);
+				continue;
+			} else if(res != RES_OK) return RES_SUBSYS_COMM_ERROR;
 			else if(!frame.isATResponse()) {
 				Console::console.printfBroadcast("Ignoring frame of type 0x%x while waiting for AT response\n", frame.data()[0]);
 				continue;
@@ -995,28 +1336,34 @@ bb::Result bb::XBee::sendAPIModeATCommand(uint8_t frameID, const char* cmd, uint
 	return res;
 }
 
-static uint32_t total = 0;
-
-//#define MEMDEBUG
+uint8_t bb::XBee::APIFrame::pool_[POOL_SIZE][MAX_LENGTH];
+uint8_t bb::XBee::APIFrame::poolUsed_ = 0;
+unsigned long bb::XBee::APIFrame::poolFailures_ = 0;
+
+uint8_t* bb::XBee::APIFrame::acquire(uint16_t length) {
+	static_assert(MAX_LENGTH == FrameParser::MAX_LENGTH, "Received frames must fit into an APIFrame");
+	static_assert(POOL_SIZE <= 8, "The pool bitmask has 8 bits");
+	if(length <= MAX_LENGTH) {
+		for(unsigned int i=0; i<POOL_SIZE; i++) {
+			if((poolUsed_ & (1<<i)) == 0) {
+				poolUsed_ |= (1<<i);
+				return pool_[i];
+			}
+		}
+	}
+	poolFailures_++;
+	return NULL;
+}
 
-static uint8_t *allocBlock(uint32_t size, const char *loc="unknown") {
-#if defined(MEMDEBUG)
-	bb::Console::console.printfBroadcast("Allocing block size %d from \"%s\"...", size, loc);
-#endif
-	uint8_t *block = new uint8_t[size];
-	total += size;
-#if defined(MEMDEBUG)
-	bb::Console::console.printfBroadcast("result: 0x%x, total %d.\n", block, total);
-#endif
-	return block;
+void bb::XBee::APIFrame::release(uint8_t* buf) {
+	if(buf == NULL) return;
+	poolUsed_ &= ~(1 << ((buf - pool_[0]) / MAX_LENGTH));
 }
 
-static void freeBlock(uint8_t *block, uint32_t size, const char *loc="unknown") {
-	delete block;
-	total -= size;
-#if defined(MEMDEBUG)
-	bb::Console::console.printfBroadcast("Deleted block 0x%x, size %d, total %d from \"%s\"\n", block, size, total, loc);
-#endif
+unsigned int bb::XBee::APIFrame::poolInUse() {
+	unsigned int n = 0;
+	for(unsigned int i=0; i<POOL_SIZE; i++) if(poolUsed_ & (1<<i)) n++;
+	return n;
 }
 
 bb::XBee::APIFrame::APIFrame() {
@@ -1026,70 +1373,57 @@ bb::XBee::APIFrame::APIFrame() {
 }
 
 bb::XBee::APIFrame::APIFrame(const uint8_t *data, uint16_t length) {
-	//data_ = new uint8_t[length];
-	data_ = allocBlock(length, "APIFrame(const uint8_t*,uint16_t)");
-	length_ = length;
-	memcpy(data_, data, length);
-	calcChecksum();
+	data_ = NULL;
+	length_ = 0;
+	set(data, length);
 }
 
 bb::XBee::APIFrame::APIFrame(const bb::XBee::APIFrame& other) {
-	//Console::console.printfBroadcast("APIFrame 2\n");
-	if(other.data_ != NULL) {
-		length_ = other.length_;
-		data_ = allocBlock(length_, "APIFrame(const APIFrame&)");
-//		data_ = new uint8_t[length_];
-		memcpy(data_, other.data_, length_);
-	} else {
-		data_ = NULL;
-		length_ = 0;
-	}
+	data_ = NULL;
+	length_ = 0;
+	if(other.data_ != NULL) set(other.data_, other.length_);
 	checksum_ = other.checksum_;
 }
 
 bb::XBee::APIFrame::APIFrame(uint16_t length) {
-	//Console::console.printfBroadcast("APIFrame 1\n");
-	//data_ = new uint8_t[length];
-	data_ = allocBlock(length, "APIFrame(uint16_t)");
-	length_ = length;
+	data_ = acquire(length);
+	length_ = data_ != NULL ? length : 0;
+	checksum_ = 0;
 }
 
 bb::XBee::APIFrame& bb::XBee::APIFrame::operator=(const APIFrame& other) {
-	//Console::console.printfBroadcast("operator=\n");
-	if(other.data_ == NULL) {           	// they don't have data
-		if(data_ != NULL) {
-			freeBlock(data_, length_, "operator=(const APIFrame&) 1");
-			//delete data_; 	// ...but we do - delete
-		}
-		data_ = NULL;						// now we don't have data either
+	if(this == &other) return *this;
+	if(other.data_ == NULL) {
+		release(data_);
+		data_ = NULL;
 		length_ = 0;
-	} else {  								// they do have data
-		if(data_ != NULL) {					// and so do we
-			if(length_ != other.length_) {	// but it's of a different size
-				//delete data_;				// reallocate
-				freeBlock(data_, length_, "operator=(const APIFrame&) 2");
-				length_ = other.length_;
-				//data_ = new uint8_t[length_];
-				data_ = allocBlock(length_, "operator=(const APIFrame&) 3");
-			}
-			memcpy(data_, other.data_, length_); // and copy
-		} else {							// and we don't
-			length_ = other.length_;		
-			//data_ = new uint8_t[length_];
-			data_ = allocBlock(length_, "operator=(const APIFrame&) 4");
-			memcpy(data_, other.data_, length_);
-		}
+	} else {
+		set(other.data_, other.length_);
 	}
 	checksum_ = other.checksum_;
-
 	return *this;
 }
 
-bb::XBee::APIFrame::~APIFrame() {
-	if(data_ != NULL) {
-		//delete data_;
-		freeBlock(data_, length_, "~APIFrame");
+bool bb::XBee::APIFrame::set(const uint8_t *data, uint16_t length) {
+	if(length > MAX_LENGTH) {
+		poolFailures_++;
+		return false;
+	}
+	if(data_ == NULL) {
+		data_ = acquire(length);
+		if(data_ == NULL) {
+			length_ = 0;
+			return false;
+		}
 	}
+	memcpy(data_, data, length);
+	length_ = length;
+	calcChecksum();
+	return true;
+}
+
+bb::XBee::APIFrame::~APIFrame() {
+	release(data_);
 }
 
 void bb::XBee::APIFrame::calcChecksum() {
@@ -1166,36 +1500,23 @@ bb::Result bb::XBee::APIFrame::unpackATResponse(uint8_t &frameID, uint16_t &comm
 	return RES_OK;
 }
 
-static inline int writeEscapedByte(HardwareSerial* uart, uint8_t byte) {
-	int sent = 0;
+static inline size_t appendEscapedByte(uint8_t* buf, size_t pos, uint8_t byte) {
 	if(byte == 0x7d || byte == 0x7e || byte == 0x11 || byte == 0x13) {
-		sent += uart->write(0x7d);
-		sent += uart->write(byte ^ 0x20);
+		buf[pos++] = 0x7d;
+		buf[pos++] = byte ^ 0x20;
 	} else {
-		sent += uart->write(byte);
+		buf[pos++] = byte;
 	}
-	return sent;
-}
-
-static inline uint8_t readEscapedByte(HardwareSerial* uart) {
-	uint8_t byte = uart->read();
-	if(byte != 0x7d) return byte;
-	return (uart->read()^0x20);
+	return pos;
 }
 
 bb::Result bb::XBee::send(const APIFrame& frame) {
 	if(apiMode_ == false) return RES_SUBSYS_WRONG_MODE;
+	if(frame.data() == NULL) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
 	
 	uint16_t length = frame.length();
 	const uint8_t *data = frame.data();
 
-	uint8_t lengthMSB = (length >> 8) & 0xff;
-	uint8_t lengthLSB = length & 0xff;
-	
-	uart_->write(0x7e); // start delimiter
-	writeEscapedByte(uart_, lengthMSB);
-	writeEscapedByte(uart_, lengthLSB);
-
 #if 0
 	Console::console.printfBroadcast("Writing %d bytes: ", length);
 	for(uint16_t i=0; i<length; i++) {
@@ -1205,59 +1526,103 @@ bb::Result bb::XBee::send(const APIFrame& frame) {
 	Console::console.printfBroadcast("Writing checksum %x\n", frame.checksum());
 #endif
 
+	size_t pos = 0;
+	txBuf_[pos++] = 0x7e; // start delimiter
+	pos = appendEscapedByte(txBuf_, pos, (length >> 8) & 0xff);
+	pos = appendEscapedByte(txBuf_, pos, length & 0xff);
 	for(uint16_t i=0; i<length; i++) {
-		writeEscapedByte(uart_, data[i]);
+		pos = appendEscapedByte(txBuf_, pos, data[i]);
 	}
-	writeEscapedByte(uart_, frame.checksum());
+	pos = appendEscapedByte(txBuf_, pos, frame.checksum());
 
+	if(uart_->write(txBuf_, pos) != pos) return RES_SUBSYS_COMM_ERROR;
 	return RES_OK;
 }
 
 bb::Result bb::XBee::receive(APIFrame& frame) {
-	uint8_t byte = 0xff;
+	Result res = receiveFrame();
+	if(res != RES_OK) return res;
+	if(!frame.set(rx_.data(), rx_.length())) return RES_SUBSYS_RESOURCE_NOT_AVAILABLE;
+	return RES_OK;
+}
 
+bb::Result bb::XBee::receiveFrame() {
 	while(uart_->available()) {
-		byte = uart_->read();
-		if(byte == 0x7e) {
-			break;
-		} else {
-			// Console::console.printfBroadcast("Read garbage '%c' 0x%x\n", byte, byte);
-		}
+		if(rx_.feed(uart_->read())) return RES_OK;
 	}
-	if(byte != 0x7e) {
-		return RES_SUBSYS_COMM_ERROR;
-	}
-//	Console::console.printfBroadcast("Start delimiter found\n");
+	return RES_PACKET_INCOMPLETE;
+}
 
-	if(!uart_->available()) delayMicroseconds(200);
-	if(!uart_->available()) return RES_SUBSYS_COMM_ERROR;	
-	uint8_t lengthMSB = readEscapedByte(uart_);
-	if(!uart_->available()) delayMicroseconds(200);
-	if(!uart_->available()) return RES_SUBSYS_COMM_ERROR;	
-	uint8_t lengthLSB = readEscapedByte(uart_);
+bb::XBee::FrameParser::FrameParser() {
+	reset();
+	resetCounters();
+}
 
-	if(lengthLSB == 0x7e || lengthMSB == 0x7e) {
-		Console::console.printfBroadcast("Extra start delimiter found\n");
-		return RES_SUBSYS_COMM_ERROR;		
-	}
+void bb::XBee::FrameParser::reset() {
+	state_ = WAIT_DELIMITER;
+	escaped_ = false;
+	length_ = pos_ = 0;
+	sum_ = 0;
+}
 
-	uint16_t length = (lengthMSB << 8) | lengthLSB;
-	frame = APIFrame(length);
-	uint8_t *buf = frame.data();
-	for(uint16_t i=0; i<length; i++) {
-		//Console::console.printfBroadcast("Reading byte %d of %d\n", i, length);
-		if(!uart_->available()) delayMicroseconds(200);
-		buf[i] = readEscapedByte(uart_);
+bool bb::XBee::FrameParser::feed(uint8_t byte) {
+	if(byte == 0x7e) { // start delimiter - never escaped
+		if(state_ != WAIT_DELIMITER) framingErrors_++;
+		state_ = LENGTH_MSB;
+		escaped_ = false;
+		return false;
+	}
+	if(state_ == WAIT_DELIMITER) {
+		discardedBytes_++;
+		return false;
 	}
-	frame.calcChecksum();
 
-	if(!uart_->available()) delayMicroseconds(200);
-	uint8_t checksum = readEscapedByte(uart_);
+	if(byte == 0x7d) {
+		if(escaped_) { // escaped escape
+			framingErrors_++;
+			reset();
+		} else {
+			escaped_ = true;
+		}
+		return false;
+	}
+	if(escaped_) {
+		byte ^= 0x20;
+		escaped_ = false;
+	}
 
-	if(frame.verifyChecksum(checksum) == false) {
-		//Console::console.printfBroadcast("Checksum invalid - expected 0x%x, got 0x%x\n", frame.checksum(), checksum);
-		return RES_SUBSYS_COMM_ERROR;
+	switch(state_) {
+	case LENGTH_MSB:
+		length_ = byte << 8;
+		state_ = LENGTH_LSB;
+		break;
+	case LENGTH_LSB:
+		length_ |= byte;
+		if(length_ == 0 || length_ > MAX_LENGTH) {
+			framingErrors_++;
+			reset();
+			break;
+		}
+		pos_ = 0;
+		sum_ = 0;
+		state_ = DATA;
+		break;
+	case DATA:
+		buf_[pos_++] = byte;
+		sum_ += byte;
+		if(pos_ == length_) state_ = CHECKSUM;
+		break;
+	case CHECKSUM:
+		state_ = WAIT_DELIMITER;
+		if(uint8_t(sum_ + byte) != 0xff) {
+			checksumErrors_++;
+			return false;
+		}
+		frames_++;
+		return true;
+	default:
+		break;
 	}
 
-	return RES_OK;
-}
\ No newline at end of file
+	return false;
+}
@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include <vector>
+#include <functional>
 #include "BBSubsystem.h"
 #include "BBConfigStorage.h"
 #include "BBPacket.h"
@@ -11,6 +12,10 @@
 #define DEFAULT_PAN     0x3332
 
 #define DEFAULT_BPS     9600
+
+#if !defined(BB_XBEE_TX_QUEUE_DEPTH)
+#define BB_XBEE_TX_QUEUE_DEPTH 4   // per transmit class
+#endif
 	
 namespace bb {
 
@@ -18,6 +23,9 @@ class XBee: public Subsystem {
 public:
 	static XBee xbee;
 
+	//! Largest RF payload of an unencrypted 802.15.4 frame.
+	static const size_t MAX_PAYLOAD = 100;
+
 	enum StationType {
 		STATION_DROID      = 0,
 		STATION_REMOTE     = 1,
@@ -53,9 +61,10 @@ public:
 	virtual Result stop(ConsoleStream *stream = NULL);
 	virtual Result step();
 	virtual Result parameterValue(const String& name, String& value);
-	virtual Result setParameterValue(const String& name, const String& value);
+	virtual Result setParameterValue(const char* name, const char* value);
+	virtual void parameterChangedCallback(const char* name);
+	virtual void printExtendedStatus(ConsoleStream *stream = NULL);
 	virtual Result initialize(uint8_t chan, uint16_t pan, uint32_t bps, HardwareSerial *uart=&Serial1);
-	virtual Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream);
 
 	Result addPacketReceiver(PacketReceiver *receiver);
 	Result removePacketReceiver(PacketReceiver *receiver);
@@ -82,17 +91,57 @@ public:
 		char name[20];
 	};
 	Result discoverNodes(std::vector<Node>& nodes);
+	//! Non-blocking discoverNodes(). The responses are collected in the runloop's idle time, and done is called with
+	//! the discovered nodes when the discovery period (10s) is over. Like with discoverNodes(), incoming packets are
+	//! dropped while the discovery is running.
+	Result discoverNodesAsync(std::function<void(Result, const std::vector<Node>&)> done);
+	bool isDiscovering() { return discovering_; }
 
 	Result send(const String& str);
 	Result send(const uint8_t *bytes, size_t size);
 	Result send(const Packet& packet);
 
-	//! Send a packet to the given 64bit HW address. Uses sendToXBee(), not sendtoXBee3(), because the latter is not supported by all firmwares.
-	Result sendTo(const HWAddress& dest, const Packet& packet, bool ack) { return sendToXBee(dest, packet, ack); }
+	//! Transmit priority classes, highest first.
+	enum TXClass {
+		TX_CONTROL    = 0,
+		TX_STATE      = 1,
+		TX_CONFIG     = 2, // config and pairing packets
+		TX_DIAGNOSTIC = 3, // raw payloads, e.g. bulk parameter replies
+		TX_NUM_CLASSES
+	};
+	static TXClass txClassFor(const Packet& packet);
+	//! Estimated time the frame occupies the 250kbps channel: PHY and MAC overhead, the interframe space, and the ACK if requested.
+	static uint32_t airtimeMicros(size_t payloadLen, bool ack);
+
+	/*!
+		\brief Queue a packet for sending to the given 64bit HW address.
+
+		Packets go out right away if the airtime budget allows, else from step() once it does - highest class first,
+		and within a class in the order they were queued. A control or state packet supersedes one of the same type
+		and source that's still queued for the same destination, so a backed up queue never sends stale commands.
+		repeats sends that many extra copies, but only when no first copy of any class is waiting.
+
+		If a class queue is full, control and state drop their oldest packet, config and diagnostics refuse the new
+		one with RES_SUBSYS_RESOURCE_NOT_AVAILABLE. Sends with sendToXBee(), not sendToXBee3(), because the latter is
+		not supported by all firmwares.
+	*/
+	Result sendTo(const HWAddress& dest, const Packet& packet, bool ack, uint8_t repeats = 0);
+	//! Same for a control packet with a forward error correction trailer - see ControlFECEncoder::encode().
+	Result sendTo(const HWAddress& dest, const Packet& packet, const ControlFEC& fec, bool ack, uint8_t repeats = 0);
+	//! Same for a raw payload of up to MAX_PAYLOAD bytes. In the other classes, it mustn't be longer than a packet
+	//! with a FEC trailer (PACKET_SLOT_SIZE).
+	Result sendTo(const HWAddress& dest, const uint8_t* payload, size_t len, bool ack, TXClass cls = TX_DIAGNOSTIC);
+	//! Sends what the airtime budget allows. Called from step().
+	void flushTXQueue();
+	unsigned int txQueueDepth(TXClass cls) { return txQueues_[cls].count; }
+	void resetTXStatistics();
 	//! Send using the newer 0x10 instruction, which is not supported by older firmwares
 	Result sendToXBee3(const HWAddress& dest, const Packet& packet, bool ack);
-	//! Send using the old 0x00 instruction, deprecated but still supported by all firmwares
+	//! Send using the old 0x00 instruction, deprecated but still supported by all firmwares. Sends immediately,
+	//! bypassing the queue, but is charged to the airtime budget.
 	Result sendToXBee(const HWAddress& dest, const Packet& packet, bool ack);
+	//! Same for a raw payload of up to MAX_PAYLOAD bytes.
+	Result sendToXBee(const HWAddress& dest, const uint8_t* payload, size_t len, bool ack);
 	Result sendConfigPacket(const HWAddress& dest, bb::PacketSource src, const ConfigPacket& packet, ConfigPacket::ConfigReplyType& replyType,
 	                        uint8_t seqnum, bool waitForReply = true);
 	Result sendPairingPacket(const HWAddress& dest, bb::PacketSource src, PairingPacket& packet, uint8_t seqnum);
@@ -100,7 +149,18 @@ public:
 	
 	bool available();
 	String receive();
+	/*!
+		\brief Takes what the UART has, up to the end of the next frame, and unpacks the packet in it.
+
+		Never waits for bytes - if the frame isn't complete yet, returns RES_PACKET_INCOMPLETE and picks up where it
+		left off on the next call. Returns RES_PACKET_CONSUMED for frames handled by the XBee subsystem itself
+		(bulk parameter requests). If the packet came with a ControlFEC trailer, receivedFEC() returns it until the
+		next call.
+	*/
 	Result receiveAPIMode(HWAddress& src, uint8_t& rssi, Packet& packet);
+	const ControlFEC* receivedFEC() { return rxHasFEC_ ? &rxFEC_ : NULL; }
+	//! Rebuilds lost control frames from source, see step().
+	ControlFECDecoder& fecDecoder(PacketSource source) { return fecDecoders_[source]; }
 
 	typedef enum {
 		DEBUG_SILENT = 0,
@@ -113,6 +173,10 @@ public:
 protected:
 	XBee();
 	virtual ~XBee();
+	Result cmdSend(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdAPIMode(const ConsoleWords& words, ConsoleStream *stream);
+	Result cmdTXReset(const ConsoleWords& words, ConsoleStream *stream);
+	static const CommandDef COMMANDS[];
 
 	DebugFlags debug_;
 	int timeout_;
@@ -122,22 +186,71 @@ protected:
 	int currentBPS_;
 	bool apiMode_;
 
+	Result receiveNodeDiscoveryResponse(Node& node);
+
+	struct TXEntry {
+		HWAddress dest;
+		uint8_t len;
+		bool ack, isPacket;
+		bool sent;           // first copy is out
+		uint8_t repeats;     // copies left after the first
+		uint8_t* payload;    // one of the class's slots - moves along with the entry
+	};
+	struct TXQueue {
+		TXEntry entries[BB_XBEE_TX_QUEUE_DEPTH]; // oldest first
+		unsigned int count, maxCount;
+		size_t slotSize;
+		unsigned long queued, sent, superseded, dropped;
+	};
+	TXEntry* enqueue(TXClass cls, const HWAddress& dest, const Packet* packet);
+	//! Keeps the entry's payload slot for the next one queued.
+	void removeEntry(TXQueue& q, unsigned int index);
+	void chargeAirtime(uint32_t micros);
+	bool airtimeAvailable();
+	TXQueue txQueues_[TX_NUM_CLASSES];
+	// Control, state and config only ever queue a packet, with a FEC trailer at most. Only diagnostics (the last class)
+	// need room for MAX_PAYLOAD.
+	static const size_t PACKET_SLOT_SIZE = sizeof(Packet) + sizeof(ControlFEC);
+	uint8_t packetSlots_[TX_DIAGNOSTIC][BB_XBEE_TX_QUEUE_DEPTH][PACKET_SLOT_SIZE];
+	uint8_t diagnosticSlots_[BB_XBEE_TX_QUEUE_DEPTH][MAX_PAYLOAD];
+	unsigned int airtimeBudget_;       // us per second, 0 is unlimited
+	int32_t airtimeTokens_;            // may go negative - a frame goes out as long as this isn't
+	uint32_t airtimeRefillMicros_;
+	unsigned long airtimeUsed_, budgetDeferrals_;
+
+	//! Answers the frame if it holds a bulk parameter request. Returns false if it doesn't.
+	bool handleParameterBlock(const HWAddress& srcAddr, const uint8_t* payload, size_t len);
+	uint8_t paramBlockBuf_[sizeof(ParamBlockHeader) + MAX_XBEE_PARAM_ENTRIES*sizeof(ParamEntry)];
+	bool discovering_;
+	uint32_t discoveryStartMS_;
+	std::vector<Node> discoveredNodes_;
+	std::function<void(Result, const std::vector<Node>&)> discoveryDone_;
+
 	typedef struct {
 		int chan;
 		int pan;
 		int bps;
 		char name[20];
+		unsigned int airtimeBudget;
 	} XBeeParams;
 	XBeeParams params_;
 	HWAddress hwAddress_;
 	ConfigStorage::HANDLE paramsHandle_;
 	std::vector<PacketReceiver*> receivers_;
 
-	uint8_t packetBuf_[255];
-	size_t packetBufPos_;
+	/*!
+		\brief An API frame's data (frame type onwards), held in a buffer from a small fixed pool.
 
+		Frames are built in place: construct with the length, fill in data(), then calcChecksum(). Nothing is
+		allocated on the heap. If the pool is used up or the length is over MAX_LENGTH, the frame stays empty
+		(data() is NULL) and send() refuses it.
+	*/
 	class APIFrame {
 	public:
+		//! Same as FrameParser::MAX_LENGTH, so any received frame fits.
+		static const uint16_t MAX_LENGTH = 128;
+		static const unsigned int POOL_SIZE = 4;
+
 		APIFrame();
 		APIFrame(const uint8_t *data, uint16_t dataLength);
 		APIFrame(uint16_t length);
@@ -145,6 +258,12 @@ protected:
 		~APIFrame();
 
 		APIFrame& operator=(const APIFrame& frame);
+		//! Copies data into the frame, taking a buffer from the pool if it doesn't have one yet.
+		bool set(const uint8_t *data, uint16_t length);
+		
+		static unsigned int poolInUse();
+		//! Frames that couldn't get a buffer.
+		static unsigned long poolFailures() { return poolFailures_; }
 		
 		virtual uint8_t *data() const { return data_; }
 		virtual uint16_t length() const { return length_; }
@@ -205,16 +324,79 @@ protected:
 		};
 
 	protected:
+		static uint8_t* acquire(uint16_t length);
+		static void release(uint8_t* buf);
+
+		static uint8_t pool_[POOL_SIZE][MAX_LENGTH];
+		static uint8_t poolUsed_; // bitmask
+		static unsigned long poolFailures_;
+
 		uint8_t *data_;
 		uint16_t length_;
 		uint8_t checksum_;
 	};
 
+	/*!
+		\brief Incremental API frame parser.
+
+		Takes the bytes as they come off the wire, undoing 0x7d escapes and summing up the checksum on the fly, so a
+		frame can arrive across any number of runloop cycles. An unescaped 0x7e always starts a new frame.
+	*/
+	class FrameParser {
+	public:
+		//! Enough for an RX frame (11 bytes header) with MAX_PAYLOAD bytes, and for any AT response.
+		static const uint16_t MAX_LENGTH = 128;
+
+		FrameParser();
+		void reset();
+		//! Returns true if byte completes a frame with a valid checksum, which is then in data() until the next feed().
+		bool feed(uint8_t byte);
+
+		const uint8_t* data() const { return buf_; }
+		uint16_t length() const { return length_; }
+		bool inFrame() const { return state_ != WAIT_DELIMITER; }
+
+		unsigned long frames() const { return frames_; }
+		//! Frames cut short by a start delimiter, invalid escapes, and lengths of 0 or over MAX_LENGTH.
+		unsigned long framingErrors() const { return framingErrors_; }
+		unsigned long checksumErrors() const { return checksumErrors_; }
+		//! Bytes outside of frames.
+		unsigned long discardedBytes() const { return discardedBytes_; }
+		void resetCounters() { frames_ = framingErrors_ = checksumErrors_ = discardedBytes_ = 0; }
+
+	protected:
+		enum State {
+			WAIT_DELIMITER,
+			LENGTH_MSB,
+			LENGTH_LSB,
+			DATA,
+			CHECKSUM
+		};
+
+		State state_;
+		bool escaped_;
+		uint16_t length_, pos_;
+		uint8_t sum_;
+		uint8_t buf_[MAX_LENGTH];
+		unsigned long frames_, framingErrors_, checksumErrors_, discardedBytes_;
+	};
+	FrameParser rx_;
+	ControlFEC rxFEC_;
+	bool rxHasFEC_;
+	ControlFECDecoder fecDecoders_[4]; // by PacketSource
+	// Start delimiter, then length, data and checksum, every byte of which may need escaping.
+	uint8_t txBuf_[1 + 2*(2 + APIFrame::MAX_LENGTH + 1)];
+
+	//! Feeds rx_ what the UART has, up to the end of the next frame. Returns RES_PACKET_INCOMPLETE if there's none yet.
+	Result receiveFrame();
+
 	String sendStringAndWaitForResponse(const String& str, int predelay=0, bool cr=true);
 	bool sendStringAndWaitForOK(const String& str, int predelay=0, bool cr=true);
 	bool readString(String& str, unsigned char terminator='\r');
 
+	//! Escapes the frame into txBuf_ and hands it to the UART in one write.
 	Result send(const APIFrame& frame);
+	//! Copies the next frame out of rx_. Same non-blocking behaviour as receiveAPIMode().
 	Result receive(APIFrame& frame);
 };
 
@@ -6,19 +6,28 @@
 
 #include "BBSubsystem.h"
 #include "BBXBee.h"
-#include "BBWifiServer.h"
 #include "BBConsole.h"
 #include "BBRunloop.h"
+#include "BBTrace.h"
+#include "BBLogRecord.h"
+#include "BBBinaryLog.h"
+#include "BBLogLimiter.h"
+#include "BBFastLoop.h"
+#include "BBStorageBackend.h"
 #include "BBConfigStorage.h"
 #include "BBControllers.h"
 #include "BBLowPassFilter.h"
+#include "BBLinkQuality.h"
 #include "BBDCMotor.h"
+#if !defined(ARDUINO_ARCH_NATIVE) // host build (see Utilities/LibBBBench) has no WiFi, IMU, servos
+#include "BBWifiServer.h"
 #include "BBIMU.h"
 #include "BBServos.h"
+#include "BBLinAlg.h"
+#endif
 #if defined(ARDUINO_ARCH_SAMD)
 #include "BBEncoder.h"
 #endif
-#include "BBLinAlg.h"
 
 // A couple of convenience macros
 #define WRAPPEDDIFF(a, b, max) ((a>=b) ? a-b : (max-b)+a)
@@ -24,8 +24,7 @@ public:
   Result start(ConsoleStream *stream = NULL);
   Result stop(ConsoleStream *stream = NULL);
   Result step();
-  Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream);
-	virtual void parameterChangedCallback(const String& name);
+	virtual void parameterChangedCallback(const char* name);
 
   Result incomingControlPacket(const HWAddress& srcAddr, PacketSource source, uint8_t rssi, uint8_t seqnum, const ControlPacket& packet);
   Result incomingStatePacket(const HWAddress& srcAddr, PacketSource source, uint8_t rssi, uint8_t seqnum, const StatePacket& packet);
@@ -51,6 +50,12 @@ public:
 
   void setSendRepeats(uint8_t sr);
   uint8_t sendRepeats() { return params_.config.sendRepeats; }
+  void setAdaptiveRepeats(bool yesno);
+  bool adaptiveRepeats() { return params_.config.adaptiveRepeats; }
+  //! What the last control packet went out with - differs from sendRepeats() in adaptive mode.
+  uint8_t currentRepeats() { return currentRepeats_; }
+  const LinkQuality& droidLink() { return droidLink_; }
+  uint8_t fecSpan() { return params_.config.fecSpan; }
 
   void startCalibration();
   void finishCalibration();
@@ -80,8 +85,23 @@ public:
 
 protected:
   RRemote();
+  void addTasks();
+  Result cmdRunningStatus(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdCalibrate(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdCalibrateIMU(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdReset(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSetDroid(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdSetOtherRemote(const ConsoleWords& words, ConsoleStream *stream);
+  Result cmdTestsuite(const ConsoleWords& words, ConsoleStream *stream);
+  static const CommandDef COMMANDS[];
+  //! Adaptive mode picks the repeats for targetLossPercent_ from the droid link. Goes up right away, but only goes
+  //! down again after the lower count has held for REPEATS_HOLD_MS, so the count doesn't flap.
+  uint8_t chooseRepeats();
+  void showLinkQuality();
 
   static const unsigned int MSGDELAY = 2000;
+  static const uint8_t MAX_REPEATS = 7;
+  static const unsigned int REPEATS_HOLD_MS = 1000;
 
   Mode mode_;
   
@@ -109,7 +129,15 @@ protected:
 
   static RemoteParams params_;
   static bb::ConfigStorage::HANDLE paramsHandle_;
-  unsigned int ledBrightness_, deadbandPercent_, sendRepeats_;
+  unsigned int ledBrightness_, deadbandPercent_, sendRepeats_, fecSpan_;
+  bool adaptiveRepeats_;
+  float targetLossPercent_;
+
+  LinkQuality droidLink_;
+  ControlFECEncoder fecEncoder_;
+  uint8_t currentRepeats_;
+  bool lowering_;
+  unsigned long loweringSinceMs_, lastLinkDisplayMs_;
   
   unsigned long lastRightMs_, lastDroidMs_;
 };
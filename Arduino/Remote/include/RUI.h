@@ -35,6 +35,7 @@ public:
     void drawScreensaver();
 
     void setTopTitle(const String& title);
+    void setBottomTitle(const String& title);
 
     // Other callbacks
     void setIncrRotButtonCB(RInput::Button button, bool left);
@@ -60,6 +61,10 @@ public:
 protected:
     RUI();
 
+    // Completion of showPairDroidMenu() / showPairRemoteMenu(), called once node discovery is done.
+    void pairDroidMenuDiscovered(Result res);
+    void pairRemoteMenuDiscovered(Result res);
+
     RMenuWidget mainMenu_, pairMenu_, pairDroidMenu_, pairRemoteMenu_;
     RMenuWidget leftRemoteMenu_, rightRemoteMenu_, bothRemotesMenu_, droidMenu_;
     RMenuWidget lRIncrRotMenu_, rRIncrRotMenu_;
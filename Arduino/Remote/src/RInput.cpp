@@ -318,7 +318,7 @@ void RInput::update() {
       }
     }
   } else {
-    bb::printf("MCP not OK\n");
+    PRINTF_LIMITED(1000, "MCP not OK\n");
   }
 #endif // ARDUINO_ARCH_ESP32
   if(buttonsChanged[BUTTON_LEFT]) {
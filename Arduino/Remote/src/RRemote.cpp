@@ -6,6 +6,16 @@ RRemote RRemote::remote;
 RRemote::RemoteParams RRemote::params_;
 bb::ConfigStorage::HANDLE RRemote::paramsHandle_;
 
+const Subsystem::CommandDef RRemote::COMMANDS[] = {
+  command("running_status",   1, 1, &RRemote::cmdRunningStatus),
+  command("calibrate",        0, 0, &RRemote::cmdCalibrate),
+  command("calibrate_imu",    0, 0, &RRemote::cmdCalibrateIMU),
+  command("reset",            0, 0, &RRemote::cmdReset),
+  command("set_droid",        1, 1, &RRemote::cmdSetDroid),
+  command("set_other_remote", 1, 1, &RRemote::cmdSetOtherRemote),
+  command("testsuite",        0, 0, &RRemote::cmdTestsuite)
+};
+
 RRemote::RRemote(): 
   mode_(MODE_REGULAR) {
   name_ = "remote";
@@ -19,6 +29,7 @@ RRemote::RRemote():
 "\treset                  Factory reset\n"\
 "\tset_droid ADDR         Set droid address to ADDR (64bit hex - max 16 digits, omit the 0x)\n"\
 "\tset_other_remote ADDR  Set other remote address to ADDR (64bit hex - max 16 digits, omit the 0x)\n";
+  setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
 
   started_ = false;
   operationStatus_ = RES_SUBSYS_NOT_STARTED;
@@ -30,17 +41,28 @@ RRemote::RRemote():
   params_.config.leftIsPrimary = true;
   params_.config.ledBrightness = 7;
   params_.config.sendRepeats = 1;
+  params_.config.adaptiveRepeats = false;
+  params_.config.fecSpan = 0;
   params_.config.lIncrRotBtn = RInput::BUTTON_4;
   params_.config.rIncrRotBtn = RInput::BUTTON_4;
   params_.config.lIncrTransBtn = RInput::BUTTON_NONE;
   params_.config.rIncrTransBtn = RInput::BUTTON_NONE;
   params_.config.deadbandPercent = 8;
+
+  adaptiveRepeats_ = false;
+  targetLossPercent_ = 1.0f;
+  currentRepeats_ = params_.config.sendRepeats;
+  lowering_ = false;
+  loweringSinceMs_ = lastLinkDisplayMs_ = 0;
 }
 
 Result RRemote::initialize() { 
   addParameter("led_brightness", "LED Brightness", ledBrightness_, 8);
   addParameter("deadband", "Joystick deadband in percent", deadbandPercent_, 15);
   addParameter("send_repeats", "Send repeats for control packets (0 = send only once)", sendRepeats_, 15);
+  addParameter("adaptive_repeats", "Pick send repeats from the droid link quality, send_repeats is the fallback", adaptiveRepeats_);
+  addParameter("target_loss", "Control packet loss in percent that adaptive repeats aim for", targetLossPercent_, 0.1, 50);
+  addParameter("fec_span", "Send an XOR parity of the previous control packet with every one (0 = off, 1 = on, droid must support it)", fecSpan_, MAX_FEC_SPAN);
 
   paramsHandle_ = ConfigStorage::storage.reserveBlock("remote", sizeof(params_), (uint8_t*)&params_);
 	if(ConfigStorage::storage.blockIsValid(paramsHandle_)) {
@@ -59,6 +81,11 @@ Result RRemote::initialize() {
   deadbandPercent_ = params_.config.deadbandPercent;
   ledBrightness_ = params_.config.ledBrightness;
   sendRepeats_ = params_.config.sendRepeats;
+  adaptiveRepeats_ = params_.config.adaptiveRepeats;
+  currentRepeats_ = params_.config.sendRepeats;
+  if(params_.config.fecSpan > MAX_FEC_SPAN) params_.config.fecSpan = MAX_FEC_SPAN; // stored when longer spans were sent
+  fecSpan_ = params_.config.fecSpan;
+  if(fecSpan_ != 0) fecEncoder_.setSpan(fecSpan_);
   RInput::input.setDeadbandPercent(params_.config.deadbandPercent);
   RDisplay::display.setLEDBrightness(ledBrightness_<<2);
 
@@ -71,6 +98,8 @@ Result RRemote::initialize() {
     setPacketSource(PACKET_SOURCE_RIGHT_REMOTE);
   }
 
+  addTasks();
+
   return Subsystem::initialize();
 }
 
@@ -109,44 +138,57 @@ Result RRemote::step() {
     if(millis()-lastRightMs_ > 500) RUI::ui.setNoComm(PACKET_SOURCE_RIGHT_REMOTE, true);
   }
 
-  if((bb::Runloop::runloop.getSequenceNumber() % 4) == 0) {
+  return RES_OK;
+}
+
+void RRemote::addTasks() {
+  // Cost estimates are rough and only used for the initial phase plan - "runloop tasks rebalance" replans with measured cost.
+  bb::Runloop::runloop.addTask(this, "send", 25, [this]() {
     if(runningStatus_) {
       printExtendedStatusLine();
     }
     fillAndSend();
-  } else if((bb::Runloop::runloop.getSequenceNumber() % 4) == 1) {
+    // fillAndSend() lights up the comm LED; switch it off again a little later.
+    bb::Runloop::runloop.scheduleTimedCallback(20, []() { RDisplay::display.setLED(RDisplay::LED_COMM, RDisplay::LED_OFF); });
+  }, 2000);
+
+  bb::Runloop::runloop.addTask(this, "gui", 25, [this]() {
     updateStatusLED();
     if(isLeftRemote) {
       if(RInput::input.secondsSinceLastMotion() > 10.0) RUI::ui.drawScreensaver();
       else RUI::ui.drawGUI();
     }
-  } else {
-    RDisplay::display.setLED(RDisplay::LED_COMM, RDisplay::LED_OFF);
-  }
+  }, 4000);
 
-  if((bb::Runloop::runloop.getSequenceNumber() % 10) == 0) {
+  bb::Runloop::runloop.addTask(this, "brightness", 10, [this]() {
     if(RInput::input.secondsSinceLastMotion() > 10 || params_.config.ledBrightness <= 2) {
       RDisplay::display.setLEDBrightness(1);
     } else {
       RDisplay::display.setLEDBrightness(params_.config.ledBrightness << 2);
     }
-  }
-
-  return RES_OK;
+  }, 100);
 }
 
-void RRemote::parameterChangedCallback(const String& name) {
-  if(name == "deadband") {
+void RRemote::parameterChangedCallback(const char* name) {
+  if(!strcmp(name, "deadband")) {
     params_.config.deadbandPercent = deadbandPercent_;
     RInput::input.setDeadbandPercent(deadbandPercent_);
     Console::console.printfBroadcast("Set deadband percent to %d\n", deadbandPercent_);
-  } else if (name == "led_brightness") {
+  } else if (!strcmp(name, "led_brightness")) {
     params_.config.ledBrightness = ledBrightness_;
     RDisplay::display.setLEDBrightness(ledBrightness_<<2);
     Console::console.printfBroadcast("Set LED Brightness to %d\n", ledBrightness_);
-  } else if(name == "send_repeats") {
+  } else if(!strcmp(name, "send_repeats")) {
     params_.config.sendRepeats = sendRepeats_;
     Console::console.printfBroadcast("Set send repeats to %d\n", sendRepeats_);
+  } else if(!strcmp(name, "adaptive_repeats")) {
+    params_.config.adaptiveRepeats = adaptiveRepeats_;
+    Console::console.printfBroadcast("Adaptive send repeats %s\n", adaptiveRepeats_ ? "on" : "off");
+  } else if(!strcmp(name, "fec_span")) {
+    params_.config.fecSpan = fecSpan_;
+    if(fecSpan_ != 0) fecEncoder_.setSpan(fecSpan_);
+    fecEncoder_.reset();
+    Console::console.printfBroadcast("FEC span %d%s\n", fecSpan_, fecSpan_ == 0 ? " (off)" : "");
   }
 }
 
@@ -332,13 +374,73 @@ void RRemote::setJoyDeadband(uint8_t db) {
 }
 
 void RRemote::setSendRepeats(uint8_t sr) {
-  if(sr > 7) sr = 7;
+  if(sr > MAX_REPEATS) sr = MAX_REPEATS;
   if(sr == params_.config.sendRepeats) return;
   params_.config.sendRepeats = sendRepeats_ = sr;
   if(isLeftRemote) sendConfigToRightRemote();
   storeParams();
 }
 
+void RRemote::setAdaptiveRepeats(bool yesno) {
+  if(yesno == params_.config.adaptiveRepeats) return;
+  params_.config.adaptiveRepeats = adaptiveRepeats_ = yesno;
+  if(isLeftRemote) {
+    sendConfigToRightRemote();
+    RUI::ui.setNeedsMenuRebuild();
+  }
+  storeParams();
+}
+
+uint8_t RRemote::chooseRepeats() {
+  uint8_t repeats = params_.config.sendRepeats;
+  if(params_.config.adaptiveRepeats) {
+    // With FEC a frame is only lost if the next one is too, so about twice the exponent
+    float target = targetLossPercent_/100.0f;
+    if(params_.config.fecSpan != 0) target = sqrtf(target);
+    repeats = droidLink_.repeatsFor(target, MAX_REPEATS, params_.config.sendRepeats, millis());
+    if(repeats < currentRepeats_) {
+      if(!lowering_) {
+        lowering_ = true;
+        loweringSinceMs_ = millis();
+      }
+      if(millis() - loweringSinceMs_ < REPEATS_HOLD_MS) repeats = currentRepeats_;
+    } else {
+      lowering_ = false;
+    }
+  }
+
+  if(repeats != currentRepeats_) {
+    if(params_.config.adaptiveRepeats) {
+      Console::console.printfBroadcast("Send repeats %d -> %d (droid link %.1f%%, RSSI -%.0fdBm)\n", currentRepeats_, repeats,
+                                       droidLink_.deliveryRatio()*100.0f, droidLink_.rssi());
+    }
+    currentRepeats_ = repeats;
+    lowering_ = false;
+    lastLinkDisplayMs_ = 0;
+  }
+
+  if(millis() - lastLinkDisplayMs_ > 1000) {
+    showLinkQuality();
+    lastLinkDisplayMs_ = millis();
+  }
+  return repeats;
+}
+
+void RRemote::showLinkQuality() {
+  if(!isLeftRemote) return;
+
+  char buf[48];
+  if(!params_.config.adaptiveRepeats) {
+    snprintf(buf, sizeof(buf), "Reps %d", currentRepeats_);
+  } else if(droidLink_.hasEstimate(millis())) {
+    snprintf(buf, sizeof(buf), "Reps %d A  %d%% -%ddBm", currentRepeats_, int(droidLink_.deliveryRatio()*100.0f + 0.5f),
+             int(droidLink_.rssi() + 0.5f));
+  } else {
+    snprintf(buf, sizeof(buf), "Reps %d A  no link", currentRepeats_);
+  }
+  RUI::ui.setBottomTitle(buf);
+}
+
 Result RRemote::sendConfigToRightRemote() {
   if(!isLeftRemote) {
     LOG(LOG_ERROR, "BUG: sendConfigToRightRemote() called in right remote, only valid in left remote\n");
@@ -396,11 +498,14 @@ bb::Result RRemote::fillAndSend() {
     if(res != RES_OK) Console::console.printfBroadcast("%s\n", errorMessage(res));
   }
 
-  // both remotes send to droid (unless we're calibrating)
+  // both remotes send to droid (unless we're calibrating). The XBee sends the repeats when there's airtime left.
   if(!params_.droidAddress.isZero() && mode_ == MODE_REGULAR) {
-    for(int i=0; i<params_.config.sendRepeats+1; i++) {
-      delayMicroseconds(random(100));
-      res = bb::XBee::xbee.sendTo(params_.droidAddress, packet, false);
+    if(params_.config.fecSpan != 0) {
+      ControlFEC fec;
+      fecEncoder_.encode(packet, fec);
+      res = bb::XBee::xbee.sendTo(params_.droidAddress, packet, fec, false, chooseRepeats());
+    } else {
+      res = bb::XBee::xbee.sendTo(params_.droidAddress, packet, false, chooseRepeats());
     }
     if(res != RES_OK) {
       r = 255; g = 0; b = 0;
@@ -412,83 +517,77 @@ bb::Result RRemote::fillAndSend() {
   return res;
 }
 
-Result RRemote::handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream) {
-  if(words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
-  if(words[0] == "running_status") {
-    if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words[1] == "on" || words[1] == "true") {
-      runningStatus_ = true;
-      return RES_OK;
-    } else if(words[1] == "off" || words[1] == "false") {
-      runningStatus_ = false;
-      return RES_OK;
+// 64bit hex address, max 16 digits, no 0x
+static Result parseAddress(const ConsoleWord& word, HWAddress& address, ConsoleStream *stream) {
+  if(word.length() > 16) return RES_CMD_INVALID_ARGUMENT;
+  uint64_t addr = 0;
+  for(size_t i=0; i<word.length(); i++) {
+    if(i!=0) addr <<= 4;
+    if(word[i] >= '0' && word[i] <= '9') addr = addr + (word[i]-'0');
+    else if(word[i] >= 'a' && word[i] <= 'f') addr = addr + (word[i]-'a') + 0xa;
+    else if(word[i] >= 'A' && word[i] <= 'F') addr = addr + (word[i]-'A') + 0xa;
+    else {
+      stream->printf("Invalid character '%c' at position %d - must be 0-9a-fA-F.\n", word[i], (int)i);
+      return RES_CMD_INVALID_ARGUMENT;
     }
-    return RES_CMD_INVALID_ARGUMENT;
   }
+  address = {uint32_t(addr>>32), uint32_t(addr&0xffffffff)};
+  return RES_OK;
+}
 
-  else if(words[0] == "calibrate") {
-    startCalibration();
-
+Result RRemote::cmdRunningStatus(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)stream;
+  if(words[1] == "on" || words[1] == "true") {
+    runningStatus_ = true;
     return RES_OK;
-  }
-
-  else if(words[0] == "calibrate_imu") {
-    RInput::input.imu().calibrate();
+  } else if(words[1] == "off" || words[1] == "false") {
+    runningStatus_ = false;
     return RES_OK;
   }
+  return RES_CMD_INVALID_ARGUMENT;
+}
 
-  else if(words[0] == "reset") {
-    factoryReset();
-    return RES_OK;
-  }
+Result RRemote::cmdCalibrate(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  (void)stream;
+  startCalibration();
+  return RES_OK;
+}
 
-  else if(words[0] == "set_droid") {
-    if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words[1].length() > 16) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    uint64_t addr = 0;
-    String addrstr = words[1];
-    for(int i=0; i<addrstr.length(); i++) {
-      if(i!=0) addr <<= 4;
-      if(addrstr[i] >= '0' && addrstr[i] <= '9') addr = addr + (addrstr[i]-'0');
-      else if(addrstr[i] >= 'a' && addrstr[i] <= 'f') addr = addr + (addrstr[i]-'a') + 0xa;
-      else if(addrstr[i] >= 'A' && addrstr[i] <= 'F') addr = addr + (addrstr[i]-'a') + 0xa;
-      else {
-        stream->printf("Invalid character '%c' at position %d - must be 0-9a-fA-F.\n");
-        return RES_CMD_INVALID_ARGUMENT;
-      }
-    }
-    params_.droidAddress = {uint32_t(addr>>32), uint32_t(addr&0xffffffff)};
-    stream->printf("Setting droid address to 0x%lx:%lx.\n", params_.droidAddress.addrHi, params_.droidAddress.addrLo);
-    return RES_OK;
-  }
+Result RRemote::cmdCalibrateIMU(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  (void)stream;
+  RInput::input.imu().calibrate();
+  return RES_OK;
+}
 
-  else if(words[0] == "set_other_remote") {
-    if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    if(words[1].length() > 16) return RES_CMD_INVALID_ARGUMENT_COUNT;
-    uint64_t addr = 0;
-    String addrstr = words[1];
-    for(int i=0; i<addrstr.length(); i++) {
-      if(i!=0) addr <<= 4;
-      if(addrstr[i] >= '0' && addrstr[i] <= '9') addr = addr + (addrstr[i]-'0');
-      else if(addrstr[i] >= 'a' && addrstr[i] <= 'f') addr = addr + (addrstr[i]-'a');
-      else if(addrstr[i] >= 'A' && addrstr[i] <= 'F') addr = addr + (addrstr[i]-'a');
-      else {
-        stream->printf("Invalid character '%c' at position %d - must be 0-9a-fA-F.\n");
-        return RES_CMD_INVALID_ARGUMENT;
-      }
-    }
-    params_.otherRemoteAddress = {uint32_t(addr>>32), uint32_t(addr&0xffffffff)};
-    stream->printf("Setting other remote address to 0x%lx:%lx.\n", params_.otherRemoteAddress.addrHi, params_.otherRemoteAddress.addrLo);
-    return RES_OK;
-  }
+Result RRemote::cmdReset(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  (void)stream;
+  factoryReset();
+  return RES_OK;
+}
 
-  else if(words[0] == "testsuite") {
-    runTestsuite();
-    return RES_OK;
-  }
+Result RRemote::cmdSetDroid(const ConsoleWords& words, ConsoleStream *stream) {
+  Result res = parseAddress(words[1], params_.droidAddress, stream);
+  if(res != RES_OK) return res;
+  stream->printf("Setting droid address to 0x%lx:%lx.\n", params_.droidAddress.addrHi, params_.droidAddress.addrLo);
+  return RES_OK;
+}
 
-  return Subsystem::handleConsoleCommand(words, stream);
-} 
+Result RRemote::cmdSetOtherRemote(const ConsoleWords& words, ConsoleStream *stream) {
+  Result res = parseAddress(words[1], params_.otherRemoteAddress, stream);
+  if(res != RES_OK) return res;
+  stream->printf("Setting other remote address to 0x%lx:%lx.\n", params_.otherRemoteAddress.addrHi, params_.otherRemoteAddress.addrLo);
+  return RES_OK;
+}
+
+Result RRemote::cmdTestsuite(const ConsoleWords& words, ConsoleStream *stream) {
+  (void)words;
+  (void)stream;
+  runTestsuite();
+  return RES_OK;
+}
 
 Result RRemote::incomingControlPacket(const HWAddress& srcAddr, PacketSource source, uint8_t rssi, uint8_t seqnum, const ControlPacket& packet) {
   if(!isLeftRemote) {
@@ -527,6 +626,7 @@ Result RRemote::incomingStatePacket(const HWAddress& srcAddr, PacketSource sourc
   }
 
   RUI::ui.visualizeFromStatePacket(source, seqnum, packet);
+  droidLink_.packetReceived(seqnum, rssi, millis());
 
   lastDroidMs_ = millis();
 
@@ -587,6 +687,9 @@ Result RRemote::incomingConfigPacket(const HWAddress& srcAddr, PacketSource sour
                                       packet.cfgPayload.remoteConfig.lIncrRotBtn, packet.cfgPayload.remoteConfig.rIncrRotBtn, 
                                       packet.cfgPayload.remoteConfig.lIncrTransBtn, packet.cfgPayload.remoteConfig.rIncrTransBtn);
     params_.config = packet.cfgPayload.remoteConfig;
+    adaptiveRepeats_ = params_.config.adaptiveRepeats;
+    fecSpan_ = params_.config.fecSpan;
+    if(fecSpan_ != 0) fecEncoder_.setSpan(fecSpan_);
     RInput::input.setIncrementalRot(RInput::Button(params_.config.rIncrRotBtn));
     ConfigStorage::storage.writeBlock(paramsHandle_);
     return RES_OK; 
@@ -630,6 +733,19 @@ void RRemote::printExtendedStatus(ConsoleStream* stream) {
   stream->printf("Software version: " VERSION_STRING "\n");
   stream->printf("Sequence number: %ld\n", seqnum_);
   stream->printf("Primary remote: %s\n", isPrimary() ? "Yes" : "No");
+  if(params_.config.adaptiveRepeats) {
+    stream->printf("Send repeats: %d, adaptive for %.1f%% loss (fallback %d)\n", currentRepeats_, targetLossPercent_, params_.config.sendRepeats);
+  } else {
+    stream->printf("Send repeats: %d\n", currentRepeats_);
+  }
+  if(params_.config.fecSpan != 0) stream->printf("FEC: parity of the previous control packet\n");
+  else stream->printf("FEC: off\n");
+  if(droidLink_.hasEstimate(millis())) {
+    stream->printf("Droid link: %.1f%% delivered, RSSI -%.0fdBm, %lu received, %lu lost\n", droidLink_.deliveryRatio()*100.0f,
+                   droidLink_.rssi(), droidLink_.packetsReceived(), droidLink_.packetsLost());
+  } else {
+    stream->printf("Droid link: no estimate, %lu received, %lu lost\n", droidLink_.packetsReceived(), droidLink_.packetsLost());
+  }
   stream->printf("Addressing:\n");
   stream->printf("\tThis remote:  0x%lx:%lx\n", XBee::xbee.hwAddress().addrHi, XBee::xbee.hwAddress().addrLo);
   stream->printf("\tOther remote: 0x%lx:%lx\n", params_.otherRemoteAddress.addrHi, params_.otherRemoteAddress.addrLo);
@@ -76,7 +76,17 @@ void RUI::showPairDroidMenu() {
     pairDroidMenu_.clear();
   
     Console::console.printfBroadcast("Discovering nodes...\n");
-    Result res = XBee::xbee.discoverNodes(discoveredNodes_);
+    // Discovery takes 10s - keep the runloop (and the display) going while it runs.
+    Result res = XBee::xbee.discoverNodesAsync([this](Result res, const std::vector<XBee::Node>& nodes) {
+      discoveredNodes_ = nodes;
+      pairDroidMenuDiscovered(res);
+    });
+    if(res != RES_OK) {
+      Console::console.printfBroadcast("%s\n", errorMessage(res));
+    }
+}
+
+void RUI::pairDroidMenuDiscovered(Result res) {
     if(res != RES_OK) {
       Console::console.printfBroadcast("%s\n", errorMessage(res));
       return;
@@ -120,7 +130,17 @@ void RUI::showPairRemoteMenu() {
   
     pairRemoteMenu_.clear();
   
-    Result res = XBee::xbee.discoverNodes(discoveredNodes_);
+    Result res = XBee::xbee.discoverNodesAsync([this](Result res, const std::vector<XBee::Node>& nodes) {
+      discoveredNodes_ = nodes;
+      pairRemoteMenuDiscovered(res);
+    });
+    if(res != RES_OK) {
+      Console::console.printfBroadcast("%s\n", errorMessage(res));
+      showMenu(&pairMenu_);
+    }
+}
+
+void RUI::pairRemoteMenuDiscovered(Result res) {
     if(res != RES_OK) {
       Console::console.printfBroadcast("%s\n", errorMessage(res));
       showMenu(&pairMenu_);
@@ -224,7 +244,10 @@ void RUI::populateMenus() {
     bothRemotesMenu_.addEntry("LED Level", [=]{showLEDBrightnessDialog();});
     bothRemotesMenu_.addEntry("Joy Deadband", [=]{showJoyDeadbandDialog();});
     bothRemotesMenu_.addEntry("Send Repeats", [=]{showSendRepeatsDialog();});
+    bothRemotesMenu_.addEntry("Adaptive Reps", [=]{RRemote::remote.setAdaptiveRepeats(!RRemote::remote.adaptiveRepeats());showMain();},
+                              RRemote::remote.adaptiveRepeats()?1:0);
     bothRemotesMenu_.addEntry("<--", [=]() {showMenu(&mainMenu_);});
+    bothRemotesMenu_.highlightWidgetsWithTag(1);
 }
 
 void RUI::drawGUI() {
@@ -264,6 +287,10 @@ void RUI::setTopTitle(const String& title) {
     topLabel_.setTitle(title);
 }  
 
+void RUI::setBottomTitle(const String& title) {
+    bottomLabel_.setTitle(title);
+}
+
 void RUI::setIncrRotButtonCB(RInput::Button button, bool left) {
     if(left) {
         if(RRemote::remote.incrRotButton(PACKET_SOURCE_LEFT_REMOTE) == button) return;
@@ -68,6 +68,9 @@ void setup() {
 
   ConfigStorage::storage.initialize();
   Runloop::runloop.initialize();
+  Trace::trace.initialize();
+  BinaryLog::binlog.initialize();
+  Trace::trace.start();
 
   RDisplay::display.initialize();
   RDisplay::display.start();
@@ -102,6 +102,8 @@ static const float MM_PER_TICK = WHEEL_CIRCUMFERENCE / WHEEL_TICKS_PER_TURN;
 
 class DCMotorTest: public bb::Subsystem {
 public:
+  DCMotorTest();
+
   Result initialize() {
     name_ = "dcmotortest";
     description_ = "DC Motor Test";
@@ -117,7 +119,6 @@ public:
 "While the test is running, information about controller state will be output in a format suited for\n"\
 "the Arduino serial plotter. While it is running, you can either enter \"stop\" to stop the test, or\n"\
 "enter numerical setpoints.\n";
-
     addParameter("useMotor", "0: none, 1: motor 0, 2: motor 1, 3: both", useMotor, 0, 3);
     addParameter("mode", "0: PWM, 1: speed, 2: position", mode, 0, 2);
     addParameter("outputMode", "0: output for Arduino Serial Plotter , 1: output for Curio Res Serial Analyzer", outputMode, 0, 1);
@@ -258,36 +259,40 @@ public:
     return RES_OK;
   }
   
-  Result handleConsoleCommand(const std::vector<String>& words, ConsoleStream *stream) {
-    if(words.size() == 0) return RES_CMD_UNKNOWN_COMMAND;
-
-    if(words[0] == "help") {
-      stream->printf(help_);
-      printParameters(stream);
-      return RES_OK;
-    }
+  Result cmdHelp(const ConsoleWords& words, ConsoleStream *stream) {
+    (void)words;
+    stream->printfFinal(help_);
+    printParameters(stream);
+    return RES_OK;
+  }
 
-    if(words[0] == "start") {
-      start(stream);
-      return RES_OK;
-    }
+  Result cmdStart(const ConsoleWords& words, ConsoleStream *stream) {
+    (void)words;
+    start(stream);
+    return RES_OK;
+  }
 
-    if(words[0] == "stop") {
-      stop(stream);
-      return RES_OK;
-    }
+  Result cmdStop(const ConsoleWords& words, ConsoleStream *stream) {
+    (void)words;
+    stop(stream);
+    return RES_OK;
+  }
 
-    if(words[0] == "reset") {
-      for(int i=0; i<2; i++) control[i].reset();
-      return RES_OK;
-    }
+  Result cmdReset(const ConsoleWords& words, ConsoleStream *stream) {
+    (void)words;
+    (void)stream;
+    for(int i=0; i<2; i++) control[i].reset();
+    return RES_OK;
+  }
 
-    if(words[0] == "add") {
-      if(words.size() != 2) return RES_CMD_INVALID_ARGUMENT_COUNT;
-      goal += words[1].toFloat();
-      return RES_OK;
-    }
+  Result cmdAdd(const ConsoleWords& words, ConsoleStream *stream) {
+    (void)stream;
+    goal += words[1].toFloat();
+    return RES_OK;
+  }
 
+  // A bare number sets the goal while running - can't be in the command table.
+  Result handleConsoleCommand(const ConsoleWords& words, ConsoleStream *stream) {
     if(isStarted() && words.size() == 1) {
       bool isNumber = true;
       for(unsigned int i=0; i<words[0].length(); i++) {
@@ -306,8 +311,23 @@ public:
 
     return Subsystem::handleConsoleCommand(words, stream);
   }
+
+protected:
+  static const CommandDef COMMANDS[];
+};
+
+const Subsystem::CommandDef DCMotorTest::COMMANDS[] = {
+  command("help",  0, 0, &DCMotorTest::cmdHelp),
+  command("start", 0, 0, &DCMotorTest::cmdStart),
+  command("stop",  0, 0, &DCMotorTest::cmdStop),
+  command("reset", 0, 0, &DCMotorTest::cmdReset),
+  command("add",   1, 1, &DCMotorTest::cmdAdd)
 };
 
+DCMotorTest::DCMotorTest() {
+  setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0]));
+}
+
 DCMotorTest sut;
 
 void setup() {
@@ -0,0 +1,89 @@
+#include "Arduino.h"
+#include "Wire.h"
+#include "EEPROM.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial(true);
+HardwareSerial Serial1;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long millis() {
+	return micros() / 1000;
+}
+
+void delay(unsigned long ms) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+	std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+	std::this_thread::yield();
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+long random(long max) {
+	if(max <= 0) return 0;
+	return ::random() % max;
+}
+
+long random(long min, long max) {
+	if(min >= max) return min;
+	return random(max - min) + min;
+}
+
+void randomSeed(unsigned long seed) {
+	srandom(seed);
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+int analogRead(uint8_t) { return 0; }
+void analogWrite(uint8_t, int) {}
+void analogReadResolution(int) {}
+void analogWriteResolution(int) {}
+
+int HardwareSerial::read() {
+	if(rxCount_ == 0) return -1;
+	uint8_t c = rx_[rxHead_];
+	rxHead_ = (rxHead_ + 1) % RX_BUFFER_SIZE;
+	rxCount_--;
+	return c;
+}
+
+size_t HardwareSerial::feed(const uint8_t* buf, size_t size) {
+	size_t i;
+	for(i=0; i<size && rxCount_ < RX_BUFFER_SIZE; i++) {
+		rx_[(rxHead_ + rxCount_) % RX_BUFFER_SIZE] = buf[i];
+		rxCount_++;
+	}
+	return i;
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t size) {
+	txCount_ += size;
+	writeCalls_++;
+	if(capture_ != nullptr) {
+		size_t n = size < captureSize_ - captured_ ? size : captureSize_ - captured_;
+		memcpy(capture_ + captured_, buf, n);
+		captured_ += n;
+	}
+	if(echo_) fwrite(buf, 1, size, stdout);
+	return size;
+}
@@ -0,0 +1,59 @@
+#if !defined(ARDUINO_SHIM_H)
+#define ARDUINO_SHIM_H
+
+// Minimal Arduino API shim so LibBB can be built and benchmarked natively on Linux.
+// Only covers what LibBB's non-hardware parts need. Timing is backed by std::chrono.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT          0x0
+#define OUTPUT         0x1
+#define INPUT_PULLUP   0x2
+#define INPUT_PULLDOWN 0x3
+
+#define PI         3.1415926535897932384626433832795
+#define HALF_PI    1.5707963267948966192313216916398
+#define TWO_PI     6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+template<class T, class L> auto min(const T& a, const L& b) -> decltype(a < b ? a : b) { return (b < a) ? b : a; }
+template<class T, class L> auto max(const T& a, const L& b) -> decltype(a < b ? a : b) { return (a < b) ? b : a; }
+template<class T, class L, class H> T constrain(const T& x, const L& lo, const H& hi) { return x < lo ? lo : (x > hi ? hi : x); }
+#define sq(x) ((x)*(x))
+#define radians(deg) ((deg)*DEG_TO_RAD)
+#define degrees(rad) ((rad)*RAD_TO_DEG)
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void analogReadResolution(int bits);
+void analogWriteResolution(int bits);
+
+#include "WString.h"
+#include "HardwareSerial.h"
+
+#endif // ARDUINO_SHIM_H
@@ -0,0 +1,29 @@
+#if !defined(ARDUINO_SHIM_EEPROM_H)
+#define ARDUINO_SHIM_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// RAM-backed EEPROM emulation, erased to 0xff like real flash.
+class EEPROMClass {
+public:
+	static const int SIZE = 4096;
+
+	EEPROMClass() { memset(data_, 0xff, sizeof(data_)); }
+	void begin(int) {}
+	uint8_t read(int addr) { return (addr >= 0 && addr < SIZE) ? data_[addr] : 0xff; }
+	void write(int addr, uint8_t val) { if(addr >= 0 && addr < SIZE) { data_[addr] = val; dirty_ = true; } }
+	void update(int addr, uint8_t val) { if(read(addr) != val) write(addr, val); }
+	void commit() { if(dirty_) commits_++; dirty_ = false; }
+	int length() { return SIZE; }
+	unsigned commits() const { return commits_; }
+
+protected:
+	uint8_t data_[SIZE];
+	bool dirty_ = false;
+	unsigned commits_ = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // ARDUINO_SHIM_EEPROM_H
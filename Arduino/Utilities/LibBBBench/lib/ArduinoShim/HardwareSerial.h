@@ -0,0 +1,80 @@
+#if !defined(ARDUINO_SHIM_HARDWARESERIAL_H)
+#define ARDUINO_SHIM_HARDWARESERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "WString.h"
+
+// Print subset. Everything funnels into write(const uint8_t*, size_t).
+class Print {
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) { return write(&c, 1); }
+	virtual size_t write(const uint8_t* buf, size_t size) = 0;
+	size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+	size_t write(const char* buf, size_t size) { return write((const uint8_t*)buf, size); }
+
+	size_t print(const char* str) { return write(str); }
+	size_t print(const String& str) { return write(str.c_str(), str.length()); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char val, int base = DEC) { return print(String(val, base)); }
+	size_t print(int val, int base = DEC) { return print(String(val, base)); }
+	size_t print(unsigned int val, int base = DEC) { return print(String(val, base)); }
+	size_t print(long val, int base = DEC) { return print(String(val, base)); }
+	size_t print(unsigned long val, int base = DEC) { return print(String(val, base)); }
+	size_t print(double val, int decimals = 2) { return print(String(val, decimals)); }
+
+	size_t println() { return write("\r\n"); }
+	template<class T> size_t println(const T& val) { size_t n = print(val); return n + println(); }
+	template<class T> size_t println(const T& val, int fmt) { size_t n = print(val, fmt); return n + println(); }
+};
+
+// Host stand-in for a UART. Bytes written are counted (and optionally echoed to stdout),
+// bytes to be received can be injected with feed(). Like a real UART, the RX buffer has a fixed
+// size and never allocates; bytes fed into a full buffer are dropped.
+class HardwareSerial: public Print {
+public:
+	HardwareSerial(bool echo = false): echo_(echo) {}
+
+	void begin(unsigned long baud) { baud_ = baud; open_ = true; }
+	void end() { open_ = false; }
+	operator bool() const { return open_; }
+
+	static const size_t RX_BUFFER_SIZE = 4096;
+	static const int TX_BUFFER_SIZE = 4096;
+
+	int available() { return rxCount_; }
+	int peek() { return rxCount_ == 0 ? -1 : rx_[rxHead_]; }
+	int read();
+	void flush() {}
+
+	using Print::write;
+	size_t write(const uint8_t* buf, size_t size) override;
+	// Writes never block on the host.
+	int availableForWrite() { return TX_BUFFER_SIZE; }
+
+	size_t feed(const uint8_t* buf, size_t size);
+	size_t bytesWritten() const { return txCount_; }
+	// Calls to write(), which on a real UART each cost a trip through the driver.
+	size_t writeCalls() const { return writeCalls_; }
+	// Copies what's written into buf, up to size bytes, until capture(NULL, 0). captured() is how much was copied.
+	void capture(uint8_t* buf, size_t size) { capture_ = buf; captureSize_ = size; captured_ = 0; }
+	size_t captured() const { return captured_; }
+	unsigned long baud() const { return baud_; }
+	void setEcho(bool echo) { echo_ = echo; }
+
+protected:
+	bool echo_, open_ = false;
+	unsigned long baud_ = 0;
+	size_t txCount_ = 0, writeCalls_ = 0;
+	uint8_t* capture_ = nullptr;
+	size_t captureSize_ = 0, captured_ = 0;
+	uint8_t rx_[RX_BUFFER_SIZE];
+	size_t rxHead_ = 0, rxCount_ = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif // ARDUINO_SHIM_HARDWARESERIAL_H
@@ -0,0 +1,112 @@
+#include "WString.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <algorithm>
+
+static std::string formatUnsigned(unsigned long long val, unsigned char base) {
+	if(base < 2 || base > 36) base = 10;
+	if(val == 0) return "0";
+	std::string s;
+	while(val) {
+		unsigned digit = val % base;
+		s += (char)(digit < 10 ? '0'+digit : 'A'+digit-10);
+		val /= base;
+	}
+	std::reverse(s.begin(), s.end());
+	return s;
+}
+
+static std::string formatSigned(long long val, unsigned char base) {
+	if(val < 0 && base == 10) return "-" + formatUnsigned(-(unsigned long long)val, base);
+	return formatUnsigned((unsigned long long)val, base);
+}
+
+static std::string formatFloat(double val, unsigned char decimals) {
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+	return buf;
+}
+
+String::String(const char* cstr): str_(cstr ? cstr : "") {}
+String::String(char c): str_(1, c) {}
+String::String(unsigned char val, unsigned char base): str_(formatUnsigned(val, base)) {}
+String::String(int val, unsigned char base): str_(formatSigned(val, base)) {}
+String::String(unsigned int val, unsigned char base): str_(formatUnsigned(val, base)) {}
+String::String(long val, unsigned char base): str_(formatSigned(val, base)) {}
+String::String(unsigned long val, unsigned char base): str_(formatUnsigned(val, base)) {}
+String::String(long long val, unsigned char base): str_(formatSigned(val, base)) {}
+String::String(unsigned long long val, unsigned char base): str_(formatUnsigned(val, base)) {}
+String::String(float val, unsigned char decimals): str_(formatFloat(val, decimals)) {}
+String::String(double val, unsigned char decimals): str_(formatFloat(val, decimals)) {}
+
+bool String::equalsIgnoreCase(const String& s) const {
+	if(s.str_.length() != str_.length()) return false;
+	for(size_t i=0; i<str_.length(); i++) {
+		if(tolower(str_[i]) != tolower(s.str_[i])) return false;
+	}
+	return true;
+}
+
+bool String::endsWith(const String& suffix) const {
+	if(suffix.str_.length() > str_.length()) return false;
+	return str_.compare(str_.length()-suffix.str_.length(), suffix.str_.length(), suffix.str_) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+	size_t pos = str_.find(c, from);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& s, unsigned int from) const {
+	size_t pos = str_.find(s.str_, from);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+	size_t pos = str_.rfind(c);
+	return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+	if(from > to) std::swap(from, to);
+	if(from >= str_.length()) return String();
+	if(to > str_.length()) to = str_.length();
+	return String(str_.substr(from, to-from).c_str());
+}
+
+void String::replace(char find, char replace) {
+	std::replace(str_.begin(), str_.end(), find, replace);
+}
+
+void String::replace(const String& find, const String& replace) {
+	if(find.str_.empty()) return;
+	size_t pos = 0;
+	while((pos = str_.find(find.str_, pos)) != std::string::npos) {
+		str_.replace(pos, find.str_.length(), replace.str_);
+		pos += replace.str_.length();
+	}
+}
+
+void String::remove(unsigned int index) {
+	if(index < str_.length()) str_.erase(index);
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+	if(index < str_.length()) str_.erase(index, count);
+}
+
+void String::toLowerCase() {
+	for(auto& c: str_) c = tolower(c);
+}
+
+void String::toUpperCase() {
+	for(auto& c: str_) c = toupper(c);
+}
+
+void String::trim() {
+	size_t begin = str_.find_first_not_of(" \t\r\n");
+	if(begin == std::string::npos) { str_.clear(); return; }
+	size_t end = str_.find_last_not_of(" \t\r\n");
+	str_ = str_.substr(begin, end-begin+1);
+}
@@ -0,0 +1,91 @@
+#if !defined(ARDUINO_SHIM_WSTRING_H)
+#define ARDUINO_SHIM_WSTRING_H
+
+#include <stdlib.h>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Subset of Arduino's String class, backed by std::string.
+class String {
+public:
+	String(const char* cstr = "");
+	String(const String& str) = default;
+	String(String&& str) = default;
+	explicit String(char c);
+	explicit String(unsigned char val, unsigned char base = 10);
+	explicit String(int val, unsigned char base = 10);
+	explicit String(unsigned int val, unsigned char base = 10);
+	explicit String(long val, unsigned char base = 10);
+	explicit String(unsigned long val, unsigned char base = 10);
+	explicit String(long long val, unsigned char base = 10);
+	explicit String(unsigned long long val, unsigned char base = 10);
+	explicit String(float val, unsigned char decimals = 2);
+	explicit String(double val, unsigned char decimals = 2);
+
+	String& operator=(const String& rhs) = default;
+	String& operator=(String&& rhs) = default;
+	String& operator=(const char* cstr) { str_ = cstr ? cstr : ""; return *this; }
+
+	unsigned int length() const { return str_.length(); }
+	bool isEmpty() const { return str_.empty(); }
+	const char* c_str() const { return str_.c_str(); }
+	void reserve(unsigned int size) { str_.reserve(size); }
+
+	bool concat(const String& s) { str_ += s.str_; return true; }
+	bool concat(const char* cstr) { if(cstr) str_ += cstr; return true; }
+	bool concat(char c) { str_ += c; return true; }
+	template<class T> bool concat(T val) { return concat(String(val)); }
+
+	String& operator+=(const String& rhs) { concat(rhs); return *this; }
+	String& operator+=(const char* rhs) { concat(rhs); return *this; }
+	String& operator+=(char rhs) { concat(rhs); return *this; }
+	template<class T> String& operator+=(T rhs) { concat(String(rhs)); return *this; }
+
+	bool equals(const String& s) const { return str_ == s.str_; }
+	bool equals(const char* cstr) const { return str_ == cstr; }
+	bool equalsIgnoreCase(const String& s) const;
+	bool operator==(const String& rhs) const { return equals(rhs); }
+	bool operator==(const char* rhs) const { return equals(rhs); }
+	bool operator!=(const String& rhs) const { return !equals(rhs); }
+	bool operator!=(const char* rhs) const { return !equals(rhs); }
+	bool operator<(const String& rhs) const { return str_ < rhs.str_; }
+	bool startsWith(const String& prefix) const { return str_.compare(0, prefix.str_.length(), prefix.str_) == 0; }
+	bool endsWith(const String& suffix) const;
+
+	char charAt(unsigned int index) const { return index < str_.length() ? str_[index] : 0; }
+	char operator[](unsigned int index) const { return charAt(index); }
+	char& operator[](unsigned int index) { return str_[index]; }
+
+	int indexOf(char c, unsigned int from = 0) const;
+	int indexOf(const String& s, unsigned int from = 0) const;
+	int lastIndexOf(char c) const;
+	String substring(unsigned int from) const { return substring(from, str_.length()); }
+	String substring(unsigned int from, unsigned int to) const;
+
+	void replace(char find, char replace);
+	void replace(const String& find, const String& replace);
+	void remove(unsigned int index);
+	void remove(unsigned int index, unsigned int count);
+	void toLowerCase();
+	void toUpperCase();
+	void trim();
+
+	long toInt() const { return strtol(str_.c_str(), nullptr, 10); }
+	float toFloat() const { return strtof(str_.c_str(), nullptr); }
+	double toDouble() const { return strtod(str_.c_str(), nullptr); }
+
+protected:
+	std::string str_;
+};
+
+inline String operator+(const String& lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+inline String operator+(const String& lhs, const char* rhs) { String s(lhs); s += rhs; return s; }
+inline String operator+(const char* lhs, const String& rhs) { String s(lhs); s += rhs; return s; }
+inline String operator+(const String& lhs, char rhs) { String s(lhs); s += rhs; return s; }
+template<class T> String operator+(const String& lhs, T rhs) { String s(lhs); s += String(rhs); return s; }
+
+#endif // ARDUINO_SHIM_WSTRING_H
@@ -0,0 +1,24 @@
+#if !defined(ARDUINO_SHIM_WIRE_H)
+#define ARDUINO_SHIM_WIRE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// I2C stand-in. There are no devices on the host bus, so every transmission NACKs.
+class TwoWire {
+public:
+	void begin() {}
+	void end() {}
+	void setClock(uint32_t) {}
+	void beginTransmission(uint8_t) {}
+	uint8_t endTransmission(bool stop = true) { (void)stop; return 2; }
+	uint8_t requestFrom(uint8_t, size_t) { return 0; }
+	size_t write(uint8_t) { return 1; }
+	size_t write(const uint8_t*, size_t size) { return size; }
+	int available() { return 0; }
+	int read() { return -1; }
+};
+
+extern TwoWire Wire;
+
+#endif // ARDUINO_SHIM_WIRE_H
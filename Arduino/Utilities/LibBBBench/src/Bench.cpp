@@ -0,0 +1,30 @@
+#include "Bench.h"
+
+#include <stdlib.h>
+#include <new>
+
+const char* bench::filter = nullptr;
+
+static size_t allocations = 0;
+
+size_t bench::allocationCount() {
+  return allocations;
+}
+
+// Count every heap allocation made through C++ new. LibBB allocates via new (std::vector, String,
+// std::function, APIFrame buffers), so this catches all of it on the hot paths benchmarked here.
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if(p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
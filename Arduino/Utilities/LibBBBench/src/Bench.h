@@ -0,0 +1,42 @@
+#if !defined(BENCH_H)
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// Tiny benchmark harness for the native LibBB build.
+// Reports wall time per operation and heap allocations (operator new / malloc) per operation.
+
+namespace bench {
+
+size_t allocationCount();
+
+// Only run benchmarks whose name contains this string (set from argv[1] in main()).
+extern const char* filter;
+
+inline bool selected(const char* name) {
+  return filter == nullptr || strstr(name, filter) != nullptr;
+}
+
+// Returns the time per operation in ns, or 0 if not selected.
+template<class F> double run(const char* name, unsigned long iterations, F f) {
+  if(!selected(name)) return 0;
+
+  for(unsigned long i=0; i<iterations/10+1; i++) f(); // warm up
+
+  size_t allocs = allocationCount();
+  auto start = std::chrono::steady_clock::now();
+  for(unsigned long i=0; i<iterations; i++) f();
+  auto end = std::chrono::steady_clock::now();
+  allocs = allocationCount() - allocs;
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  printf("%-40s %10lu ops %12.1f ns/op %8.2f allocs/op\n", name, iterations, ns/iterations, double(allocs)/iterations);
+  return ns/iterations;
+}
+
+}
+
+#endif // BENCH_H
@@ -0,0 +1,2125 @@
+// LibBBBench - host-side micro-benchmarks for LibBB hot paths.
+// Build and run with "pio run -e native -t exec", optionally followed by "-a <filter>"
+// to only run benchmarks whose name contains <filter>. Simulations against a simulated clock
+// (named "sim:...") run last; the program exits with 1 if any of them fails.
+
+#include <LibBB.h>
+
+#include "Bench.h"
+
+using namespace bb;
+
+// Does nothing, but gets stepped by the runloop like any real subsystem.
+class NullSubsystem: public Subsystem {
+public:
+  NullSubsystem(const char* name) { name_ = name; }
+  virtual Result start(ConsoleStream *stream = NULL) { (void)stream; started_ = true; operationStatus_ = RES_OK; return RES_OK; }
+  virtual Result stop(ConsoleStream *stream = NULL) { (void)stream; started_ = false; return RES_OK; }
+  virtual Result step() { return RES_OK; }
+};
+
+// Clock for the simulations below - only moves when the runloop waits or a subsystem pretends to work.
+static VirtualTimeSource simClock;
+
+// Burns simulated time in step(): a uniformly distributed load, plus an occasional spike.
+class LoadSubsystem: public Subsystem {
+public:
+  LoadSubsystem(const char* name) { name_ = name; }
+  virtual Result start(ConsoleStream *stream = NULL) { (void)stream; started_ = true; operationStatus_ = RES_OK; return RES_OK; }
+  virtual Result stop(ConsoleStream *stream = NULL) { (void)stream; started_ = false; return RES_OK; }
+  virtual Result step() {
+    unsigned long load = random(minUS, maxUS+1);
+    if(spikeEvery != 0 && random(spikeEvery) == 0) load += spikeUS;
+    simClock.advance(load);
+    return RES_OK;
+  }
+
+  unsigned long minUS = 0, maxUS = 0, spikeUS = 0;
+  long spikeEvery = 0;
+};
+
+class ConstantInput: public ControlInput {
+public:
+  virtual float present() { return value_; }
+  virtual Result update() { value_ += 0.001f; return RES_OK; }
+protected:
+  float value_ = 0;
+};
+
+class NullOutput: public ControlOutput {
+public:
+  virtual float present() { return value_; }
+  virtual Result set(float value) { value_ = value; return RES_OK; }
+protected:
+  float value_ = 0;
+};
+
+// Gives the benchmark access to the XBee receive path without having to talk to a real radio.
+class BenchXBee: public XBee {
+public:
+  BenchXBee(HardwareSerial* uart) {
+    uart_ = uart;
+    apiMode_ = true;
+    operationStatus_ = RES_OK;
+  }
+  virtual ~BenchXBee() {}
+  using XBee::FrameParser;
+  using XBee::APIFrame;
+  const FrameParser& parser() { return rx_; }
+};
+
+static void appendEscaped(std::vector<uint8_t>& buf, uint8_t byte) {
+  if(byte == 0x7d || byte == 0x7e || byte == 0x11 || byte == 0x13) {
+    buf.push_back(0x7d);
+    buf.push_back(byte ^ 0x20);
+  } else {
+    buf.push_back(byte);
+  }
+}
+
+// Builds an escaped 64bit-address RX frame (API type 0x80) as the XBee would put it on the wire.
+static std::vector<uint8_t> makeRXFrame(const uint8_t* payload, size_t len) {
+  std::vector<uint8_t> data = {0x80, 0x00, 0x13, 0xa2, 0x00, 0x41, 0x7d, 0x11, 0x7e, 0x30, 0x00};
+  data.insert(data.end(), payload, payload+len);
+
+  uint8_t checksum = 0;
+  for(auto b: data) checksum += b;
+  checksum = 0xff - checksum;
+
+  std::vector<uint8_t> frame = {0x7e};
+  appendEscaped(frame, (data.size() >> 8) & 0xff);
+  appendEscaped(frame, data.size() & 0xff);
+  for(auto b: data) appendEscaped(frame, b);
+  appendEscaped(frame, checksum);
+  return frame;
+}
+
+static std::vector<uint8_t> makeRXFrame(const Packet& packet) {
+  return makeRXFrame((const uint8_t*)&packet, sizeof(packet));
+}
+
+static Packet makeControlPacket(unsigned long seqnum) {
+  Packet packet(PACKET_TYPE_CONTROL, PACKET_SOURCE_LEFT_REMOTE, seqnum);
+  memset(&packet.payload, 0, sizeof(packet.payload));
+  packet.payload.control.button0 = true;
+  packet.payload.control.setAxis(0, 0.5f);
+  packet.payload.control.setAxis(1, -0.25f);
+  packet.crc = packet.calculateCRC();
+  return packet;
+}
+
+static void benchRunloop() {
+  static NullSubsystem subsystems[] = {
+    NullSubsystem("null0"), NullSubsystem("null1"), NullSubsystem("null2"), NullSubsystem("null3"),
+    NullSubsystem("null4"), NullSubsystem("null5"), NullSubsystem("null6"), NullSubsystem("null7")
+  };
+  static bool initialized = false;
+  if(!initialized) {
+    for(auto& s: subsystems) {
+      s.initialize();
+      s.start();
+    }
+    initialized = true;
+  }
+
+  // Cycle time 0 means every cycle "overruns" - we only want to measure loop overhead, not the wait.
+  Runloop::runloop.setCycleTimeMicros(0);
+  Console::console.handleCommandLine("runloop suppress_overrun on", NULL);
+  bench::run("Runloop::cycle (8 subsystems)", 100000, []() {
+    Runloop::runloop.cycle();
+  });
+}
+
+static void benchTrace() {
+  Trace::trace.start();
+  bench::run("Trace::record", 1000000, []() {
+    Trace::trace.record(Trace::EVENT_MARKER, 0, 42);
+  });
+  bench::run("Runloop::cycle (8 subsystems, traced)", 100000, []() {
+    Runloop::runloop.cycle();
+  });
+  Trace::trace.stop();
+}
+
+static void benchTimedCallbacks() {
+  static const unsigned int PENDING = 1000;
+  std::vector<Runloop::TimedCallbackHandle> handles;
+  unsigned int fired = 0;
+
+  // 1k recurring callbacks far in the future - none of them becomes due during the benchmark.
+  for(unsigned int i=0; i<PENDING; i++) {
+    handles.push_back(Runloop::runloop.scheduleTimedCallback(60000 + i, [&fired]() { fired++; }, false));
+  }
+  bench::run("Runloop::cycle (1k callbacks pending)", 100000, []() {
+    Runloop::runloop.cycle();
+  });
+  bench::run("schedule+cancel (1k callbacks pending)", 100000, [&fired]() {
+    Runloop::TimedCallbackHandle h = Runloop::runloop.scheduleTimedCallback(30000, [&fired]() { fired++; });
+    Runloop::runloop.cancelTimedCallback(h);
+  });
+  for(auto h: handles) Runloop::runloop.cancelTimedCallback(h);
+}
+
+static void benchTaskPlanning() {
+  static NullSubsystem droid("droid");
+  droid.initialize();
+  droid.start();
+
+  // Roughly what DODroid registers, at the IMU's 104Hz
+  Runloop::runloop.setCycleTimeMicros(9615);
+  Runloop::runloop.addTask(&droid, "head", 50, []() {}, 2000);
+  Runloop::runloop.addTask(&droid, "drive", 50, []() {}, 2000);
+  Runloop::runloop.addTask(&droid, "state", 25, []() {}, 2000);
+  Runloop::runloop.addTask(&droid, "power", 1, []() {}, 500);
+  Runloop::runloop.addTask(&droid, "sdcard", 0.1, []() {}, 5000);
+  Runloop::runloop.addTask(&droid, "timing", 1, []() {}, 1000);
+  if(bench::selected("Runloop::rebalanceTasks")) {
+    Serial.setEcho(true);
+    Runloop::runloop.printTasks(Console::console.serialStream());
+    Serial.setEcho(false);
+  }
+
+  bench::run("Runloop::rebalanceTasks (6 tasks)", 1000, []() {
+    Runloop::runloop.rebalanceTasks();
+  });
+
+  for(const char* name: {"head", "drive", "state", "power", "sdcard", "timing"}) Runloop::runloop.removeTask(&droid, name);
+  droid.stop();
+}
+
+static void benchPIDController() {
+  ConstantInput input;
+  NullOutput output;
+  PIDController pid(input, output);
+  pid.setControlParameters(1.0, 0.1, 0.01);
+  pid.setIBounds(-10, 10);
+  pid.setControlBounds(-1, 1);
+  pid.setGoal(1.0);
+  bench::run("PIDController::update", 1000000, [&]() {
+    pid.update();
+  });
+}
+
+static void benchLowPassFilter() {
+  LowPassFilter fixed(10, 100, false);
+  LowPassFilter adaptive(10, 100, true);
+  float x = 0;
+  bench::run("LowPassFilter::filter", 1000000, [&]() {
+    x = fixed.filter(x + 1.0f);
+  });
+  bench::run("LowPassFilter::filter (adaptive)", 1000000, [&]() {
+    x = adaptive.filter(x + 1.0f);
+  });
+}
+
+// DODroid's parameters, once as a constant table and once the way Subsystem used to keep them: one heap object
+// per parameter with String name and help, found by comparing Strings one after the other.
+static float paramValues[38];
+static constexpr Subsystem::ParameterDef PARAM_TABLE[] = {
+  Subsystem::parameter("accel", "Acceleration in mm/s^2", paramValues[0]),
+  Subsystem::parameter("aerial_anim", "Animation angle for aerials", paramValues[1]),
+  Subsystem::parameter("aerial_offset", "Offset for aerials", paramValues[2]),
+  Subsystem::parameter("auto_pos_control", "Automatically switch to position control", paramValues[3]),
+  Subsystem::parameter("auto_pos_kd", "Derivative constant for position PID controller", paramValues[4]),
+  Subsystem::parameter("auto_pos_ki", "Integrative constant for position PID controller", paramValues[5]),
+  Subsystem::parameter("auto_pos_kp", "Proportional constant for position PID controller", paramValues[6]),
+  Subsystem::parameter("bal_kd", "Derivative constant for balance PID controller", paramValues[7]),
+  Subsystem::parameter("bal_ki", "Integrative constant for balance PID controller", paramValues[8]),
+  Subsystem::parameter("bal_kp", "Proportional constant for balance PID controller", paramValues[9]),
+  Subsystem::parameter("fa_aerial_speed", "Free Anim: Aerial position on wheel speed setpoint", paramValues[10]),
+  Subsystem::parameter("fa_head_anneal_time", "Free Anim: Head anneal time", paramValues[11]),
+  Subsystem::parameter("fa_head_heading_turn", "Free Anim: Head heading on turn speed", paramValues[12]),
+  Subsystem::parameter("fa_head_pitch_speed_sp", "Free Anim - head pitch on wheel speed setpoint", paramValues[13]),
+  Subsystem::parameter("fa_head_roll_turn", "Free Anim: Head roll on turn speed", paramValues[14]),
+  Subsystem::parameter("fa_neck_imu_accel", "Free Anim - neck on IMU accel", paramValues[15]),
+  Subsystem::parameter("fa_neck_sp_accel", "Free Anim - neck on accel setpoint", paramValues[16]),
+  Subsystem::parameter("fa_neck_speed", "Free Anim - neck on wheel speed", paramValues[17]),
+  Subsystem::parameter("fa_neck_speed_sp", "Free Anim - neck on wheel speed setpoint", paramValues[18]),
+  Subsystem::parameter("head_heading_offset", "Head heading servo servo offset", paramValues[19]),
+  Subsystem::parameter("head_heading_range", "Head heading servo movement range", paramValues[20]),
+  Subsystem::parameter("head_pitch_offset", "Head pitch servo offset", paramValues[21]),
+  Subsystem::parameter("head_pitch_range", "Head pitch servo movement range", paramValues[22]),
+  Subsystem::parameter("head_roll_offset", "Head roll servo servo offset", paramValues[23]),
+  Subsystem::parameter("head_roll_range", "Head roll servo movement range", paramValues[24]),
+  Subsystem::parameter("lean_head_to_body", "Lean multiplier to counter head motion with body motion", paramValues[25]),
+  Subsystem::parameter("max_speed", "Maximum speed (only honored in speed control mode)", paramValues[26]),
+  Subsystem::parameter("mot_deadband", "Deadband for drive motors", paramValues[27]),
+  Subsystem::parameter("neck_offset", "Neck servo offset", paramValues[28]),
+  Subsystem::parameter("neck_range", "Neck servo movement range", paramValues[29]),
+  Subsystem::parameter("pos_kd", "Derivative constant for position PID controller", paramValues[30]),
+  Subsystem::parameter("pos_ki", "Integrative constant for position PID controller", paramValues[31]),
+  Subsystem::parameter("pos_kp", "Proportional constant for position PID controller", paramValues[32]),
+  Subsystem::parameter("rot_axis_gain", "Gain for controller rot axis", paramValues[33]),
+  Subsystem::parameter("speed_axis_gain", "Gain for controller speed axis", paramValues[34]),
+  Subsystem::parameter("wheel_kd", "Derivative constant for wheel speed PID controller", paramValues[35]),
+  Subsystem::parameter("wheel_ki", "Integrative constant for wheel speed PID controller", paramValues[36]),
+  Subsystem::parameter("wheel_kp", "Proportional constant for wheel speed PID controller", paramValues[37])
+};
+static const size_t NUM_PARAMS = sizeof(PARAM_TABLE) / sizeof(PARAM_TABLE[0]);
+
+class ParamSubsystem: public NullSubsystem {
+public:
+  ParamSubsystem(): NullSubsystem("params") { setParameterTable(PARAM_TABLE, NUM_PARAMS); }
+  const ParameterDef* find(const char* name) { return findParameter(name); }
+};
+
+class LegacyParameter {
+public:
+  LegacyParameter(const String& name, float& val, String help): val_(val), help_(help) { name_ = name; }
+  virtual ~LegacyParameter() {}
+  virtual const String& name() const { return name_; }
+protected:
+  String name_;
+  float& val_;
+  String help_;
+  float min_ = INT_MIN, max_ = INT_MAX;
+};
+
+static void benchParameters() {
+  ParamSubsystem table;
+  std::vector<LegacyParameter*> legacy;
+  size_t legacyBytes = 0;
+  for(auto& p: PARAM_TABLE) {
+    legacy.push_back(new LegacyParameter(p.name, *(float*)p.value, p.help));
+    legacyBytes += sizeof(LegacyParameter) + strlen(p.name) + 1 + strlen(p.help) + 1 + sizeof(LegacyParameter*);
+  }
+  std::vector<String> names;
+  for(auto& p: PARAM_TABLE) names.push_back(p.name);
+
+  size_t i = 0;
+  volatile const void* found;
+  bench::run("Subsystem::findParameter (table)", 1000000, [&]() {
+    found = table.find(names[i].c_str());
+    i = (i + 1) % NUM_PARAMS;
+  });
+  bench::run("Subsystem::findParameter (legacy)", 1000000, [&]() {
+    found = nullptr;
+    for(auto p: legacy) {
+      if(p->name() == names[i]) { found = p; break; }
+    }
+    i = (i + 1) % NUM_PARAMS;
+  });
+  String unknown("no_such_param");
+  bench::run("Subsystem::findParameter (table, miss)", 1000000, [&]() {
+    found = table.find(unknown.c_str());
+  });
+  bench::run("Subsystem::findParameter (legacy, miss)", 1000000, [&]() {
+    found = nullptr;
+    for(auto p: legacy) {
+      if(p->name() == unknown) { found = p; break; }
+    }
+  });
+  (void)found;
+  String value("1.5");
+  bench::run("Subsystem::setParameterValue", 1000000, [&]() {
+    table.setParameterValue(names[i].c_str(), value.c_str());
+    i = (i + 1) % NUM_PARAMS;
+  });
+  if(bench::selected("Subsystem::findParameter")) {
+    ::printf("%u parameters: table %u bytes const, legacy %u bytes heap\n", (unsigned)NUM_PARAMS, (unsigned)sizeof(PARAM_TABLE),
+             (unsigned)legacyBytes);
+  }
+
+  for(auto p: legacy) delete p;
+}
+
+// Builds a bulk parameter request for the given subsystem, with the CRC filled in.
+static size_t makeParamBlock(uint8_t* buf, const char* subsys, uint8_t op, const std::vector<ParamEntry>& entries) {
+  ParamBlockHeader* header = (ParamBlockHeader*)buf;
+  memset(header, 0, sizeof(ParamBlockHeader));
+  header->magic = PARAM_BLOCK_MAGIC;
+  header->version = PARAM_BLOCK_VERSION;
+  header->op = op;
+  header->numEntries = entries.size();
+  strncpy(header->subsystem, subsys, sizeof(header->subsystem));
+  memcpy(buf + sizeof(ParamBlockHeader), entries.data(), entries.size()*sizeof(ParamEntry));
+  size_t len = sizeof(ParamBlockHeader) + entries.size()*sizeof(ParamEntry);
+  header->crc = calculateCRC16(buf, len);
+  return len;
+}
+
+// Pushes D-O's whole parameter set through the bulk protocol, the way ParamTool.py does via UDP, and checks the
+// replies. The console equivalent is one "set" command per parameter.
+static bool benchParameterBlock() {
+  static ParamSubsystem subsys;
+  subsys.initialize();
+
+  std::vector<ParamEntry> entries;
+  for(auto& p: PARAM_TABLE) {
+    ParamEntry e;
+    e.hash = p.hash;
+    e.type = Subsystem::PARAMETER_FLOAT;
+    e.result = 0;
+    e.value.f = 0.5f;
+    entries.push_back(e);
+  }
+  uint8_t request[sizeof(ParamBlockHeader) + MAX_PARAM_ENTRIES*sizeof(ParamEntry)], buf[sizeof(request)];
+  size_t len = makeParamBlock(request, "params", PARAM_OP_SET, entries);
+
+  size_t replyLen = 0;
+  bench::run("SubsystemManager::handleParameterBlock", 100000, [&]() {
+    memcpy(buf, request, len);
+    replyLen = SubsystemManager::manager.handleParameterBlock(buf, len, sizeof(buf));
+  });
+  if(!bench::selected("SubsystemManager::handleParameterBlock")) return true;
+
+  bool ok = true;
+  ParamBlockHeader* header = (ParamBlockHeader*)buf;
+  ParamEntry* reply = (ParamEntry*)(buf + sizeof(ParamBlockHeader));
+  uint16_t crc = header->crc;
+  header->crc = 0;
+  if(replyLen != len || crc != calculateCRC16(buf, replyLen) || header->op != (PARAM_OP_SET | PARAM_OP_REPLY) || header->result != RES_OK) ok = false;
+  for(size_t i=0; ok && i<NUM_PARAMS; i++) {
+    if(reply[i].result != RES_OK || reply[i].value.f != 0.5f || paramValues[i] != 0.5f) ok = false;
+  }
+
+  // Wrong type, unknown hash and a corrupted block
+  entries.resize(2);
+  entries[0].type = Subsystem::PARAMETER_INT;
+  entries[1].hash = Subsystem::hashParameterName("no_such_param");
+  len = makeParamBlock(buf, "params", PARAM_OP_SET, entries);
+  if(SubsystemManager::manager.handleParameterBlock(buf, len, sizeof(buf)) != len ||
+     reply[0].result != RES_PARAM_INVALID_TYPE || reply[1].result != RES_PARAM_NO_SUCH_PARAMETER) ok = false;
+  len = makeParamBlock(buf, "params", PARAM_OP_GET, entries);
+  buf[len-1] ^= 1;
+  if(SubsystemManager::manager.handleParameterBlock(buf, len, sizeof(buf)) != 0) ok = false;
+
+  // Listing in pages, like over the XBee
+  unsigned int listed = 0;
+  for(uint8_t first = 0; ok; first += MAX_XBEE_PARAM_ENTRIES) {
+    len = makeParamBlock(buf, "params", PARAM_OP_LIST, {});
+    header->first = first;
+    header->crc = 0;
+    header->crc = calculateCRC16(buf, len);
+    if(SubsystemManager::manager.handleParameterBlock(buf, len, sizeof(ParamBlockHeader) + MAX_XBEE_PARAM_ENTRIES*sizeof(ParamEntry)) == 0) ok = false;
+    if(header->numEntries == 0) break;
+    listed += header->numEntries;
+  }
+  if(listed != subsys.numParameters()) ok = false;
+
+  // Same request via an XBee frame: consumed by the XBee subsystem, reply goes back out on the UART
+  static BenchXBee xbee(&Serial1);
+  Serial1.begin(115200);
+  entries.resize(MAX_XBEE_PARAM_ENTRIES);
+  for(size_t i=0; i<entries.size(); i++) entries[i] = ParamEntry{PARAM_TABLE[i].hash, Subsystem::PARAMETER_FLOAT, 0, {0}};
+  len = makeParamBlock(buf, "params", PARAM_OP_GET, entries);
+  std::vector<uint8_t> frame = makeRXFrame(buf, len);
+  Serial1.feed(frame.data(), frame.size());
+  size_t written = Serial1.bytesWritten();
+  HWAddress src;
+  uint8_t rssi;
+  Packet packet;
+  if(xbee.receiveAPIMode(src, rssi, packet) != RES_PACKET_CONSUMED || Serial1.bytesWritten() - written < 11 + len) ok = false;
+
+  ::printf("%u parameters in one %u byte datagram, %u entries per XBee frame: %s\n", (unsigned)NUM_PARAMS, (unsigned)replyLen,
+           (unsigned)MAX_XBEE_PARAM_ENTRIES, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+static void benchPacketCRC() {
+  Packet packet = makeControlPacket(3);
+  volatile uint8_t crc;
+  bench::run("Packet::calculateCRC", 1000000, [&]() {
+    packet.seqnum++;
+    crc = packet.calculateCRC();
+  });
+  (void)crc;
+}
+
+// Swallows console output, only counts it.
+class CountingStream: public ConsoleStream {
+public:
+  virtual bool available() { return false; }
+  virtual int printfFinal(const char* str) { size_t len = strlen(str); bytes += len; return len; }
+  size_t bytes = 0;
+};
+
+// Hands the console the same input line over and over, one byte per read(). Output is swallowed.
+class LineFeedStream: public QueuedConsoleStream {
+public:
+  LineFeedStream(const char* line): line_(line), pos_(strlen(line)) { setBlocking(false); }
+  void feed() { pos_ = 0; }
+  virtual bool available() { return line_[pos_] != '\0'; }
+  virtual int read() { return line_[pos_] != '\0' ? line_[pos_++] : -1; }
+protected:
+  virtual size_t txSpace() { return SIZE_MAX; }
+  virtual size_t txWrite(const uint8_t* buf, size_t len) { (void)buf; return len; }
+  const char* line_;
+  size_t pos_;
+};
+
+// Logs like any subsystem does.
+class LoggingSubsystem: public NullSubsystem {
+public:
+  LoggingSubsystem(): NullSubsystem("logger") {}
+  void log(int i, float f) { LOG(LOG_INFO, "step %d, filtered value %f\n", i, f); }
+  void complain(int sensor) { LOG_LIMITED(LOG_ERROR, 1000, "sensor %d not available\n", sensor); }
+};
+
+static void printThroughput(double nsPerOp, size_t bytesPerOp) {
+  if(nsPerOp != 0) ::printf("%-40s %10.1f bytes/us\n", "", bytesPerOp / (nsPerOp / 1000.0));
+}
+
+static void benchConsolePrintf() {
+  static CountingStream stream, second;
+  static LoggingSubsystem logger;
+  int i = 0;
+
+  size_t bytes = stream.printf("step %d, filtered value %f\n", 1000, 0.125f);
+  double ns = bench::run("ConsoleStream::printf", 1000000, [&]() {
+    stream.printf("step %d, filtered value %f\n", i++, 0.125f);
+  });
+  printThroughput(ns, bytes);
+
+  // Formatted once for both the Serial console and a second stream.
+  Console::console.addConsoleStream(&second);
+  size_t before = second.bytes;
+  logger.log(1000, 0.125f);
+  bytes = second.bytes - before;
+  ns = bench::run("LOG (broadcast to 2 streams)", 1000000, [&]() {
+    logger.log(i++, 0.125f);
+  });
+  printThroughput(ns, bytes);
+  Console::console.removeConsoleStream(&second);
+
+  // Same call, but only the format ID and the raw arguments go into the binary log.
+  BinaryLog::binlog.clear();
+  BinaryLog::binlog.start();
+  logger.log(1000, 0.125f);
+  size_t recordBytes = BinaryLog::binlog.bytesUsed();
+  ns = bench::run("LOG (binary)", 1000000, [&]() {
+    logger.log(i++, 0.125f);
+  });
+  BinaryLog::binlog.stop();
+  if(ns != 0) ::printf("%-40s %10lu bytes/record instead of %lu\n", "", (unsigned long)recordBytes, (unsigned long)bytes);
+
+  // After the first one, everything within the next second only gets counted.
+  bench::run("LOG_LIMITED (suppressed)", 1000000, [&]() {
+    logger.complain(i++);
+  });
+}
+
+// What a scripted command costs, from the line to the subsystem's handler.
+static void benchConsoleCommands() {
+  static CountingStream stream;
+  String line("binlog clear");
+  bench::run("Console::split (legacy)", 1000000, [&]() {
+    std::vector<String> words = Console::split(line);
+  });
+  bench::run("Console::handleCommandLine", 1000000, [&]() {
+    Console::console.handleCommandLine("binlog clear", &stream);
+  });
+  bench::run("Console::handleCommandLine (set)", 1000000, [&]() {
+    Console::console.handleCommandLine("binlog set udp_stream false", &stream);
+  });
+  // Typed input, read byte by byte into the stream's own line buffer and tokenized there.
+  static LineFeedStream input("binlog clear\n");
+  size_t allocs = bench::allocationCount();
+  double ns = bench::run("Console::handleStreamInput", 1000000, [&]() {
+    input.feed();
+    Console::console.handleStreamInput(&input);
+  });
+  allocs = bench::allocationCount() - allocs;
+  if(ns == 0) return;
+
+  // Backspace and whitespace are handled in the buffer, a line too long is dropped without hurting the next one.
+  static LineFeedStream edited("  binx\blog clear \r\n");
+  static std::string tooLong = std::string(Console::LINE_MAXLEN + 10, 'x') + "\nbinlog clear\n";
+  static LineFeedStream overflow(tooLong.c_str());
+  char *cleaned, *first, *second;
+  edited.feed();
+  overflow.feed();
+  bool good = edited.readLine('\n', cleaned) && cleaned != NULL && !strcmp(cleaned, "binlog clear") &&
+              overflow.readLine('\n', first) && first == NULL &&
+              overflow.readLine('\n', second) && second != NULL && !strcmp(second, "binlog clear");
+  ::printf("%-40s %10lu allocs, line editing %s: %s\n", "", (unsigned long)allocs, good ? "ok" : "wrong",
+           allocs == 0 && good ? "ok" : "FAILED");
+}
+
+static void benchXBeeReceive() {
+  static BenchXBee xbee(&Serial1);
+  Serial1.begin(115200);
+
+  std::vector<uint8_t> frame = makeRXFrame(makeControlPacket(5));
+  HWAddress src;
+  uint8_t rssi;
+  Packet packet;
+  bench::run("XBee::receiveAPIMode", 200000, [&]() {
+    Serial1.feed(frame.data(), frame.size());
+    if(xbee.receiveAPIMode(src, rssi, packet) != RES_OK) {
+      ::printf("receiveAPIMode() failed!\n");
+      exit(-1);
+    }
+  });
+}
+
+// sendTo() of a control packet, to an address that needs escaping. Also checks that what goes out on the wire is the
+// frame that was meant to go out, by feeding it back through the receive side's parser.
+static void benchXBeeSend() {
+  if(!bench::selected("XBee::sendTo")) return;
+  static BenchXBee xbee(&Serial1);
+  Serial1.begin(115200);
+
+  HWAddress dest = {0x0013a200, 0x417d7e11};
+  Packet packet = makeControlPacket(7);
+
+  xbee.setParameter("airtime_budget", 0u); // measure the send path, not the queue
+  static uint8_t wire[256];
+  size_t calls = Serial1.writeCalls();
+  Serial1.capture(wire, sizeof(wire));
+  xbee.sendTo(dest, packet, false);
+  size_t len = Serial1.captured();
+  Serial1.capture(NULL, 0);
+  calls = Serial1.writeCalls() - calls;
+
+  BenchXBee::FrameParser parser;
+  bool complete = false;
+  for(size_t i=0; i<len; i++) complete = parser.feed(wire[i]);
+  bool ok = complete && parser.length() == 11 + sizeof(packet) && parser.data()[0] == 0x00 &&
+            parser.data()[6] == 0x41 && parser.data()[7] == 0x7d && parser.data()[8] == 0x7e && parser.data()[9] == 0x11 &&
+            memcmp(parser.data() + 11, &packet, sizeof(packet)) == 0;
+
+  bench::run("XBee::sendTo", 1000000, [&]() {
+    xbee.sendTo(dest, packet, false);
+  });
+  if(BenchXBee::APIFrame::poolInUse() != 0) ok = false;
+  ::printf("%-40s %u bytes on the wire in %u UART write(s): %s\n", "", (unsigned)len, (unsigned)calls, ok ? "ok" : "FAILED");
+  if(!ok) exit(1);
+}
+
+// Runs the runloop against the simulated clock, starting just before micros() wraps, and checks that the cycle
+// rate doesn't drift and that overruns are handled according to the overrun policy.
+static bool simRunloopDeadlines() {
+  if(!bench::selected("sim:runloop")) return true;
+
+  static const unsigned long CYCLETIME = 9615; // what the IMU's 104Hz gives us
+  static const unsigned int CYCLES = 100000;
+  static LoadSubsystem load("load");
+  load.initialize();
+  load.start();
+
+  struct Scenario {
+    const char* name;
+    Runloop::OverrunPolicy policy;
+    unsigned long minUS, maxUS, spikeUS;
+    long spikeEvery;
+  } scenarios[] = {
+    {"no overruns",                Runloop::OVERRUN_SKIP,    1000, 9000,     0,   0},
+    {"exactly on the deadline",    Runloop::OVERRUN_SKIP,    CYCLETIME, CYCLETIME, 0, 0},
+    {"1% overruns, skip",          Runloop::OVERRUN_SKIP,    1000, 6000, 10000, 100},
+    {"1% overruns, catchup",       Runloop::OVERRUN_CATCHUP, 1000, 6000, 10000, 100},
+    {"1% long overruns, catchup",  Runloop::OVERRUN_CATCHUP, 1000, 6000, 60000, 100}
+  };
+
+  bool ok = true;
+  randomSeed(104);
+  for(auto& sc: scenarios) {
+    load.minUS = sc.minUS;
+    load.maxUS = sc.maxUS;
+    load.spikeUS = sc.spikeUS;
+    load.spikeEvery = sc.spikeEvery;
+
+    simClock = VirtualTimeSource(0xffffffff - 100000);
+    Runloop::runloop.setTimeSource(&simClock);
+    Runloop::runloop.setOverrunPolicy(sc.policy);
+    Runloop::runloop.setCycleTimeMicros(CYCLETIME);
+    Console::console.handleCommandLine("runloop suppress_overrun on", NULL);
+    Runloop::runloop.cycle();
+    Runloop::runloop.resetTimingStats();
+    uint32_t start = Runloop::runloop.micros();
+    for(unsigned int i=0; i<CYCLES; i++) Runloop::runloop.cycle();
+    uint32_t elapsed = Runloop::runloop.micros() - start;
+
+    // Every cycle either ran or was skipped, so we must be exactly on the grid - no drift.
+    const TimingStats& period = Runloop::runloop.periodTiming();
+    unsigned long slots = CYCLES + Runloop::runloop.skippedCycles();
+    bool onGrid = (elapsed == slots * CYCLETIME);
+    // Without spikes no cycle runs past its deadline, so none may be skipped
+    bool skipsOk = sc.spikeEvery != 0 || Runloop::runloop.skippedCycles() == 0;
+    ::printf("sim:runloop %-26s %8.3fHz, period mean %luus stddev %7.1fus, max jitter %6luus, %5lu skipped  %s\n", sc.name, 
+             1e6 * CYCLES / elapsed, (unsigned long)period.mean(), period.stddev(), 
+             (unsigned long)Runloop::runloop.maxPeriodJitter(), (unsigned long)Runloop::runloop.skippedCycles(),
+             !onGrid ? "DRIFT" : skipsOk ? "OK" : "SKIPPED");
+    if(!onGrid || !skipsOk) ok = false;
+  }
+
+  Runloop::runloop.setTimeSource(NULL);
+  Runloop::runloop.setOverrunPolicy(Runloop::OVERRUN_SKIP);
+  load.stop();
+  return ok;
+}
+
+// Stands in for DODroid's use of bb::IMU: reads the latest sample at the start of step(), computes, actuates.
+class IMUConsumer: public Subsystem {
+public:
+  IMUConsumer() { name_ = "imu_consumer"; }
+  virtual Result start(ConsoleStream *stream = NULL) { (void)stream; started_ = true; operationStatus_ = RES_OK; return RES_OK; }
+  virtual Result stop(ConsoleStream *stream = NULL) { (void)stream; started_ = false; return RES_OK; }
+  virtual Result step() {
+    simClock.advance(300); // I2C read
+    if(sampleSeq == consumedSeq) {
+      stale++;
+    } else {
+      missed += sampleSeq - consumedSeq - 1;
+      consumedSeq = sampleSeq;
+      consumedUS = sampleUS;
+    }
+    simClock.advance(random(1000, 3000)); // control
+    if(consumedSeq != 0) latency.add(Runloop::runloop.micros() - consumedUS); // what IMU::markActuation() does
+    return RES_OK;
+  }
+
+  // Written by the simulated data-ready interrupt
+  uint32_t sampleSeq = 0, sampleUS = 0;
+
+  uint32_t consumedSeq = 0, consumedUS = 0;
+  uint32_t stale = 0, missed = 0;
+  TimingStats latency;
+};
+
+// The IMU's output data rate is nominally 104Hz, but comes from its own oscillator. Compares sample-to-actuation
+// latency with the runloop on its own timer against the runloop synced to the data-ready interrupt.
+static bool simIMUSync() {
+  if(!bench::selected("sim:imu_sync")) return true;
+
+  static IMUConsumer consumer;
+  static bool initialized = false;
+  if(!initialized) {
+    consumer.initialize();
+    initialized = true;
+  }
+
+  static const double ODR = 104.0 * 0.997;
+  TimingStats latency[2];
+  bool ok = true;
+  for(int synced=0; synced<2; synced++) {
+    simClock = VirtualTimeSource(0);
+    Runloop::runloop.setTimeSource(&simClock);
+    Runloop::runloop.setCycleTimeMicros(1000000/104);
+    Runloop::runloop.setSyncMode(synced ? Runloop::SYNC_EXTERNAL : Runloop::SYNC_TIMER);
+    randomSeed(7);
+    consumer.sampleSeq = consumer.consumedSeq = consumer.stale = consumer.missed = 0;
+    consumer.latency.reset();
+    simClock.setPeriodicEvent(random(9615), 1e6/ODR, [synced]() {
+      consumer.sampleSeq++;
+      consumer.sampleUS = Runloop::runloop.micros();
+      if(synced) Runloop::runloop.triggerCycle();
+    });
+
+    consumer.start();
+    for(unsigned int i=0; i<20000; i++) Runloop::runloop.cycle();
+    consumer.stop();
+
+    const TimingStats& l = consumer.latency;
+    ::printf("sim:imu_sync %-15s sample to actuation mean %5luus p99 %5luus max %5luus, %4lu samples missed, %4lu stale cycles, %lu sync timeouts\n",
+             synced ? "data ready sync" : "fixed cycle", (unsigned long)l.mean(), (unsigned long)l.percentile(0.99), (unsigned long)l.max(), 
+             (unsigned long)consumer.missed, (unsigned long)consumer.stale, (unsigned long)Runloop::runloop.syncTimeouts());
+    latency[synced] = l;
+    // The very first cycle starts before the first sample, so it's always stale.
+    if(synced && (consumer.missed != 0 || consumer.stale > 1)) ok = false;
+  }
+  if(latency[1].mean() >= latency[0].mean()) ok = false;
+
+  simClock.setPeriodicEvent(0, 0, nullptr);
+  Runloop::runloop.setSyncMode(Runloop::SYNC_TIMER);
+  Runloop::runloop.setTimeSource(NULL);
+  return ok;
+}
+
+// Mass on a damped spring, pushed around by a PID controller. The position is measured with noise through an 
+// adaptive low pass filter, so the plant, the filter and the controller all depend on the runloop's clock.
+struct Plant {
+  float x, v, force;
+  uint32_t lastUS;
+};
+
+class PlantInput: public ControlInput {
+public:
+  PlantInput(Plant& plant): plant_(plant), filter_(20, 104, true) {}
+  virtual float present() { return value_; }
+  virtual Result update() { value_ = filter_.filter(plant_.x + random(-1000, 1001)/100000.0f); return RES_OK; }
+protected:
+  Plant& plant_;
+  LowPassFilter filter_;
+  float value_ = 0;
+};
+
+class PlantOutput: public ControlOutput {
+public:
+  PlantOutput(Plant& plant): plant_(plant) {}
+  virtual float present() { return plant_.force; }
+  virtual Result set(float value) { plant_.force = value; return RES_OK; }
+protected:
+  Plant& plant_;
+};
+
+class PlantSubsystem: public Subsystem {
+public:
+  PlantSubsystem(): plant(NULL), pid(NULL) { name_ = "plant"; }
+  virtual Result start(ConsoleStream *stream = NULL) { (void)stream; started_ = true; operationStatus_ = RES_OK; return RES_OK; }
+  virtual Result stop(ConsoleStream *stream = NULL) { (void)stream; started_ = false; return RES_OK; }
+  virtual Result step() {
+    uint32_t us = Runloop::runloop.micros();
+    float dt = (us - plant->lastUS) / 1e6;
+    plant->lastUS = us;
+    plant->v += (plant->force - 4.0f*plant->x - 0.5f*plant->v) * dt;
+    plant->x += plant->v * dt;
+
+    // Setpoint flips every 10 seconds.
+    pid->setGoal(((Runloop::runloop.millisSinceStart() / 10000) % 2) ? 1.0f : -1.0f);
+    pid->update();
+    simClock.advance(random(500, 3000));
+    return RES_OK;
+  }
+
+  Plant* plant;
+  PIDController* pid;
+};
+
+// Runs a 10 minute session at 104Hz on the virtual clock. Returns the final plant state.
+static Plant runVirtualSession() {
+  static PlantSubsystem subsys;
+  static bool initialized = false;
+  if(!initialized) {
+    subsys.initialize();
+    initialized = true;
+  }
+
+  simClock = VirtualTimeSource(1000000);
+  Runloop::runloop.setTimeSource(&simClock);
+  Runloop::runloop.setCycleTimeMicros(9615);
+  Runloop::runloop.setOverrunPolicy(Runloop::OVERRUN_SKIP);
+  randomSeed(42);
+
+  Plant plant = {0, 0, 0, Runloop::runloop.micros()};
+  PlantInput input(plant);
+  PlantOutput output(plant);
+  PIDController pid(input, output);
+  pid.setControlParameters(20.0, 2.0, 4.0);
+  pid.setIBounds(-10, 10);
+  pid.setControlBounds(-50, 50);
+  subsys.plant = &plant;
+  subsys.pid = &pid;
+
+  subsys.start();
+  Runloop::runloop.cycle(); // anchors millisSinceStart() and the cycle grid
+  Runloop::runloop.resetTimingStats();
+  for(unsigned int i=0; i<10*60*104; i++) Runloop::runloop.cycle();
+  subsys.stop();
+
+  Runloop::runloop.setTimeSource(NULL);
+  return plant;
+}
+
+// A virtual-time session must run much faster than realtime, and two runs must agree bit for bit.
+static bool simVirtualTime() {
+  if(!bench::selected("sim:virtual_time")) return true;
+
+  auto t0 = micros();
+  Plant a = runVirtualSession();
+  auto t1 = micros();
+  Plant b = runVirtualSession();
+
+  bool same = !memcmp(&a, &b, sizeof(Plant));
+  ::printf("sim:virtual_time 10min @104Hz in %.3fs wall time (%.0fx realtime), x=%f v=%f, %s\n", (t1-t0)/1e6, 600e6/(t1-t0),
+           a.x, a.v, same ? "reproducible" : "NOT REPRODUCIBLE");
+  return same;
+}
+
+// Background work in idle tasks must only use the slack between cycles. Chunks that fit must never cause an
+// overrun; a chunk too large for any slack must still run once it has waited maxWaitMillis.
+static bool simIdleTasks() {
+  if(!bench::selected("sim:idle")) return true;
+
+  static LoadSubsystem load("idle_load");
+  static bool initialized = false;
+  if(!initialized) {
+    load.initialize();
+    initialized = true;
+  }
+  load.minUS = 3000;
+  load.maxUS = 8000;
+  load.spikeUS = load.spikeEvery = 0;
+
+  bool ok = true;
+  randomSeed(42);
+  for(int withLarge=0; withLarge<2; withLarge++) {
+    simClock = VirtualTimeSource(0);
+    Runloop::runloop.setTimeSource(&simClock);
+    Runloop::runloop.setCycleTimeMicros(9615);
+    Console::console.handleCommandLine("runloop suppress_overrun on", NULL);
+    load.start();
+    Runloop::runloop.cycle();
+    Runloop::runloop.resetTimingStats();
+
+    unsigned int smallChunks = 0, largeChunks = 0;
+    Runloop::runloop.addIdleTask("small", 1000, [&smallChunks]() { simClock.advance(1000); return ++smallChunks < 500; });
+    if(withLarge) Runloop::runloop.addIdleTask("large", 8000, [&largeChunks]() { simClock.advance(8000); return ++largeChunks < 5; }, 100);
+
+    unsigned int cycles = 0;
+    while(Runloop::runloop.numIdleTasks() != 0 && cycles < 100000) {
+      Runloop::runloop.cycle();
+      cycles++;
+    }
+    load.stop();
+
+    ::printf("sim:idle %-24s %3u + %u chunks in %5u cycles, %lu skipped cycles\n", withLarge ? "small + starving large" : "small chunks only",
+             smallChunks, largeChunks, cycles, (unsigned long)Runloop::runloop.skippedCycles());
+    if(Runloop::runloop.numIdleTasks() != 0) ok = false;
+    if(!withLarge && Runloop::runloop.skippedCycles() != 0) ok = false;
+    if(withLarge && Runloop::runloop.skippedCycles() > largeChunks) ok = false;
+  }
+
+  Runloop::runloop.setTimeSource(NULL);
+  return ok;
+}
+
+// Tunes a stored block every cycle for two seconds, like a user dragging a slider, and checks that the write behind
+// coalesces all of that into a single commit after the quiet period, without costing the runloop any cycles.
+static bool simConfigWriteBehind() {
+  if(!bench::selected("sim:config")) return true;
+
+  static uint8_t block[256];
+  static ConfigStorage::HANDLE handle = ConfigStorage::storage.reserveBlock("sim", sizeof(block), block);
+  static LoadSubsystem load("cfg_load");
+  static bool initialized = false;
+  if(!initialized) {
+    load.initialize();
+    initialized = true;
+  }
+  load.minUS = 3000;
+  load.maxUS = 8000;
+  load.spikeUS = load.spikeEvery = 0;
+
+  simClock = VirtualTimeSource(0);
+  Runloop::runloop.setTimeSource(&simClock);
+  Runloop::runloop.setCycleTimeMicros(10000);
+  load.start();
+  Runloop::runloop.cycle();
+  Runloop::runloop.resetTimingStats();
+
+  bool ok = true;
+  ConfigStorage::storage.flush();
+  unsigned int commits = ConfigStorage::storage.numCommits(), changes = 0;
+  uint32_t lastChangeMS = 0, committedMS = 0;
+  for(unsigned int cycle=0; cycle<500; cycle++) {
+    if(cycle < 200) {
+      block[cycle % sizeof(block)] = cycle;
+      ConfigStorage::storage.markDirty(handle);
+      lastChangeMS = Runloop::runloop.millis();
+      changes++;
+    }
+    Runloop::runloop.cycle();
+    if(committedMS == 0 && ConfigStorage::storage.numCommits() != commits) committedMS = Runloop::runloop.millis();
+  }
+  load.stop();
+
+  uint8_t expected[sizeof(block)];
+  memcpy(expected, block, sizeof(block));
+  memset(block, 0, sizeof(block));
+  ConfigStorage::storage.readBlock(handle);
+  if(memcmp(expected, block, sizeof(block)) != 0) ok = false;
+  unsigned int written = ConfigStorage::storage.numCommits() - commits;
+  if(written != 1 || ConfigStorage::storage.hasDirtyBlocks()) ok = false;
+  if(committedMS - lastChangeMS < ConfigStorage::DEFAULT_QUIET_MILLIS) ok = false;
+  if(Runloop::runloop.skippedCycles() != 0) ok = false;
+
+  // Unchanged data doesn't touch the flash at all.
+  ConfigStorage::storage.markDirty(handle);
+  ConfigStorage::storage.flush();
+  if(ConfigStorage::storage.numCommits() != commits + written) ok = false;
+
+  ::printf("sim:config %u changes, %u commit %lums after the last one, %lu skipped cycles: %s\n", changes, written,
+           (unsigned long)(committedMS - lastChangeMS), (unsigned long)Runloop::runloop.skippedCycles(), ok ? "ok" : "FAILED");
+  Runloop::runloop.setTimeSource(NULL);
+  return ok;
+}
+
+// ConfigStorage on a file, constructed anew for every simulated boot.
+class JournalStorage: public ConfigStorage {
+public:
+  JournalStorage(StorageBackend* backend) { setBackend(backend); initialize(); }
+};
+
+static const char* JOURNAL_PATH = "/tmp/libbbbench-journal.bin";
+static const size_t JOURNAL_SIZE = 1024;
+
+static std::vector<uint8_t> readJournalFile() {
+  std::vector<uint8_t> bytes(JOURNAL_SIZE);
+  FILE* f = fopen(JOURNAL_PATH, "rb");
+  if(f != NULL) {
+    if(fread(bytes.data(), 1, bytes.size(), f) != bytes.size()) bytes.clear();
+    fclose(f);
+  }
+  return bytes;
+}
+
+static void writeJournalFile(const std::vector<uint8_t>& bytes) {
+  FILE* f = fopen(JOURNAL_PATH, "wb");
+  if(f == NULL) return;
+  fwrite(bytes.data(), 1, bytes.size(), f);
+  fclose(f);
+}
+
+// Two blocks that are only ever changed together, so each must come back all old or all new.
+struct JournalBlocks {
+  uint8_t a[64], b[100];
+  ConfigStorage::HANDLE ha, hb;
+
+  void reserve(ConfigStorage& storage) {
+    ha = storage.reserveBlock("a", sizeof(a), a);
+    hb = storage.reserveBlock("b", sizeof(b), b);
+  }
+  void fill(uint8_t gen) {
+    memset(a, gen, sizeof(a));
+    memset(b, gen, sizeof(b));
+  }
+  // Returns the generation stored, or -1 if the blocks don't match each other.
+  int load(ConfigStorage& storage) {
+    if(!storage.blockIsValid(ha) || !storage.blockIsValid(hb)) return -1;
+    if(storage.readBlock(ha) != RES_OK || storage.readBlock(hb) != RES_OK) return -1;
+    for(size_t i=0; i<sizeof(a); i++) if(a[i] != a[0]) return -1;
+    for(size_t i=0; i<sizeof(b); i++) if(b[i] != a[0]) return -1;
+    return a[0];
+  }
+};
+
+// Cuts power at every byte of a commit that moves from 'from' to 'to', starting from the journal in 'before', and
+// checks that every reboot finds either all of 'from' or all of 'to'. Returns the number of cut points tried.
+static unsigned int journalPowerLossSweep(const std::vector<uint8_t>& before, uint8_t from, uint8_t to, bool& ok) {
+  for(size_t cutoff=0; ; cutoff++) {
+    writeJournalFile(before);
+    bool committed;
+    {
+      FileStorageBackend backend(JOURNAL_PATH, JOURNAL_SIZE);
+      JournalStorage storage(&backend);
+      JournalBlocks blocks;
+      blocks.reserve(storage);
+      if(blocks.load(storage) != from) ok = false;
+      blocks.fill(to);
+      storage.writeAll();
+      backend.failCommitAfter(cutoff);
+      committed = storage.commit() == RES_OK;
+    }
+
+    FileStorageBackend backend(JOURNAL_PATH, JOURNAL_SIZE);
+    JournalStorage storage(&backend);
+    JournalBlocks blocks;
+    blocks.reserve(storage);
+    int gen = blocks.load(storage);
+    if(gen != from && gen != to) ok = false;
+    if(committed) {
+      if(gen != to) ok = false;
+      return cutoff + 1;
+    }
+  }
+}
+
+// Journaled config storage on a file backend: survives reboots, spreads the writes, and never comes back from a power
+// loss with half a commit applied.
+static bool simConfigJournal() {
+  if(!bench::selected("sim:journal")) return true;
+  bool ok = true;
+
+  // Wear: one small change per commit, like storing a tuned parameter again and again.
+  remove(JOURNAL_PATH);
+  unsigned int commits = 400;
+  unsigned long maxWrites = 0;
+  uint32_t scanUS = 0;
+  {
+    FileStorageBackend backend(JOURNAL_PATH, JOURNAL_SIZE);
+    JournalStorage storage(&backend);
+    JournalBlocks blocks;
+    blocks.reserve(storage);
+    blocks.fill(0);
+    storage.writeAll();
+    storage.commit();
+    for(unsigned int i=1; i<commits; i++) {
+      blocks.a[i % sizeof(blocks.a)] = i;
+      storage.writeBlock(blocks.ha);
+      if(storage.commit() != RES_OK) ok = false;
+    }
+    if(storage.numCommits() != commits) ok = false;
+    for(size_t addr=0; addr<JOURNAL_SIZE; addr++) maxWrites = std::max(maxWrites, backend.writeCount(addr));
+
+    // Reboot and compare
+    uint8_t a[sizeof(blocks.a)];
+    memcpy(a, blocks.a, sizeof(a));
+    FileStorageBackend backend2(JOURNAL_PATH, JOURNAL_SIZE);
+    JournalStorage storage2(&backend2);
+    JournalBlocks blocks2;
+    blocks2.reserve(storage2);
+    if(storage2.readBlock(blocks2.ha) != RES_OK || memcmp(a, blocks2.a, sizeof(a)) != 0) ok = false;
+    scanUS = storage2.scanMicros();
+  }
+  // In place, the block's bytes would have been written once per commit.
+  if(maxWrites * 4 > commits) ok = false;
+  ::printf("sim:journal %u commits, at most %lu writes per byte, boot scan %luus\n", commits, maxWrites, (unsigned long)scanUS);
+
+  // Power loss while appending to the active bank
+  remove(JOURNAL_PATH);
+  {
+    FileStorageBackend backend(JOURNAL_PATH, JOURNAL_SIZE);
+    JournalStorage storage(&backend);
+    JournalBlocks blocks;
+    blocks.reserve(storage);
+    blocks.fill(1);
+    storage.writeAll();
+    storage.commit();
+  }
+  unsigned int appendCuts = journalPowerLossSweep(readJournalFile(), 1, 2, ok);
+
+  // Power loss while moving to the other bank: fill the active bank until both blocks don't fit anymore.
+  unsigned int bank;
+  {
+    FileStorageBackend backend(JOURNAL_PATH, JOURNAL_SIZE);
+    JournalStorage storage(&backend);
+    JournalBlocks blocks;
+    blocks.reserve(storage);
+    blocks.load(storage);
+    uint8_t gen = 2;
+    while(storage.bankFree() >= 2*16 + sizeof(blocks.a) + sizeof(blocks.b) + 16) {
+      blocks.fill(++gen);
+      storage.writeAll();
+      storage.commit();
+    }
+    bank = storage.activeBank();
+  }
+  std::vector<uint8_t> full = readJournalFile();
+  uint8_t gen;
+  {
+    FileStorageBackend backend(JOURNAL_PATH, JOURNAL_SIZE);
+    JournalStorage storage(&backend);
+    JournalBlocks blocks;
+    blocks.reserve(storage);
+    gen = blocks.load(storage);
+  }
+  unsigned int switchCuts = journalPowerLossSweep(full, gen, gen+1, ok);
+  {
+    FileStorageBackend backend(JOURNAL_PATH, JOURNAL_SIZE);
+    JournalStorage storage(&backend);
+    if(storage.activeBank() == bank) ok = false;
+  }
+  remove(JOURNAL_PATH);
+
+  ::printf("sim:journal power loss at %u points while appending, %u while switching banks: %s\n", appendCuts, switchCuts,
+           ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// Console stream on a slow link, e.g. a USB host that doesn't keep up or a stalled TCP client. Takes bytesPerSecond
+// in simulated time, with a 64 byte transport buffer. In blocking mode, writes wait for the link.
+class SlowLinkStream: public QueuedConsoleStream {
+public:
+  SlowLinkStream(unsigned long bytesPerSecond): bps_(bytesPerSecond) {}
+  virtual bool available() { return false; }
+  virtual int read() { return -1; }
+  size_t delivered = 0;
+
+protected:
+  static constexpr double BUFFER = 64;
+  void refill() {
+    uint32_t now = simClock.micros();
+    credit_ = std::min(credit_ + double(now - lastUS_) * bps_ / 1e6, BUFFER);
+    lastUS_ = now;
+  }
+  virtual size_t txSpace() { refill(); return size_t(credit_); }
+  virtual size_t txWrite(const uint8_t* buf, size_t len) {
+    (void)buf;
+    refill();
+    if(len > credit_) {
+      simClock.advance(uint32_t((len - credit_) * 1e6 / bps_));
+      lastUS_ = simClock.micros();
+      credit_ = len;
+    }
+    credit_ -= len;
+    delivered += len;
+    return len;
+  }
+  unsigned long bps_;
+  uint32_t lastUS_ = 0;
+  double credit_ = 0;
+};
+
+// Prints a status line every cycle and a burst of output every now and then, like a "status" command would.
+class ChattySubsystem: public NullSubsystem {
+public:
+  ChattySubsystem(): NullSubsystem("chatty") {}
+  virtual Result step() {
+    produced += stream->printf("cycle %6lu: speed %8.3f, heading %8.3f, battery %5.2fV\n", cycles, 0.5, 270.0, 16.4);
+    if(++cycles % 100 == 0) {
+      for(int i=0; i<10; i++) produced += stream->printf("%-99s\n", "subsystem status line");
+    }
+    return RES_OK;
+  }
+  ConsoleStream* stream = nullptr;
+  unsigned long cycles = 0;
+  size_t produced = 0;
+};
+
+// A 115200bps console that gets more output than it can take in bursts: blocking stalls the runloop, the queued
+// stream keeps the cycle time and drops what doesn't fit.
+static bool simConsoleQueue() {
+  if(!bench::selected("sim:console")) return true;
+
+  static LoadSubsystem load("con_load");
+  static ChattySubsystem chatty;
+  static bool initialized = false;
+  if(!initialized) {
+    load.initialize();
+    chatty.initialize();
+    initialized = true;
+  }
+  load.minUS = 2000;
+  load.maxUS = 5000;
+  load.spikeUS = load.spikeEvery = 0;
+  Console::console.start();
+
+  bool ok = true;
+  const char* modes[] = {"blocking", "queued, drop oldest", "queued, drop newest"};
+  for(int mode=0; mode<3; mode++) {
+    SlowLinkStream link(115200/10);
+    link.setDropPolicy(mode == 2 ? QueuedConsoleStream::DROP_NEWEST : QueuedConsoleStream::DROP_OLDEST);
+    chatty.stream = &link;
+    chatty.cycles = chatty.produced = 0;
+
+    simClock = VirtualTimeSource(0);
+    Runloop::runloop.setTimeSource(&simClock);
+    Runloop::runloop.setCycleTimeMicros(10000);
+    Console::console.addConsoleStream(&link);
+    if(mode == 0) link.setBlocking(true);
+    load.start();
+    chatty.start();
+    Runloop::runloop.cycle();
+    Runloop::runloop.resetTimingStats();
+    link.resetCounters();
+    size_t producedBefore = chatty.produced, deliveredBefore = link.delivered, queuedBefore = link.queued();
+
+    for(int i=0; i<1000; i++) Runloop::runloop.cycle();
+
+    chatty.stop();
+    load.stop();
+    Console::console.removeConsoleStream(&link);
+    Runloop::runloop.setTimeSource(NULL);
+
+    size_t produced = chatty.produced - producedBefore, delivered = link.delivered - deliveredBefore;
+    ::printf("sim:console %-20s %6lu bytes printed, %6lu sent, %5lu dropped, max %3lu queued, %3lu skipped cycles\n", modes[mode],
+             (unsigned long)produced, (unsigned long)delivered, link.droppedBytes(), (unsigned long)link.maxQueued(),
+             (unsigned long)Runloop::runloop.skippedCycles());
+    if(mode != 0) {
+      if(Runloop::runloop.skippedCycles() != 0) ok = false;
+      if(link.droppedBytes() == 0 || link.maxQueued() > link.queueSize()) ok = false;
+      if(queuedBefore + produced != delivered + link.droppedBytes() + link.queued()) ok = false;
+    }
+  }
+
+  // "help" to all streams while one client has stopped reading: once that one counts as stalled, the help text
+  // has to get through to the other one, instead of waiting for the stalled client forever. Polling writeSpace()
+  // costs a little time, or the waiting help task would spin in the slack without the simulated clock moving.
+  struct PolledLinkStream: public SlowLinkStream {
+    PolledLinkStream(unsigned long bytesPerSecond): SlowLinkStream(bytesPerSecond) {}
+    virtual size_t writeSpace() { simClock.advance(5); return SlowLinkStream::writeSpace(); }
+  };
+  PolledLinkStream live(115200/10), dead(0);
+  simClock = VirtualTimeSource(0);
+  Runloop::runloop.setTimeSource(&simClock);
+  Console::console.addConsoleStream(&live);
+  Console::console.addConsoleStream(&dead);
+  live.setBlocking(false);
+  dead.setBlocking(false);
+  dead.printf("%-200s\n", "output the client never reads");
+  size_t idleTasks = Runloop::runloop.numIdleTasks();
+  Console::console.handleCommandLine("help", &BroadcastStream::bc);
+  unsigned int cycles = 0;
+  while(Runloop::runloop.numIdleTasks() > idleTasks && cycles < 10*QueuedConsoleStream::STALL_CYCLES) {
+    Runloop::runloop.cycle();
+    cycles++;
+  }
+  for(int i=0; i<100; i++) Runloop::runloop.cycle(); // let the live stream drain
+  Console::console.removeConsoleStream(&dead);
+  Console::console.removeConsoleStream(&live);
+  Runloop::runloop.setTimeSource(NULL);
+  bool stallOk = dead.stalled() && Runloop::runloop.numIdleTasks() == idleTasks && live.droppedBytes() == 0 && live.delivered > 1000;
+  ::printf("sim:console stalled client: help done after %u cycles, %lu bytes to the live client, %lu dropped for the stalled one: %s\n",
+           cycles, (unsigned long)live.delivered, dead.droppedBytes(), stallOk ? "ok" : "FAILED");
+  return ok && stallOk;
+}
+
+// Records a few seconds of a loaded runloop and checks the dump. Run with exactly "sim:trace" as filter to get the
+// dump on stdout, e.g. "bench sim:trace | python3 DroidGUI/TraceToChrome.py /dev/stdin trace.json".
+static bool simTrace() {
+  if(!bench::selected("sim:trace")) return true;
+  bool print = bench::filter != nullptr && !strcmp(bench::filter, "sim:trace");
+
+  static LoadSubsystem load("trace_load");
+  static bool initialized = false;
+  if(!initialized) {
+    load.initialize();
+    initialized = true;
+  }
+  load.minUS = 1000;
+  load.maxUS = 6000;
+  load.spikeUS = 8000;
+  load.spikeEvery = 50;
+
+  simClock = VirtualTimeSource(0);
+  Runloop::runloop.setTimeSource(&simClock);
+  Runloop::runloop.setCycleTimeMicros(9615);
+  Console::console.handleCommandLine("runloop suppress_overrun on", NULL);
+  uint8_t marker = Trace::trace.registerMarker("sim_marker");
+  load.start();
+  Trace::trace.clear();
+  Trace::trace.start();
+  for(unsigned int i=0; i<300; i++) {
+    if(i % 100 == 0) Trace::trace.marker(marker, i);
+    Runloop::runloop.cycle();
+  }
+  Trace::trace.stop();
+  load.stop();
+
+  char buf[48];
+  unsigned int events = 0, lines = 0;
+  Trace::trace.beginDump();
+  while(Trace::trace.nextDumpLine(buf, sizeof(buf))) {
+    if(!strncmp(buf, "BBT E ", 6)) events++;
+    lines++;
+    if(print) fputs(buf, stdout);
+  }
+  Trace::trace.endDump();
+  Runloop::runloop.setTimeSource(NULL);
+
+  uint32_t expected = Trace::trace.numRecorded() < BB_TRACE_EVENTS ? Trace::trace.numRecorded() : BB_TRACE_EVENTS;
+  if(!print) ::printf("sim:trace %lu events recorded, %u dumped in %u lines\n", (unsigned long)Trace::trace.numRecorded(), events, lines);
+  return events == expected;
+}
+
+// Logs through a wrapping binary log and checks that what comes out matches what went in. Run with exactly
+// "sim:binlog" as filter to get a dump on stdout, e.g. "bench sim:binlog | python3 DroidGUI/LogDecoder.py decode
+// logtable.json /dev/stdin", with the table made by "LogDecoder.py table logtable.json LibBB Utilities/LibBBBench".
+static bool simBinaryLog() {
+  if(!bench::selected("sim:binlog")) return true;
+  bool print = bench::filter != nullptr && !strcmp(bench::filter, "sim:binlog");
+
+  static LoggingSubsystem logger;
+  const unsigned int num = 500;
+  BinaryLog::binlog.clear();
+  BinaryLog::binlog.start();
+  for(unsigned int i=0; i<num; i++) logger.log(i, i/8.0f);
+  BinaryLog::binlog.stop();
+
+  bool ok = BinaryLog::binlog.numStored() == num && 
+            BinaryLog::binlog.numRecords() == num - BinaryLog::binlog.numOverwritten();
+  const uint32_t id = logHash("step %d, filtered value %f\n");
+  unsigned int records = 0, expected = num - BinaryLog::binlog.numRecords();
+  uint8_t buf[MAX_LOG_RECORD];
+  size_t len;
+  if(print) ::printf("BBL H %u %lu\n", (unsigned)BinaryLog::binlog.numRecords(), (unsigned long)BinaryLog::binlog.numOverwritten());
+  while((len = BinaryLog::binlog.pop(buf, sizeof(buf))) != 0) {
+    LogRecordHeader header;
+    memcpy(&header, buf, sizeof(header));
+    // Arguments: zigzag varint i, then the float
+    size_t pos = sizeof(header);
+    uint64_t zz = 0;
+    if(buf[pos++] != LOGARG_INT) ok = false;
+    for(unsigned int shift=0; ; shift+=7) {
+      zz |= uint64_t(buf[pos] & 0x7f) << shift;
+      if((buf[pos++] & 0x80) == 0) break;
+    }
+    if(header.length != len || header.id != id || zz != 2*expected || buf[pos] != LOGARG_FLOAT) ok = false;
+    if(print) {
+      ::printf("BBL R ");
+      for(size_t j=0; j<len; j++) ::printf("%02x", buf[j]);
+      ::printf("\n");
+    }
+    expected++;
+    records++;
+  }
+  if(print) ::printf("BBL X\n");
+  ok = ok && expected == num;
+
+  if(!print) ::printf("sim:binlog %u records logged, %u popped in order, %lu overwritten: %s\n", num, records,
+                      (unsigned long)BinaryLog::binlog.numOverwritten(), ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// Picks the rate limited messages and repeat counts out of the console output.
+class RepeatCountingStream: public CountingStream {
+public:
+  virtual int printfFinal(const char* str) {
+    unsigned long n;
+    const char* rep = strstr(str, "... repeated ");
+    if(rep != NULL && sscanf(rep, "... repeated %lu", &n) == 1) repeated += n;
+    else if(strstr(str, "not available") != NULL) messages++;
+    lines++;
+    return CountingStream::printfFinal(str);
+  }
+  unsigned long messages = 0, repeated = 0, lines = 0;
+};
+
+// A subsystem complains every cycle for 20s, then stops. Everything it logged must be accounted for, in about two
+// lines per second.
+static bool simLogLimiter() {
+  if(!bench::selected("sim:loglimit")) return true;
+
+  static LoggingSubsystem logger;
+  static RepeatCountingStream stream;
+  Console::console.addConsoleStream(&stream);
+  simClock = VirtualTimeSource(0);
+  Runloop::runloop.setTimeSource(&simClock);
+
+  const unsigned long calls = 2000;
+  for(unsigned long i=0; i<3000; i++) {
+    if(i < calls) logger.complain(7);
+    LogLimiter::flushAll();
+    simClock.advance(10000);
+  }
+
+  Runloop::runloop.setTimeSource(NULL);
+  Console::console.removeConsoleStream(&stream);
+  bool ok = stream.messages + stream.repeated == calls && stream.lines <= 2*(calls/100 + 1);
+  ::printf("sim:loglimit %lu calls in %lus: %lu printed, %lu counted as repeats, %lu lines: %s\n", calls, calls/100,
+           stream.messages, stream.repeated, stream.lines, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+// Main loop side of simFastLoop: occasional long steps, sometimes holding the fast loop off (like DODroid does
+// around I2C), reads samples from the fast tier and hands commands back.
+class FastLoopPeer: public Subsystem {
+public:
+  struct Sample { uint32_t seq, check; };
+  struct Command { uint32_t seq, check; };
+
+  FastLoopPeer() { name_ = "fastloop_peer"; }
+  virtual Result start(ConsoleStream *stream = NULL) { (void)stream; started_ = true; operationStatus_ = RES_OK; return RES_OK; }
+  virtual Result stop(ConsoleStream *stream = NULL) { (void)stream; started_ = false; return RES_OK; }
+  virtual Result step() {
+    Sample s = samples.read();
+    if(s.check != ~s.seq) inconsistent++;
+    if(s.seq > lastSample + 1) skippedSamples += s.seq - lastSample - 1;
+    lastSample = s.seq;
+
+    simClock.advance(random(2000, 8000));
+    if(random(20) == 0) simClock.advance(25000); // long console command or WiFi step
+    if(random(10) == 0) {
+      FastLoop::CriticalSection cs;
+      simClock.advance(CRITICAL_US);
+    }
+
+    cmdSeq++;
+    commands.write({cmdSeq, ~cmdSeq});
+    return RES_OK;
+  }
+
+  static const uint32_t CRITICAL_US = 400;
+  DoubleBuffer<Sample> samples = DoubleBuffer<Sample>({0, ~0U});
+  DoubleBuffer<Command> commands = DoubleBuffer<Command>({0, ~0U});
+  uint32_t lastSample = 0, skippedSamples = 0, cmdSeq = 0, inconsistent = 0;
+};
+
+// Feeds a stream of RX frames into the XBee UART in random chunks, the way they trickle in between runloop cycles,
+// with line noise between frames, frames with a bad checksum and frames cut short by the next start delimiter.
+// Every intact frame must come out once and in order, every broken one must be counted.
+static bool simXBeeReceive() {
+  if(!bench::selected("sim:xbeerx")) return true;
+
+  static BenchXBee xbee(&Serial1);
+  Serial1.begin(115200);
+  while(Serial1.available()) Serial1.read();
+  randomSeed(42);
+
+  const unsigned int NUM_FRAMES = 2000;
+  std::vector<uint8_t> wire;
+  std::vector<Packet> expected;
+  unsigned long corrupted = 0, truncated = 0, noise = 0;
+  for(unsigned int i=0; i<NUM_FRAMES; i++) {
+    Packet packet = makeControlPacket(i);
+    packet.payload.control.axis2 = i % 1024;
+    packet.payload.control.axis5 = i % 256; // runs through the bytes that need escaping
+    packet.crc = packet.calculateCRC();
+    std::vector<uint8_t> frame = makeRXFrame(packet);
+
+    long what = random(20);
+    if(what == 0) { // bad checksum - flip a bit in a byte that doesn't take part in escaping
+      for(size_t k=frame.size()/2; k<frame.size(); k++) {
+        uint8_t b = frame[k], f = b ^ 0x01;
+        if(frame[k-1] == 0x7d || b == 0x7d || b == 0x7e || f == 0x7d || f == 0x7e || f == 0x11 || f == 0x13) continue;
+        frame[k] = f;
+        break;
+      }
+      corrupted++;
+    } else if(what == 1) { // cut short - the next frame's delimiter comes in the middle
+      frame.resize(4 + random(frame.size() - 5));
+      truncated++;
+    } else {
+      expected.push_back(packet);
+    }
+    wire.insert(wire.end(), frame.begin(), frame.end());
+
+    if(what != 1 && random(10) == 0) { // noise on the line before the next frame (after a cut frame, it would count as its data)
+      long n = 1 + random(8);
+      for(long j=0; j<n; j++) wire.push_back(random(0x7e));
+      noise += n;
+    }
+  }
+  wire.push_back(0x7e); // ends the last frame if it was cut short
+
+  size_t pos = 0, next = 0;
+  unsigned long chunks = 0, received = 0, outOfOrder = 0, incomplete = 0;
+  size_t allocs = bench::allocationCount();
+  while(pos < wire.size()) {
+    size_t n = std::min(size_t(1 + random(40)), wire.size() - pos);
+    Serial1.feed(wire.data() + pos, n);
+    pos += n;
+    chunks++;
+
+    HWAddress src;
+    uint8_t rssi;
+    Packet packet;
+    while(true) {
+      Result res = xbee.receiveAPIMode(src, rssi, packet);
+      if(res == RES_PACKET_INCOMPLETE) {
+        incomplete++;
+        break;
+      }
+      if(res != RES_OK) continue;
+      if(next < expected.size() && memcmp(&packet, &expected[next], sizeof(packet)) == 0) next++;
+      else outOfOrder++;
+      received++;
+    }
+  }
+  allocs = bench::allocationCount() - allocs;
+
+  const BenchXBee::FrameParser& rx = xbee.parser();
+  bool ok = received == expected.size() && next == expected.size() && outOfOrder == 0 && rx.checksumErrors() == corrupted &&
+            rx.framingErrors() == truncated && rx.discardedBytes() == noise && allocs == 0;
+  ::printf("sim:xbeerx %u frames in %lu chunks: %lu received, %lu bad checksums, %lu cut short, %lu noise bytes, %lu allocs: %s\n",
+           NUM_FRAMES, chunks, received, rx.checksumErrors(), rx.framingErrors(), rx.discardedBytes(), (unsigned long)allocs,
+           ok ? "ok" : "FAILED");
+  if(!ok) ::printf("sim:xbeerx expected %lu received, %lu out of order, %lu checksum, %lu framing, %lu noise\n",
+                   (unsigned long)expected.size(), outOfOrder, corrupted, truncated, noise);
+  return ok;
+}
+
+// Commands that take simulated time, and a condition that comes true a number of cycles after being armed.
+class ScriptTarget: public NullSubsystem {
+public:
+  ScriptTarget(): NullSubsystem("scripted") { setCommandTable(COMMANDS, sizeof(COMMANDS)/sizeof(COMMANDS[0])); }
+  virtual Result step() { if(readyIn > 0) readyIn--; return RES_OK; }
+  virtual Result checkCondition(const ConsoleWords& words, bool& met) {
+    if(words.size() == 1 && words[0] == "ready") {
+      met = readyIn == 0;
+      return RES_OK;
+    }
+    return Subsystem::checkCondition(words, met);
+  }
+
+  Result cmdWork(const ConsoleWords& words, ConsoleStream* stream) {
+    (void)words; (void)stream;
+    simClock.advance(300);
+    if(cycle != lastCycle) {
+      lastCycle = cycle;
+      inCycle = 0;
+    }
+    if(++inCycle > maxPerCycle) maxPerCycle = inCycle;
+    work++;
+    return RES_OK;
+  }
+  Result cmdFail(const ConsoleWords& words, ConsoleStream* stream) { (void)words; (void)stream; return RES_CMD_FAILURE; }
+  Result cmdArm(const ConsoleWords& words, ConsoleStream* stream) { (void)stream; readyIn = words[1].toInt(); return RES_OK; }
+
+  unsigned long cycle = 0, lastCycle = 0, inCycle = 0, maxPerCycle = 0, work = 0;
+  long readyIn = 0;
+
+  static const CommandDef COMMANDS[3];
+};
+
+const Subsystem::CommandDef ScriptTarget::COMMANDS[] = {
+  command("work", 0, 0, &ScriptTarget::cmdWork),
+  command("fail", 0, 0, &ScriptTarget::cmdFail),
+  command("arm",  1, 1, &ScriptTarget::cmdArm)
+};
+
+// Keeps tabs on a script's report.
+class ScriptReportStream: public CountingStream {
+public:
+  virtual int printfFinal(const char* str) {
+    unsigned int line;
+    if(sscanf(str, "%u ", &line) == 1) {
+      reported++;
+      if(strstr(str, ": OK,") == NULL) failed++;
+    }
+    if(strncmp(str, "Script done", 11) == 0) done = true;
+    if(strncmp(str, "Script stopped", 14) == 0) stopped = true;
+    return CountingStream::printfFinal(str);
+  }
+  void reset() { reported = failed = 0; done = stopped = false; }
+  unsigned long reported = 0, failed = 0;
+  bool done = false, stopped = false;
+};
+
+// Runs the loaded script to its end, or for at most maxCycles.
+static unsigned long runScript(ScriptTarget& target, ScriptReportStream& stream, unsigned long maxCycles) {
+  stream.reset();
+  Console::console.script().run(&stream);
+  unsigned long cycles = 0;
+  while(Console::console.script().isRunning() && cycles < maxCycles) {
+    target.cycle++;
+    Runloop::runloop.cycle();
+    cycles++;
+  }
+  return cycles;
+}
+
+// A remote's traffic for 10s of simulated time against the airtime budget: control packets every 10ms with two
+// repeats each, more than the budget allows, plus state, config and diagnostics traffic. Every control packet has
+// to go out in its own cycle, everything else has to go out at all, and the repeats get what's left.
+static bool simXBeeTransmit() {
+  if(!bench::selected("sim:xbeetx")) return true;
+
+  static const unsigned int CYCLES = 1000;
+  static const unsigned long CYCLETIME = 10000;
+  static const unsigned int BUDGET = 400000;
+  static const size_t DIAG_LEN = 60;
+
+  static BenchXBee xbee(&Serial1);
+  Serial1.begin(115200);
+  Runloop::runloop.setTimeSource(&simClock);
+  xbee.setParameter("airtime_budget", BUDGET);
+  xbee.resetTXStatistics();
+
+  HWAddress droid = {0x0013a200, 0x41000001}, remote = {0x0013a200, 0x41000002};
+  Packet control = makeControlPacket(0);
+  Packet state(PACKET_TYPE_STATE, PACKET_SOURCE_DROID, 0);
+  memset(&state.payload, 0, sizeof(state.payload));
+  Packet config(PACKET_TYPE_CONFIG, PACKET_SOURCE_LEFT_REMOTE, 0);
+  memset(&config.payload, 0, sizeof(config.payload));
+  uint8_t diag[DIAG_LEN];
+  memset(diag, 0x55, sizeof(diag));
+
+  static uint8_t wire[4096];
+  BenchXBee::FrameParser parser;
+  unsigned int queued[XBee::TX_NUM_CLASSES] = {0}, sent[XBee::TX_NUM_CLASSES] = {0};
+  unsigned int controlInCycle = 0, repeatsSent = 0;
+  unsigned long airtime = 0;
+  bool ok = true;
+  size_t allocs = bench::allocationCount();
+
+  for(unsigned int cycle=0; cycle<CYCLES; cycle++) {
+    Serial1.capture(wire, sizeof(wire));
+
+    control.seqnum = cycle % 8;
+    xbee.sendTo(droid, control, false, 2);
+    queued[XBee::TX_CONTROL]++;
+    if(cycle % 4 == 0) {
+      xbee.sendTo(remote, state, false);
+      queued[XBee::TX_STATE]++;
+    }
+    if(cycle % 50 == 0) {
+      if(xbee.sendTo(droid, config, false) != RES_OK) ok = false;
+      queued[XBee::TX_CONFIG]++;
+    }
+    if(cycle % 20 == 0) {
+      if(xbee.sendTo(droid, diag, sizeof(diag), false) != RES_OK) ok = false;
+      queued[XBee::TX_DIAGNOSTIC]++;
+    }
+    simClock.advance(CYCLETIME);
+    xbee.flushTXQueue();
+
+    size_t len = Serial1.captured();
+    Serial1.capture(NULL, 0);
+    bool seen = false;
+    for(size_t i=0; i<len; i++) {
+      if(!parser.feed(wire[i])) continue;
+      size_t payloadLen = parser.length() - 11;
+      airtime += XBee::airtimeMicros(payloadLen, false);
+      if(payloadLen == DIAG_LEN) {
+        sent[XBee::TX_DIAGNOSTIC]++;
+        continue;
+      }
+      const Packet* p = (const Packet*)(parser.data() + 11);
+      XBee::TXClass cls = XBee::txClassFor(*p);
+      if(cls == XBee::TX_CONTROL) {
+        if(p->seqnum == cycle % 8) {
+          if(seen) repeatsSent++;
+          else controlInCycle++;
+          seen = true;
+        } else {
+          ok = false; // stale control packet
+        }
+      } else {
+        sent[cls]++;
+      }
+    }
+  }
+  allocs = bench::allocationCount() - allocs;
+
+  for(int c=XBee::TX_STATE; c<XBee::TX_NUM_CLASSES; c++) if(sent[c] != queued[c]) ok = false;
+  if(controlInCycle != CYCLES || repeatsSent == 0 || repeatsSent >= 2*CYCLES) ok = false;
+  unsigned long seconds = CYCLES*CYCLETIME/1000000;
+  if(airtime > BUDGET*seconds + BUDGET/10 + XBee::airtimeMicros(XBee::MAX_PAYLOAD, true)) ok = false;
+  if(allocs != 0) ok = false;
+
+  ::printf("sim:xbeetx %u cycles: %u/%u control first copies in their cycle, %u of %u repeats, state %u/%u, config %u/%u, "
+           "diagnostic %u/%u, %lu us airtime in %lus for %u us/s, %u allocs: %s\n", CYCLES, controlInCycle, CYCLES, repeatsSent,
+           2*CYCLES, sent[XBee::TX_STATE], queued[XBee::TX_STATE], sent[XBee::TX_CONFIG], queued[XBee::TX_CONFIG],
+           sent[XBee::TX_DIAGNOSTIC], queued[XBee::TX_DIAGNOSTIC], airtime, seconds, BUDGET, (unsigned)allocs, ok ? "ok" : "FAILED");
+
+  // Out of airtime: config packets queue up (after one more has gone out, if the budget wasn't overdrawn yet) until
+  // the queue is full, then they're refused
+  xbee.setParameter("airtime_budget", 1000u);
+  unsigned int accepted = 0;
+  Result res = RES_OK;
+  while(accepted < 10 && (res = xbee.sendTo(droid, config, false)) == RES_OK) accepted++;
+  bool fullOk = res == RES_SUBSYS_RESOURCE_NOT_AVAILABLE && accepted >= BB_XBEE_TX_QUEUE_DEPTH && accepted <= 1 + BB_XBEE_TX_QUEUE_DEPTH &&
+                xbee.txQueueDepth(XBee::TX_CONFIG) == BB_XBEE_TX_QUEUE_DEPTH;
+  ::printf("sim:xbeetx queue full: %u accepted, then \"%s\": %s\n", accepted, errorMessage(res), fullOk ? "ok" : "FAILED");
+
+  // Only diagnostics have slots for MAX_PAYLOAD, the packet classes for a packet with FEC trailer
+  static uint8_t raw[XBee::MAX_PAYLOAD];
+  Result packetClassRes = xbee.sendTo(droid, raw, sizeof(raw), false, XBee::TX_STATE);
+  Result diagnosticRes = xbee.sendTo(droid, raw, sizeof(raw), false, XBee::TX_DIAGNOSTIC);
+  bool slotsOk = packetClassRes == RES_PACKET_TOO_LONG && diagnosticRes == RES_OK;
+  ::printf("sim:xbeetx %u byte payload: \"%s\" as state, \"%s\" as diagnostic: %s\n", unsigned(sizeof(raw)),
+           errorMessage(packetClassRes), errorMessage(diagnosticRes), slotsOk ? "ok" : "FAILED");
+
+  xbee.setParameter("airtime_budget", 0u);
+  xbee.flushTXQueue();
+  Runloop::runloop.setTimeSource(NULL);
+  return ok && fullOk && slotsOk;
+}
+
+// Picks repeats with LinkQuality from state packets coming in over a link with a given loss, then sends control
+// packets over the same link with these repeats - at the real rates: D-O sends state at 25Hz, the remote sends control
+// every 10ms cycle, and falls back to send_repeats (1 by default) while there's no estimate. The control packet loss
+// has to stay near the target, and the repeats have to be close to what the true loss calls for on average - the
+// estimate moves with every packet, so the count does too.
+static bool simLinkQuality() {
+  if(!bench::selected("sim:linkquality")) return true;
+
+  static const unsigned int CYCLES = 20000;
+  static const uint32_t CYCLEMS = 10;
+  static const unsigned int STATE_EVERY = 4; // 25Hz
+  static const float TARGET = 0.01f;
+  static const uint8_t MAX_REPEATS = 7;
+  static const uint8_t FALLBACK = 1;
+  bool ok = true;
+
+  struct Link { float loss; uint8_t rssi; uint8_t expected; };
+  const Link links[] = {{0.0f, 50, 0}, {0.05f, 60, 1}, {0.2f, 70, 2}, {0.5f, 80, 6}, {0.2f, 90, 3}};
+
+  for(const Link& link: links) {
+    LinkQuality quality;
+    uint32_t ms = 0;
+    unsigned long lost = 0, copies = 0, settled = 0, noEstimate = 0;
+    unsigned int minRepeats = MAX_REPEATS, maxRepeats = 0;
+    for(unsigned int cycle=0; cycle<CYCLES; cycle++) {
+      ms += CYCLEMS;
+      if(cycle % STATE_EVERY == 0 && random(1000000) >= long(link.loss*1000000)) {
+        quality.packetReceived((cycle / STATE_EVERY) % 8, link.rssi, ms);
+      }
+
+      uint8_t repeats = quality.repeatsFor(TARGET, MAX_REPEATS, FALLBACK, ms);
+      if(cycle < CYCLES/10) continue; // settling
+      settled++;
+      if(!quality.hasEstimate(ms)) noEstimate++;
+      copies += repeats + 1;
+      if(repeats < minRepeats) minRepeats = repeats;
+      if(repeats > maxRepeats) maxRepeats = repeats;
+      bool delivered = false;
+      for(unsigned int i=0; i<=repeats && !delivered; i++) delivered = random(1000000) >= long(link.loss*1000000);
+      if(!delivered) lost++;
+    }
+
+    float lossRate = float(lost)/settled;
+    float meanRepeats = float(copies)/settled - 1;
+    bool linkOk = lossRate <= 2*TARGET && fabs(meanRepeats - link.expected) <= 0.75f &&
+                  fabs(quality.deliveryRatio() - (1-link.loss)) < 0.15f;
+    ::printf("sim:linkquality %2.0f%% loss, RSSI -%u: %.1f%% delivered, repeats %u..%u, %.2f on average (expected %u), "
+             "%.2f%% control packets lost, %.2f%% of the time without estimate: %s\n", link.loss*100, link.rssi,
+             quality.deliveryRatio()*100, minRepeats, maxRepeats, meanRepeats, link.expected, lossRate*100,
+             100.0f*noEstimate/settled, linkOk ? "ok" : "FAILED");
+    ok = ok && linkOk;
+  }
+
+  // No packets for longer than the timeout: no estimate, fall back. The next packet brings the last estimate back,
+  // without counting the wrapped sequence numbers as losses.
+  LinkQuality quality;
+  uint32_t ms = 0;
+  for(unsigned int i=0; i<100; i++) quality.packetReceived(i % 8, 50, ms += STATE_EVERY*CYCLEMS);
+  bool fresh = quality.hasEstimate(ms) && quality.repeatsFor(TARGET, MAX_REPEATS, 3, ms) == 0;
+  ms += 1100;
+  bool stale = !quality.hasEstimate(ms) && quality.repeatsFor(TARGET, MAX_REPEATS, 3, ms) == 3;
+  quality.packetReceived(5, 50, ms);
+  bool resumed = quality.hasEstimate(ms) && quality.packetsLost() == 0 && quality.repeatsFor(TARGET, MAX_REPEATS, 3, ms) == 0;
+  ::printf("sim:linkquality timeout: %s\n", fresh && stale && resumed ? "ok" : "FAILED");
+
+  return ok && fresh && stale && resumed;
+}
+
+// Control packets over a channel that loses a given share of frames at random, sent plain with repeats and with a
+// ControlFEC trailer, with and without a repeat. A packet counts as delivered if it arrives, or is rebuilt before
+// anything newer is handled. Every rebuilt packet has to be identical to the one that was sent. Then the same through the
+// XBee: a frame that doesn't make it has to come out of step() before the next one.
+class FECReceiver: public PacketReceiver {
+public:
+  virtual Result incomingControlPacket(const HWAddress& src, PacketSource source, uint8_t rssi, uint8_t seqnum, const ControlPacket& packet) {
+    (void)src; (void)source; (void)rssi;
+    seqnums.push_back(seqnum);
+    axes.push_back(packet.axis2);
+    return RES_OK;
+  }
+  std::vector<uint8_t> seqnums;
+  std::vector<uint16_t> axes;
+};
+
+static Packet makeFECTestPacket(unsigned int i) {
+  Packet packet = makeControlPacket(i);
+  packet.payload.control.axis2 = i % 1024;
+  packet.payload.control.axis5 = (i * 7) % 256;
+  return packet;
+}
+
+static bool simFEC() {
+  if(!bench::selected("sim:fec")) return true;
+
+  static const unsigned int FRAMES = 20000;
+  const float losses[] = {0.01f, 0.05f, 0.1f, 0.2f, 0.3f};
+  bool ok = true;
+
+  uint32_t plainUS = XBee::airtimeMicros(sizeof(Packet), false);
+  uint32_t fecUS = XBee::airtimeMicros(sizeof(Packet) + sizeof(ControlFEC), false);
+  ::printf("sim:fec airtime per control packet: %luus plain, %luus with 1 repeat, %luus with 2, %luus with FEC, %luus with FEC and 1 repeat\n",
+           (unsigned long)plainUS, (unsigned long)(2*plainUS), (unsigned long)(3*plainUS), (unsigned long)fecUS, (unsigned long)(2*fecUS));
+
+  for(float loss: losses) {
+    auto arrives = [loss]() { return random(1000000) >= long(loss*1000000); };
+
+    float plain[3];
+    for(unsigned int repeats=0; repeats<3; repeats++) {
+      unsigned long lost = 0;
+      for(unsigned int i=0; i<FRAMES; i++) {
+        bool delivered = false;
+        for(unsigned int c=0; c<=repeats; c++) delivered = arrives() || delivered;
+        if(!delivered) lost++;
+      }
+      plain[repeats] = float(lost)/FRAMES;
+    }
+
+    // FEC without repeats, then with one repeat
+    float fec[2];
+    unsigned long wrong = 0, missedOff = 0, late = 0;
+    for(unsigned int repeats=0; repeats<2; repeats++) {
+      ControlFECEncoder encoder;
+      ControlFECDecoder decoder;
+      unsigned long delivered = 0, channelLost = 0;
+      uint32_t ms = 0;
+      for(unsigned int i=0; i<FRAMES; i++) {
+        Packet packet = makeFECTestPacket(i);
+        ControlFEC trailer;
+        encoder.encode(packet, trailer);
+        packet.crc = packet.calculateCRC();
+
+        bool arrived = false;
+        for(unsigned int c=0; c<=repeats; c++) arrived = arrives() || arrived;
+        ms += 10;
+        if(!arrived) {
+          channelLost++;
+          continue;
+        }
+        Packet recovered;
+        if(decoder.decode(packet, trailer, ms, recovered)) {
+          Packet original = makeFECTestPacket(i-1);
+          original.fec = true;
+          original.crc = original.calculateCRC();
+          if(memcmp(&recovered, &original, sizeof(Packet)) != 0) wrong++;
+          delivered++;
+        }
+        delivered++;
+      }
+      fec[repeats] = 1.0f - float(delivered)/FRAMES;
+      late += decoder.framesLate();
+      // Only losses before the first frame that arrives go uncounted
+      if(decoder.framesMissed() > channelLost || decoder.framesMissed() + 10 < channelLost) missedOff++;
+    }
+
+    // A packet is lost only if the next one is lost too, like with one repeat. With span 1, a frame is always rebuilt
+    // right with the next one, so never too late.
+    float expected = loss*loss;
+    bool lossOk = wrong == 0 && missedOff == 0 && late == 0 && fec[0] <= 1.5f*expected + 5.0f/FRAMES && fec[0] < plain[0] &&
+                  fec[1] <= fec[0] && fecUS < 2*plainUS;
+    ::printf("sim:fec %2.0f%% loss: plain %.2f%%, 1 repeat %.2f%%, 2 repeats %.2f%%, FEC %.2f%%, FEC and 1 repeat %.3f%%, "
+             "%lu rebuilt late, %lu rebuilt wrong: %s\n", loss*100, plain[0]*100, plain[1]*100, plain[2]*100, fec[0]*100,
+             fec[1]*100, late, wrong, lossOk ? "ok" : "FAILED");
+    ok = ok && lossOk;
+  }
+
+  // Senders only use span 1, but the decoder takes the longer spans the format allows: frame 1 of 0..2 lost, rebuilt
+  // from the parity over frames 0 and 1 that comes with frame 2
+  Packet frames[3];
+  ControlFEC trailers[3];
+  for(unsigned int i=0; i<3; i++) {
+    frames[i] = makeFECTestPacket(i);
+    frames[i].fec = true;
+    frames[i].crc = frames[i].calculateCRC();
+    memset(&trailers[i], 0, sizeof(ControlFEC));
+    trailers[i].frame = i;
+    trailers[i].span = i;
+    for(unsigned int f=0; f<i; f++) {
+      for(size_t j=0; j<sizeof(trailers[i].parity); j++) trailers[i].parity[j] ^= ((const uint8_t*)&frames[f])[j];
+    }
+    trailers[i].crc = trailers[i].calculateCRC();
+  }
+  ControlFECDecoder spanDecoder;
+  Packet rebuilt;
+  bool spanOk = !spanDecoder.decode(frames[0], trailers[0], 10, rebuilt) && spanDecoder.decode(frames[2], trailers[2], 30, rebuilt) &&
+                memcmp(&rebuilt, &frames[1], sizeof(Packet)) == 0;
+  ::printf("sim:fec span 2 trailer: %s\n", spanOk ? "ok" : "FAILED");
+  ok = ok && spanOk;
+
+  // Through the XBee: frames 0..9, frame 4 lost on the way. The receiver has to see all ten in order.
+  static HardwareSerial rxUART;
+  static BenchXBee sender(&Serial1), receiver(&rxUART);
+  Serial1.begin(115200);
+  rxUART.begin(115200);
+  sender.setParameter("airtime_budget", 0u);
+  FECReceiver fecReceiver;
+  receiver.addPacketReceiver(&fecReceiver);
+
+  HWAddress droid = {0x0013a200, 0x41000001};
+  ControlFECEncoder encoder(1);
+  static uint8_t wire[256];
+  BenchXBee::FrameParser parser;
+  bool sentOk = true;
+  for(unsigned int i=0; i<10; i++) {
+    Packet packet = makeFECTestPacket(i);
+    ControlFEC trailer;
+    encoder.encode(packet, trailer);
+    Serial1.capture(wire, sizeof(wire));
+    if(sender.sendTo(droid, packet, trailer, false) != RES_OK) sentOk = false;
+    size_t len = Serial1.captured();
+    Serial1.capture(NULL, 0);
+
+    for(size_t j=0; j<len; j++) {
+      if(!parser.feed(wire[j])) continue;
+      if(parser.length() != 11 + sizeof(Packet) + sizeof(ControlFEC)) sentOk = false;
+      if(i == 4) continue;
+      std::vector<uint8_t> frame = makeRXFrame(parser.data() + 11, parser.length() - 11);
+      rxUART.feed(frame.data(), frame.size());
+      receiver.step();
+    }
+  }
+  receiver.removePacketReceiver(&fecReceiver);
+
+  bool inOrder = sentOk && fecReceiver.seqnums.size() == 10;
+  for(unsigned int i=0; inOrder && i<10; i++) {
+    if(fecReceiver.seqnums[i] != i % 8 || fecReceiver.axes[i] != i % 1024) inOrder = false;
+  }
+  const ControlFECDecoder& decoder = receiver.fecDecoder(PACKET_SOURCE_LEFT_REMOTE);
+  inOrder = inOrder && decoder.framesMissed() == 1 && decoder.framesRecovered() == 1;
+  ::printf("sim:fec through XBee: %u of 10 control packets handled, %lu rebuilt: %s\n", (unsigned)fecReceiver.seqnums.size(),
+           decoder.framesRecovered(), inOrder ? "ok" : "FAILED");
+
+  return ok && inOrder;
+}
+
+// A few hundred commands in one script, with waits, against a simulated per-command cost - how many cycles it
+// takes, whether the per-cycle budget holds, and whether failures, "until" timeouts and the report work out.
+static bool simScript() {
+  if(!bench::selected("sim:script")) return true;
+
+  static ScriptTarget target;
+  static ScriptReportStream stream;
+  static bool initialized = false;
+  if(!initialized) {
+    target.initialize();
+    initialized = true;
+  }
+  target.start();
+  Console::console.start();
+  Console::console.handleCommandLine("console set script_budget 2000", NULL);
+  Console::console.handleCommandLine("console set script_timeout 1000", NULL);
+
+  simClock = VirtualTimeSource(0);
+  Runloop::runloop.setTimeSource(&simClock);
+  Runloop::runloop.setCycleTimeMicros(10000);
+  Console::console.handleCommandLine("runloop suppress_overrun on", NULL);
+  Runloop::runloop.cycle();
+  Runloop::runloop.resetTimingStats();
+
+  bool ok = true;
+  ConsoleScript& script = Console::console.script();
+
+  // Commands filling the script buffer, a fixed wait, a wait for a condition, and a failure that's allowed
+  const unsigned int WORK = (BB_SCRIPT_SIZE - 128) / (2*sizeof("scripted work"));
+  script.clear();
+  script.append("scripted arm 60");
+  for(unsigned int i=0; i<WORK; i++) script.append("scripted work");
+  script.append("wait 100");
+  script.append("until scripted ready");
+  script.append("-scripted fail");
+  for(unsigned int i=0; i<WORK; i++) script.append("scripted work");
+  unsigned int lines = script.numLines();
+
+  size_t allocs = bench::allocationCount();
+  unsigned long cycles = runScript(target, stream, 10000);
+  allocs = bench::allocationCount() - allocs;
+  bool good = stream.done && stream.reported == lines && stream.failed == 1 && target.work == 2*WORK &&
+              target.maxPerCycle <= 2000/300 + 1 && Runloop::runloop.skippedCycles() == 0 && allocs == 0;
+  ::printf("sim:script %u lines in %lu cycles, max %lu commands/cycle, %lu reported, %lu failed, %lu allocs: %s\n", lines,
+           cycles, target.maxPerCycle, stream.reported, stream.failed, (unsigned long)allocs, good ? "ok" : "FAILED");
+  ok = ok && good;
+
+  // Stops at the first failure that isn't allowed
+  script.clear();
+  const char* text = "scripted work\nscripted fail\nscripted work\n";
+  script.appendText(text, strlen(text));
+  target.work = 0;
+  runScript(target, stream, 100);
+  good = stream.stopped && !stream.done && stream.reported == 2 && target.work == 1;
+  ::printf("sim:script stop at failure: %lu lines reported: %s\n", stream.reported, good ? "ok" : "FAILED");
+  ok = ok && good;
+
+  // "until" gives up after script_timeout
+  Console::console.handleCommandLine("console set script_timeout 50", NULL);
+  script.clear();
+  text = "scripted arm 1000\nuntil scripted ready\nscripted work\n";
+  script.appendText(text, strlen(text));
+  target.work = 0;
+  cycles = runScript(target, stream, 100);
+  good = stream.stopped && stream.reported == 2 && stream.failed == 1 && target.work == 0 && cycles <= 50/10 + 2;
+  ::printf("sim:script until timeout: stopped after %lu cycles: %s\n", cycles, good ? "ok" : "FAILED");
+  ok = ok && good;
+
+  Console::console.handleCommandLine("console set script_timeout 10000", NULL);
+  target.stop();
+  Runloop::runloop.setTimeSource(NULL);
+  return ok;
+}
+
+// Fast tier on a (simulated) 200Hz timer interrupt next to a main loop with long, jittery steps. The fast loop
+// period must only ever be disturbed by the critical sections the main loop takes, never by its step times.
+static bool simFastLoop() {
+  if(!bench::selected("sim:fastloop")) return true;
+
+  static const unsigned int RATE = 200;
+  static FastLoopPeer peer;
+  static uint32_t sampleSeq = 0, lastCmd = 0, cmdInconsistent = 0;
+  struct Drive { bool on; float vel; };
+  static DoubleBuffer<Drive> driveCmd({false, 0});
+  static float motor = 0;
+  static bool initialized = false;
+  if(!initialized) {
+    peer.initialize();
+    FastLoop::fastloop.addTask("sample", []() {
+      sampleSeq++;
+      peer.samples.write({sampleSeq, ~sampleSeq});
+    });
+    FastLoop::fastloop.addTask("control", []() {
+      FastLoopPeer::Command c = peer.commands.read();
+      if(c.check != ~c.seq || c.seq < lastCmd) cmdInconsistent++;
+      lastCmd = c.seq;
+    });
+    FastLoop::fastloop.addTask("drive", []() {
+      Drive d = driveCmd.read();
+      motor = d.on ? d.vel : 0;
+    });
+    initialized = true;
+  }
+
+  randomSeed(200);
+  simClock = VirtualTimeSource(0);
+  Runloop::runloop.setTimeSource(&simClock);
+  Runloop::runloop.setCycleTimeMicros(9615);
+  Console::console.handleCommandLine("runloop suppress_overrun on", NULL);
+  FastLoop::fastloop.setRateHz(RATE);
+  FastLoop::fastloop.start();
+  simClock.setPeriodicEvent(1000, 1e6/RATE, []() { FastLoop::fastloop.tick(); });
+  peer.start();
+  Runloop::runloop.cycle();
+  Runloop::runloop.resetTimingStats();
+  FastLoop::fastloop.resetTimingStats();
+
+  for(unsigned int i=0; i<10000; i++) Runloop::runloop.cycle();
+  peer.stop();
+
+  const TimingStats& fast = FastLoop::fastloop.periodTiming();
+  const TimingStats& slow = Runloop::runloop.periodTiming();
+  ::printf("sim:fastloop main loop  period mean %6luus stddev %7.1fus, max jitter %6luus\n", (unsigned long)slow.mean(), slow.stddev(),
+           (unsigned long)Runloop::runloop.maxPeriodJitter());
+  ::printf("sim:fastloop fast loop  period mean %6luus stddev %7.1fus, max jitter %6luus, %lu overruns\n", (unsigned long)fast.mean(),
+           fast.stddev(), (unsigned long)FastLoop::fastloop.maxPeriodJitter(), (unsigned long)FastLoop::fastloop.overruns());
+  ::printf("sim:fastloop handover   %lu samples, %lu commands, %lu inconsistent reads\n", (unsigned long)sampleSeq,
+           (unsigned long)peer.cmdSeq, (unsigned long)(peer.inconsistent + cmdInconsistent));
+
+  bool ok = peer.inconsistent == 0 && cmdInconsistent == 0 &&
+             FastLoop::fastloop.maxPeriodJitter() <= FastLoopPeer::CRITICAL_US && FastLoop::fastloop.overruns() == 0;
+
+  // Battery cutoff like DODroid::stepPowerProtect(): zeroing the motors from the main loop alone doesn't hold while
+  // the fast loop keeps running the last drive command, it has to be stopped and the command switched off first.
+  driveCmd.write({true, 0.5});
+  simClock.advance(20000);
+  bool drove = motor == 0.5;
+  motor = 0;
+  simClock.advance(20000);
+  bool redriven = motor != 0;
+  FastLoop::fastloop.stop();
+  driveCmd.write({false, 0});
+  motor = 0;
+  bool heldOff = true;
+  for(unsigned int i=0; i<10; i++) {
+    simClock.advance(1000000);
+    if(motor != 0) heldOff = false;
+  }
+  ::printf("sim:fastloop cutoff     motors %s without stop, %s after stop: %s\n", redriven ? "redriven" : "off",
+           heldOff ? "off" : "redriven", drove && redriven && heldOff ? "ok" : "FAILED");
+  if(!drove || !redriven || !heldOff) ok = false;
+
+  simClock.setPeriodicEvent(0, 0, nullptr);
+  Runloop::runloop.setTimeSource(NULL);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  if(argc > 1) bench::filter = argv[1];
+
+  Serial.begin(115200);
+  Serial.setEcho(false);
+  ConfigStorage::storage.initialize();
+  Console::console.initialize();
+  Trace::trace.initialize();
+  BinaryLog::binlog.initialize();
+  FastLoop::fastloop.initialize();
+
+  benchRunloop();
+  benchTrace();
+  benchTimedCallbacks();
+  benchTaskPlanning();
+  benchPIDController();
+  benchLowPassFilter();
+  benchParameters();
+  if(!benchParameterBlock()) return 1;
+  benchPacketCRC();
+  benchConsolePrintf();
+  benchConsoleCommands();
+  benchXBeeReceive();
+  benchXBeeSend();
+
+  if(!simRunloopDeadlines()) return 1;
+  if(!simVirtualTime()) return 1;
+  if(!simIMUSync()) return 1;
+  if(!simIdleTasks()) return 1;
+  if(!simConfigWriteBehind()) return 1;
+  if(!simConfigJournal()) return 1;
+  if(!simConsoleQueue()) return 1;
+  if(!simTrace()) return 1;
+  if(!simBinaryLog()) return 1;
+  if(!simLogLimiter()) return 1;
+  if(!simXBeeReceive()) return 1;
+  if(!simXBeeTransmit()) return 1;
+  if(!simLinkQuality()) return 1;
+  if(!simFEC()) return 1;
+  if(!simScript()) return 1;
+  if(!simFastLoop()) return 1;
+
+  return 0;
+}
@@ -1,6 +1,7 @@
 #!/usr/bin/env python3
 
 from UDPHandler import UDPHandler
+from RunloopTimingPacket import RunloopTimingPacket
 from RemoteHandler import RemoteHandler
 from Utilities import vectorToAngles
 import dearpygui.dearpygui as dpg
@@ -118,6 +119,8 @@ class BB8DearPyGui:
 					self.batt2Plot.createGUI(-1, -1)
 				with dpg.tab(label="Servo Load"):
 					self.servoLoadPlot.createGUI(-1, -1)
+				with dpg.tab(label="Runloop Timing"):
+					self.timingText = dpg.add_text("No timing data yet")
 
 
 
@@ -127,6 +130,10 @@ class BB8DearPyGui:
 			if packet is None:
 				break
 
+			if isinstance(packet, RunloopTimingPacket):
+				dpg.configure_item(self.timingText, default_value=packet.table())
+				continue
+
 			# dpg.configure_item(self.seqnumText, default_value="Sequence: %d" % self.handler.getSeqNum())
 			# if self.lastSeqnum is not None and self.handler.getSeqNum() != (self.lastSeqnum+1)%256:
 			# 	fd = (self.handler.getSeqNum() - (self.lastSeqnum+1)%256)
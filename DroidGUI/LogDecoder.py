@@ -0,0 +1,200 @@
+import json
+import os
+import re
+import socket
+import struct
+import sys
+
+# Decodes the binary log ("binlog dump" on the console, or "binlog send" / udp_stream via UDP) back into text.
+#
+# The droid only stores a hash of each LOG() format string, so decoding needs a table of the format strings,
+# collected from the sources. The D-O build generates it as logtable.json in the build directory by running
+# this as a PlatformIO extra script.
+#
+# Usage: python3 LogDecoder.py table <table.json> <source dir>...
+#        python3 LogDecoder.py decode <table.json> <console log>|--udp
+
+LOG_PORTNUM = 3000
+
+# Must match bb::LogRecordHeader and bb::LogArgTag
+HEADER = struct.Struct("<BBHII")
+LOGARG_INT    = 0
+LOGARG_UINT   = 1
+LOGARG_FLOAT  = 2
+LOGARG_STRING = 3
+LOGARG_CUT    = 4
+
+DATAGRAM_MAGIC = b"BBL1"
+
+# Logged by bb::LogLimiter, not through a LOG() call
+BUILTIN_FORMATS = ["... repeated %lu times\n"]
+
+LOG_RE = re.compile(r'\bLOG(?:_LIMITED)?\s*\((?:\s*[\w:]+\s*,)+\s*((?:"(?:[^"\\\n]|\\.)*"\s*)+)')
+NAME_RE = re.compile(r'\bname_\s*=\s*"((?:[^"\\\n]|\\.)*)"')
+LITERAL_RE = re.compile(r'"((?:[^"\\\n]|\\.)*)"')
+SPEC_RE = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|j|t|L)?([diouxXeEfFgGcsp%])')
+
+def logHash(data):
+	"""FNV-1a, as bb::logHash()"""
+	h = 2166136261
+	for b in data:
+		h = ((h ^ b) * 16777619) & 0xffffffff
+	return h
+
+def unescape(literal):
+	return literal.encode("latin1").decode("unicode_escape")
+
+def scanSources(dirs):
+	formats = {logHash(fmt.encode("latin1")): fmt for fmt in BUILTIN_FORMATS}
+	sources = {}
+	for d in dirs:
+		for root, subdirs, files in os.walk(d):
+			for name in files:
+				if not name.endswith((".cpp", ".h", ".ino")):
+					continue
+				with open(os.path.join(root, name), errors="replace") as f:
+					text = f.read()
+				for m in LOG_RE.finditer(text):
+					fmt = "".join(unescape(l) for l in LITERAL_RE.findall(m.group(1)))
+					formats[logHash(fmt.encode("latin1"))] = fmt
+				for m in NAME_RE.finditer(text):
+					src = unescape(m.group(1))
+					sources[logHash(src.encode("latin1")) & 0xffff] = src
+	return {"formats": {str(k): v for k, v in formats.items()}, "sources": {str(k): v for k, v in sources.items()}}
+
+def loadTable(filename):
+	with open(filename) as f:
+		t = json.load(f)
+	return {int(k): v for k, v in t["formats"].items()}, {int(k): v for k, v in t["sources"].items()}
+
+def readVarint(data, pos):
+	val = 0
+	shift = 0
+	while True:
+		b = data[pos]
+		pos += 1
+		val |= (b & 0x7f) << shift
+		shift += 7
+		if b & 0x80 == 0:
+			return val, pos
+
+def toPython(fmt):
+	def repl(m):
+		flags, conv = m.group(1), m.group(2)
+		if conv == "%":
+			return "%%"
+		if conv == "u":
+			conv = "d"
+		elif conv == "p":
+			return "0x%" + flags + "x"
+		return "%" + flags + conv
+	return SPEC_RE.sub(repl, fmt)
+
+def decodeRecord(data, formats, sources):
+	length, level, source, id, us = HEADER.unpack_from(data)
+	args = []
+	cut = False
+	pos = HEADER.size
+	while pos < length:
+		tag = data[pos]
+		pos += 1
+		if tag == LOGARG_INT:
+			v, pos = readVarint(data, pos)
+			args.append((v >> 1) ^ -(v & 1))
+		elif tag == LOGARG_UINT:
+			v, pos = readVarint(data, pos)
+			args.append(v)
+		elif tag == LOGARG_FLOAT:
+			args.append(struct.unpack_from("<f", data, pos)[0])
+			pos += 4
+		elif tag == LOGARG_STRING:
+			n = data[pos]
+			args.append(data[pos+1:pos+1+n].decode("latin1"))
+			pos += 1 + n
+		else:
+			cut = True
+			break
+
+	name = sources.get(source, "source %04x" % source)
+	fmt = formats.get(id)
+	if fmt is None:
+		text = "<unknown format %08x> %s\n" % (id, " ".join(str(a) for a in args))
+	else:
+		try:
+			text = toPython(fmt) % tuple(args)
+		except (TypeError, ValueError):
+			text = "%s <%s%s>\n" % (fmt.rstrip("\n"), ", ".join(str(a) for a in args), ", cut" if cut else "")
+	return us, "%s(%d):%s" % (name, level, text)
+
+def splitRecords(data):
+	"""Splits concatenated raw records (as in a datagram)."""
+	records = []
+	pos = 0
+	while pos + HEADER.size <= len(data):
+		length = data[pos]
+		if length < HEADER.size or pos + length > len(data):
+			break
+		records.append(data[pos:pos+length])
+		pos += length
+	return records
+
+def parseLines(lines):
+	records = []
+	for line in lines:
+		i = line.find("BBL ")
+		if i < 0:
+			continue
+		w = line[i:].split()
+		try:
+			if w[1] == "H" and int(w[3]) != 0:
+				print("%s records were overwritten" % w[3], file=sys.stderr)
+			elif w[1] == "R":
+				records.append(bytes.fromhex(w[2]))
+		except (IndexError, ValueError):
+			print("Ignoring garbled line \"%s\"" % line.strip(), file=sys.stderr)
+	return records
+
+def printRecords(records, formats, sources):
+	for r in records:
+		us, text = decodeRecord(r, formats, sources)
+		sys.stdout.write("%10.3f %s" % (us / 1000.0, text))
+	sys.stdout.flush()
+
+def receiveUDP(formats, sources, port = LOG_PORTNUM):
+	sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	sock.bind(('', port))
+	print("Waiting for log records on port %d (run \"binlog send\" or set udp_stream on the droid)..." % port, file=sys.stderr)
+	while True:
+		buf, addr = sock.recvfrom(2048)
+		if buf.startswith(DATAGRAM_MAGIC):
+			printRecords(splitRecords(buf[len(DATAGRAM_MAGIC):]), formats, sources)
+
+def writeTable(filename, dirs):
+	table = scanSources(dirs)
+	with open(filename, "w") as f:
+		json.dump(table, f, indent=1)
+	return table
+
+if "Import" in globals():
+	# Run as a PlatformIO extra script
+	Import("env")
+	project = env.subst("$PROJECT_DIR")
+	builddir = env.subst("$BUILD_DIR")
+	os.makedirs(builddir, exist_ok=True)
+	table = writeTable(os.path.join(builddir, "logtable.json"), [os.path.join(project, "src"), os.path.join(project, "include"), os.path.join(project, "..", "LibBB", "src")])
+	print("Log table: %d formats, %d sources" % (len(table["formats"]), len(table["sources"])))
+
+elif __name__ == "__main__":
+	if len(sys.argv) >= 4 and sys.argv[1] == "table":
+		table = writeTable(sys.argv[2], sys.argv[3:])
+		print("%d formats, %d sources written to %s" % (len(table["formats"]), len(table["sources"]), sys.argv[2]), file=sys.stderr)
+	elif len(sys.argv) == 4 and sys.argv[1] == "decode":
+		formats, sources = loadTable(sys.argv[2])
+		if sys.argv[3] == "--udp":
+			receiveUDP(formats, sources)
+		else:
+			with open(sys.argv[3], errors="replace") as f:
+				printRecords(parseLines(f.readlines()), formats, sources)
+	else:
+		print("Usage: %s table <table.json> <source dir>...\n       %s decode <table.json> <console log>|--udp" % (sys.argv[0], sys.argv[0]), file=sys.stderr)
+		sys.exit(1)
@@ -0,0 +1,230 @@
+import socket
+import struct
+import sys
+import time
+
+# Reads and writes droid parameters in bulk via UDP, using the binary parameter protocol
+# (see ParamBlockHeader in LibBB's BBPacket.h) instead of one console "set" per value.
+#
+# Usage: python3 ParamTool.py <droid ip> <subsystem> get <name> [<name> ...]
+#        python3 ParamTool.py <droid ip> <subsystem> set <name>=<value> [...] [--store]
+#        python3 ParamTool.py <droid ip> <subsystem> push <gain file> [--store]
+#        python3 ParamTool.py <droid ip> <subsystem> list
+#
+# A gain file has one "<name> <value>" or "<name>=<value>" per line; "#" starts a comment.
+# --store writes the configuration to flash once the whole set has been applied.
+
+PARAM_PORTNUM = 3000
+
+PARAM_BLOCK_MAGIC = 0x4d504242
+PARAM_BLOCK_VERSION = 1
+
+PARAM_OP_GET           = 0
+PARAM_OP_SET           = 1
+PARAM_OP_SET_AND_STORE = 2
+PARAM_OP_LIST          = 3
+PARAM_OP_REPLY         = 0x80
+
+MAX_PARAM_ENTRIES = 48
+
+# Must match bb::Subsystem::ParameterType
+PARAMETER_INT    = 0
+PARAMETER_UINT   = 1
+PARAMETER_FLOAT  = 2
+PARAMETER_BOOL   = 3
+PARAMETER_STRING = 4
+
+# Must match bb::Result
+RES_OK = 0
+RESULTS = {0: "OK", 1: "no such parameter", 2: "invalid type", 3: "invalid value", 8: "no such subsystem",
+	11: "protocol error", 19: "config storage error", 21: "unknown command", 27: "out of range"}
+
+HEADER_FORMAT = "<IBBBBBBB8sH"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+ENTRY_FORMAT = "<IBB4s"
+ENTRY_SIZE = struct.calcsize(ENTRY_FORMAT)
+
+def hashName(name):
+	"""FNV-1a, like bb::Subsystem::hashParameterName()."""
+	h = 2166136261
+	for c in name.encode("ascii"):
+		h = ((h ^ c) * 16777619) & 0xffffffff
+	return h
+
+def crc16(data):
+	"""CRC-16/CCITT-FALSE, like bb::calculateCRC16()."""
+	crc = 0xffff
+	for b in data:
+		crc ^= b << 8
+		for _ in range(8):
+			crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+			crc &= 0xffff
+	return crc
+
+def resultString(res):
+	return RESULTS.get(res, "error %d" % res)
+
+def packValue(type, value):
+	if type == PARAMETER_FLOAT:
+		return struct.pack("<f", value)
+	if type == PARAMETER_INT:
+		return struct.pack("<i", value)
+	return struct.pack("<I", value)
+
+def unpackValue(type, raw):
+	if type == PARAMETER_FLOAT:
+		return struct.unpack("<f", raw)[0]
+	if type == PARAMETER_INT:
+		return struct.unpack("<i", raw)[0]
+	if type == PARAMETER_BOOL:
+		return struct.unpack("<I", raw)[0] != 0
+	return struct.unpack("<I", raw)[0]
+
+def convertValue(type, s):
+	if type == PARAMETER_FLOAT:
+		return float(s)
+	if type == PARAMETER_BOOL:
+		if s.lower() in ("true", "yes", "1"):
+			return 1
+		if s.lower() in ("false", "no", "0"):
+			return 0
+		raise ValueError("Not a bool: %s" % s)
+	return int(s)
+
+class ParamClient:
+	def __init__(self, host, port = PARAM_PORTNUM, timeout = 0.5, retries = 3):
+		self.addr = (host, port)
+		self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+		self.sock.settimeout(timeout)
+		self.retries = retries
+		self.seqnum = 0
+
+	def request(self, subsystem, op, entries, first = 0):
+		"""Sends one block and returns (result, total, [(hash, type, result, value)])."""
+		self.seqnum = (self.seqnum + 1) & 0xff
+		body = b"".join(struct.pack(ENTRY_FORMAT, h, t, 0, packValue(t, v)) for h, t, v in entries)
+		header = struct.pack(HEADER_FORMAT, PARAM_BLOCK_MAGIC, PARAM_BLOCK_VERSION, op, self.seqnum, 0, first, 0,
+			len(entries), subsystem.encode("ascii"), 0)
+		crc = crc16(header + body)
+		packet = header[:-2] + struct.pack("<H", crc) + body
+
+		for attempt in range(self.retries):
+			self.sock.sendto(packet, self.addr)
+			try:
+				while True:
+					reply, _ = self.sock.recvfrom(2048)
+					parsed = self.parseReply(reply, op)
+					if parsed is not None:
+						return parsed
+			except socket.timeout:
+				continue
+		raise TimeoutError("No reply from %s:%d" % self.addr)
+
+	def parseReply(self, reply, op):
+		if len(reply) < HEADER_SIZE:
+			return None
+		magic, version, rop, seqnum, result, first, total, num, subsys, crc = struct.unpack(HEADER_FORMAT, reply[:HEADER_SIZE])
+		if magic != PARAM_BLOCK_MAGIC or rop != (op | PARAM_OP_REPLY) or seqnum != self.seqnum:
+			return None
+		if len(reply) != HEADER_SIZE + num * ENTRY_SIZE or crc16(reply[:HEADER_SIZE-2] + b"\0\0" + reply[HEADER_SIZE:]) != crc:
+			print("Garbled reply, ignoring", file=sys.stderr)
+			return None
+		entries = []
+		for i in range(num):
+			h, t, res, raw = struct.unpack(ENTRY_FORMAT, reply[HEADER_SIZE + i*ENTRY_SIZE:HEADER_SIZE + (i+1)*ENTRY_SIZE])
+			entries.append((h, t, res, unpackValue(t, raw)))
+		return result, total, entries
+
+	def get(self, subsystem, names):
+		result, _, entries = self.request(subsystem, PARAM_OP_GET, [(hashName(n), PARAMETER_INT, 0) for n in names])
+		return result, entries
+
+	def set(self, subsystem, values, store = False):
+		"""values is a list of (name, text). Fetches the parameter types first, then sends MAX_PARAM_ENTRIES per block
+		and stores with the last one."""
+		types = {}
+		for i in range(0, len(values), MAX_PARAM_ENTRIES):
+			result, entries = self.get(subsystem, [n for n, _ in values[i:i+MAX_PARAM_ENTRIES]])
+			if result != RES_OK:
+				return result, entries
+			for h, t, res, _ in entries:
+				if res == RES_OK:
+					types[h] = t
+		missing = [n for n, _ in values if hashName(n) not in types]
+		if len(missing):
+			raise ValueError("Unknown or string parameters: %s" % " ".join(missing))
+
+		replies = []
+		result = RES_OK
+		for i in range(0, len(values), MAX_PARAM_ENTRIES):
+			chunk = [(hashName(n), types[hashName(n)], convertValue(types[hashName(n)], v)) for n, v in values[i:i+MAX_PARAM_ENTRIES]]
+			last = i + MAX_PARAM_ENTRIES >= len(values)
+			op = PARAM_OP_SET_AND_STORE if store and last else PARAM_OP_SET
+			result, _, entries = self.request(subsystem, op, chunk)
+			replies += entries
+			if result != RES_OK:
+				break
+		return result, replies
+
+	def list(self, subsystem):
+		entries = []
+		while True:
+			result, total, chunk = self.request(subsystem, PARAM_OP_LIST, [], first = len(entries))
+			if result != RES_OK or len(chunk) == 0:
+				return result, entries
+			entries += chunk
+			if len(entries) >= total:
+				return result, entries
+
+def readGainFile(filename):
+	values = []
+	with open(filename) as f:
+		for line in f:
+			line = line.split("#")[0].strip()
+			if line == "":
+				continue
+			name, value = line.replace("=", " ").split()
+			values.append((name, value))
+	return values
+
+def printEntries(entries, names = {}):
+	for h, t, res, value in entries:
+		name = names.get(h, "0x%08x" % h)
+		if res != RES_OK:
+			print("%s: %s" % (name, resultString(res)))
+		else:
+			print("%s: %s" % (name, value))
+
+if __name__ == "__main__":
+	args = [a for a in sys.argv[1:] if a != "--store"]
+	store = "--store" in sys.argv
+	if len(args) < 3 or args[2] not in ("get", "set", "push", "list"):
+		print("Usage: %s <droid ip> <subsystem> get <name>... | set <name>=<value>... | push <gain file> | list [--store]" % sys.argv[0],
+			file=sys.stderr)
+		sys.exit(1)
+
+	host, subsystem, cmd = args[:3]
+	if len(subsystem) > 8:
+		print("Subsystem names are limited to 8 characters", file=sys.stderr)
+		sys.exit(1)
+
+	client = ParamClient(host)
+	start = time.perf_counter()
+	if cmd == "get":
+		names = {hashName(n): n for n in args[3:]}
+		result, entries = client.get(subsystem, args[3:])
+	elif cmd == "list":
+		names = {}
+		result, entries = client.list(subsystem)
+	else:
+		if cmd == "set":
+			values = [tuple(a.split("=", 1)) for a in args[3:]]
+		else:
+			values = readGainFile(args[3])
+		names = {hashName(v[0]): v[0] for v in values}
+		result, entries = client.set(subsystem, values, store)
+	elapsed = time.perf_counter() - start
+
+	printEntries(entries, names)
+	print("%d parameters in %.1fms: %s" % (len(entries), elapsed * 1000, resultString(result)), file=sys.stderr)
+	sys.exit(0 if result == RES_OK and all(e[2] == RES_OK for e in entries) else 1)
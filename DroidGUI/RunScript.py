@@ -0,0 +1,75 @@
+import socket
+import sys
+import time
+
+# Runs a console script on the droid (see bb::ConsoleScript in LibBB's BBConsoleScript.h) and prints the report,
+# one line per command with its result and duration, followed by a summary.
+#
+# Usage: python3 RunScript.py <droid ip> <script file> [--udp]
+#
+# By default the script goes over the console's TCP port, recorded with "script begin" ... "end", and the report is
+# read back until the script is done. --udp uploads it via the parameter port instead and returns right away; the
+# report then goes to whatever console is connected.
+#
+# Besides console commands, a script can contain "wait <ms>" and "until <subsys> <condition> [<args>]"
+# (e.g. "until servos idle"). A leading "-" lets the script go on if that command fails. "#" starts a comment line.
+
+TERMINAL_PORTNUM = 23
+SCRIPT_PORTNUM = 3000
+
+SCRIPT_MAGIC = b"BBS1"
+MAX_CHUNK = 400 # must fit the droid's UDP receive buffer
+
+def readScript(filename):
+	with open(filename) as f:
+		lines = [l.strip() for l in f.readlines()]
+	return [l for l in lines if l != "" and not l.startswith("#")]
+
+def runTCP(ip, lines):
+	sock = socket.create_connection((ip, TERMINAL_PORTNUM))
+	f = sock.makefile("rw", newline="\n")
+	f.write("script begin\n")
+	for l in lines:
+		f.write(l + "\n")
+	f.write("end\n")
+	f.write("script run\n")
+	f.flush()
+
+	for line in f:
+		line = line.replace("script> ", "").lstrip("\r> ").rstrip()
+		if line == "":
+			continue
+		print(line)
+		if line.startswith("Script done") or line.startswith("Script stopped") or line.startswith("Script aborted"):
+			break
+	sock.close()
+
+def runUDP(ip, lines):
+	sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	sock.sendto(SCRIPT_MAGIC + b"C", (ip, SCRIPT_PORTNUM))
+
+	chunk = b""
+	for l in lines:
+		l = l.encode("ascii") + b"\n"
+		if len(chunk) + len(l) > MAX_CHUNK:
+			sock.sendto(SCRIPT_MAGIC + b"A" + chunk, (ip, SCRIPT_PORTNUM))
+			chunk = b""
+			time.sleep(0.05) # the droid takes one datagram per cycle
+		chunk += l
+	if chunk != b"":
+		sock.sendto(SCRIPT_MAGIC + b"A" + chunk, (ip, SCRIPT_PORTNUM))
+		time.sleep(0.05)
+
+	sock.sendto(SCRIPT_MAGIC + b"R", (ip, SCRIPT_PORTNUM))
+	print("%d lines sent, script started" % len(lines))
+
+if __name__ == "__main__":
+	if len(sys.argv) < 3 or (len(sys.argv) == 4 and sys.argv[3] != "--udp") or len(sys.argv) > 4:
+		print("Usage: %s <droid ip> <script file> [--udp]" % sys.argv[0], file=sys.stderr)
+		sys.exit(1)
+
+	lines = readScript(sys.argv[2])
+	if len(sys.argv) == 4:
+		runUDP(sys.argv[1], lines)
+	else:
+		runTCP(sys.argv[1], lines)
@@ -0,0 +1,39 @@
+import struct
+
+NUM_BUCKETS = 16
+MAX_TIMING_SUBSYSTEMS = 12
+
+class SubsystemTimingState:
+	PACK_FORMAT = "12s6I%dH" % NUM_BUCKETS
+	def __init__(self, t):
+		(self.name, self.count, self.overruns, self.minUS, self.meanUS, self.maxUS, self.p99US) = t[0:7]
+		self.name = self.name.split(b'\0', 1)[0].decode('ascii', 'replace')
+		self.histogram = [h / 10000.0 for h in t[7:7+NUM_BUCKETS]] # share of samples below 2^(i+1) us
+	@classmethod
+	def numValues(cls):
+		return 7 + NUM_BUCKETS
+
+class RunloopTimingPacket:
+	PACK_FORMAT = "<fIB" + (1 + MAX_TIMING_SUBSYSTEMS) * SubsystemTimingState.PACK_FORMAT
+
+	@classmethod
+	def size(cls):
+		return struct.calcsize(cls.PACK_FORMAT)
+
+	def __init__(self, packet):
+		t = struct.unpack(self.PACK_FORMAT, packet)
+		self.timestamp, self.cycleTimeUS, self.numSubsystems = t[0:3]
+		i = 3
+		self.total = SubsystemTimingState(t[i:i+SubsystemTimingState.numValues()])
+		i += SubsystemTimingState.numValues()
+		self.subsys = []
+		for j in range(self.numSubsystems):
+			self.subsys.append(SubsystemTimingState(t[i:i+SubsystemTimingState.numValues()]))
+			i += SubsystemTimingState.numValues()
+
+	def table(self):
+		lines = ["Cycle time %dus" % self.cycleTimeUS,
+			"%-12s %9s %7s %7s %7s %7s %8s" % ("Subsystem", "Count", "Min", "Mean", "Max", "p99", "Overruns")]
+		for s in self.subsys + [self.total]:
+			lines.append("%-12s %9d %7d %7d %7d %7d %8d" % (s.name, s.count, s.minUS, s.meanUS, s.maxUS, s.p99US, s.overruns))
+		return "\n".join(lines)
@@ -0,0 +1,172 @@
+import json
+import socket
+import sys
+
+# Converts a runloop trace ("trace dump" on the console, or "trace send" via UDP) to Chrome trace JSON
+# that can be loaded into chrome://tracing or https://ui.perfetto.dev.
+#
+# Usage: python3 TraceToChrome.py <console log> [out.json]
+#        python3 TraceToChrome.py --udp [out.json]
+
+TRACE_PORTNUM = 3000
+
+# Must match bb::Trace::EventType
+EVENT_CYCLE          = 0
+EVENT_STEP_BEGIN     = 1
+EVENT_STEP_END       = 2
+EVENT_CALLBACK_BEGIN = 3
+EVENT_CALLBACK_END   = 4
+EVENT_IDLE_BEGIN     = 5
+EVENT_IDLE_END       = 6
+EVENT_PACKET_RX      = 7
+EVENT_PACKET_TX      = 8
+EVENT_OVERRUN        = 9
+EVENT_MARKER         = 10
+
+PACKET_TYPES = ["control", "state", "config", "pairing"]
+PACKET_SOURCES = ["left remote", "right remote", "droid", "test"]
+
+TID_RUNLOOP = 0
+TID_PACKETS = 1
+TID_MARKERS = 2
+
+class Trace:
+	def __init__(self):
+		self.subsystems = {}
+		self.markers = {}
+		self.events = []
+		self.cycleTimeUS = 0
+		self.overwritten = 0
+		self.complete = False
+
+def parseLines(lines):
+	"""Returns the last complete trace in lines, or the last incomplete one if there is none."""
+	trace = None
+	last = None
+	for line in lines:
+		i = line.find("BBT ")
+		if i < 0:
+			continue
+		w = line[i:].split()
+		try:
+			if w[1] == "H":
+				trace = Trace()
+				trace.overwritten = int(w[3])
+				trace.cycleTimeUS = int(w[4])
+				if last is None or not last.complete:
+					last = trace
+			elif trace is None:
+				continue
+			elif w[1] == "S":
+				trace.subsystems[int(w[2])] = " ".join(w[3:])
+			elif w[1] == "M":
+				trace.markers[int(w[2])] = " ".join(w[3:])
+			elif w[1] == "E":
+				trace.events.append((int(w[2]), int(w[3]), int(w[4]), int(w[5])))
+			elif w[1] == "X":
+				trace.complete = True
+				last = trace
+				trace = None
+		except (IndexError, ValueError):
+			print("Ignoring garbled line \"%s\"" % line.strip(), file=sys.stderr)
+	return last
+
+def receiveUDP(port = TRACE_PORTNUM, timeout = 10.0):
+	sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	sock.bind(('', port))
+	sock.settimeout(timeout)
+	lines = []
+	print("Waiting for trace on port %d (run \"trace send\" on the droid)..." % port, file=sys.stderr)
+	try:
+		while True:
+			buf, addr = sock.recvfrom(2048)
+			if not buf.startswith(b"BBT "):
+				continue
+			lines += buf.decode("ascii", "replace").splitlines()
+			if lines[-1].startswith("BBT X"):
+				break
+	except socket.timeout:
+		print("Timeout, trace may be incomplete", file=sys.stderr)
+	return lines
+
+def toChrome(trace):
+	out = []
+	out.append({"name": "process_name", "ph": "M", "pid": 0, "tid": 0, "args": {"name": "runloop"}})
+	for tid, name in [(TID_RUNLOOP, "cycles"), (TID_PACKETS, "packets"), (TID_MARKERS, "markers")]:
+		out.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": tid, "args": {"name": name}})
+
+	def subsysName(i):
+		return trace.subsystems.get(i, "subsystem %d" % i)
+
+	# Timestamps are 32 bit microseconds - unwrap, and make them relative to the first event.
+	base = None
+	offset = 0
+	prev = None
+	# The buffer may start in the middle of a step - drop ends without a beginning.
+	depth = {EVENT_STEP_BEGIN: 0, EVENT_CALLBACK_BEGIN: 0, EVENT_IDLE_BEGIN: 0}
+
+	for us, type, id, arg in trace.events:
+		if prev is not None and us < prev:
+			offset += 1 << 32
+		prev = us
+		if base is None:
+			base = us
+		ts = us + offset - base
+
+		e = {"pid": 0, "ts": ts}
+		if type == EVENT_CYCLE:
+			e.update({"name": "cycle %d" % arg, "ph": "i", "s": "p", "tid": TID_RUNLOOP})
+		elif type in (EVENT_STEP_BEGIN, EVENT_CALLBACK_BEGIN, EVENT_IDLE_BEGIN):
+			depth[type] += 1
+			e.update({"ph": "B", "tid": TID_RUNLOOP})
+			if type == EVENT_STEP_BEGIN:
+				e["name"] = subsysName(id)
+			elif type == EVENT_CALLBACK_BEGIN:
+				e["name"] = "timed callback"
+				e["args"] = {"slot": arg}
+			else:
+				e["name"] = "idle"
+		elif type in (EVENT_STEP_END, EVENT_CALLBACK_END, EVENT_IDLE_END):
+			if depth[type-1] == 0:
+				continue
+			depth[type-1] -= 1
+			e.update({"ph": "E", "tid": TID_RUNLOOP})
+		elif type in (EVENT_PACKET_RX, EVENT_PACKET_TX):
+			ptype = PACKET_TYPES[arg] if arg < len(PACKET_TYPES) else str(arg)
+			psrc = PACKET_SOURCES[id] if id < len(PACKET_SOURCES) else str(id)
+			e.update({"name": "%s %s" % ("RX" if type == EVENT_PACKET_RX else "TX", ptype), "ph": "i", "s": "t", "tid": TID_PACKETS,
+				"args": {"source": psrc}})
+		elif type == EVENT_OVERRUN:
+			e.update({"name": "overrun", "ph": "i", "s": "g", "tid": TID_RUNLOOP,
+				"args": {"looptime_us": arg, "cycletime_us": trace.cycleTimeUS, "slowest": subsysName(id)}})
+		elif type == EVENT_MARKER:
+			e.update({"name": trace.markers.get(id, "marker %d" % id), "ph": "i", "s": "t", "tid": TID_MARKERS, "args": {"value": arg}})
+		else:
+			continue
+		out.append(e)
+
+	return {"traceEvents": out, "displayTimeUnit": "ms",
+		"otherData": {"cycle_time_us": trace.cycleTimeUS, "overwritten_events": trace.overwritten}}
+
+if __name__ == "__main__":
+	if len(sys.argv) < 2 or len(sys.argv) > 3:
+		print("Usage: %s <console log>|--udp [out.json]" % sys.argv[0], file=sys.stderr)
+		sys.exit(1)
+
+	if sys.argv[1] == "--udp":
+		lines = receiveUDP()
+	else:
+		with open(sys.argv[1], errors="replace") as f:
+			lines = f.readlines()
+
+	trace = parseLines(lines)
+	if trace is None:
+		print("No trace found", file=sys.stderr)
+		sys.exit(1)
+	if not trace.complete:
+		print("Trace is incomplete", file=sys.stderr)
+
+	outname = sys.argv[2] if len(sys.argv) == 3 else "trace.json"
+	with open(outname, "w") as f:
+		json.dump(toChrome(trace), f)
+	print("%d events written to %s" % (len(trace.events), outname), file=sys.stderr)
@@ -1,6 +1,7 @@
 import socket
 
 from LargeStatePacket import LargeStatePacket
+from RunloopTimingPacket import RunloopTimingPacket
 
 STATE_PORTNUM = 3000
 
@@ -11,6 +12,7 @@ class UDPHandler:
 		self.sock.setblocking(0)
 		self.cmdqueue = []
 		self.states = {}
+		self.timing = {}
 		self.address = None
 		self.broadcast = False
 		self.seqnum = 0
@@ -42,6 +44,14 @@ class UDPHandler:
 				shouldCallCallback = True
 			else:
 				shouldCallCallback = False
+			if buf[0].startswith(b"BBT "):
+				return None # trace dump, see TraceToChrome.py
+			if buf[0].startswith(b"BBL1"):
+				return None # binary log, see LogDecoder.py
+			if len(buf[0]) == RunloopTimingPacket.size():
+				packet = RunloopTimingPacket(buf[0])
+				self.timing[address] = packet
+				return packet
 			packet = LargeStatePacket(buf[0])
 
 			self.states[address] = packet